@@ -0,0 +1,173 @@
+/*
+This file contains the definitions of the benchmark statistics and output functions.
+*/
+
+// Default C library
+#include <stdlib.h>
+#include <stdio.h>
+
+// Our headers
+#include "bench.h"
+#include "utils.h"
+#include "constants.h"
+#include "config.h"
+
+
+uint64_t csr_matrix_bytes(const Matrix* const matrix) {
+    return (sizeof(float) + sizeof(uint64_t)) * matrix->valuesSize + sizeof(uint64_t) * matrix->rowPointersSize;
+}
+
+int summarize_bench_runs(const BenchResult* const result, BenchSummary* const summary) {
+    double* times = malloc_safe(sizeof(double), result->run_count);
+    if (times == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    for (uint64_t i = 0; i < result->run_count; i++) {
+        times[i] = result->runs[i].total;
+    }
+    summary->min = _sorted_percentile(times, result->run_count, 0);
+    summary->median = _sorted_percentile(times, result->run_count, 50);
+    summary->p95 = _sorted_percentile(times, result->run_count, BENCH_P95_PERCENT);
+
+    // Every phase is summarized on its own, their medians don't have to add up to the median
+    for (uint64_t i = 0; i < result->run_count; i++) {
+        times[i] = result->runs[i].symbolic;
+    }
+    summary->symbolic = _sorted_percentile(times, result->run_count, 50);
+    for (uint64_t i = 0; i < result->run_count; i++) {
+        times[i] = result->runs[i].numeric;
+    }
+    summary->numeric = _sorted_percentile(times, result->run_count, 50);
+    for (uint64_t i = 0; i < result->run_count; i++) {
+        times[i] = result->runs[i].compaction;
+    }
+    summary->compaction = _sorted_percentile(times, result->run_count, 50);
+    free(times);
+
+    summary->gflops = summary->median > 0 ? 1e-9 * result->flops / summary->median : 0;
+    summary->gbytes = summary->median > 0 ? 1e-9 * result->bytes / summary->median : 0;
+    return 0;
+}
+
+double _sorted_percentile(double* const times, const uint64_t count, const unsigned int percent) {
+    for (uint64_t i = 1; i < count; i++) {
+        double time = times[i];
+        uint64_t j = i;
+        while (j > 0 && times[j - 1] > time) {
+            times[j] = times[j - 1];
+            j--;
+        }
+        times[j] = time;
+    }
+
+    if (percent == 50 && count % 2 == 0) {
+        return (times[count / 2 - 1] + times[count / 2]) / 2;
+    }
+    // Nearest rank: the smallest time that is not below percent of the times
+    uint64_t rank = (count * percent + 99) / 100;
+    return times[rank > 0 ? rank - 1 : 0];
+}
+
+void print_bench_header(
+    const BenchConfig* const bench, const char* filename_matrix_a, const char* filename_matrix_b,
+    const uint64_t run_count
+    ) {
+    switch (bench->format) {
+        case BENCH_JSON:
+            printf("{\n  \"matrix_a\": ");
+            _print_json_string(filename_matrix_a);
+            printf(",\n  \"matrix_b\": ");
+            _print_json_string(filename_matrix_b);
+            printf(",\n  \"warmup\": %lu,\n  \"runs\": %lu,\n  \"results\": [", bench->warmup, run_count);
+            break;
+        case BENCH_CSV:
+            printf(
+                "implementation,runs,nnz,flops,bytes,min,median,p95,gflops,gbytes_per_second,"
+                "symbolic,numeric,compaction,read,write\n"
+                );
+            break;
+        default:  // BENCH_TEXT
+            printf(
+                "Benchmark of %s * %s: %lu warmup and %lu measured runs per implementation\n",
+                filename_matrix_a, filename_matrix_b, bench->warmup, run_count
+                );
+            break;
+    }
+}
+
+void print_bench_result(
+    const BenchConfig* const bench, const BenchResult* const result, const BenchSummary* const summary,
+    const int first
+    ) {
+    switch (bench->format) {
+        case BENCH_JSON:
+            printf(
+                "%s\n    {\"implementation\": %u, \"nnz\": %lu, \"flops\": %lu, \"bytes\": %lu, "
+                "\"min\": %.9g, \"median\": %.9g, \"p95\": %.9g, \"gflops\": %.6g, \"gbytes_per_second\": %.6g, ",
+                first ? "" : ",", result->implementation, result->nnz, result->flops, result->bytes,
+                summary->min, summary->median, summary->p95, summary->gflops, summary->gbytes
+                );
+            if (result->phases) {
+                printf(
+                    "\"symbolic\": %.9g, \"numeric\": %.9g, \"compaction\": %.9g, ",
+                    summary->symbolic, summary->numeric, summary->compaction
+                    );
+            } else {
+                printf("\"symbolic\": null, \"numeric\": null, \"compaction\": null, ");
+            }
+            printf("\"read\": %.9g, \"write\": %.9g, \"times\": [", result->read, result->write);
+            for (uint64_t i = 0; i < result->run_count; i++) {
+                printf("%s%.9g", i ? ", " : "", result->runs[i].total);
+            }
+            printf("]}");
+            break;
+        case BENCH_CSV:
+            printf(
+                "%u,%lu,%lu,%lu,%lu,%.9g,%.9g,%.9g,%.6g,%.6g,", result->implementation, result->run_count,
+                result->nnz, result->flops, result->bytes, summary->min, summary->median, summary->p95,
+                summary->gflops, summary->gbytes
+                );
+            if (result->phases) {
+                printf("%.9g,%.9g,%.9g,", summary->symbolic, summary->numeric, summary->compaction);
+            } else {
+                printf(",,,");  // empty fields, the implementation doesn't record its phases
+            }
+            printf("%.9g,%.9g\n", result->read, result->write);
+            break;
+        default:  // BENCH_TEXT
+            printf(
+                "V%u: min %g s, median %g s, p95 %g s, %g GFLOP/s, %g GB/s, %lu non-zero values\n",
+                result->implementation, summary->min, summary->median, summary->p95,
+                summary->gflops, summary->gbytes, result->nnz
+                );
+            if (result->phases) {
+                printf(
+                    "    median phases: symbolic %g s, numeric %g s, compaction %g s\n",
+                    summary->symbolic, summary->numeric, summary->compaction
+                    );
+            }
+            printf("    I/O: read %g s, write %g s\n", result->read, result->write);
+            break;
+    }
+}
+
+void print_bench_footer(const BenchConfig* const bench) {
+    if (bench->format == BENCH_JSON) {
+        printf("\n  ]\n}\n");
+    }
+}
+
+void _print_json_string(const char* string) {
+    putchar('"');
+    for (const unsigned char* c = (const unsigned char*) string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20) {
+            printf("\\u%04x", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
@@ -0,0 +1,125 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Default C library headers
+#include <stdint.h>
+
+// Our headers
+#include "constants.h"
+#include "csrmatrix.h"
+#include "config.h"
+
+// This file contains the statistics and the output of the benchmark mode (--bench).
+
+// Every implementation but the dense V1, whose runtime grows with the cube of the dimensions
+#define BENCH_DEFAULT_IMPLEMENTATIONS (((UINT64_C(1) << NUMBER_OF_IMPLEMENTATIONS) - 1) & ~UINT64_C(2))
+
+#define BENCH_P95_PERCENT 95  // percentile of the run times reported next to min and median
+
+/*
+The struct BenchRun holds the seconds of one measured run of --bench. total is the whole call
+of the implementation, the phases are copied from last_multiply_phases (0 if the
+implementation doesn't record them).
+*/
+typedef struct BenchRun {
+    double total;
+    double symbolic;
+    double numeric;
+    double compaction;
+} BenchRun;
+
+/*
+The struct BenchResult holds everything --bench measured for one implementation.
+
+runs are the run_count measured runs, the warmup runs are not part of them.
+phases is 1 if the implementation recorded its phases in last_multiply_phases.
+flops is the number of floating point operations of A*B, a multiplication and an addition
+for every product of a value of A with a value of B (twice the products of --stats).
+bytes is the memory of A, B and C (values, column indices and row pointers), the data every
+implementation has to touch at least once.
+nnz is the number of non-zero values of C.
+read is the time of reading A and B, write the time of writing C, in seconds.
+*/
+typedef struct BenchResult {
+    uint8_t implementation;
+    BenchRun* runs;
+    uint64_t run_count;
+    int phases;
+    uint64_t flops;
+    uint64_t bytes;
+    uint64_t nnz;
+    double read;
+    double write;
+} BenchResult;
+
+/*
+The struct BenchSummary holds the statistics of a BenchResult. min, median and p95 are taken
+over the total times of the runs, the phases are the median of every phase. gflops and
+gbytes are the flops and bytes of the BenchResult divided by the median time, in GFLOP/s and
+GB/s.
+*/
+typedef struct BenchSummary {
+    double min;
+    double median;
+    double p95;
+    double symbolic;
+    double numeric;
+    double compaction;
+    double gflops;
+    double gbytes;
+} BenchSummary;
+
+/*
+Returns the bytes of the values, column indices and row pointers of matrix.
+*/
+uint64_t csr_matrix_bytes(const Matrix* const matrix);
+
+/*
+Computes the statistics of the runs of result into summary.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the copy of the times that is sorted cannot be malloc'ed.
+*/
+int summarize_bench_runs(const BenchResult* const result, BenchSummary* const summary);
+
+/*
+Sorts count times in place (insertion sort, there are only a few runs) and returns the value at percent (nearest rank, 50 is the median,
+which is the mean of the two middle values for an even count).
+
+This function is called in summarize_bench_runs() and should not be called outside of it.
+*/
+double _sorted_percentile(double* const times, const uint64_t count, const unsigned int percent);
+
+/*
+Prints the start of the output of --bench in the format of bench: the inputs and the number
+of warmup and measured runs (text, json) or the column names (csv).
+*/
+void print_bench_header(
+    const BenchConfig* const bench, const char* filename_matrix_a, const char* filename_matrix_b,
+    const uint64_t run_count
+    );
+
+/*
+Prints the measurements of one implementation in the format of bench, first is 1 for the
+first implementation (json separates the results with commas).
+*/
+void print_bench_result(
+    const BenchConfig* const bench, const BenchResult* const result, const BenchSummary* const summary,
+    const int first
+    );
+
+/*
+Prints the end of the output of --bench in the format of bench.
+*/
+void print_bench_footer(const BenchConfig* const bench);
+
+/*
+Prints string as a JSON string literal with quotes, escaping quotes, backslashes and
+control characters.
+
+This function is called in print_bench_header() and should not be called outside of it.
+*/
+void _print_json_string(const char* string);
+
+#endif
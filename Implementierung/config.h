@@ -0,0 +1,239 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+// This file contains the runtime configuration of the multiplication algorithms.
+
+// Scheduling strategies for the threads in matr_mult_csr()
+#define SCHEDULE_STATIC 0  // every thread gets the same number of rows
+#define SCHEDULE_BALANCED 1  // every thread gets one slice with the same number of estimated flops
+#define SCHEDULE_DYNAMIC 2  // threads pull flop-balanced chunks of rows from an atomic counter
+
+#define DYNAMIC_CHUNKS_PER_THREAD 16  // number of chunks per thread if no chunk size is given
+#define MAX_CHUNKS (1u << 20)  // upper limit for the number of chunks of a multiplication
+
+// Cost model for the number of threads in matr_mult_csr(), every thread should get at least...
+#define MIN_THREADS 2
+#define MAX_THREADS 4096  // upper limit for a thread count given by the user
+#define THREAD_COND_MIN_VALUES 40  // ...this many non-zero values of A
+#define THREAD_COND_MIN_ROWS 4  // ...this many rows of A
+#define THREAD_COND_MIN_FLOPS 65536  // ...this many estimated flops
+#define DEFAULT_CACHE_SIZE (256 * 1024)  // L2 size used when the system does not report it
+
+// Products of matr_mult_csr_batch() are grouped into this many tasks per thread with the same work
+#define BATCH_TASKS_PER_THREAD 16
+
+// Rows of a DenseMatrix are padded to this many floats (a cache line), values is aligned to it
+#define DENSE_STRIDE_FLOATS 16
+#define DENSE_ALIGNMENT (DENSE_STRIDE_FLOATS * sizeof(float))
+
+// Row bins of matr_mult_csr(), every row of C goes to the accumulator of its bin. With u the
+// upper bound of the non-zero values of the row (its flops, at most noCols of B), a row goes to...
+#define ROW_BIN_LIST 0  // ...a list that is searched linearly if u <= ROW_BIN_LIST_MAX
+#define ROW_BIN_DENSE 1  // ...the dense accumulator if noCols of B <= u * ROW_BIN_DENSE_RATIO
+#define ROW_BIN_HASH 2  // ...a hash table with linear probing if u <= ROW_BIN_HASH_MAX
+#define ROW_BIN_ESC 3  // ...expand-sort-compress otherwise (a wide B and a long row)
+#define ROW_BIN_COUNT 4
+#define ROW_BIN_LIST_MAX 16
+#define ROW_BIN_DENSE_RATIO 4
+#define ROW_BIN_HASH_MAX 4096
+
+// Expand-sort-compress (V10): products of consecutive rows are sorted together up to...
+#define ESC_TILE_PRODUCTS (1u << 14)  // ...this many products (keys and values stay in the L2 cache)
+#define ESC_INSERTION_SORT 32  // tiles with fewer products are insertion sorted instead of radix sorted
+
+// Column-tiled Gustavson (V11): the accumulator of a panel of columns of B takes 1/this of the L2 cache
+#define COLUMN_PANEL_CACHE_SHARE 2
+
+// Dense tiles (V12): A and B are cut into square tiles of DENSE_TILE_SIZE rows and columns, a tile
+// with at least DENSE_TILE_MIN_NNZ values is multiplied as a dense block. Three tiles (A, B and C)
+// fit into the L1 cache, the size is a multiple of DENSE_STRIDE_FLOATS for the AVX kernels
+#define DENSE_TILE_SIZE 64
+#define DENSE_TILE_MIN_NNZ (DENSE_TILE_SIZE * DENSE_TILE_SIZE / 4)
+
+// Number of non-zero values (and at most the number of rows) of A per block of --stream
+#define STREAM_BLOCK_NNZ (1u << 22)
+
+// Blocks of --pipeline are smaller, so reading, multiplying and writing overlap for smaller matrices too
+#define PIPELINE_BLOCK_NNZ (1u << 18)
+#define PIPELINE_QUEUE_DEPTH 4  // blocks of A read ahead and blocks of the result waiting to be written
+
+// NUMA modes of matr_mult_csr() (--numa)
+#define NUMA_OFF 0  // the threads float freely
+#define NUMA_PIN 1  // the threads are pinned to CPUs spread over the nodes
+#define NUMA_REPLICATE 2  // NUMA_PIN, and the threads of every node read their own copy of B...
+#define NUMA_REPLICATE_MAX_BYTES (256u << 20)  // ...if B has at most this many bytes
+#define NUMA_MAX_NODES 64  // nodes with higher ids are ignored
+
+// Output size estimators of V5 (--estimate), see estimate_values_dimension() in matrixutils.h
+#define SIZE_ESTIMATE_BOUND 1  // flops of every row, at most noCols of B (an upper bound)
+#define SIZE_ESTIMATE_EXACT 2  // distinct columns of every row from a symbolic pass
+#define SIZE_ESTIMATE_SAMPLE 3  // distinct columns of a sample of rows, scaled to all rows
+#define SIZE_SAMPLE_ROWS 1024  // rows of A in the sample
+#define SIZE_SAMPLE_MARGIN 8  // the sampled estimate is raised by 1/SIZE_SAMPLE_MARGIN of itself
+
+// Value types of the two-phase Gustavson implementations (V6 - V9)
+#define PRECISION_FLOAT 0  // float values, float accumulation
+#define PRECISION_MIXED 1  // float values, double accumulation
+#define PRECISION_DOUBLE 2  // double values (DoubleMatrix), double accumulation
+
+/*
+The struct MultiplyConfig holds the settings of the multithreaded implementation.
+
+schedule is one of the SCHEDULE_* strategies above.
+chunk_size is the number of rows per chunk for SCHEDULE_DYNAMIC. If it is 0, the rows
+are split into DYNAMIC_CHUNKS_PER_THREAD chunks per thread with the same number of
+estimated flops each.
+thread_count overrides the cost model of choose_thread_count() if it is not 0.
+precision is one of the PRECISION_* value types above. Only V6 - V9 support a
+precision other than PRECISION_FLOAT. For PRECISION_DOUBLE, the matrices passed to
+them are DoubleMatrix structs.
+numa is one of the NUMA_* modes above.
+stats is 1 if matr_mult_csr() records its counters in last_multiply_stats (--stats or the
+environment variable MULTIPLY_STATS_ENV), it has no effect if MULTIPLY_STATS is 0.
+size_estimate is the SIZE_ESTIMATE_* estimator V5 allocates its result with.
+*/
+typedef struct MultiplyConfig {
+    int schedule;
+    uint64_t chunk_size;
+    unsigned int thread_count;
+    int precision;
+    int numa;
+    int stats;
+    int size_estimate;
+} MultiplyConfig;
+
+/*
+The struct ThreadDecision records why choose_thread_count() picked a number of threads.
+
+thread_count is the number of threads used, values below MIN_THREADS mean that the
+rows were multiplied on the calling thread.
+available_threads is the number of CPUs in the affinity mask of the process.
+flops is the estimated number of flops of the multiplication.
+working_set is the estimated number of bytes touched by the multiplication.
+cache_size is the L2 cache size used by the model.
+overridden is 1 if the thread count was given by the user.
+bin_rows is the number of rows of C in every row bin (ROW_BIN_*).
+numa_nodes is the number of NUMA nodes the threads were spread over, 0 without --numa.
+replicated is 1 if every node read its own copy of B.
+bin_rows, numa_nodes and replicated are filled in by matr_mult_csr(), not by
+choose_thread_count().
+*/
+typedef struct ThreadDecision {
+    unsigned int thread_count;
+    unsigned int available_threads;
+    uint64_t flops;
+    uint64_t working_set;
+    uint64_t cache_size;
+    int overridden;
+    uint64_t bin_rows[ROW_BIN_COUNT];
+    unsigned int numa_nodes;
+    int replicated;
+} ThreadDecision;
+
+// Output formats of --bench
+#define BENCH_TEXT 0
+#define BENCH_JSON 1
+#define BENCH_CSV 2
+
+#define BENCH_DEFAULT_RUNS 5  // measured runs of --bench if -B<n> is not given
+#define BENCH_DEFAULT_WARMUP 1  // runs of --bench before the measured runs
+
+/*
+The struct BenchConfig holds the settings of --bench.
+
+enabled is 1 if the benchmark mode is used.
+format is one of the BENCH_* output formats above.
+warmup is the number of runs of every implementation that are not measured.
+implementations has bit i set if implementation Vi is benchmarked.
+*/
+typedef struct BenchConfig {
+    int enabled;
+    int format;
+    uint64_t warmup;
+    uint64_t implementations;
+} BenchConfig;
+
+/*
+The struct MultiplyPhases holds the seconds the last call of matr_mult_csr(), matr_mult_csr_ws()
+or matr_mult_csr_planned() spent in every phase. The other implementations don't record
+their phases and leave recorded at 0.
+
+symbolic is the work before the rows are multiplied: flop estimate, thread count, row slots
+and allocation, or creating the plan.
+numeric is the multiplication of the rows.
+compaction is moving the chunks of C together and shrinking its arrays.
+*/
+typedef struct MultiplyPhases {
+    int recorded;
+    double symbolic;
+    double numeric;
+    double compaction;
+} MultiplyPhases;
+
+// The counters of --stats are compiled in unless this is 0 (make STATS=0)
+#ifndef MULTIPLY_STATS
+#define MULTIPLY_STATS 1
+#endif
+
+// Checked before every counter update, a constant 0 removes the updates
+#if MULTIPLY_STATS
+#define STATS_ENABLED() (mult_config.stats)
+#else
+#define STATS_ENABLED() 0
+#endif
+
+#define MULTIPLY_STATS_ENV "MATR_MULT_STATS"  // switches the counters on if set to anything but 0
+#define MULTIPLY_STATS_MAX_WORKERS 256  // workers with counters, the rest are not counted
+
+/*
+The struct WorkerStats holds the counters of one worker of matr_mult_csr(). A worker is a
+RowScratch slot, exactly one thread works on a slot at a time, so there is one worker for
+every thread that runs at the same time. busy is the time the worker spent in its chunks in
+seconds, rows and chunks are the number of rows and chunks it multiplied.
+*/
+typedef struct WorkerStats {
+    double busy;
+    uint64_t rows;
+    uint64_t chunks;
+} WorkerStats;
+
+/*
+The struct MultiplyStats holds the counters of the last call of matr_mult_csr() or
+matr_mult_csr_ws() with stats switched on (see MultiplyConfig). recorded is 0 if no
+multiplication recorded them yet.
+
+flops is the number of products of A*B. Every product is a multiplication and an addition,
+so A*B takes 2 * flops floating point operations (the flops of --bench).
+predicted_nnz is the number of values C was allocated for (the sum of the row slots, see
+fill_row_offsets()), nnz the actual number of non-zero values of C.
+bytes_allocated is the memory malloc'ed by the multiplication, including the scratch of the
+row bins (a workspace only counts its growth).
+phases are the times of last_multiply_phases.
+worker_count is the number of workers, workers their counters.
+*/
+typedef struct MultiplyStats {
+    int recorded;
+    uint64_t flops;
+    uint64_t predicted_nnz;
+    uint64_t nnz;
+    uint64_t bytes_allocated;
+    MultiplyPhases phases;
+    unsigned int worker_count;
+    WorkerStats workers[MULTIPLY_STATS_MAX_WORKERS];
+} MultiplyStats;
+
+// Configuration used by matr_mult_csr(), defined in matrix.c
+extern MultiplyConfig mult_config;
+
+// Decision of the last call of matr_mult_csr(), defined in matrix.c
+extern ThreadDecision last_thread_decision;
+
+// Phases of the last call of matr_mult_csr(), defined in matrix.c
+extern MultiplyPhases last_multiply_phases;
+
+// Counters of the last call of matr_mult_csr() with stats, defined in matrix.c
+extern MultiplyStats last_multiply_stats;
+
+#endif
@@ -4,7 +4,7 @@
 // Constants defined below
 #define HEAP_MEMORY_ERROR -1
 
-#define NUMBER_OF_IMPLEMENTATIONS 6 // How many implementations do we have?
+#define NUMBER_OF_IMPLEMENTATIONS 13 // How many implementations do we have?
 
 extern const char* HEAP_MEMORY_ERROR_MSG;  // message to print when out of memory (malloc/realloc returned null ptr)
 
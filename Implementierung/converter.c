@@ -0,0 +1,96 @@
+/*
+This file converts CSR matrices between the text and the binary CSR format. Build and run it with:
+
+gcc -O3 converter.c constants.c utils.c -o convert
+./convert [-d] <input> <output>
+
+The input format is detected automatically, the output is written in the binary format if its
+filename ends with .csrb (BINARY_CSR_EXTENSION) and in the text format otherwise.
+Use -d to convert a matrix with double precision values without rounding them to float.
+*/
+
+// We need this to silence VSCode errors for getopt
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "csrmatrix.h"
+#include "utils.h"
+
+const char* CONVERTER_USAGE_MSG = "Usage: %s [-d] <input> <output>\n";
+
+/*
+Prints the error message for the given read/write result code, if it is one.
+Returns 0 if result is a success code, 1 otherwise.
+*/
+int report_file_error(const int result, const char* filename) {
+    switch (result) {
+        case FILE_OPEN_ERROR:
+            fprintf(stderr, FILE_OPEN_ERROR_MSG, filename);
+            return 1;
+        case MATRIX_FILE_FORMAT_ERROR:  // same value as FILE_WRITE_ERROR
+            fprintf(stderr, MATRIX_FILE_FORMAT_ERROR_MSG, filename);
+            return 1;
+        case HEAP_MEMORY_ERROR:
+            fprintf(stderr, "%s", HEAP_MEMORY_ERROR_MSG);
+            return 1;
+        default:  // MATRIX_READ_SUCCESS or MATRIX_WRITE_SUCCESS
+            return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    int double_flag = 0;
+    int ch;
+    while ((ch = getopt(argc, argv, "d")) != -1) {
+        switch (ch) {
+            case 'd':
+                double_flag = 1;
+                break;
+            default:
+                fprintf(stderr, CONVERTER_USAGE_MSG, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, CONVERTER_USAGE_MSG, argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* input = argv[optind];
+    const char* output = argv[optind + 1];
+
+    int result;
+    if (double_flag) {
+        DoubleMatrix* matrix;
+        result = read_double_matrix_from_file(input, &matrix);
+        if (report_file_error(result, input)) {
+            return EXIT_FAILURE;
+        }
+        result = write_double_matrix_to_file(output, matrix);
+        free_double_csr_matrix(matrix);
+    } else {
+        Matrix* matrix;
+        result = read_matrix_from_file(input, &matrix);
+        if (report_file_error(result, input)) {
+            return EXIT_FAILURE;
+        }
+        result = write_matrix_to_file(output, matrix);
+        free_csr_matrix(matrix);
+    }
+
+    // Write errors share their codes with read errors, so report them explicitly
+    if (result == FILE_OPEN_ERROR) {
+        fprintf(stderr, FILE_OPEN_ERROR_MSG, output);
+        return EXIT_FAILURE;
+    }
+    if (result == FILE_WRITE_ERROR) {
+        fprintf(stderr, FILE_WRITE_ERROR_MSG, output);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -16,6 +16,9 @@ valuesSize is the size of the 'values' array.
 colIndices is an array that contains the index of every value in the matrix.
 rowPointers is an array that indicates where a row starts and where it ends.
 rowPointersSize is the size of the 'rowPointers' array.
+mapping is NULL if the subarrays are allocated on the heap. A matrix read from a binary
+CSR file points straight into the memory mapped file instead. mapping is then the start
+and mappingSize the length of the mapping, which is released instead of the subarrays.
 
 values, colIndices and rowPointers are commonly referred to as a matrix'
 subarrays in the documentation.
@@ -32,6 +35,65 @@ typedef struct Matrix {
 
     uint64_t* rowPointers;
     uint64_t rowPointersSize;
+
+    void* mapping;
+    size_t mappingSize;
 } Matrix;
 
+/*
+The struct DoubleMatrix is a CSR Matrix with double precision values, used for
+--precision double. The members have the same meaning as in Matrix.
+*/
+typedef struct DoubleMatrix {
+    uint64_t noRows;
+    uint64_t noCols;
+
+    double* values;
+    uint64_t valuesSize;
+
+    uint64_t* colIndices;
+
+    uint64_t* rowPointers;
+    uint64_t rowPointersSize;
+
+    void* mapping;
+    size_t mappingSize;
+} DoubleMatrix;
+
+/*
+The struct CompactMatrix is a CSR Matrix with 32-bit indices. Every non-zero value
+costs 8 instead of 12 bytes, which reduces the memory traffic of the index loads.
+
+The members have the same meaning as in Matrix. A Matrix can only be narrowed to a
+CompactMatrix if noRows, noCols and valuesSize are all smaller than UINT32_MAX
+(see compact_csr_fits() and narrow_csr_matrix() in matrixutils.h).
+*/
+typedef struct CompactMatrix {
+    uint64_t noRows;
+    uint64_t noCols;
+
+    float* values;
+    uint64_t valuesSize;
+
+    uint32_t* colIndices;
+
+    uint32_t* rowPointers;
+    uint64_t rowPointersSize;
+} CompactMatrix;
+
+/*
+The struct DenseMatrix is a dense matrix in row-major order, the right-hand side and the
+result of matr_mult_spmm(). Row i starts at values + i * stride. stride is noCols rounded up
+to DENSE_STRIDE_FLOATS (see config.h), so every row starts on a cache line and the SIMD
+kernels never need a tail. A single column (a vector) is not padded, its stride is 1.
+The padding of every row is zero.
+*/
+typedef struct DenseMatrix {
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t stride;
+
+    float* values;
+} DenseMatrix;
+
 #endif
\ No newline at end of file
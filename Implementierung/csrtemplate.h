@@ -0,0 +1,283 @@
+/*
+This file is a template for the two-phase (symbolic/numeric) Gustavson kernels. It is
+included once per index width and value type in matrixutils.c, the following macros must
+be defined before including it:
+
+CSR_MATRIX is the type of the input matrices (Matrix, CompactMatrix or DoubleMatrix).
+CSR_INDEX is the type of their colIndices and rowPointers (uint64_t or uint32_t).
+CSR_RESULT is the type of the result matrix (Matrix or DoubleMatrix). Its indices are
+always 64-bit, they are only written once per non-zero value, while the indices of B
+are loaded once per product.
+CSR_VALUE is the type of the values of the input and result matrices (float or double).
+CSR_ACCUM is the type the products are accumulated in (float or double).
+CSR_NUMERIC is the name of the numeric pass (e.g. multiply_V6).
+
+Optional macros:
+
+CSR_SYMBOLIC is the name of the symbolic pass. It only depends on the index types, so it
+is only generated once per pair of input and result type.
+CSR_KERNEL_DRIVER is the name of a numeric pass that accumulates every row with a row
+kernel of type CSR_ROW_FN (see accumulate_row_fn in matrixutils.h).
+
+The loops of both passes are static helpers named like the pass with a leading underscore
+(e.g. _multiply_V6). They take their scratch arrays from the caller, so create_multiply_plan()
+can reuse the symbolic loop.
+
+All macros are undefined at the end of this file. There is no include guard on purpose.
+*/
+
+#define CSR_PASTE(a, b) CSR_PASTE_(a, b)
+#define CSR_PASTE_(a, b) a##b
+
+#ifdef CSR_SYMBOLIC
+/*
+Counts the distinct columns of every row of C into rowPointers (noRows of A + 1) as a prefix
+sum. marker must hold noCols of B elements, its contents are overwritten.
+*/
+static void CSR_PASTE(_, CSR_SYMBOLIC)(
+    const CSR_MATRIX* const restrict matrix_a,
+    const CSR_MATRIX* const restrict matrix_b,
+    uint64_t* const restrict rowPointers,
+    CSR_INDEX* const restrict marker
+    ) {
+    // marker[col] holds the last row of C in which col was seen
+    memset(marker, 0xff, sizeof(CSR_INDEX) * matrix_b->noCols);  // no row is the largest index
+
+    // Count the distinct columns of every row of C
+    rowPointers[0] = 0;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t rowCount = 0;
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            CSR_INDEX rowB = matrix_a->colIndices[indexA];
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                CSR_INDEX columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA) {
+                    marker[columnB] = (CSR_INDEX) rowA;
+                    rowCount++;
+                }
+            }
+        }
+        // Prefix sum of the row counts gives the row pointers
+        rowPointers[rowA + 1] = rowPointers[rowA] + rowCount;
+    }
+}
+
+int CSR_SYMBOLIC(
+    const CSR_MATRIX* const restrict matrix_a,
+    const CSR_MATRIX* const restrict matrix_b,
+    CSR_RESULT* const restrict matrix_result
+    ) {
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    if (rowPointers == NULL) {
+        matrix_result->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    CSR_INDEX* marker = malloc_safe(sizeof(CSR_INDEX), matrix_b->noCols);
+    if (marker == NULL) {
+        free(rowPointers);
+        matrix_result->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+    CSR_PASTE(_, CSR_SYMBOLIC)(matrix_a, matrix_b, rowPointers, marker);
+    free(marker);
+
+    // Allocate at least one element so that an empty result is not mistaken for an error
+    uint64_t valuesSize = rowPointers[matrix_a->noRows];
+    uint64_t allocSize = valuesSize ? valuesSize : 1;
+
+    CSR_VALUE* values = malloc_safe(sizeof(CSR_VALUE), allocSize);
+    if (values == NULL) {
+        free(rowPointers);
+        matrix_result->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), allocSize);
+    if (colIndices == NULL) {
+        free(values);
+        free(rowPointers);
+        matrix_result->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = matrix_b->noCols;
+    matrix_result->values = values;
+    matrix_result->valuesSize = valuesSize;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    return 0;
+}
+#endif
+
+/*
+Writes the rows of C into the arrays of matrix_result, which have the structure of the symbolic
+pass. accumulator (noCols of B elements) must be zeroed and is zeroed again on return, the
+contents of marker (noCols of B elements) are overwritten.
+
+Return value: The number of non-zero values of C, less than valuesSize if values cancelled out.
+*/
+static uint64_t CSR_PASTE(_, CSR_NUMERIC)(
+    const CSR_MATRIX* const restrict matrix_a,
+    const CSR_MATRIX* const restrict matrix_b,
+    CSR_RESULT* const restrict matrix_result,
+    CSR_ACCUM* const restrict accumulator,
+    CSR_INDEX* const restrict marker
+    ) {
+    memset(marker, 0xff, sizeof(CSR_INDEX) * matrix_b->noCols);
+
+    // valuesEndPtr never overtakes the symbolic start of a row, so cancelled
+    // entries (exact zeros) can be dropped in place while the row is written
+    uint64_t valuesEndPtr = 0;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t rowCBeg = valuesEndPtr;
+        uint64_t rowCEnd = valuesEndPtr;
+
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            CSR_ACCUM valueA = matrix_a->values[indexA];
+            CSR_INDEX rowB = matrix_a->colIndices[indexA];
+
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                CSR_INDEX columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA) {
+                    // First product for this column in the current row
+                    marker[columnB] = (CSR_INDEX) rowA;
+                    matrix_result->colIndices[rowCEnd++] = columnB;
+                }
+                accumulator[columnB] += valueA * (CSR_ACCUM) matrix_b->values[indexB];
+            }
+        }
+
+        // Gather the row from the accumulator and reset the touched entries
+        for (uint64_t i = rowCBeg; i < rowCEnd; i++) {
+            uint64_t columnC = matrix_result->colIndices[i];
+            CSR_VALUE valueC = (CSR_VALUE) accumulator[columnC];  // rounded once per value of C
+            accumulator[columnC] = 0;
+            if (valueC != 0) {
+                matrix_result->values[valuesEndPtr] = valueC;
+                matrix_result->colIndices[valuesEndPtr++] = columnC;
+            }
+        }
+        matrix_result->rowPointers[rowA + 1] = valuesEndPtr;
+    }
+
+    return valuesEndPtr;
+}
+
+int CSR_NUMERIC(
+    const CSR_MATRIX* const restrict matrix_a,
+    const CSR_MATRIX* const restrict matrix_b,
+    CSR_RESULT* const restrict matrix_result
+    ) {
+    // Numeric pass of the two-phase Gustavson, the structure comes from symbolic_multiply()
+    CSR_ACCUM* accumulator = calloc(matrix_b->noCols, sizeof(CSR_ACCUM));
+    if (accumulator == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    CSR_INDEX* marker = malloc_safe(sizeof(CSR_INDEX), matrix_b->noCols);
+    if (marker == NULL) {
+        free(accumulator);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    uint64_t valuesEndPtr = CSR_PASTE(_, CSR_NUMERIC)(matrix_a, matrix_b, matrix_result, accumulator, marker);
+
+    free(accumulator);
+    free(marker);
+
+    // Numerical cancellation is rare, the arrays only have to shrink when it happened
+    if (valuesEndPtr < matrix_result->valuesSize) {
+        matrix_result->valuesSize = valuesEndPtr;
+        _shrink_result_arrays(
+            (void**) &matrix_result->values, sizeof(CSR_VALUE), &matrix_result->colIndices, valuesEndPtr
+            );
+    }
+
+    return 0;
+}
+
+#ifdef CSR_KERNEL_DRIVER
+int CSR_KERNEL_DRIVER(
+    const CSR_MATRIX* const restrict matrix_a,
+    const CSR_MATRIX* const restrict matrix_b,
+    CSR_RESULT* const restrict matrix_result,
+    CSR_ROW_FN accumulate_row
+    ) {
+    // Numeric pass like CSR_NUMERIC, but the products are accumulated by accumulate_row
+    CSR_ACCUM* accumulator = calloc(matrix_b->noCols, sizeof(CSR_ACCUM));
+    if (accumulator == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    CSR_INDEX* marker = malloc_safe(sizeof(CSR_INDEX), matrix_b->noCols);
+    if (marker == NULL) {
+        free(accumulator);
+        return HEAP_MEMORY_ERROR;
+    }
+    memset(marker, 0xff, sizeof(CSR_INDEX) * matrix_b->noCols);  // no row is the largest index
+
+    uint64_t valuesEndPtr = 0;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t rowCBeg = valuesEndPtr;
+        uint64_t rowCEnd = valuesEndPtr;
+
+        // Collect the columns of the row of C
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            CSR_INDEX rowB = matrix_a->colIndices[indexA];
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                CSR_INDEX columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA) {
+                    marker[columnB] = (CSR_INDEX) rowA;
+                    matrix_result->colIndices[rowCEnd++] = columnB;
+                }
+            }
+        }
+
+        accumulate_row(matrix_a, matrix_b, rowA, accumulator);
+
+        // Gather the row from the accumulator and reset the touched entries
+        for (uint64_t i = rowCBeg; i < rowCEnd; i++) {
+            uint64_t columnC = matrix_result->colIndices[i];
+            CSR_VALUE valueC = (CSR_VALUE) accumulator[columnC];
+            accumulator[columnC] = 0;
+            if (valueC != 0) {
+                matrix_result->values[valuesEndPtr] = valueC;
+                matrix_result->colIndices[valuesEndPtr++] = columnC;
+            }
+        }
+        matrix_result->rowPointers[rowA + 1] = valuesEndPtr;
+    }
+
+    free(accumulator);
+    free(marker);
+
+    // Shrink the arrays if values cancelled out
+    if (valuesEndPtr < matrix_result->valuesSize) {
+        matrix_result->valuesSize = valuesEndPtr;
+        _shrink_result_arrays(
+            (void**) &matrix_result->values, sizeof(CSR_VALUE), &matrix_result->colIndices, valuesEndPtr
+            );
+    }
+
+    return 0;
+}
+#endif
+
+#undef CSR_MATRIX
+#undef CSR_INDEX
+#undef CSR_RESULT
+#undef CSR_VALUE
+#undef CSR_ACCUM
+#undef CSR_NUMERIC
+#undef CSR_SYMBOLIC
+#undef CSR_KERNEL_DRIVER
+#undef CSR_ROW_FN
+#undef CSR_PASTE
+#undef CSR_PASTE_
@@ -1,12 +1,25 @@
 /*
-This file generates input data for testing. As the tutor, you can execute the commands
-below to generate test cases:
+This file generates input data for testing and benchmarking. As the tutor, you can execute
+the commands below to generate the test cases:
 
-gcc -w -O3 -lm -mavx generator.c constants.c utils.c matrix.c matrixutils.c -o generate
+gcc -O3 generator.c constants.c utils.c matrix.c matrixutils.c threadpool.c numautils.c -lm -lpthread -o generate
 ./generate -s <seed>
 
 You can use the -s flag to set a seed and generate deterministic test matrices.
 Seed is set to time(NULL) if you don't specify the seed or specify an invalid seed.
+
+A single matrix with a sparsity pattern is generated with -o:
+
+./generate -r <rows> -c <cols> -n <nnz> -p <pattern> -o <filename> [-s <seed>] [-t <threads>]
+           [-w <half bandwidth>] [-k <block size>]
+
+The patterns are uniform (every row and column equally likely), rmat (power law row and
+column lengths of the recursive R-MAT model, like the graphs of social networks), banded
+(the columns of every row lie within w of the diagonal) and block (block diagonal with
+blocks of k rows). The rows are generated in parallel on t threads (default: all CPUs),
+the result is the same for every number of threads unless rows fill up. The output is
+written in the binary CSR format if the filename ends with .csrb. The options of a pattern
+are rejected without -o, unknown options print this usage.
 */
 
 // We need this to silence VSCode errors for getopt
@@ -25,11 +38,35 @@ Seed is set to time(NULL) if you don't specify the seed or specify an invalid se
 #include "csrmatrix.h"
 #include "matrixutils.h"
 #include "matrix.h"
+#include "threadpool.h"
 #include "utils.h"
 
 #define MAX_VALUE 100
 #define FILENAME_SIZE 80
 int generation_index = 0;
+unsigned int generation_seed = 0;
+
+// Sparsity patterns of -p
+#define PATTERN_UNIFORM 0
+#define PATTERN_RMAT 1
+#define PATTERN_BANDED 2
+#define PATTERN_BLOCK 3
+
+// Quadrant probabilities of R-MAT (top left, top right, bottom left, bottom right = the rest)
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+
+#define DEFAULT_BLOCK_SIZE 64  // rows per block of the block pattern without -k
+#define DRAW_BLOCK_SIZE (1u << 16)  // row draws per task, every block has its own random stream
+#define ROW_CHUNKS_PER_THREAD 16  // tasks per thread for the columns of the rows
+#define MAX_SAMPLE_ROUNDS 8  // redraws of duplicate columns before an R-MAT row falls back to uniform
+
+// Printed for unknown options and missing arguments, see the comment at the top
+const char* USAGE_MSG = "Usage: ./generate [-s <seed>] [-t <threads>]\n"
+"       ./generate -r <rows> -c <cols> -n <nnz> -p <pattern> -o <filename> [-s <seed>] [-t <threads>]\n"
+"                  [-w <half bandwidth>] [-k <block size>]\n"
+"The patterns are uniform, rmat, banded and block.\n";
 
 // This case should fail as there is a trailing new line at the end of the file.
 const char* ERROR_CASE_0 = "3,4\n"
@@ -86,207 +123,391 @@ const char* ERROR_CASE_10 = "3,4\n"
 "0,1,0,1,2\n"
 "0,20,10,5,5";
 
-int contains(uint64_t* arr, uint64_t size, uint64_t value) {
-    for (uint64_t i = 0; i < size; i++) {
-        if (arr[i] == value) { return 1; }
-    }
-    return 0;
+// This case is valid, but row 0 of B has column 0 four times, as many as an AVX2 vector has lanes.
+// Every implementation but V1 (2D array) adds them up, A * B must be "2,8\n4,1,8,2\n0,1,0,1\n0,2,4".
+const char* DUPLICATE_CASE_A = "2,1\n"
+"1,2\n"
+"0,0\n"
+"0,1,2";
+const char* DUPLICATE_CASE_B = "1,8\n"
+"1,1,1,1,1\n"
+"0,0,0,0,1\n"
+"0,5";
+
+/*
+Everything that decides how a matrix is generated. bandwidth is the half bandwidth of the
+banded pattern, block_size the rows per block of the block pattern.
+*/
+typedef struct GenSpec {
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t nnz;
+    int pattern;
+    uint64_t seed;
+    uint64_t bandwidth;
+    uint64_t block_size;
+} GenSpec;
+
+// Task of the first pass: draw_count rows get one more value each
+struct RowDrawArg {
+    const GenSpec* spec;
+    uint64_t* counts;
+    uint64_t block;
+    uint64_t draw_count;
+};
+
+// Task of the second pass: the columns and values of the rows start_row to end_row
+struct RowFillArg {
+    const GenSpec* spec;
+    Matrix* matrix;
+    uint64_t start_row;
+    uint64_t end_row;
+};
+
+/*
+splitmix64, a small generator with a 64 bit state. Every row and every block of draws seeds
+its own state, so the rows don't depend on which thread generates them.
+*/
+uint64_t gen_next(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15u);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+    return z ^ (z >> 31);
 }
 
-void clear_array(uint64_t* arr, uint64_t size) {
-    for (uint64_t i = 0; i < size; i++) {
-        arr[i] = UINT64_MAX;
-    }
+// Random number in [0, n) without a division (multiply and shift)
+uint64_t gen_below(uint64_t* state, uint64_t n) {
+    return (uint64_t) (((unsigned __int128) gen_next(state) * n) >> 64);
 }
 
-void generate_error_case(char* filename, const char* error_str, int error_index) {
-    FILE* file = fopen(filename, "w");
-    if (file == NULL) {
-    error_case_1_error: fprintf(stderr, "Error generating error test case %d\n", error_index);
-        return;
-    }
-    if (fprintf(file, error_str) != strlen(error_str)) {  // use strlen to see if fprintf wrote successfully
-        goto error_case_1_error;
-    }
+// Random number in [0, 1)
+double gen_unit(uint64_t* state) {
+    return (gen_next(state) >> 11) * 0x1.0p-53;
+}
 
-    printf("Generation successful for error test case %d\n", error_index);
+// Independent stream number stream of seed
+uint64_t gen_stream(uint64_t seed, uint64_t stream) {
+    uint64_t state = seed ^ (stream * 0xd1b54a32d192ed03u);
+    return gen_next(&state);
+}
 
-    fclose(file);
+// Non-zero value with one decimal place in (-MAX_VALUE, MAX_VALUE), a quarter are negative
+float gen_value(uint64_t* state) {
+    float value;
+    do {
+        value = (float) gen_below(state, MAX_VALUE) + (float) gen_below(state, 10) / 10.0f;
+    } while (value == 0.0f);
+    return gen_below(state, 4) == 0 ? -value : value;
 }
 
-Matrix* gen_empty_matrix(uint64_t noRows, uint64_t noCols, uint64_t valuesSize) {
-    if (valuesSize < 0)
-    {
-        fprintf(stderr, "maxNumValues must be greater than or equal 0\n");
+// Number of bits of the largest index below n
+unsigned int index_bits(uint64_t n) {
+    unsigned int bits = 0;
+    while (bits < 64 && (UINT64_C(1) << bits) < n) {
+        bits++;
     }
-    if (valuesSize == 0) { valuesSize = 1; }
+    return bits;
+}
 
-    Matrix* matrix = malloc(sizeof(Matrix));
-    if (matrix == NULL) {
-        return NULL;
-    }
+/*
+R-MAT row: on every level, the row goes to the bottom half with the probability of the two
+bottom quadrants. Rows beyond noRows are drawn again.
+*/
+uint64_t gen_rmat_row(uint64_t* state, uint64_t noRows) {
+    unsigned int bits = index_bits(noRows);
+    uint64_t row;
+    do {
+        row = 0;
+        for (unsigned int level = 0; level < bits; level++) {
+            row = row << 1 | (gen_unit(state) >= RMAT_A + RMAT_B);
+        }
+    } while (row >= noRows);
+    return row;
+}
 
-    float* values = calloc(sizeof(float), valuesSize);
-    if (values == NULL) {
-        free(matrix);
-        return NULL;
-    }
+/*
+R-MAT column of row: on every level, the column goes to the right half with the probability
+of the right quadrant of the half the row is in. Columns beyond noCols are drawn again.
+*/
+uint64_t gen_rmat_column(uint64_t* state, uint64_t row, uint64_t noRows, uint64_t noCols) {
+    unsigned int row_bits = index_bits(noRows);
+    unsigned int col_bits = index_bits(noCols);
+    uint64_t column;
+    do {
+        column = 0;
+        for (unsigned int level = 0; level < col_bits; level++) {
+            double right;
+            if (level < row_bits) {
+                right = (row >> (row_bits - 1 - level)) & 1
+                    ? (1 - RMAT_A - RMAT_B - RMAT_C) / (1 - RMAT_A - RMAT_B)
+                    : RMAT_B / (RMAT_A + RMAT_B);
+            } else {
+                right = 1 - RMAT_A - RMAT_C;  // the row has no more levels
+            }
+            column = column << 1 | (gen_unit(state) < right);
+        }
+    } while (column >= noCols);
+    return column;
+}
 
-    uint64_t* colIndices = calloc(sizeof(uint64_t), valuesSize);
-    if (colIndices == NULL) {
-        free(matrix);
-        free(values);
-        return NULL;
+// Columns [first, end) row may have values in, depending on the pattern
+void row_column_range(const GenSpec* spec, uint64_t row, uint64_t* first, uint64_t* end) {
+    switch (spec->pattern) {
+        case PATTERN_BANDED: {
+            uint64_t center = (uint64_t) ((unsigned __int128) row * spec->noCols / spec->noRows);
+            *first = center > spec->bandwidth ? center - spec->bandwidth : 0;
+            *end = center + spec->bandwidth + 1 < spec->noCols ? center + spec->bandwidth + 1 : spec->noCols;
+            break;
+        }
+        case PATTERN_BLOCK: {
+            uint64_t block = row / spec->block_size;
+            *first = (uint64_t) ((unsigned __int128) block * spec->block_size * spec->noCols / spec->noRows);
+            *end = (uint64_t) ((unsigned __int128) (block + 1) * spec->block_size * spec->noCols / spec->noRows);
+            *end = *end < spec->noCols ? *end : spec->noCols;
+            *end = *end > *first ? *end : (*first < spec->noCols ? *first + 1 : *first);
+            break;
+        }
+        default:  // PATTERN_UNIFORM, PATTERN_RMAT
+            *first = 0;
+            *end = spec->noCols;
+            break;
     }
+}
 
-    uint64_t* rowPointers = calloc(sizeof(uint64_t), (noRows + 1));
-    if (rowPointers == NULL) {
-        free(matrix);
-        free(values);
-        free(colIndices);
-        return NULL;
+// Adds draw_count values to randomly drawn rows that are not full yet
+void* draw_rows(void* void_arg) {
+    struct RowDrawArg* arg = (struct RowDrawArg*) void_arg;
+    const GenSpec* spec = arg->spec;
+    uint64_t state = gen_stream(spec->seed, arg->block);
+
+    for (uint64_t i = 0; i < arg->draw_count; i++) {
+        while (1) {
+            uint64_t row = spec->pattern == PATTERN_RMAT
+                ? gen_rmat_row(&state, spec->noRows)
+                : gen_below(&state, spec->noRows);
+            uint64_t first, end;
+            row_column_range(spec, row, &first, &end);
+            if (__atomic_fetch_add(&arg->counts[row], 1, __ATOMIC_RELAXED) < end - first) {
+                break;
+            }
+            __atomic_fetch_sub(&arg->counts[row], 1, __ATOMIC_RELAXED);  // full, draw another row
+        }
     }
+    return NULL;
+}
 
-    matrix->noRows = noRows;
-    matrix->noCols = noCols;
-    matrix->values = values;
-    matrix->valuesSize = valuesSize;
-    matrix->colIndices = colIndices;
-    matrix->rowPointers = rowPointers;
-    matrix->rowPointersSize = noRows + 1;
+// Runs the tasks on the thread pool, or on the calling thread if there is no pool (-t 1)
+void run_tasks(thread_pool_fn fn, void** args, uint64_t task_count) {
+    if (thread_pool_run(fn, args, (unsigned int) task_count, 0) != 0) {
+        for (uint64_t i = 0; i < task_count; i++) {
+            fn(args[i]);
+        }
+    }
+}
 
-    return matrix;
+int compare_columns(const void* a, const void* b) {
+    uint64_t column_a = *(const uint64_t*) a;
+    uint64_t column_b = *(const uint64_t*) b;
+    return (column_a > column_b) - (column_a < column_b);
 }
 
-// for example 10, 10, 15.0
-Matrix* gen_rand_matrix(uint64_t noRows, uint64_t noCols, uint64_t valuesSize) {
-    Matrix* matrix = gen_empty_matrix(noRows, noCols, valuesSize);
-    if (matrix == NULL) {
-        fprintf(stderr, "%s", HEAP_MEMORY_ERROR_MSG);
-        return NULL;
+/*
+Writes count distinct, sorted columns in [first, end) to columns. Rows that fill at least half
+of their range are selected in one pass over the range, the others draw columns, sort them
+and draw again for the duplicates.
+*/
+void fill_row_columns(
+    const GenSpec* spec, uint64_t* state, uint64_t row, uint64_t first, uint64_t end,
+    uint64_t* columns, uint64_t count
+    ) {
+    uint64_t range = end - first;
+    if (2 * count >= range) {
+        // Selection sampling: every column is taken with probability needed / remaining
+        uint64_t needed = count;
+        for (uint64_t column = first; needed > 0; column++) {
+            if (gen_below(state, end - column) < needed) {
+                *columns++ = column;
+                needed--;
+            }
+        }
+        return;
     }
 
-    if (valuesSize == 0)
-    {
-        return matrix;
+    uint64_t unique = 0;
+    for (unsigned int round = 0; unique < count; round++) {
+        // R-MAT rows with few likely columns finish with uniform columns
+        int rmat = spec->pattern == PATTERN_RMAT && round < MAX_SAMPLE_ROUNDS;
+        for (uint64_t i = unique; i < count; i++) {
+            columns[i] = rmat
+                ? gen_rmat_column(state, row, spec->noRows, spec->noCols)
+                : first + gen_below(state, range);
+        }
+        qsort(columns, count, sizeof(uint64_t), compare_columns);
+        unique = 1;
+        for (uint64_t i = 1; i < count; i++) {
+            if (columns[i] != columns[unique - 1]) {
+                columns[unique++] = columns[i];
+            }
+        }
     }
+}
 
-
-    for (uint64_t i = 0; i < valuesSize; i++) {
-        matrix->values[i] = (float)((rand() % MAX_VALUE) + ((float)(rand() % 10) / 10.0));
-        while (matrix->values[i] == 0.0)
-        {
-            matrix->values[i] = (float)(rand() % MAX_VALUE) + ((float)(rand() % 10) / 10.0);
+// Generates the columns and values of the rows of the task
+void* fill_rows(void* void_arg) {
+    struct RowFillArg* arg = (struct RowFillArg*) void_arg;
+    const GenSpec* spec = arg->spec;
+    Matrix* matrix = arg->matrix;
+
+    for (uint64_t row = arg->start_row; row < arg->end_row; row++) {
+        uint64_t start = matrix->rowPointers[row];
+        uint64_t count = matrix->rowPointers[row + 1] - start;
+        if (count == 0) {
+            continue;
         }
-
-
-        if (rand() % 4 == 0) {
-            matrix->values[i] *= -1;
+        uint64_t state = gen_stream(spec->seed, ~row);  // the streams of draw_rows() count up from 0
+        uint64_t first, end;
+        row_column_range(spec, row, &first, &end);
+        fill_row_columns(spec, &state, row, first, end, matrix->colIndices + start, count);
+        for (uint64_t i = start; i < start + count; i++) {
+            matrix->values[i] = gen_value(&state);
         }
-
     }
+    return NULL;
+}
 
-    uint64_t num_elements_in_row = 0;
-    uint64_t random_row = rand() % noRows;
-    // Set row pointers
-    for (uint64_t i = 0; i < valuesSize; i++) {
-        // Returns an index from 1 to noCols-1
-        do {
-            random_row = 1 + (random_row % noRows);
-            num_elements_in_row = matrix->rowPointers[random_row] - matrix->rowPointers[random_row - 1];
-        } while (num_elements_in_row >= noCols);
-
-        for (uint64_t j = random_row; j < noRows + 1; j++) {
-            matrix->rowPointers[j]++;
-        }
+/*
+Generates a matrix following spec on thread_count threads. First the values are distributed
+over the rows, then every row gets its columns and values.
+
+Return value: The matrix, or NULL if spec asks for more values than fit or memory ran out.
+*/
+Matrix* gen_matrix(const GenSpec* spec, unsigned int thread_count) {
+    // The values must fit into the column ranges of the rows
+    uint64_t capacity = 0;
+    for (uint64_t row = 0; row < spec->noRows; row++) {
+        uint64_t first, end;
+        row_column_range(spec, row, &first, &end);
+        capacity += end - first;
+    }
+    if (spec->nnz > capacity) {
+        fprintf(stderr, "%lu non-zero values don't fit into the pattern (at most %lu)\n", spec->nnz, capacity);
+        return NULL;
     }
 
-    uint64_t row_index = 0;
-    uint64_t used_col_counter = 0;
-    uint64_t row_end = matrix->rowPointers[row_index + 1];
-    uint64_t* used_col_array = malloc(valuesSize * sizeof(uint64_t));
-    if (used_col_array == NULL)
-    {
+    Matrix* matrix = malloc(sizeof(Matrix));
+    uint64_t valuesSize = spec->nnz > 0 ? spec->nnz : 1;  // an empty matrix holds a single zero
+    uint64_t draw_tasks = (spec->nnz + DRAW_BLOCK_SIZE - 1) / DRAW_BLOCK_SIZE;
+    uint64_t chunk_count = (uint64_t) thread_count * ROW_CHUNKS_PER_THREAD;
+    chunk_count = chunk_count < spec->noRows ? chunk_count : (spec->noRows > 0 ? spec->noRows : 1);
+    uint64_t task_count = draw_tasks > chunk_count ? draw_tasks : chunk_count;
+    void** tasks = malloc_safe(sizeof(void*), task_count);
+    struct RowDrawArg* draws = malloc_safe(sizeof(struct RowDrawArg), draw_tasks > 0 ? draw_tasks : 1);
+    struct RowFillArg* fills = malloc_safe(sizeof(struct RowFillArg), chunk_count);
+    if (matrix == NULL || tasks == NULL || draws == NULL || fills == NULL) {
+        free_pointers(4, matrix, tasks, draws, fills);
+        fprintf(stderr, "%s", HEAP_MEMORY_ERROR_MSG);
+        return NULL;
+    }
+    matrix->noRows = spec->noRows;
+    matrix->noCols = spec->noCols;
+    matrix->values = malloc_safe(sizeof(float), valuesSize);
+    matrix->valuesSize = valuesSize;
+    matrix->colIndices = malloc_safe(sizeof(uint64_t), valuesSize);
+    matrix->rowPointers = calloc(spec->noRows + 1, sizeof(uint64_t));
+    matrix->rowPointersSize = spec->noRows + 1;
+    matrix->mapping = NULL;
+    matrix->mappingSize = 0;
+    if (matrix->values == NULL || matrix->colIndices == NULL || matrix->rowPointers == NULL) {
+        free_pointers(3, tasks, draws, fills);
+        free_csr_matrix(matrix);
         fprintf(stderr, "%s", HEAP_MEMORY_ERROR_MSG);
         return NULL;
     }
 
-    clear_array(used_col_array, valuesSize);
-    // Set column indices
-    uint64_t random_col;
-    for (uint64_t i = 0; i < valuesSize; i++) {
+    matrix->values[0] = 0;
+    matrix->colIndices[0] = 0;
 
-        if (i >= row_end) {
-            clear_array(used_col_array, valuesSize);
-            used_col_counter = 0;
-            row_index++;
-            row_end = matrix->rowPointers[row_index + 1];
+    // Count the values of every row in rowPointers[row + 1], the prefix sum makes them row pointers
+    for (uint64_t i = 0; i < draw_tasks; i++) {
+        uint64_t left = spec->nnz - i * DRAW_BLOCK_SIZE;
+        draws[i] = (struct RowDrawArg) {spec, matrix->rowPointers + 1, i, left < DRAW_BLOCK_SIZE ? left : DRAW_BLOCK_SIZE};
+        tasks[i] = &draws[i];
+    }
+    run_tasks(&draw_rows, tasks, draw_tasks);
+    for (uint64_t row = 0; row < spec->noRows; row++) {
+        matrix->rowPointers[row + 1] += matrix->rowPointers[row];
+    }
 
+    // Chunks with the same number of values
+    uint64_t row = 0;
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        uint64_t end_row = row;
+        uint64_t target = (uint64_t) ((unsigned __int128) spec->nnz * (i + 1) / chunk_count);
+        while (end_row < spec->noRows && (matrix->rowPointers[end_row] < target || i + 1 == chunk_count)) {
+            end_row++;
         }
-        do {
-            random_col = rand() % (noCols);
-            // Set col_index
-        } while (contains(used_col_array, used_col_counter, random_col) == 1);
-
-        matrix->colIndices[i] = random_col;
-        used_col_array[used_col_counter] = random_col;
-        used_col_counter++;
+        fills[i] = (struct RowFillArg) {spec, matrix, row, end_row};
+        tasks[i] = &fills[i];
+        row = end_row;
     }
-    free(used_col_array);
+    run_tasks(&fill_rows, tasks, chunk_count);
 
+    free_pointers(3, tasks, draws, fills);
     return matrix;
 }
 
+void generate_error_case(char* filename, const char* error_str, int error_index) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+    error_case_1_error: fprintf(stderr, "Error generating error test case %d\n", error_index);
+        return;
+    }
+    if (fputs(error_str, file) == EOF) {
+        fclose(file);
+        goto error_case_1_error;
+    }
+
+    printf("Generation successful for error test case %d\n", error_index);
+
+    fclose(file);
+}
+
+void generate_text_case(char* filename, const char* matrix_str) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+    text_case_error: fprintf(stderr, "Error generating %s\n", filename);
+        return;
+    }
+    if (fputs(matrix_str, file) == EOF) {
+        fclose(file);
+        goto text_case_error;
+    }
 
+    printf("Generation successful for %s\n", filename);
+
+    fclose(file);
+}
 
 void generate(uint64_t noRows, uint64_t noCols, uint64_t maxNumValues) {
     char filename[FILENAME_SIZE];
     snprintf(filename, FILENAME_SIZE, "generated/matrix_%d.txt", generation_index);
-    Matrix* matrix = gen_rand_matrix(noRows, noCols, maxNumValues);
-    if (gen_rand_matrix == NULL) {
+    GenSpec spec = {noRows, noCols, maxNumValues, PATTERN_UNIFORM, gen_stream(generation_seed, generation_index), 0, 0};
+    Matrix* matrix = gen_matrix(&spec, thread_pool_size() + 1);
+    if (matrix == NULL) {
         fprintf(stderr, "Generation failed for %d\n", generation_index);
+        generation_index++;
+        return;
     }
     if (write_matrix_to_file(filename, matrix) != MATRIX_WRITE_SUCCESS) {
         fprintf(stderr, "Error writing matrix to file for %d\n", generation_index);
+    } else {
+        printf("Generation successful for %d\n", generation_index);
     }
     free_csr_matrix(matrix);
-    printf("Generation successful for %d\n", generation_index);
     generation_index++;
 }
 
-
-int main(int argc, char** argv) {
-    // Check if seed was given
-    int seed_flag = 0;
-    unsigned int seed = 0;
-    int ch;
-    char* endptr;
-    const char* optstring = "s:";
-    while ((ch = getopt(argc, argv, optstring)) != -1) {
-        switch (ch) {
-        case 's':
-            errno = 0;
-            seed = (unsigned int)strtoul(optarg, &endptr, 10);
-            if (errno || *endptr != '\0') {
-                // error parsing string, no seed set
-                fprintf(stderr, "Invalid seed, defaulting to using time...\n\n");
-                break;
-            }
-            seed_flag = 1;
-            break;
-        default:
-            break;
-        }
-    }
-
-    // Initialize seed for random number generator here
-    if (seed_flag) {
-        srand(seed);
-    }
-    else {  // no seed given, use the current time as the seed
-        srand(time(NULL));
-    }
-
+void generate_test_cases(void) {
     // Standard cases
     generate(10, 10, 10);  // matrix 0, squared
     generate(300, 500, 30);  // matrix 1, can be multipied with 2
@@ -304,6 +525,10 @@ int main(int argc, char** argv) {
     // Matrix 9, this edge case shows the weakness of V1 (conversion to 2D array)
     generate(16, 16, 2);
 
+    // Duplicate column indices in a row of B, they have to be added up
+    generate_text_case("generated/duplicate_matrix_a.txt", DUPLICATE_CASE_A);
+    generate_text_case("generated/duplicate_matrix_b.txt", DUPLICATE_CASE_B);
+
     // B.I.G Matrices
     generate(1000, 1000, 10); // matrix 10 can be squared (extra sparse)
     generate(1000, 1000, 1000); // matrix 11 can be squared
@@ -325,6 +550,153 @@ int main(int argc, char** argv) {
     generate_error_case("generated/error_matrix_8.txt", ERROR_CASE_8, error_index++);
     generate_error_case("generated/error_matrix_9.txt", ERROR_CASE_9, error_index++);
     generate_error_case("generated/error_matrix_10.txt", ERROR_CASE_10, error_index++);
+}
+
+// Parses a positive number (zero if allow_zero) of option ch, prints an error otherwise
+int parse_count(const char* arg, char ch, int allow_zero, uint64_t* count) {
+    char* endptr;
+    errno = 0;
+    *count = strtoull(arg, &endptr, 10);
+    if (arg[0] == '-' || errno || *endptr != '\0' || (*count == 0 && !allow_zero)) {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, ch);
+        return -1;
+    }
+    return 0;
+}
+
 
+int main(int argc, char** argv) {
+    // Check if seed was given
+    int seed_flag = 0;
+    unsigned int seed = 0;
+    GenSpec spec = {0, 0, 0, PATTERN_UNIFORM, 0, 0, DEFAULT_BLOCK_SIZE};
+    int bandwidth_flag = 0;
+    int pattern_flag = 0;  // an option of the pattern generation (-r, -c, -n, -p, -w or -k) was given
+    uint64_t thread_count = available_cpus();
+    const char* filename = NULL;
+    int ch;
+    char* endptr;
+    const char* optstring = "s:r:c:n:p:o:t:w:k:";
+    while ((ch = getopt(argc, argv, optstring)) != -1) {
+        switch (ch) {
+        case 's':
+            errno = 0;
+            seed = (unsigned int)strtoul(optarg, &endptr, 10);
+            if (errno || *endptr != '\0') {
+                // error parsing string, no seed set
+                fprintf(stderr, "Invalid seed, defaulting to using time...\n\n");
+                break;
+            }
+            seed_flag = 1;
+            break;
+        case 'r':
+            if (parse_count(optarg, ch, 0, &spec.noRows) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            if (parse_count(optarg, ch, 0, &spec.noCols) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            if (parse_count(optarg, ch, 1, &spec.nnz) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't':
+            if (parse_count(optarg, ch, 0, &thread_count) != 0 || thread_count > MAX_THREADS) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'w':
+            if (parse_count(optarg, ch, 1, &spec.bandwidth) != 0) {
+                return EXIT_FAILURE;
+            }
+            bandwidth_flag = 1;
+            break;
+        case 'k':
+            if (parse_count(optarg, ch, 0, &spec.block_size) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p':
+            if (!strcmp(optarg, "uniform")) {
+                spec.pattern = PATTERN_UNIFORM;
+            } else if (!strcmp(optarg, "rmat")) {
+                spec.pattern = PATTERN_RMAT;
+            } else if (!strcmp(optarg, "banded")) {
+                spec.pattern = PATTERN_BANDED;
+            } else if (!strcmp(optarg, "block")) {
+                spec.pattern = PATTERN_BLOCK;
+            } else {
+                fprintf(stderr, "Unknown pattern \"%s\" (use uniform, rmat, banded or block)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'o':
+            filename = optarg;
+            break;
+        default:  // '?', unknown option or missing argument, getopt() printed which
+            fprintf(stderr, "%s", USAGE_MSG);
+            return EXIT_FAILURE;
+        }
+        pattern_flag = pattern_flag || strchr("rcnpwk", ch) != NULL;
+    }
+
+    // Without -o the test suite is generated, which has its own dimensions and pattern
+    if (pattern_flag && filename == NULL) {
+        fprintf(stderr, "-r, -c, -n, -p, -w and -k need -o\n%s", USAGE_MSG);
+        return EXIT_FAILURE;
+    }
+
+    // Initialize seed for random number generator here
+    if (!seed_flag) {  // no seed given, use the current time as the seed
+        seed = (unsigned int) time(NULL);
+    }
+    generation_seed = seed;
+
+    // The calling thread works on the tasks as well
+    if (thread_count > 1 && thread_pool_init((unsigned int) thread_count - 1) != 0) {
+        fprintf(stderr, "%s", THREAD_START_ERROR_MSG);
+        return EXIT_FAILURE;
+    }
+
+    if (filename == NULL) {
+        generate_test_cases();
+        thread_pool_shutdown();
+        return 0;
+    }
+
+    if (spec.noRows == 0 || spec.noCols == 0) {
+        fprintf(stderr, "-o needs the dimensions of the matrix (-r and -c)\n");
+        thread_pool_shutdown();
+        return EXIT_FAILURE;
+    }
+    if (!bandwidth_flag) {
+        // Wide enough for the average row and some variation
+        spec.bandwidth = spec.nnz / spec.noRows + 1;
+    }
+    spec.seed = seed;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Matrix* matrix = gen_matrix(&spec, (unsigned int) thread_count);
+    thread_pool_shutdown();
+    if (matrix == NULL) {
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf(
+        "Generated %lux%lu matrix with %lu non-zero values in %g seconds\n", spec.noRows, spec.noCols, spec.nnz,
+        end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec)
+        );
+
+    if (write_matrix_to_file(filename, matrix) != MATRIX_WRITE_SUCCESS) {
+        fprintf(stderr, FILE_WRITE_ERROR_MSG, filename);
+        free_csr_matrix(matrix);
+        return EXIT_FAILURE;
+    }
+    free_csr_matrix(matrix);
     return 0;
 }
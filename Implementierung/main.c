@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <errno.h>
+#include <unistd.h>
 
 // Our header files
 #include "constants.h"
@@ -14,6 +15,10 @@
 #include "csrmatrix.h"
 #include "matrixutils.h"
 #include "matrix.h"
+#include "threadpool.h"
+#include "bench.h"
+#include "pipeline.h"
+#include "config.h"
 
 
 // Multiplication algorithm function type
@@ -36,11 +41,1040 @@ mult_fn choose_mult_fn(uint8_t implementation) {
             return matr_mult_csr_V4;
         case 5:
             return matr_mult_csr_V5;
+        case 6:
+            return matr_mult_csr_V6;
+        case 7:
+            return matr_mult_csr_V7;
+        case 8:
+            return matr_mult_csr_V8;
+        case 9:
+            return matr_mult_csr_V9;
+        case 10:
+            return matr_mult_csr_V10;
+        case 11:
+            return matr_mult_csr_V11;
+        case 12:
+            return matr_mult_csr_V12;
         default:  // invalid input (this is actually never the case)
             return NULL;
     }
 }
 
+/*
+Prints how many threads the main implementation used and why, and how its rows were binned.
+*/
+void print_thread_decision(const ThreadDecision* const decision) {
+    if (decision->thread_count < MIN_THREADS) {
+        printf("Used 1 thread");
+    } else {
+        printf("Used %u threads", decision->thread_count);
+    }
+    printf(
+        " of %u available (%s, %lu estimated flops, %lu bytes working set, %lu bytes L2 cache)\n",
+        decision->available_threads, decision->overridden ? "set by --threads" : "cost model",
+        decision->flops, decision->working_set, decision->cache_size
+        );
+    printf(
+        "Row bins: %lu list, %lu dense (%s), %lu hash, %lu ESC\n",
+        decision->bin_rows[ROW_BIN_LIST], decision->bin_rows[ROW_BIN_DENSE], row_kernel_name(best_row_kernel()),
+        decision->bin_rows[ROW_BIN_HASH], decision->bin_rows[ROW_BIN_ESC]
+        );
+    if (decision->numa_nodes) {
+        printf(
+            "NUMA: threads pinned over %u node(s)%s\n", decision->numa_nodes,
+            decision->replicated ? ", B replicated on every node" : ""
+            );
+    }
+}
+
+/*
+Prints the counters of --stats of the last multiplication of the main implementation.
+*/
+void print_multiply_stats(const MultiplyStats* const stats) {
+    if (!stats->recorded) {
+        printf("No stats recorded (only V0 records them%s)\n", MULTIPLY_STATS ? "" : ", built with STATS=0");
+        return;
+    }
+
+    printf(
+        "Stats: %lu products (%lu flops), %lu of %lu predicted non-zero values (%.1f%%), %lu bytes allocated\n",
+        stats->flops, 2 * stats->flops, stats->nnz, stats->predicted_nnz,
+        stats->predicted_nnz ? 100.0 * stats->nnz / stats->predicted_nnz : 100.0, stats->bytes_allocated
+        );
+    printf(
+        "Phases: symbolic %g s, numeric %g s, compaction %g s\n",
+        stats->phases.symbolic, stats->phases.numeric, stats->phases.compaction
+        );
+
+    // The imbalance is the busiest worker compared to the mean, 1 is a perfect balance
+    double max_busy = 0;
+    double sum_busy = 0;
+    unsigned int workers = stats->worker_count < MULTIPLY_STATS_MAX_WORKERS
+        ? stats->worker_count
+        : MULTIPLY_STATS_MAX_WORKERS;
+    for (unsigned int i = 0; i < workers; i++) {
+        const WorkerStats* worker = &stats->workers[i];
+        printf("Worker %u: busy %g s, %lu rows in %lu chunk(s)\n", i, worker->busy, worker->rows, worker->chunks);
+        max_busy = worker->busy > max_busy ? worker->busy : max_busy;
+        sum_busy += worker->busy;
+    }
+    if (stats->worker_count > workers) {
+        printf("%u more worker(s) not counted\n", stats->worker_count - workers);
+    }
+    if (workers > 1 && sum_busy > 0) {
+        printf("Load imbalance: %.2f (busiest worker / mean)\n", max_busy * workers / sum_busy);
+    }
+}
+
+/*
+Prints the order of the subchain of the operands first to last that was chosen for the chain,
+with the operands numbered from 1 like "((M1 * M2) * M3)".
+*/
+void print_chain_order(const MultiplyChain* const chain, const unsigned int first, const unsigned int last) {
+    if (first == last) {
+        printf("M%u", first + 1);
+        return;
+    }
+    const unsigned int split = chain->split[first * chain->count + last];
+    printf("(");
+    print_chain_order(chain, first, split);
+    printf(" * ");
+    print_chain_order(chain, split + 1, last);
+    printf(")");
+}
+
+/*
+Sets error_message for the return value of a function that reads the matrix in filename
+(read_matrix_from_file() and the other readers of utils.h).
+
+Return values:
+    0 if the matrix was read (MATRIX_READ_SUCCESS).
+    -1 otherwise, error_message is set then.
+*/
+int _check_read_result(const int read_result, const char* filename, char** error_message) {
+    switch (read_result) {
+        case FILE_OPEN_ERROR:
+            set_error_message(error_message, FILE_OPEN_ERROR_MSG, filename);
+            return -1;
+        case MATRIX_FILE_FORMAT_ERROR:
+            set_error_message(error_message, MATRIX_FILE_FORMAT_ERROR_MSG, filename);
+            return -1;
+        case HEAP_MEMORY_ERROR:
+            set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+            return -1;
+        default:  // MATRIX_READ_SUCCESS
+            return 0;
+    }
+}
+
+/*
+Sets error_message for the return value of a function that writes to filename
+(write_matrix_to_file() and the other writers of utils.h).
+
+Return values:
+    0 if the matrix was written (MATRIX_WRITE_SUCCESS).
+    -1 otherwise, error_message is set then.
+*/
+int _check_write_result(const int write_result, const char* filename, char** error_message) {
+    switch (write_result) {
+        case FILE_OPEN_ERROR:
+            set_error_message(error_message, FILE_OPEN_ERROR_MSG, filename);
+            return -1;
+        case FILE_WRITE_ERROR:
+            set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename);
+            return -1;
+        case HEAP_MEMORY_ERROR:
+            set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+            return -1;
+        default:  // MATRIX_WRITE_SUCCESS
+            return 0;
+    }
+}
+
+/*
+Reads the CSR matrix in filename into *matrix (see read_matrix_from_file()).
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set then.
+*/
+int _read_operand(const char* filename, Matrix** matrix, char** error_message) {
+    return _check_read_result(read_matrix_from_file(filename, matrix), filename, error_message);
+}
+
+/*
+Checks if a noRows_a x noCols_a matrix can be multiplied with a noRows_b x noCols_b matrix.
+Every mode checks this before it multiplies, so the multiplications never fail with
+MATRIX_DIMENSION_ERROR.
+
+Return values:
+    0 if the multiplication is defined.
+    -1 otherwise, error_message is set then.
+*/
+int _check_dimensions(
+    const uint64_t noRows_a, const uint64_t noCols_a, const uint64_t noRows_b, const uint64_t noCols_b,
+    char** error_message
+    ) {
+    if (noCols_a != noRows_b) {
+        set_error_message(error_message, MATRIX_DIM_ERROR_MSG, noRows_a, noCols_a, noRows_b, noCols_b);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Sets error_message for the errno a multiplication left behind. The dimensions are checked
+before with _check_dimensions().
+
+Return values:
+    0 if the multiplication succeeded.
+    -1 otherwise, error_message is set then.
+*/
+int _check_multiply_error(const int error, char** error_message) {
+    switch (error) {
+        case MATRIX_CONVERSION_ERROR:
+            set_error_message(error_message, MATRIX_CONV_ERROR_MSG);
+            return -1;
+        case THREAD_START_ERROR:
+            set_error_message(error_message, THREAD_START_ERROR_MSG);
+            return -1;
+        case HEAP_MEMORY_ERROR:
+            set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+            return -1;
+        default:  // no error
+            return 0;
+    }
+}
+
+/*
+Creates the worker threads of the thread pool once (see thread_pool_init()), so thread
+startup is not part of the repeated or block-wise multiplications. It has to be shut down
+with thread_pool_shutdown(). The calling thread works on the tasks of the pool as well, so
+--threads n (or one thread per CPU) needs n - 1 workers, and none for a single thread.
+
+Return values:
+    0 on success.
+    -1 if the threads could not be started, error_message is set then.
+*/
+int _init_thread_pool(char** error_message) {
+    unsigned int thread_count = mult_config.thread_count ? mult_config.thread_count : available_cpus();
+    if (thread_count > 1 && thread_pool_init(thread_count - 1) != 0) {
+        set_error_message(error_message, THREAD_START_ERROR_MSG);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Reads A and B as DoubleMatrix structs, multiplies them and writes the result, used for
+--precision double. Works like multiply_files(), including the time measurement.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and all matrices are freed.
+*/
+int multiply_double_precision(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    mult_fn matr_mult_csr_fn, const int measure_flag, const uint64_t number_measures, char** error_message
+    ) {
+    DoubleMatrix* matrix_a = NULL;
+    DoubleMatrix* matrix_b = NULL;
+    DoubleMatrix* matrix_result = NULL;
+    int ret = -1;
+
+    // Read both matrices
+    const char* filenames[2] = {filename_matrix_a, filename_matrix_b};
+    DoubleMatrix** matrices[2] = {&matrix_a, &matrix_b};
+    for (int i = 0; i < 2; i++) {
+        if (_check_read_result(read_double_matrix_from_file(filenames[i], matrices[i]), filenames[i], error_message) != 0) {
+            goto double_cleanup;
+        }
+    }
+    if (_check_dimensions(matrix_a->noRows, matrix_a->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0) {
+        goto double_cleanup;
+    }
+
+    // Initialize the result matrix with NULL ptrs (safety for free())
+    matrix_result = calloc(1, sizeof(DoubleMatrix));
+    if (matrix_result == NULL) {
+        set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+        goto double_cleanup;
+    }
+
+    struct timespec start;
+    if (measure_flag) {
+        // Create the worker threads once, so thread startup is not measured
+        if (_init_thread_pool(error_message) != 0) {
+            goto double_cleanup;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    // Every run but the last writes into a temporary result that is freed right away
+    uint64_t runs = measure_flag ? number_measures : 1;
+    for (uint64_t i = 0; i < runs; i++) {
+        DoubleMatrix tmp_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+        DoubleMatrix* run_result = i + 1 == runs ? matrix_result : &tmp_result;
+        errno = 0;
+        matr_mult_csr_fn(matrix_a, matrix_b, run_result);
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto double_cleanup;
+        }
+        free_pointers(3, tmp_result.values, tmp_result.colIndices, tmp_result.rowPointers);
+    }
+
+    if (measure_flag) {
+        // Calculate time it took for the function to execute number_measures times
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        thread_pool_shutdown();
+        printf("Took %g seconds to multiply\n", time);
+    }
+
+    // Write result to file
+    if (_check_write_result(write_double_matrix_to_file(filename_matrix_output, matrix_result),
+            filename_matrix_output, error_message) != 0) {
+        goto double_cleanup;
+    }
+    ret = 0;
+
+    double_cleanup:
+    free_double_csr_matrix(matrix_a);
+    free_double_csr_matrix(matrix_b);
+    free_double_csr_matrix(matrix_result);
+    return ret;
+}
+
+/*
+Multiplies A and B for --stream: B is read as a whole (a binary B is memory mapped), A is read
+in blocks of rows. Every block is multiplied with B and its result rows are appended to the
+output right away, so only B and one block of A and of the result are in memory at once.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set, everything is freed and the output removed.
+*/
+int multiply_streaming(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    mult_fn matr_mult_csr_fn, const uint64_t block_nnz, char** error_message
+    ) {
+    Matrix* matrix_b = NULL;
+    RowBlockReader* reader = NULL;
+    RowBlockWriter* writer = NULL;
+    Matrix block_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    int ret = -1;
+
+    if (_read_operand(filename_matrix_b, &matrix_b, error_message) != 0 ||
+        _check_read_result(open_row_block_reader(filename_matrix_a, block_nnz, &reader), filename_matrix_a, error_message) != 0 ||
+        _check_dimensions(reader->noRows, reader->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0 ||
+        _check_write_result(open_row_block_writer(filename_matrix_output, reader->noRows, matrix_b->noCols, &writer),
+            filename_matrix_output, error_message) != 0) {
+        goto stream_cleanup;
+    }
+
+    // Create the worker threads once instead of once per block
+    if (_init_thread_pool(error_message) != 0) {
+        goto stream_cleanup;
+    }
+
+    while (1) {
+        if (_check_read_result(read_row_block(reader), filename_matrix_a, error_message) != 0) {
+            goto stream_cleanup;
+        }
+        const Matrix* block = &reader->block;
+        if (!block->noRows) {
+            break;  // all rows were read
+        }
+
+        if (block->valuesSize) {
+            errno = 0;
+            matr_mult_csr_fn(block, matrix_b, &block_result);
+            if (_check_multiply_error(errno, error_message) != 0) {
+                goto stream_cleanup;
+            }
+            if (write_row_block(writer, &block_result) != MATRIX_WRITE_SUCCESS) {
+                set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+                goto stream_cleanup;
+            }
+            free_pointers(3, block_result.values, block_result.colIndices, block_result.rowPointers);
+            block_result.values = NULL;
+            block_result.colIndices = NULL;
+            block_result.rowPointers = NULL;
+        } else if (write_row_block(writer, block) != MATRIX_WRITE_SUCCESS) {
+            // A block of empty rows has an empty result
+            set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+            goto stream_cleanup;
+        }
+    }
+
+    RowBlockWriter* finished_writer = writer;
+    writer = NULL;  // freed by finish_row_block_writer() in any case
+    if (finish_row_block_writer(finished_writer) != MATRIX_WRITE_SUCCESS) {
+        set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+        unlink(filename_matrix_output);
+        goto stream_cleanup;
+    }
+    ret = 0;
+
+    stream_cleanup:
+    thread_pool_shutdown();
+    discard_row_block_writer(writer, filename_matrix_output);
+    close_row_block_reader(reader);
+    free_csr_matrix(matrix_b);
+    free_pointers(3, block_result.values, block_result.colIndices, block_result.rowPointers);
+    return ret;
+}
+
+/*
+Multiplies A and B for --pipeline, which streams like multiply_streaming() but overlaps the
+stages: a reader thread parses A block by block while this thread reads B, then this thread
+multiplies the blocks of A that are ready and a writer thread appends the finished blocks of
+the result. The queues between the stages hold at most PIPELINE_QUEUE_DEPTH blocks each.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set, everything is freed and the output removed.
+*/
+int multiply_pipelined(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    mult_fn matr_mult_csr_fn, const uint64_t block_nnz, char** error_message
+    ) {
+    Matrix* matrix_b = NULL;
+    RowBlockReader* reader = NULL;
+    RowBlockWriter* writer = NULL;
+    BlockQueue blocks_a;
+    BlockQueue blocks_result;
+    BlockReaderTask reader_task = {NULL, &blocks_a};
+    BlockWriterTask writer_task = {NULL, &blocks_result};
+    pthread_t reader_thread;
+    pthread_t writer_thread;
+    int reader_started = 0;
+    int writer_started = 0;
+    int ret = -1;
+
+    if (init_block_queue(&blocks_a) != 0) {
+        set_error_message(error_message, THREAD_START_ERROR_MSG);
+        return -1;
+    }
+    if (init_block_queue(&blocks_result) != 0) {
+        free_block_queue(&blocks_a);
+        set_error_message(error_message, THREAD_START_ERROR_MSG);
+        return -1;
+    }
+
+    if (_check_read_result(open_row_block_reader(filename_matrix_a, block_nnz, &reader), filename_matrix_a, error_message) != 0) {
+        goto pipeline_cleanup;
+    }
+
+    // A is parsed while B is read
+    reader_task.reader = reader;
+    if (pthread_create(&reader_thread, NULL, &read_blocks_thread, &reader_task) != 0) {
+        set_error_message(error_message, THREAD_START_ERROR_MSG);
+        goto pipeline_cleanup;
+    }
+    reader_started = 1;
+
+    if (_read_operand(filename_matrix_b, &matrix_b, error_message) != 0 ||
+        _check_dimensions(reader->noRows, reader->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0 ||
+        _check_write_result(open_row_block_writer(filename_matrix_output, reader->noRows, matrix_b->noCols, &writer),
+            filename_matrix_output, error_message) != 0) {
+        goto pipeline_cleanup;
+    }
+    writer_task.writer = writer;
+    if (pthread_create(&writer_thread, NULL, &write_blocks_thread, &writer_task) != 0) {
+        set_error_message(error_message, THREAD_START_ERROR_MSG);
+        goto pipeline_cleanup;
+    }
+    writer_started = 1;
+
+    // Create the worker threads once instead of once per block
+    if (_init_thread_pool(error_message) != 0) {
+        goto pipeline_cleanup;
+    }
+
+    Matrix* block;
+    while ((block = pop_block(&blocks_a)) != NULL) {
+        Matrix* block_result = block;  // a block of empty rows has an empty result
+        if (block->valuesSize) {
+            block_result = calloc(1, sizeof(Matrix));
+            if (block_result == NULL) {
+                free_csr_matrix(block);
+                set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+                goto pipeline_cleanup;
+            }
+            errno = 0;
+            matr_mult_csr_fn(block, matrix_b, block_result);
+            free_csr_matrix(block);
+            if (_check_multiply_error(errno, error_message) != 0) {
+                free_csr_matrix(block_result);
+                goto pipeline_cleanup;
+            }
+        }
+        if (push_block(&blocks_result, block_result) != 0) {
+            // The writer failed
+            free_csr_matrix(block_result);
+            set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+            goto pipeline_cleanup;
+        }
+    }
+    if (_check_read_result(blocks_a.error, filename_matrix_a, error_message) != 0) {
+        goto pipeline_cleanup;
+    }
+
+    // Wait until the writer has appended the last block
+    close_block_queue(&blocks_result, 0);
+    pthread_join(writer_thread, NULL);
+    writer_started = 0;
+    if (blocks_result.error) {
+        set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+        goto pipeline_cleanup;
+    }
+
+    RowBlockWriter* finished_writer = writer;
+    writer = NULL;  // freed by finish_row_block_writer() in any case
+    if (finish_row_block_writer(finished_writer) != MATRIX_WRITE_SUCCESS) {
+        set_error_message(error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+        unlink(filename_matrix_output);
+        goto pipeline_cleanup;
+    }
+    ret = 0;
+
+    pipeline_cleanup:
+    // Stop the stages that are still running, they return as soon as their queue is closed
+    close_block_queue(&blocks_a, THREAD_START_ERROR);
+    close_block_queue(&blocks_result, THREAD_START_ERROR);
+    if (reader_started) {
+        pthread_join(reader_thread, NULL);
+    }
+    if (writer_started) {
+        pthread_join(writer_thread, NULL);
+    }
+    thread_pool_shutdown();
+    free_block_queue(&blocks_a);
+    free_block_queue(&blocks_result);
+    discard_row_block_writer(writer, filename_matrix_output);
+    close_row_block_reader(reader);
+    free_csr_matrix(matrix_b);
+    return ret;
+}
+
+/*
+Multiplies the chain A * B * C1 * ... of --chain with matr_mult_chain(): all operands are read,
+the order is chosen once and the intermediate products stay in the workspaces of the chain.
+With measure_flag, the chain is multiplied number_measures times, the later runs reuse the
+order and the workspaces. The chosen order is printed then as well.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and everything is freed.
+*/
+int multiply_chain_files(
+    const char* filename_matrix_a, const char* filename_matrix_b, char** const chain_filenames,
+    const unsigned int chain_count, const char* filename_matrix_output, const int measure_flag,
+    const uint64_t number_measures, char** error_message
+    ) {
+    const unsigned int count = chain_count + 2;
+    Matrix matrix_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    MultiplyChain chain;
+    init_multiply_chain(&chain);
+    int ret = -1;
+
+    Matrix** operands = calloc(count, sizeof(Matrix*));
+    if (operands == NULL) {
+        set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+        return -1;
+    }
+
+    // Read all operands in the order of the chain
+    for (unsigned int i = 0; i < count; i++) {
+        const char* filename = i == 0 ? filename_matrix_a : i == 1 ? filename_matrix_b : chain_filenames[i - 2];
+        if (_read_operand(filename, &operands[i], error_message) != 0) {
+            goto chain_cleanup;
+        }
+    }
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        if (_check_dimensions(operands[i]->noRows, operands[i]->noCols,
+                operands[i + 1]->noRows, operands[i + 1]->noCols, error_message) != 0) {
+            goto chain_cleanup;
+        }
+    }
+
+    // The intermediate products are multiplied by the thread pool as well
+    if (_init_thread_pool(error_message) != 0) {
+        goto chain_cleanup;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Every run but the last frees its result right away
+    uint64_t runs = measure_flag ? number_measures : 1;
+    for (uint64_t i = 0; i < runs; i++) {
+        free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+        errno = 0;
+        matr_mult_chain((const Matrix* const*) operands, count, &matrix_result, &chain);
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto chain_cleanup;
+        }
+    }
+
+    if (measure_flag) {
+        // Calculate time it took for the function to execute number_measures times
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        printf("Took %g seconds to multiply\n", time);
+        printf("Order: ");
+        print_chain_order(&chain, 0, count - 1);
+        printf(" (%g estimated flops)\n", chain.flops[count - 1]);
+    }
+
+    // Write result to file
+    if (_check_write_result(write_matrix_to_file(filename_matrix_output, &matrix_result),
+            filename_matrix_output, error_message) != 0) {
+        goto chain_cleanup;
+    }
+    ret = 0;
+
+    chain_cleanup:
+    thread_pool_shutdown();
+    free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+    free_multiply_chain(&chain);
+    for (unsigned int i = 0; i < count; i++) {
+        free_csr_matrix(operands[i]);
+    }
+    free(operands);
+    return ret;
+}
+
+/*
+Multiplies the sparse A with the dense B of --dense with matr_mult_spmm() and writes the dense
+result. With measure_flag, the product is computed number_measures times on the thread pool
+and the time and the kernel that was used are printed.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and everything is freed.
+*/
+int multiply_dense_file(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    const int measure_flag, const uint64_t number_measures, char** error_message
+    ) {
+    Matrix* matrix_a = NULL;
+    DenseMatrix* matrix_b = NULL;
+    DenseMatrix matrix_result = {0, 0, 0, NULL};
+    int ret = -1;
+
+    if (_read_operand(filename_matrix_a, &matrix_a, error_message) != 0 ||
+        _check_read_result(read_dense_matrix_from_file(filename_matrix_b, &matrix_b), filename_matrix_b, error_message) != 0 ||
+        _check_dimensions(matrix_a->noRows, matrix_a->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0) {
+        goto dense_cleanup;
+    }
+
+    // Repeated runs don't start new threads every time
+    if (measure_flag && _init_thread_pool(error_message) != 0) {
+        goto dense_cleanup;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Every run but the last frees its result right away
+    uint64_t runs = measure_flag ? number_measures : 1;
+    for (uint64_t i = 0; i < runs; i++) {
+        free(matrix_result.values);
+        errno = 0;
+        matr_mult_spmm(matrix_a, matrix_b, &matrix_result);
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto dense_cleanup;
+        }
+    }
+
+    if (measure_flag) {
+        // Calculate time it took for the function to execute number_measures times
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        printf("Took %g seconds to multiply\n", time);
+        dense_rows_fn kernel = matrix_b->noCols == 1 ? best_spmv_kernel() : best_spmm_kernel();
+        printf("Used the %s %s kernel\n", dense_kernel_name(kernel), matrix_b->noCols == 1 ? "SpMV" : "SpMM");
+    }
+
+    // Write result to file
+    if (_check_write_result(write_dense_matrix_to_file(filename_matrix_output, &matrix_result),
+            filename_matrix_output, error_message) != 0) {
+        goto dense_cleanup;
+    }
+    ret = 0;
+
+    dense_cleanup:
+    thread_pool_shutdown();
+    free(matrix_result.values);
+    free_dense_matrix(matrix_b);
+    free_csr_matrix(matrix_a);
+    return ret;
+}
+
+/*
+Multiplies A and B restricted to the pattern of the mask of --mask with matr_mult_csr_masked(),
+or to its complement with matr_mult_csr_masked_complement() if complement_flag is set, and
+writes the result. With measure_flag, the product is computed number_measures times on the
+thread pool and the time is printed.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and everything is freed.
+*/
+int multiply_masked_files(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_mask,
+    const char* filename_matrix_output, const int complement_flag, const int measure_flag,
+    const uint64_t number_measures, char** error_message
+    ) {
+    const char* filenames[3] = {filename_matrix_a, filename_matrix_b, filename_mask};
+    Matrix* matrices[3] = {NULL, NULL, NULL};  // A, B and the mask
+    Matrix matrix_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    int ret = -1;
+
+    for (int i = 0; i < 3; i++) {
+        if (_read_operand(filenames[i], &matrices[i], error_message) != 0) {
+            goto masked_cleanup;
+        }
+    }
+    if (_check_dimensions(matrices[0]->noRows, matrices[0]->noCols,
+            matrices[1]->noRows, matrices[1]->noCols, error_message) != 0) {
+        goto masked_cleanup;
+    }
+    if (matrices[2]->noRows != matrices[0]->noRows || matrices[2]->noCols != matrices[1]->noCols) {
+        // The mask must have the dimensions of the result
+        set_error_message(
+            error_message, MATRIX_DIM_ERROR_MSG,
+            matrices[0]->noRows, matrices[1]->noCols, matrices[2]->noRows, matrices[2]->noCols
+            );
+        goto masked_cleanup;
+    }
+
+    // Repeated runs don't start new threads every time
+    if (measure_flag && _init_thread_pool(error_message) != 0) {
+        goto masked_cleanup;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Every run but the last frees its result right away
+    uint64_t runs = measure_flag ? number_measures : 1;
+    for (uint64_t i = 0; i < runs; i++) {
+        free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+        errno = 0;
+        if (complement_flag) {
+            matr_mult_csr_masked_complement(matrices[0], matrices[1], matrices[2], &matrix_result);
+        } else {
+            matr_mult_csr_masked(matrices[0], matrices[1], matrices[2], &matrix_result);
+        }
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto masked_cleanup;
+        }
+    }
+
+    if (measure_flag) {
+        // Calculate time it took for the function to execute number_measures times
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        printf("Took %g seconds to multiply\n", time);
+    }
+
+    // Write result to file
+    if (_check_write_result(write_matrix_to_file(filename_matrix_output, &matrix_result),
+            filename_matrix_output, error_message) != 0) {
+        goto masked_cleanup;
+    }
+    ret = 0;
+
+    masked_cleanup:
+    thread_pool_shutdown();
+    free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+    free_csr_matrices(3, matrices[0], matrices[1], matrices[2]);
+    return ret;
+}
+
+/*
+Reads A and B, multiplies them with the implementation chosen by -V (or with a plan for --plan)
+and writes the result. With measure_flag, the product is computed number_measures times on the
+thread pool: the first run writes the result, the other runs reuse the plan or the workspace
+of V0. V9 multiplies A and B narrowed once before the time measurement.
+The time, the thread count decision of V0 and, with --stats, the counters are printed.
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and all matrices are freed.
+*/
+int multiply_files(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    const uint8_t implementation, const int plan_flag, const int measure_flag, const uint64_t number_measures,
+    char** error_message
+    ) {
+    Matrix* matrix_a = NULL;
+    Matrix* matrix_b = NULL;
+    Matrix matrix_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    Matrix tmp_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    CompactMatrix compact_a = {0, 0, NULL, 0, NULL, NULL, 0};
+    CompactMatrix compact_b = {0, 0, NULL, 0, NULL, NULL, 0};
+    MultiplyPlan plan;
+    init_multiply_plan(&plan, 1);
+    MultiplyWorkspace workspace;
+    init_multiply_workspace(&workspace);
+    int ret = -1;
+
+    // Get implementation/matrix multiplication algorithm the user wants
+    mult_fn matr_mult_csr_fn = choose_mult_fn(implementation);
+    if (matr_mult_csr_fn == NULL) {
+        set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+        return -1;
+    }
+
+    if (_read_operand(filename_matrix_a, &matrix_a, error_message) != 0 ||
+        _read_operand(filename_matrix_b, &matrix_b, error_message) != 0 ||
+        _check_dimensions(matrix_a->noRows, matrix_a->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0) {
+        goto files_cleanup;
+    }
+
+    if (measure_flag) {
+        // Create the worker threads once, so thread startup is not measured
+        if (_init_thread_pool(error_message) != 0) {
+            goto files_cleanup;
+        }
+
+        // V9 narrows the indices of A and B on every call, here they are narrowed once
+        int compact_flag = !plan_flag && implementation == 9 && compact_csr_fits(matrix_a) && compact_csr_fits(matrix_b);
+        if (compact_flag && (narrow_csr_matrix(matrix_a, &compact_a) == HEAP_MEMORY_ERROR ||
+            narrow_csr_matrix(matrix_b, &compact_b) == HEAP_MEMORY_ERROR)) {
+            set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+            goto files_cleanup;
+        }
+
+        // Get start time
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        // Do the first iteration outside of the loop to store results,
+        // with --plan it creates the plan and the other runs reuse it
+        errno = 0;
+        if (plan_flag) {
+            matr_mult_csr_planned(matrix_a, matrix_b, &matrix_result, &plan);
+        } else if (compact_flag) {
+            matr_mult_csr_V9_compact(&compact_a, &compact_b, &matrix_result);
+        } else {
+            matr_mult_csr_fn(matrix_a, matrix_b, &matrix_result);
+        }
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto files_cleanup;
+        }
+
+        // The main implementation reuses its buffers, the other runs then don't allocate
+        for (uint64_t i = 1; i < number_measures; i++) {
+            errno = 0;
+            if (plan_flag) {
+                matr_mult_csr_planned(matrix_a, matrix_b, &tmp_result, &plan);
+            } else if (compact_flag) {
+                matr_mult_csr_V9_compact(&compact_a, &compact_b, &tmp_result);
+            } else if (implementation == 0) {
+                matr_mult_csr_ws(matrix_a, matrix_b, &tmp_result, &workspace);
+            } else {
+                matr_mult_csr_fn(matrix_a, matrix_b, &tmp_result);
+            }
+            if (_check_multiply_error(errno, error_message) != 0) {
+                goto files_cleanup;
+            }
+            // Free subarrays of the temporary result matrix, unless they belong to the workspace
+            if (plan_flag || implementation != 0) {
+                free_pointers(3, tmp_result.values, tmp_result.colIndices, tmp_result.rowPointers);
+            }
+            tmp_result.values = NULL;
+            tmp_result.colIndices = NULL;
+            tmp_result.rowPointers = NULL;
+        }
+
+        // Calculate time it took for the function to execute number_measures times
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+
+        // Print time measurement on the console
+        printf("Took %g seconds to multiply\n", time);
+
+        // Report the thread count decision of the main implementation
+        if (implementation == 0 && !plan_flag) {
+            print_thread_decision(&last_thread_decision);
+        }
+    } else {
+        // Just do the multiplication, no time measurement
+        errno = 0;
+        matr_mult_csr_fn(matrix_a, matrix_b, &matrix_result);
+        if (_check_multiply_error(errno, error_message) != 0) {
+            goto files_cleanup;
+        }
+    }
+    if (mult_config.stats) {
+        print_multiply_stats(&last_multiply_stats);
+    }
+
+    // Write result to file
+    if (_check_write_result(write_matrix_to_file(filename_matrix_output, &matrix_result),
+            filename_matrix_output, error_message) != 0) {
+        goto files_cleanup;
+    }
+    ret = 0;
+
+    files_cleanup:
+    thread_pool_shutdown();
+    // A failed run can leave a temporary result that is not owned by the workspace
+    if (tmp_result.rowPointers != workspace.rowPointers) {
+        free_pointers(3, tmp_result.values, tmp_result.colIndices, tmp_result.rowPointers);
+    }
+    free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+    free_multiply_workspace(&workspace);
+    free_multiply_plan(&plan);
+    free_pointers(4, compact_a.colIndices, compact_a.rowPointers, compact_b.colIndices, compact_b.rowPointers);
+    free_csr_matrices(2, matrix_a, matrix_b);
+    return ret;
+}
+
+/*
+Runs the benchmark of --bench: A and B are read once, then every implementation of bench does
+bench->warmup unmeasured and run_count measured runs on them, V0 on a workspace like with -B.
+The result of every implementation is written to the output, the statistics are printed
+after every implementation (see bench.h).
+
+Return values:
+    0 on success.
+    -1 if an error occured, error_message is set and everything is freed.
+*/
+int multiply_benchmark(
+    const char* filename_matrix_a, const char* filename_matrix_b, const char* filename_matrix_output,
+    const BenchConfig* const bench, const uint64_t run_count, char** error_message
+    ) {
+    Matrix* matrix_a = NULL;
+    Matrix* matrix_b = NULL;
+    Matrix matrix_result = {0, 0, NULL, 0, NULL, NULL, 0, NULL, 0};
+    BenchResult result = {0, NULL, run_count, 0, 0, 0, 0, 0, 0};
+    MultiplyWorkspace workspace;
+    init_multiply_workspace(&workspace);
+    int ret = -1;
+
+    // Read both matrices, the time is reported with every implementation
+    double read_start = monotonic_seconds();
+    const char* filenames[2] = {filename_matrix_a, filename_matrix_b};
+    Matrix** matrices[2] = {&matrix_a, &matrix_b};
+    for (int i = 0; i < 2; i++) {
+        if (_read_operand(filenames[i], matrices[i], error_message) != 0) {
+            goto bench_cleanup;
+        }
+    }
+    result.read = monotonic_seconds() - read_start;
+
+    if (_check_dimensions(matrix_a->noRows, matrix_a->noCols, matrix_b->noRows, matrix_b->noCols, error_message) != 0) {
+        goto bench_cleanup;
+    }
+
+    // Every product of a value of A and a value of B is a multiplication and an addition
+    uint64_t* row_flops;
+    result.runs = malloc_safe(sizeof(BenchRun), run_count);
+    if (result.runs == NULL || compute_row_flops(matrix_a, matrix_b, &row_flops) == HEAP_MEMORY_ERROR) {
+        set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+        goto bench_cleanup;
+    }
+    result.flops = 2 * row_flops[matrix_a->noRows];
+    free(row_flops);
+
+    // Create the worker threads once, so thread startup is not measured
+    if (_init_thread_pool(error_message) != 0) {
+        goto bench_cleanup;
+    }
+
+    print_bench_header(bench, filename_matrix_a, filename_matrix_b, run_count);
+    int first = 1;
+    for (uint8_t implementation = 0; implementation < NUMBER_OF_IMPLEMENTATIONS; implementation++) {
+        if (!((bench->implementations >> implementation) & 1)) {
+            continue;
+        }
+        mult_fn matr_mult_csr_fn = choose_mult_fn(implementation);
+        result.implementation = implementation;
+        result.phases = 1;
+
+        for (uint64_t i = 0; i < bench->warmup + run_count; i++) {
+            // The result of the last run is kept for writing
+            if (implementation != 0) {
+                free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+                matrix_result.values = NULL;
+                matrix_result.colIndices = NULL;
+                matrix_result.rowPointers = NULL;
+            }
+
+            last_multiply_phases.recorded = 0;
+            errno = 0;
+            double start = monotonic_seconds();
+            if (implementation == 0) {
+                matr_mult_csr_ws(matrix_a, matrix_b, &matrix_result, &workspace);
+            } else {
+                matr_mult_csr_fn(matrix_a, matrix_b, &matrix_result);
+            }
+            double total = monotonic_seconds() - start;
+            if (_check_multiply_error(errno, error_message) != 0) {
+                goto bench_cleanup;
+            }
+
+            if (i >= bench->warmup) {
+                BenchRun* run = &result.runs[i - bench->warmup];
+                run->total = total;
+                run->symbolic = last_multiply_phases.recorded ? last_multiply_phases.symbolic : 0;
+                run->numeric = last_multiply_phases.recorded ? last_multiply_phases.numeric : 0;
+                run->compaction = last_multiply_phases.recorded ? last_multiply_phases.compaction : 0;
+                result.phases = result.phases && last_multiply_phases.recorded;
+            }
+        }
+        result.nnz = matrix_result.rowPointers[matrix_result.noRows];
+        result.bytes = csr_matrix_bytes(matrix_a) + csr_matrix_bytes(matrix_b) + csr_matrix_bytes(&matrix_result);
+
+        double write_start = monotonic_seconds();
+        if (_check_write_result(write_matrix_to_file(filename_matrix_output, &matrix_result),
+                filename_matrix_output, error_message) != 0) {
+            goto bench_cleanup;
+        }
+        result.write = monotonic_seconds() - write_start;
+
+        BenchSummary summary;
+        if (summarize_bench_runs(&result, &summary) == HEAP_MEMORY_ERROR) {
+            set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+            goto bench_cleanup;
+        }
+        print_bench_result(bench, &result, &summary, first);
+        fflush(stdout);
+        first = 0;
+
+        // The result of V0 belongs to the workspace
+        if (implementation != 0) {
+            free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+        }
+        matrix_result.values = NULL;
+        matrix_result.colIndices = NULL;
+        matrix_result.rowPointers = NULL;
+    }
+    print_bench_footer(bench);
+    ret = 0;
+
+    bench_cleanup:
+    thread_pool_shutdown();
+    if (matrix_result.rowPointers != workspace.rowPointers) {
+        free_pointers(3, matrix_result.values, matrix_result.colIndices, matrix_result.rowPointers);
+    }
+    free_multiply_workspace(&workspace);
+    free_csr_matrices(2, matrix_a, matrix_b);
+    free(result.runs);
+    return ret;
+}
+
 int main(int argc, char** argv) {
     // Args that must be provided
     char* filename_matrix_a = NULL;
@@ -51,6 +1085,15 @@ int main(int argc, char** argv) {
     uint8_t implementation = 0;  // which implementation to use
     int measure_flag = 0;  // flag to measure execution time
     uint64_t number_measures = 1;  // how many times we want to execute the function
+    uint64_t stream_block_nnz = 0;  // block size of --stream or --pipeline, 0 if not streaming
+    int pipeline_flag = 0;  // overlap reading, multiplying and writing (--pipeline)
+    int plan_flag = 0;  // measure with a cached plan (--plan)
+    BenchConfig bench;  // settings of --bench
+    char** chain_filenames = NULL;  // operands after A and B (--chain)
+    unsigned int chain_count = 0;  // number of --chain operands
+    int dense_flag = 0;  // B and the result are dense (--dense)
+    char* filename_mask = NULL;  // only compute the values of C in its pattern (--mask)
+    int complement_flag = 0;  // only compute the values of C outside the mask (--complement)
 
     // Used in the main function for printing errors
     char* error_message = NULL;
@@ -59,12 +1102,16 @@ int main(int argc, char** argv) {
             argc, argv,
             &filename_matrix_a, &filename_matrix_b, &filename_matrix_output,
             &implementation, &measure_flag, &number_measures,
+            &mult_config, &stream_block_nnz, &pipeline_flag, &plan_flag, &bench,
+            &chain_filenames, &chain_count, &dense_flag, &filename_mask, &complement_flag,
             &error_message
         );
 
     switch (parse_result) {
         case ARGPARSE_ERROR:
             main_error:
+            // Stop the worker threads if they were started (does nothing otherwise)
+            thread_pool_shutdown();
             // Print error message
             if (error_message == NULL) {  // if there was an error creating the error message
                 fprintf(stderr, "%s", HEAP_MEMORY_ERROR_MSG);
@@ -76,222 +1123,104 @@ int main(int argc, char** argv) {
             // Free filename strings (they are either null ptrs or valid values)
             // Matrices are already freed before reaching here
             free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+            free_filename_list(chain_filenames, chain_count);
+            free(filename_mask);
             // Print that we are exiting due to an error
             fprintf(stderr, "%s", EXIT_FAIL_MSG);
             // Return failure as specified in stdlib.h
             return EXIT_FAILURE;
         case ARGPARSE_SUCCESS:
-            // Read matrix a
-            Matrix* matrix_a;
-            int op_result = read_matrix_from_file(filename_matrix_a, &matrix_a);
-            switch (op_result) {
-                case FILE_OPEN_ERROR:
-                    set_error_message(&error_message, FILE_OPEN_ERROR_MSG, filename_matrix_a);
-                    goto main_error;
-                case MATRIX_FILE_FORMAT_ERROR:
-                    set_error_message(&error_message, MATRIX_FILE_FORMAT_ERROR_MSG, filename_matrix_a);
+            if (chain_count) {
+                // Multiply all operands in memory instead of writing the intermediate products
+                if (multiply_chain_files(
+                        filename_matrix_a, filename_matrix_b, chain_filenames, chain_count,
+                        filename_matrix_output, measure_flag, number_measures, &error_message
+                        ) != 0) {
                     goto main_error;
-                case HEAP_MEMORY_ERROR:
-                    set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                    goto main_error;
-                default:  // MATRIX_READ_SUCCESS
-                    break;
+                }
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                free_filename_list(chain_filenames, chain_count);
+                return EXIT_SUCCESS;
             }
-
-            // Read matrix b
-            Matrix* matrix_b;
-            op_result = read_matrix_from_file(filename_matrix_b, &matrix_b);
-            switch (op_result) {
-                case FILE_OPEN_ERROR:
-                    // Error reading matrix b, we only have to free matrix a
-                    free_csr_matrix(matrix_a);
-                    set_error_message(&error_message, FILE_OPEN_ERROR_MSG, filename_matrix_b);
-                    goto main_error;
-                case MATRIX_FILE_FORMAT_ERROR:
-                    free_csr_matrix(matrix_a);
-                    set_error_message(&error_message, MATRIX_FILE_FORMAT_ERROR_MSG, filename_matrix_b);
+            if (dense_flag) {
+                // B and the result are dense, A * B needs no structure of the result
+                if (multiply_dense_file(
+                        filename_matrix_a, filename_matrix_b, filename_matrix_output,
+                        measure_flag, number_measures, &error_message
+                        ) != 0) {
                     goto main_error;
-                case HEAP_MEMORY_ERROR:
-                    free_csr_matrix(matrix_a);
-                    set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                    goto main_error;
-                default:  // MATRIX_READ_SUCCESS
-                    break;
-            }
-
-            // Initialize the result matrix with NULL ptrs (safety for free())
-            Matrix* matrix_result = malloc(sizeof(Matrix));
-            if (matrix_result == NULL) {
-                // Error allocating memory, free a and b
-                free_csr_matrices(2, matrix_a, matrix_b);
-                set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                goto main_error;
-            }
-            matrix_result->values = NULL;
-            matrix_result->colIndices = NULL;
-            matrix_result->rowPointers = NULL;
-
-            // Get implementation/matrix multiplication algorithm the user wants
-            mult_fn matr_mult_csr_fn = choose_mult_fn(implementation);
-            if (matr_mult_csr_fn == NULL) {
-                goto main_error;
+                }
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                return EXIT_SUCCESS;
             }
-            
-            if (measure_flag) {
-                // Create temporary result matrix here to avoid time measurement
-                Matrix* tmp_result = malloc(sizeof(Matrix));
-                if (tmp_result == NULL) {
-                    // Error allocating memory to result matrix, free a and b
-                    free_csr_matrices(2, matrix_a, matrix_b);
-                    free(matrix_result);
-                    set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
+            if (filename_mask != NULL) {
+                // Only the values of C in the pattern of the mask (or outside of it) are computed
+                if (multiply_masked_files(
+                        filename_matrix_a, filename_matrix_b, filename_mask, filename_matrix_output,
+                        complement_flag, measure_flag, number_measures, &error_message
+                        ) != 0) {
                     goto main_error;
                 }
-                tmp_result->values = NULL;
-                tmp_result->colIndices = NULL;
-                tmp_result->rowPointers = NULL;
-
-                // Get start time
-                struct timespec start;
-                clock_gettime(CLOCK_MONOTONIC, &start);
-
-                // Do the first iteration outside of the loop to store results
-                errno = 0;
-                matr_mult_csr_fn(matrix_a, matrix_b, matrix_result);
-                switch (errno) {
-                    case MATRIX_CONVERSION_ERROR:
-                        set_error_message(&error_message, MATRIX_CONV_ERROR_MSG);
-                        free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                        free(tmp_result);
-                        goto main_error;
-                    case MATRIX_DIMENSION_ERROR:
-                        set_error_message(
-                            &error_message, MATRIX_DIM_ERROR_MSG,
-                            matrix_a->noRows, matrix_a->noCols,
-                            matrix_b->noRows, matrix_b->noCols
-                            );
-                        free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                        free(tmp_result);
-                        goto main_error;
-                    case THREAD_START_ERROR:
-                        set_error_message(&error_message, THREAD_START_ERROR_MSG);
-                        free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                        free(tmp_result);
-                        goto main_error;
-                    case HEAP_MEMORY_ERROR:
-                        set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                        free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                        free(tmp_result);
-                        goto main_error;
-                    default:  // no error, go on
-                        break;
-                }
-
-                // Do the matrix multiplication
-                for (uint32_t i = 1; i < number_measures; i++) {
-                    errno = 0;
-                    matr_mult_csr_fn(matrix_a, matrix_b, tmp_result);
-                    switch (errno) {
-                        case MATRIX_CONVERSION_ERROR:
-                            set_error_message(&error_message, MATRIX_CONV_ERROR_MSG);
-                            free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                            free(tmp_result);
-                            goto main_error;
-                        case MATRIX_DIMENSION_ERROR:
-                            set_error_message(
-                                &error_message, MATRIX_DIM_ERROR_MSG,
-                                matrix_a->noRows, matrix_a->noCols,
-                                matrix_b->noRows, matrix_b->noCols
-                                );
-                            free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                            free(tmp_result);
-                            goto main_error;
-                        case THREAD_START_ERROR:
-                            set_error_message(&error_message, THREAD_START_ERROR_MSG);
-                            free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                            free(tmp_result);
-                            goto main_error;
-                        case HEAP_MEMORY_ERROR:
-                            set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                            free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                            free(tmp_result);
-                            goto main_error;
-                        default:  // no error, go on
-                            break;
-                    }
-                    // Free subarrays of the temporary result matrix
-                    free(tmp_result->values);
-                    free(tmp_result->colIndices);
-                    free(tmp_result->rowPointers);
+                free_pointers(4, filename_matrix_a, filename_matrix_b, filename_matrix_output, filename_mask);
+                return EXIT_SUCCESS;
+            }
+            if (bench.enabled) {
+                // Measure the implementations on the same inputs instead of a single multiplication
+                if (multiply_benchmark(
+                        filename_matrix_a, filename_matrix_b, filename_matrix_output,
+                        &bench, number_measures, &error_message
+                        ) != 0) {
+                    goto main_error;
                 }
-
-                // Calculate time it took for the function to execute number_measures times
-                struct timespec end;
-                clock_gettime(CLOCK_MONOTONIC, &end);
-                double time = end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
-
-                free(tmp_result);  // free the temporary result matrix for good
-
-                // Print time measurement on the console
-                printf("Took %g seconds to multiply\n", time);
-            } else {
-                // Just do the multiplication, no time measurement
-                matr_mult_csr_fn(matrix_a, matrix_b, matrix_result);
-                // Check if multiplication was successful
-                switch (errno) {
-                    case MATRIX_CONVERSION_ERROR:
-                        set_error_message(&error_message, MATRIX_CONV_ERROR_MSG);
-                        free_csr_matrices(2, matrix_a, matrix_b);
-                        free(matrix_result);  // the subarrays are already NULL ptrs, no need to free them
-                        goto main_error;
-                    case MATRIX_DIMENSION_ERROR:
-                        set_error_message(
-                            &error_message, MATRIX_DIM_ERROR_MSG,
-                            matrix_a->noRows, matrix_a->noCols,
-                            matrix_b->noRows, matrix_b->noCols
-                            );
-                        free_csr_matrices(2, matrix_a, matrix_b);
-                        free(matrix_result);
-                        goto main_error;
-                    case THREAD_START_ERROR:
-                        set_error_message(&error_message, THREAD_START_ERROR_MSG);
-                        free_csr_matrices(2, matrix_a, matrix_b);
-                        free(matrix_result);
-                        goto main_error;
-                    case HEAP_MEMORY_ERROR:
-                        set_error_message(&error_message, HEAP_MEMORY_ERROR_MSG);
-                        free_csr_matrices(2, matrix_a, matrix_b);
-                        free(matrix_result);
-                        goto main_error;
-                    default:  // no error, go on
-                        break;
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                return EXIT_SUCCESS;
+            }
+            if (pipeline_flag) {
+                // Stream like below, but read, multiply and write at the same time
+                if (multiply_pipelined(
+                        filename_matrix_a, filename_matrix_b, filename_matrix_output,
+                        choose_mult_fn(implementation), stream_block_nnz, &error_message
+                        ) != 0) {
+                    goto main_error;
                 }
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                return EXIT_SUCCESS;
             }
-
-            // Write result to file
-            op_result = write_matrix_to_file(filename_matrix_output, matrix_result);
-            switch (op_result) {
-                case FILE_OPEN_ERROR:
-                    // Error writing result, free all matrices
-                    free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                    set_error_message(&error_message, FILE_OPEN_ERROR_MSG, filename_matrix_output);
+            if (stream_block_nnz) {
+                // Multiply block by block without reading A or the result as a whole
+                if (multiply_streaming(
+                        filename_matrix_a, filename_matrix_b, filename_matrix_output,
+                        choose_mult_fn(implementation), stream_block_nnz, &error_message
+                        ) != 0) {
                     goto main_error;
-                case FILE_WRITE_ERROR:
-                    free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
-                    set_error_message(&error_message, FILE_WRITE_ERROR_MSG, filename_matrix_output);
+                }
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                return EXIT_SUCCESS;
+            }
+            if (mult_config.precision == PRECISION_DOUBLE) {
+                // The matrices hold doubles, so they don't fit the Matrix struct used below
+                if (multiply_double_precision(
+                        filename_matrix_a, filename_matrix_b, filename_matrix_output,
+                        choose_mult_fn(implementation), measure_flag, number_measures, &error_message
+                        ) != 0) {
                     goto main_error;
-                default:  // MATRIX_WRITE_SUCCESS
-                    break;
+                }
+                free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+                return EXIT_SUCCESS;
             }
 
-            // Free filename string pointers
+            if (multiply_files(
+                    filename_matrix_a, filename_matrix_b, filename_matrix_output, implementation,
+                    plan_flag, measure_flag, number_measures, &error_message
+                    ) != 0) {
+                goto main_error;
+            }
             free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
-            // Free matrices
-            free_csr_matrices(3, matrix_a, matrix_b, matrix_result);
             return EXIT_SUCCESS;
         case ARGPARSE_HELP:
             // Display help message and exit
             free_pointers(3, filename_matrix_a, filename_matrix_b, filename_matrix_output);
+            free_filename_list(chain_filenames, chain_count);
             printf("%s", HELP_MSG);
             return EXIT_SUCCESS;
         default:
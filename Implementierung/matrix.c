@@ -5,77 +5,824 @@
 
 // Threading
 #include <pthread.h>
-// System info for threading
-#include <sys/sysinfo.h>
 // Intrinsics
 #include <immintrin.h>
 
 // Our headers
 #include "utils.h"
 #include "matrixutils.h"
+#include "threadpool.h"
+#include "numautils.h"
 #include "csrmatrix.h"
 #include "constants.h"
 #include "matrix.h"
+#include "config.h"
 
 
+// Default configuration, changed by the command line arguments in main.c
+MultiplyConfig mult_config = {SCHEDULE_DYNAMIC, 0, 0, PRECISION_FLOAT, NUMA_OFF, 0, SIZE_ESTIMATE_SAMPLE};
+ThreadDecision last_thread_decision = {0, 0, 0, 0, 0, 0, {0}, 0, 0};
+MultiplyPhases last_multiply_phases = {0, 0, 0, 0};
+MultiplyStats last_multiply_stats;  // zeroed, so not recorded
+
 void matr_mult_csr(const void* a, const void* b, void* result) {
     // Multithreading implementation (Hauptimplementierung)
     Matrix* matrix_a = (Matrix*) a;
-    if (matrix_a->valuesSize < 10000 || matrix_a->noRows < MIN_THREADS) {
-        // Switch to Gustafson with size prediction if threading doesn't pay off
-        matr_mult_csr_V5(a, b, result);
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+    double start = monotonic_seconds();
+
+    // Check if matrices are compatible
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+    if (STATS_ENABLED()) {
+        begin_multiply_stats();
+    }
+
+    // Estimated flops per row, used for the thread count, the scheduling and the row bins
+    uint64_t* row_flops;
+    if (compute_row_flops(matrix_a, matrix_b, &row_flops) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+
+    // Deciding on thread count based on the available CPUs, the work and the cache size
+    unsigned int thread_count = choose_thread_count(
+        matrix_a, matrix_b, row_flops[matrix_a->noRows], &mult_config, &last_thread_decision
+        );
+
+    // Every row gets a slot of min(flops, noCols of B) entries
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    if (rowPointers == NULL) {
+        free(row_flops);
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    uint64_t slots = fill_row_offsets(
+        matrix_a->noRows, matrix_b->noCols, row_flops, rowPointers, last_thread_decision.bin_rows
+        );
+    uint64_t valuesSize = slots > 0 ? slots : 1;  // malloc(0) may return NULL
+
+    unsigned int scratch_count = _row_scratch_count(thread_count);
+    unsigned int chunk_count = thread_count < MIN_THREADS
+        ? 1
+        : multiply_chunk_count(thread_count, &mult_config, matrix_a->noRows);
+    float* values = malloc_safe(sizeof(float), valuesSize);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), valuesSize);
+    RowScratch* scratch = calloc(scratch_count, sizeof(RowScratch));
+    struct MultiplyArg** arguments = alloc_multiply_args(chunk_count);
+    if (values == NULL || colIndices == NULL || scratch == NULL || arguments == NULL) {
+        free_pointers(6, row_flops, rowPointers, values, colIndices, scratch, arguments);
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    if (STATS_ENABLED()) {
+        last_multiply_stats.flops = row_flops[matrix_a->noRows];
+        last_multiply_stats.predicted_nnz = slots;
+        last_multiply_stats.worker_count = scratch_count;
+        count_allocated_bytes(
+            2 * sizeof(uint64_t) * (matrix_a->noRows + 1) + (sizeof(float) + sizeof(uint64_t)) * valuesSize +
+            sizeof(RowScratch) * scratch_count + (sizeof(struct MultiplyArg*) + sizeof(struct MultiplyArg)) * chunk_count
+            );
+    }
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = matrix_b->noCols;
+    matrix_result->values = values;
+    matrix_result->valuesSize = valuesSize;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    double bins_start = monotonic_seconds();
+    last_multiply_phases.symbolic = bins_start - start;
+    int bins_result = _multiply_row_bins(
+        thread_count, matrix_a, matrix_b, matrix_result, row_flops, scratch, scratch_count,
+        arguments, chunk_count, NULL
+        );
+    free_row_scratch(scratch, scratch_count);
+    free_pointers(3, row_flops, scratch, arguments);  // arguments are a single block
+    if (bins_result != 0) {
+        free_pointers(3, matrix_result->values, matrix_result->colIndices, rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = bins_result;  // THREAD_START_ERROR or HEAP_MEMORY_ERROR
         return;
     }
 
+    // If the chunks were adjacent, the slots are still upper bounds, give the unused memory back
+    _shrink_result_arrays(
+        (void**) &matrix_result->values, sizeof(float), &matrix_result->colIndices,
+        matrix_result->valuesSize > 0 ? matrix_result->valuesSize : 1
+        );
+    last_multiply_phases.compaction = monotonic_seconds() - bins_start - last_multiply_phases.numeric;
+    last_multiply_phases.recorded = 1;
+    if (STATS_ENABLED()) {
+        finish_multiply_stats(matrix_result->valuesSize);
+    }
+}
+
+unsigned int _row_scratch_count(const unsigned int thread_count) {
+    if (thread_count < MIN_THREADS) {
+        return 1;
+    }
+    // The calling thread works on the chunks of the pool as well, at most thread_count threads join
+    unsigned int pool_threads = thread_pool_size() + 1;
+    return thread_pool_size() && pool_threads < thread_count ? pool_threads : thread_count;
+}
+
+int _multiply_row_bins(
+    const unsigned int thread_count, Matrix* const matrix_a, Matrix* const matrix_b, Matrix* const matrix_result,
+    const uint64_t* const row_flops, RowScratch* const scratch, const unsigned int scratch_count,
+    struct MultiplyArg** const arguments, const unsigned int chunk_count, MultiplyWorkspace* const workspace
+    ) {
+    struct RowBins bins = {row_flops, scratch, scratch_count, best_row_kernel(), 0, NULL, NULL, NULL};
+    double numeric_start = monotonic_seconds();
+
+    // With --numa replicate, small B are copied to every node before the threads start
+    last_thread_decision.numa_nodes = mult_config.numa != NUMA_OFF ? numa_node_count() : 0;
+    last_thread_decision.replicated = 0;
+    uint64_t bytes_b = (sizeof(float) + sizeof(uint64_t)) * matrix_b->valuesSize +
+        sizeof(uint64_t) * matrix_b->rowPointersSize;
+    if (mult_config.numa == NUMA_REPLICATE && thread_count >= MIN_THREADS && last_thread_decision.numa_nodes > 1 &&
+        bytes_b <= NUMA_REPLICATE_MAX_BYTES) {
+        int replicate_result = numa_replicate_matrix(matrix_b, &bins.replicas);
+        if (replicate_result != 0) {
+            return replicate_result;
+        }
+        last_thread_decision.replicated = 1;
+    }
+
+    if (thread_count < MIN_THREADS) {
+        // Threading doesn't pay off, all rows are multiplied on the calling thread
+        fill_multiply_args(1, arguments, matrix_a, matrix_b, matrix_result);
+        arguments[0]->bins = &bins;
+        multiply_main_implementation(arguments[0]);
+    } else {
+        // Split the rows into chunks according to the scheduling strategy
+        fill_multiply_schedule(chunk_count, &mult_config, matrix_a, matrix_b, matrix_result, row_flops, arguments);
+        for (unsigned int i = 0; i < chunk_count; i++) {
+            arguments[i]->bins = &bins;
+        }
+        int run_result = _run_multiply_chunks(thread_count, &multiply_main_implementation, arguments, chunk_count);
+        numa_free_replicas(bins.replicas);
+        if (run_result != 0) {
+            return run_result;
+        }
+    }
+    if (bins.error != 0) {
+        return bins.error;
+    }
+    last_multiply_phases.numeric = monotonic_seconds() - numeric_start;
+
+    // Every chunk is compact, the prefix sum of their nnz places them one after another
+    uint64_t nnz = 0;
+    int adjacent = 1;
+    for (unsigned int i = 0; i < chunk_count; i++) {
+        struct MultiplyArg* arg = arguments[i];
+        arg->offset = nnz;
+        if (arg->nnz == 0 && arg->slot != nnz) {
+            // Empty chunks never need a copy, only their row pointers are moved
+            for (uint64_t row = arg->start_row; row < arg->end_row; row++) {
+                matrix_result->rowPointers[row] = nnz;
+            }
+            arg->slot = nnz;
+        }
+        adjacent = adjacent && arg->slot == nnz;
+        nnz += arg->nnz;
+    }
+    matrix_result->rowPointers[matrix_a->noRows] = nnz;
+    matrix_result->valuesSize = nnz;
+    if (adjacent) {
+        return 0;  // C already is contiguous, nothing to copy
+    }
+
+    // Copy the chunks into compact arrays in parallel
+    if (workspace == NULL) {
+        bins.values = malloc_safe(sizeof(float), nnz);  // some chunk is not adjacent, so nnz > 0
+        bins.colIndices = malloc_safe(sizeof(uint64_t), nnz);
+        if (bins.values == NULL || bins.colIndices == NULL) {
+            free_pointers(2, bins.values, bins.colIndices);
+            return HEAP_MEMORY_ERROR;
+        }
+        if (STATS_ENABLED()) {
+            count_allocated_bytes((sizeof(float) + sizeof(uint64_t)) * nnz);
+        }
+    } else {
+        if (_reserve_workspace_array(
+            (void**) &workspace->compactValues, &workspace->compactValuesCapacity, sizeof(float), nnz, 0
+            ) == HEAP_MEMORY_ERROR ||
+            _reserve_workspace_array(
+            (void**) &workspace->compactColIndices, &workspace->compactColIndicesCapacity, sizeof(uint64_t), nnz, 0
+            ) == HEAP_MEMORY_ERROR) {
+            return HEAP_MEMORY_ERROR;
+        }
+        bins.values = workspace->compactValues;
+        bins.colIndices = workspace->compactColIndices;
+    }
+    int copy_result = _run_multiply_chunks(thread_count, &copy_chunk_segment, arguments, chunk_count);
+    if (copy_result != 0) {
+        if (workspace == NULL) {
+            free_pointers(2, bins.values, bins.colIndices);
+        }
+        return copy_result;
+    }
+    if (workspace == NULL) {
+        free_pointers(2, matrix_result->values, matrix_result->colIndices);
+    }
+    matrix_result->values = bins.values;
+    matrix_result->colIndices = bins.colIndices;
+    return 0;
+}
+
+int _run_multiply_chunks(
+    const unsigned int thread_count, void* (*fn)(void* arg), struct MultiplyArg** const arguments,
+    const unsigned int chunk_count
+    ) {
+    if (thread_pool_size()) {
+        // Run the chunks on thread_count threads of the persistent pool, no threads are created
+        thread_pool_run(fn, (void**) arguments, chunk_count, thread_count);
+        return 0;
+    }
+
+    // Start threads, they pull the chunks from the queue
+    struct MultiplyQueue queue = {fn, arguments, chunk_count, 0};
+    pthread_t* threads;
+    int start_result = start_threads(thread_count, &threads, &queue);
+    if (start_result != 0) {
+        return start_result;
+    }
+
+    // Join threads
+    for (unsigned int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    return 0;
+}
+
+void matr_mult_csr_ws(const void* a, const void* b, void* result, MultiplyWorkspace* const workspace) {
+    // Main implementation on the buffers of the workspace
+    Matrix* matrix_a = (Matrix*) a;
     Matrix* matrix_b = (Matrix*) b;
     Matrix* matrix_result = (Matrix*) result;
+    double start = monotonic_seconds();
+
+    // The subarrays are NULL on every error, they are never free'd by the caller
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+    matrix_result->mapping = NULL;
 
     // Check if matrices are compatible
     if (!can_multiply(matrix_a, matrix_b)) {
         errno = MATRIX_DIMENSION_ERROR;
         return;
     }
+    if (STATS_ENABLED()) {
+        begin_multiply_stats();
+    }
 
-    // Initialize matrix subarrays with no prediction
-    if (init_empty_csr_matrix(matrix_a, matrix_b, matrix_result, NO_PREDICTION) == HEAP_MEMORY_ERROR) {
+    // Estimated flops per row, used for the thread count, the scheduling and the row bins
+    if (_reserve_workspace_array(
+        (void**) &workspace->rowFlops, &workspace->rowFlopsCapacity, sizeof(uint64_t), matrix_a->noRows + 1, 0
+        ) == HEAP_MEMORY_ERROR ||
+        _reserve_workspace_array(
+        (void**) &workspace->rowPointers, &workspace->rowPointersCapacity, sizeof(uint64_t), matrix_a->noRows + 1, 0
+        ) == HEAP_MEMORY_ERROR) {
         errno = HEAP_MEMORY_ERROR;
         return;
     }
+    fill_row_flops(matrix_a, matrix_b, workspace->rowFlops);
 
-    // Deciding on thread count based on number of system threads as well as the number values and rows in matrix
-    uint64_t available_threads = get_nprocs();
-    uint64_t row_weight = matrix_a->noRows / THREAD_COND_MIN_VALUES;
-    uint64_t elem_weight = matrix_a->noRows / THREAD_COND_MIN_ROWS;
-    // Taking the minimum of both conditional parameters as thread count
-    uint64_t tmp_min = row_weight < elem_weight ? row_weight : elem_weight;
-    uint64_t thread_count = tmp_min < available_threads ? tmp_min : available_threads;
+    unsigned int thread_count = choose_thread_count(
+        matrix_a, matrix_b, workspace->rowFlops[matrix_a->noRows], &mult_config, &last_thread_decision
+        );
 
-    thread_count = thread_count < MIN_THREADS ? MIN_THREADS : thread_count;
+    // Every row gets a slot of min(flops, noCols of B) entries
+    uint64_t slots = fill_row_offsets(
+        matrix_a->noRows, matrix_b->noCols, workspace->rowFlops, workspace->rowPointers, last_thread_decision.bin_rows
+        );
+    if (_reserve_workspace_array(
+        (void**) &workspace->values, &workspace->valuesCapacity, sizeof(float), slots + 1, 0
+        ) == HEAP_MEMORY_ERROR ||
+        _reserve_workspace_array(
+        (void**) &workspace->colIndices, &workspace->colIndicesCapacity, sizeof(uint64_t), slots + 1, 0
+        ) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
 
-    // Start threads
-    pthread_t* threads;
-    struct MultiplyArg** arguments;
-    int start_result = start_threads(
-        thread_count, &threads, &arguments,
-        matrix_a, matrix_b, matrix_result
-    );
-    if (start_result == THREAD_START_ERROR) {
-        errno = THREAD_START_ERROR;
+    // The scratch slots keep their buffers, only new slots are added
+    unsigned int scratch_count = _row_scratch_count(thread_count);
+    if (scratch_count > workspace->scratchCapacity) {
+        RowScratch* scratch = realloc(workspace->scratch, sizeof(RowScratch) * scratch_count);
+        if (scratch == NULL) {
+            errno = HEAP_MEMORY_ERROR;
+            return;
+        }
+        memset(
+            scratch + workspace->scratchCapacity, 0, sizeof(RowScratch) * (scratch_count - workspace->scratchCapacity)
+            );
+        if (STATS_ENABLED()) {
+            count_allocated_bytes(sizeof(RowScratch) * (scratch_count - workspace->scratchCapacity));
+        }
+        workspace->scratch = scratch;
+        workspace->scratchCapacity = scratch_count;
+    }
+
+    // The arguments are kept for the next multiplication
+    unsigned int chunk_count = thread_count < MIN_THREADS
+        ? 1
+        : multiply_chunk_count(thread_count, &mult_config, matrix_a->noRows);
+    if (chunk_count > workspace->chunksCapacity) {
+        free(workspace->chunks);
+        workspace->chunksCapacity = 0;
+        workspace->chunks = alloc_multiply_args(chunk_count);
+        if (workspace->chunks == NULL) {
+            errno = HEAP_MEMORY_ERROR;
+            return;
+        }
+        workspace->chunksCapacity = chunk_count;
+        if (STATS_ENABLED()) {
+            count_allocated_bytes((sizeof(struct MultiplyArg*) + sizeof(struct MultiplyArg)) * chunk_count);
+        }
+    }
+    if (STATS_ENABLED()) {
+        last_multiply_stats.flops = workspace->rowFlops[matrix_a->noRows];
+        last_multiply_stats.predicted_nnz = slots;
+        last_multiply_stats.worker_count = scratch_count;
+    }
+
+    Matrix slot_result = *matrix_result;
+    slot_result.noRows = matrix_a->noRows;
+    slot_result.noCols = matrix_b->noCols;
+    slot_result.values = workspace->values;
+    slot_result.valuesSize = slots;
+    slot_result.colIndices = workspace->colIndices;
+    slot_result.rowPointers = workspace->rowPointers;
+    slot_result.rowPointersSize = matrix_a->noRows + 1;
+
+    double bins_start = monotonic_seconds();
+    last_multiply_phases.symbolic = bins_start - start;
+    int bins_result = _multiply_row_bins(
+        thread_count, matrix_a, matrix_b, &slot_result, workspace->rowFlops, workspace->scratch, scratch_count,
+        workspace->chunks, chunk_count, workspace
+        );
+    if (bins_result != 0) {
+        errno = bins_result;  // THREAD_START_ERROR or HEAP_MEMORY_ERROR
         return;
     }
 
-    // Join threads and clean up memory
-    for (unsigned int i = 0; i < thread_count; i++) {
-        pthread_join(threads[i], NULL);
-        free(arguments[i]);
+    // The buffers keep their size for the next multiplication
+    *matrix_result = slot_result;
+    last_multiply_phases.compaction = monotonic_seconds() - bins_start - last_multiply_phases.numeric;
+    last_multiply_phases.recorded = 1;
+    if (STATS_ENABLED()) {
+        finish_multiply_stats(matrix_result->valuesSize);
     }
+}
+
+void matr_mult_csr_planned(const void* a, const void* b, void* result, MultiplyPlan* const plan) {
+    // Gustavson on a cached structure, for inputs with a fixed sparsity pattern
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // The symbolic work is only redone if the plan was created for other matrices
+    double start = monotonic_seconds();
+    if (!multiply_plan_matches(plan, matrix_a, matrix_b) &&
+        create_multiply_plan(matrix_a, matrix_b, plan) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+
+    double numeric_start = monotonic_seconds();
+    if (multiply_planned(matrix_a, matrix_b, matrix_result, plan) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    last_multiply_phases.symbolic = numeric_start - start;
+    last_multiply_phases.numeric = monotonic_seconds() - numeric_start;
+    last_multiply_phases.compaction = 0;  // the plan knows the exact size of C
+    last_multiply_phases.recorded = 1;
+}
+
+void matr_mult_chain(
+    const Matrix* const* const operands, const unsigned int count, Matrix* const result,
+    MultiplyChain* const chain
+    ) {
+    result->values = NULL;
+    result->colIndices = NULL;
+    result->rowPointers = NULL;
+
+    // Check if the whole chain is mathematically defined before multiplying anything
+    if (count < 2) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        if (!can_multiply(operands[i], operands[i + 1])) {
+            errno = MATRIX_DIMENSION_ERROR;
+            return;
+        }
+    }
+
+    if (chain->count != count && choose_chain_order(operands, count, chain) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        chain->busy[i] = 0;  // the products of the previous call are not needed anymore
+    }
+
+    // Both factors of the last multiplication, which writes into the result itself
+    const unsigned int split = chain->split[count - 1];
+    const Matrix* left;
+    const Matrix* right;
+    int left_slot;
+    int right_slot;
+    if (_multiply_chain_range(operands, chain, 0, split, &left, &left_slot) != 0
+            || _multiply_chain_range(operands, chain, split + 1, count - 1, &right, &right_slot) != 0) {
+        return;
+    }
+    matr_mult_csr(left, right, result);
+}
+
+int _multiply_chain_range(
+    const Matrix* const* const operands, MultiplyChain* const chain, const unsigned int first,
+    const unsigned int last, const Matrix** const product, int* const slot
+    ) {
+    if (first == last) {
+        *product = operands[first];
+        *slot = -1;
+        return 0;
+    }
+
+    const unsigned int split = chain->split[first * chain->count + last];
+    const Matrix* left;
+    const Matrix* right;
+    int left_slot;
+    int right_slot;
+    if (_multiply_chain_range(operands, chain, first, split, &left, &left_slot) != 0
+            || _multiply_chain_range(operands, chain, split + 1, last, &right, &right_slot) != 0) {
+        return -1;
+    }
+
+    // There are fewer intermediate products alive than workspaces
+    int free_slot = 0;
+    while (chain->busy[free_slot]) {
+        free_slot++;
+    }
+    errno = 0;
+    matr_mult_csr_ws(left, right, &chain->products[free_slot], &chain->workspaces[free_slot]);
+    if (errno) {
+        return -1;
+    }
+    chain->busy[free_slot] = 1;
+    if (left_slot >= 0) {
+        chain->busy[left_slot] = 0;
+    }
+    if (right_slot >= 0) {
+        chain->busy[right_slot] = 0;
+    }
+
+    *product = &chain->products[free_slot];
+    *slot = free_slot;
+    return 0;
+}
+
+void matr_mult_csr_batch(
+    const Matrix* const* const matrices_a, const Matrix* const* const matrices_b, Matrix* const results,
+    const uint64_t count, MultiplyBatch* const batch
+    ) {
+    _clear_batch_results(results, count);
+
+    // Check every product first, so nothing is multiplied for a batch that cannot be done
+    uint64_t work = 0;  // nnz and rows of all A, the products are small and mostly cost about this
+    uint64_t row_pointer_count = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!can_multiply(matrices_a[i], matrices_b[i])) {
+            errno = MATRIX_DIMENSION_ERROR;
+            return;
+        }
+        work += matrices_a[i]->rowPointers[matrices_a[i]->noRows] + matrices_a[i]->noRows;
+        row_pointer_count += matrices_a[i]->noRows + 1;
+    }
+    if (!count) {
+        return;
+    }
+
+    // Whole products are spread over the threads, a batch that is too small stays on this thread
+    unsigned int thread_count = mult_config.thread_count ? mult_config.thread_count : available_cpus();
+    uint64_t task_count = (uint64_t) thread_count * BATCH_TASKS_PER_THREAD;
+    task_count = task_count < count ? task_count : count;
+    if (thread_count < MIN_THREADS || work / thread_count < THREAD_COND_MIN_VALUES) {
+        task_count = 1;
+    }
+    if (_reserve_workspace_array(
+            (void**) &batch->tasks, &batch->tasksCapacity, sizeof(struct BatchTask*) + sizeof(struct BatchTask),
+            task_count, 0
+            ) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    struct BatchTask* tasks = (struct BatchTask*) (batch->tasks + task_count);
+
+    // Cut the products into tasks of the same work, every task needs scratch for its widest B
+    uint64_t scratch_size = 0;
+    uint64_t task = 0;
+    uint64_t task_work = 0;
+    uint64_t task_cols = 0;
+    tasks[0].first = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        task_work += matrices_a[i]->rowPointers[matrices_a[i]->noRows] + matrices_a[i]->noRows;
+        task_cols = matrices_b[i]->noCols > task_cols ? matrices_b[i]->noCols : task_cols;
+
+        // The last task takes the remaining products
+        if (i + 1 == count || (task + 1 < task_count && task_work * task_count >= work * (task + 1))) {
+            tasks[task].last = i + 1;
+            tasks[task].scratchSize = task_cols;
+            scratch_size += task_cols;
+            if (i + 1 < count) {
+                tasks[++task].first = i + 1;
+            }
+            task_cols = 0;
+        }
+    }
+    task_count = task + 1;
+
+    // The accumulators are zeroed when they grow, and every product leaves them zeroed again
+    if (_reserve_workspace_array(
+            (void**) &batch->markers, &batch->markersCapacity, sizeof(uint64_t), scratch_size, 0
+            ) == HEAP_MEMORY_ERROR ||
+        _reserve_workspace_array(
+            (void**) &batch->accumulators, &batch->accumulatorsCapacity, sizeof(float), scratch_size, 1
+            ) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    uint64_t scratch_offset = 0;
+    for (uint64_t t = 0; t < task_count; t++) {
+        tasks[t].matricesA = matrices_a;
+        tasks[t].matricesB = matrices_b;
+        tasks[t].results = results;
+        tasks[t].marker = batch->markers + scratch_offset;
+        tasks[t].accumulator = batch->accumulators + scratch_offset;
+        scratch_offset += tasks[t].scratchSize;
+        batch->tasks[t] = &tasks[t];
+    }
+
+    // Upper bounds of the nnz of every product, stored in the valuesSize of the results
+    int run_result = _run_batch_tasks(thread_count, &batch_bound_task, batch->tasks, task_count);
+    if (run_result != 0) {
+        errno = run_result;
+        return;
+    }
+
+    // One slab for all results: the row pointers, then the column indices and the values
+    uint64_t slots = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        slots += results[i].valuesSize;
+    }
+    if (_reserve_workspace_array(
+            &batch->slab, &batch->slabCapacity, 1,
+            sizeof(uint64_t) * row_pointer_count + (sizeof(uint64_t) + sizeof(float)) * slots, 0
+            ) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    uint64_t* slab_row_pointers = (uint64_t*) batch->slab;
+    uint64_t* slab_col_indices = slab_row_pointers + row_pointer_count;
+    float* slab_values = (float*) (slab_col_indices + slots);
+    for (uint64_t i = 0; i < count; i++) {
+        Matrix* result = &results[i];
+        uint64_t bound = result->valuesSize;
+        result->noRows = matrices_a[i]->noRows;
+        result->noCols = matrices_b[i]->noCols;
+        result->rowPointers = slab_row_pointers;
+        result->rowPointersSize = result->noRows + 1;
+        result->rowPointers[0] = 0;
+        result->colIndices = slab_col_indices;
+        result->values = slab_values;
+        slab_row_pointers += result->noRows + 1;
+        slab_col_indices += bound;
+        slab_values += bound;
+    }
+
+    run_result = _run_batch_tasks(thread_count, &batch_numeric_task, batch->tasks, task_count);
+    if (run_result != 0) {
+        _clear_batch_results(results, count);
+        errno = run_result;
+    }
+}
+
+int _run_batch_tasks(
+    const unsigned int thread_count, void* (*fn)(void* arg), struct BatchTask** const tasks,
+    const uint64_t task_count
+    ) {
+    if (task_count == 1) {
+        fn(tasks[0]);
+        return 0;
+    }
+
+    // The queue of _run_multiply_chunks() only hands the pointers to fn
+    return _run_multiply_chunks(thread_count, fn, (struct MultiplyArg**) tasks, (unsigned int) task_count);
+}
+
+void _clear_batch_results(Matrix* const results, const uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        results[i].values = NULL;
+        results[i].colIndices = NULL;
+        results[i].rowPointers = NULL;
+        results[i].mapping = NULL;
+    }
+}
+
+void matr_mult_spmm(const Matrix* const a, const DenseMatrix* const b, DenseMatrix* const result) {
+    result->values = NULL;
+    if (a->noRows == 0 || a->noCols == 0 || b->noCols == 0 || a->noCols != b->noRows) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+    if (init_dense_matrix(result, a->noRows, b->noCols) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    dense_rows_fn kernel = b->noCols == 1 ? best_spmv_kernel() : best_spmm_kernel();
+
+    // A product that is too small for several threads stays on this thread
+    uint64_t nnz = a->rowPointers[a->noRows];
+    unsigned int thread_count = mult_config.thread_count ? mult_config.thread_count : available_cpus();
+    if (thread_count < MIN_THREADS || nnz * b->noCols / thread_count < THREAD_COND_MIN_FLOPS ||
+        a->noRows / thread_count < THREAD_COND_MIN_ROWS) {
+        kernel(a, b, result, 0, a->noRows);
+        return;
+    }
+
+    uint64_t chunk_count = (uint64_t) thread_count * DYNAMIC_CHUNKS_PER_THREAD;
+    chunk_count = chunk_count < a->noRows ? chunk_count : a->noRows;
+    struct DenseRowsArg** arguments = malloc((sizeof(struct DenseRowsArg*) + sizeof(struct DenseRowsArg)) * chunk_count);
+    if (arguments == NULL) {
+        free(result->values);
+        result->values = NULL;
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    struct DenseRowsArg* chunks = (struct DenseRowsArg*) (arguments + chunk_count);
+
+    // Every chunk gets about the same number of values and rows of A
+    uint64_t first_row = 0;
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        uint64_t last_row = i + 1 == chunk_count
+            ? a->noRows
+            : find_chunk_end(a->rowPointers, a->noRows, first_row, (nnz + a->noRows) * (i + 1) / chunk_count);
+        chunks[i] = (struct DenseRowsArg) {a, b, result, first_row, last_row, kernel};
+        arguments[i] = &chunks[i];
+        first_row = last_row;
+    }
+
+    // The queue of _run_multiply_chunks() only hands the pointers to dense_rows_task()
+    int run_result = _run_multiply_chunks(
+        thread_count, &dense_rows_task, (struct MultiplyArg**) arguments, (unsigned int) chunk_count
+        );
     free(arguments);
-    free(threads);
+    if (run_result != 0) {
+        free(result->values);
+        result->values = NULL;
+        errno = run_result;
+    }
+}
 
-    // Clean up nnz in matrix
-    if (clean_up_csr(matrix_result) == HEAP_MEMORY_ERROR) {
+void matr_mult_csr_masked(const void* a, const void* b, const void* mask, void* result) {
+    _matr_mult_masked((const Matrix*) a, (const Matrix*) b, (const Matrix*) mask, (Matrix*) result, 0);
+}
+
+void matr_mult_csr_masked_complement(const void* a, const void* b, const void* mask, void* result) {
+    _matr_mult_masked((const Matrix*) a, (const Matrix*) b, (const Matrix*) mask, (Matrix*) result, 1);
+}
+
+void _matr_mult_masked(
+    const Matrix* const matrix_a, const Matrix* const matrix_b, const Matrix* const mask,
+    Matrix* const matrix_result, const int complement
+    ) {
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+    if (!can_multiply(matrix_a, matrix_b) || mask->noRows != matrix_a->noRows || mask->noCols != matrix_b->noCols) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // The flops are only used to balance the chunks and, with a complemented mask, to size the rows
+    uint64_t* row_flops;
+    if (compute_row_flops(matrix_a, matrix_b, &row_flops) == HEAP_MEMORY_ERROR) {
         errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    const uint64_t noRows = matrix_a->noRows;
+    const uint64_t flops = row_flops[noRows];
+
+    // A row of C never has more values than its mask row, so nnz(M) is the size of the result
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), noRows + 1);
+    uint64_t* row_nnz = malloc_safe(sizeof(uint64_t), noRows);
+    if (rowPointers == NULL || row_nnz == NULL) {
+        free_pointers(3, row_flops, rowPointers, row_nnz);
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    uint64_t slots;
+    if (complement) {
+        slots = fill_complement_offsets(mask, matrix_b->noCols, row_flops, rowPointers);
+    } else {
+        memcpy(rowPointers, mask->rowPointers, sizeof(uint64_t) * (noRows + 1));
+        slots = rowPointers[noRows];
+    }
+    uint64_t valuesSize = slots > 0 ? slots : 1;  // malloc(0) may return NULL
+
+    // Every chunk needs its own accumulator and marker, so there is one chunk per thread
+    unsigned int thread_count = mult_config.thread_count ? mult_config.thread_count : available_cpus();
+    uint64_t chunk_count = thread_count < noRows ? thread_count : noRows;
+    if (thread_count < MIN_THREADS || flops / thread_count < THREAD_COND_MIN_FLOPS ||
+        noRows / thread_count < THREAD_COND_MIN_ROWS) {
+        chunk_count = 1;
+    }
+
+    float* values = malloc_safe(sizeof(float), valuesSize);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), valuesSize);
+    float* accumulators = calloc(chunk_count * matrix_b->noCols, sizeof(float));
+    uint64_t* markers = calloc(chunk_count * matrix_b->noCols, sizeof(uint64_t));
+    struct MaskedRowsArg** arguments = malloc(
+        (sizeof(struct MaskedRowsArg*) + sizeof(struct MaskedRowsArg)) * chunk_count
+        );
+    if (values == NULL || colIndices == NULL || accumulators == NULL || markers == NULL || arguments == NULL) {
+        free_pointers(8, row_flops, rowPointers, row_nnz, values, colIndices, accumulators, markers, arguments);
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    matrix_result->noRows = noRows;
+    matrix_result->noCols = matrix_b->noCols;
+    matrix_result->values = values;
+    matrix_result->valuesSize = valuesSize;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = noRows + 1;
+
+    // Every chunk gets about the same number of flops and rows
+    struct MaskedRowsArg* chunks = (struct MaskedRowsArg*) (arguments + chunk_count);
+    uint64_t first_row = 0;
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        uint64_t last_row = i + 1 == chunk_count
+            ? noRows
+            : find_chunk_end(row_flops, noRows, first_row, (flops + noRows) * (i + 1) / chunk_count);
+        chunks[i] = (struct MaskedRowsArg) {
+            matrix_a, matrix_b, mask, matrix_result, first_row, last_row, complement,
+            accumulators + i * matrix_b->noCols, markers + i * matrix_b->noCols, row_nnz
+            };
+        arguments[i] = &chunks[i];
+        first_row = last_row;
     }
+
+    int run_result = 0;
+    if (chunk_count == 1) {
+        masked_rows_task(chunks);
+    } else {
+        // The queue of _run_multiply_chunks() only hands the pointers to masked_rows_task()
+        run_result = _run_multiply_chunks(
+            thread_count, &masked_rows_task, (struct MultiplyArg**) arguments, (unsigned int) chunk_count
+            );
+    }
+    free_pointers(4, row_flops, accumulators, markers, arguments);
+    if (run_result != 0) {
+        free_pointers(4, row_nnz, values, colIndices, rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = run_result;
+        return;
+    }
+
+    // Move the rows to the front of their slots and give the unused memory back
+    matrix_result->valuesSize = compact_row_slots(matrix_result, row_nnz);
+    free(row_nnz);
+    _shrink_result_arrays(
+        (void**) &matrix_result->values, sizeof(float), &matrix_result->colIndices,
+        matrix_result->valuesSize > 0 ? matrix_result->valuesSize : 1
+        );
 }
 
 void matr_mult_csr_V1(const void* a, const void* b, void* result) {
@@ -259,7 +1006,7 @@ void matr_mult_csr_V4(const void* a, const void* b, void* result) {
     // SIMD with AVX, no prediction
     if (!__builtin_cpu_supports("avx")) {
         // CPU doesn't support AVX, default to SSE implementation
-        matr_mult_csr_V1(a, b, result);
+        matr_mult_csr_V3(a, b, result);
         return;
     }
 
@@ -302,16 +1049,343 @@ void matr_mult_csr_V5(const void* a, const void* b, void* result) {
         return;
     }
 
-    // Initialize the subarrays with values size prediction
-    if (init_empty_csr_matrix(matrix_a, matrix_b, matrix_result, PREDICT_SIZE) == HEAP_MEMORY_ERROR) {
-        errno = HEAP_MEMORY_ERROR;
+    // Initialize the subarrays with the configured values size estimate
+    int error = init_empty_csr_matrix(matrix_a, matrix_b, matrix_result, mult_config.size_estimate);
+    if (error) {
+        errno = error;
         return;
     }
 
-    multiply_V5(matrix_a, matrix_b, matrix_result);
+    if (multiply_V5(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
 
     // Clean up the non zero values in the values array
     if (clean_up_csr(matrix_result) == HEAP_MEMORY_ERROR) {
         errno = HEAP_MEMORY_ERROR;
     }
 }
+
+void _record_two_phases(const double start, const double numeric_start) {
+    last_multiply_phases.symbolic = numeric_start - start;
+    last_multiply_phases.numeric = monotonic_seconds() - numeric_start;
+    last_multiply_phases.compaction = 0;  // the symbolic pass sized C exactly
+    last_multiply_phases.recorded = 1;
+}
+
+void _matr_mult_csr_double(const void* a, const void* b, void* result, accumulate_row_double_fn accumulate_row) {
+    DoubleMatrix* matrix_a = (DoubleMatrix*) a;
+    DoubleMatrix* matrix_b = (DoubleMatrix*) b;
+    DoubleMatrix* matrix_result = (DoubleMatrix*) result;
+
+    // Check if multiplication is mathematically defined
+    if (matrix_a->noCols != matrix_b->noRows) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Symbolic pass: exact row pointers and subarrays of size nnz(C)
+    double start = monotonic_seconds();
+    if (symbolic_multiply_double(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    double numeric_start = monotonic_seconds();
+
+    // Numeric pass, no clean up needed afterwards
+    int op_result = accumulate_row == NULL
+        ? multiply_V6_double(matrix_a, matrix_b, matrix_result)
+        : multiply_with_row_kernel_double(matrix_a, matrix_b, matrix_result, accumulate_row);
+    if (op_result == HEAP_MEMORY_ERROR) {
+        free(matrix_result->values);
+        free(matrix_result->colIndices);
+        free(matrix_result->rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = HEAP_MEMORY_ERROR;
+    } else {
+        _record_two_phases(start, numeric_start);
+    }
+}
+
+void matr_mult_csr_V6(const void* a, const void* b, void* result) {
+    // Two-phase (symbolic/numeric) Gustavson
+    if (mult_config.precision == PRECISION_DOUBLE) {
+        _matr_mult_csr_double(a, b, result, NULL);
+        return;
+    }
+
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Symbolic pass: exact row pointers and subarrays of size nnz(C)
+    double start = monotonic_seconds();
+    if (symbolic_multiply(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    double numeric_start = monotonic_seconds();
+
+    // Numeric pass, no clean up needed afterwards
+    int op_result = mult_config.precision == PRECISION_MIXED
+        ? multiply_V6_mixed(matrix_a, matrix_b, matrix_result)
+        : multiply_V6(matrix_a, matrix_b, matrix_result);
+    if (op_result == HEAP_MEMORY_ERROR) {
+        free(matrix_result->values);
+        free(matrix_result->colIndices);
+        free(matrix_result->rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = HEAP_MEMORY_ERROR;
+    } else {
+        _record_two_phases(start, numeric_start);
+    }
+}
+
+void matr_mult_csr_V7(const void* a, const void* b, void* result) {
+    // Two-phase Gustavson, AVX2 gather + FMA
+    if (!(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))) {
+        // CPU doesn't support AVX2/FMA, default to the scalar two-phase implementation
+        matr_mult_csr_V6(a, b, result);
+        return;
+    }
+    if (mult_config.precision == PRECISION_DOUBLE) {
+        _matr_mult_csr_double(a, b, result, &accumulate_row_avx2_double);
+        return;
+    }
+
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Symbolic pass: exact row pointers and subarrays of size nnz(C)
+    double start = monotonic_seconds();
+    if (symbolic_multiply(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    double numeric_start = monotonic_seconds();
+
+    // Numeric pass, no clean up needed afterwards
+    int op_result = mult_config.precision == PRECISION_MIXED
+        ? multiply_with_row_kernel_mixed(matrix_a, matrix_b, matrix_result, &accumulate_row_avx2_mixed)
+        : multiply_V7(matrix_a, matrix_b, matrix_result);
+    if (op_result == HEAP_MEMORY_ERROR) {
+        free(matrix_result->values);
+        free(matrix_result->colIndices);
+        free(matrix_result->rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = HEAP_MEMORY_ERROR;
+    } else {
+        _record_two_phases(start, numeric_start);
+    }
+}
+
+void matr_mult_csr_V8(const void* a, const void* b, void* result) {
+    // Two-phase Gustavson, AVX-512 gather/scatter + FMA
+    if (!(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("fma"))) {
+        // CPU doesn't support AVX-512, default to the scalar two-phase implementation
+        matr_mult_csr_V6(a, b, result);
+        return;
+    }
+    if (mult_config.precision == PRECISION_DOUBLE) {
+        _matr_mult_csr_double(a, b, result, &accumulate_row_avx512_double);
+        return;
+    }
+
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Symbolic pass: exact row pointers and subarrays of size nnz(C)
+    double start = monotonic_seconds();
+    if (symbolic_multiply(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    double numeric_start = monotonic_seconds();
+
+    // Numeric pass, no clean up needed afterwards
+    int op_result = mult_config.precision == PRECISION_MIXED
+        ? multiply_with_row_kernel_mixed(matrix_a, matrix_b, matrix_result, &accumulate_row_avx512_mixed)
+        : multiply_V8(matrix_a, matrix_b, matrix_result);
+    if (op_result == HEAP_MEMORY_ERROR) {
+        free(matrix_result->values);
+        free(matrix_result->colIndices);
+        free(matrix_result->rowPointers);
+        matrix_result->values = NULL;
+        matrix_result->colIndices = NULL;
+        matrix_result->rowPointers = NULL;
+        errno = HEAP_MEMORY_ERROR;
+    } else {
+        _record_two_phases(start, numeric_start);
+    }
+}
+
+void matr_mult_csr_V9(const void* a, const void* b, void* result) {
+    // Two-phase Gustavson on 32-bit indices
+    if (mult_config.precision == PRECISION_DOUBLE) {
+        // There is no compact DoubleMatrix, V6 handles double precision
+        matr_mult_csr_V6(a, b, result);
+        return;
+    }
+
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    if (!compact_csr_fits(matrix_a) || !compact_csr_fits(matrix_b)) {
+        // Indices don't fit into 32 bits, default to the 64-bit implementation
+        matr_mult_csr_V6(a, b, result);
+        return;
+    }
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Narrow the indices, the values are shared with the input matrices
+    CompactMatrix compact_a;
+    CompactMatrix compact_b;
+    if (narrow_csr_matrix(matrix_a, &compact_a) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+    if (narrow_csr_matrix(matrix_b, &compact_b) == HEAP_MEMORY_ERROR) {
+        free_pointers(2, compact_a.colIndices, compact_a.rowPointers);
+        errno = HEAP_MEMORY_ERROR;
+        return;
+    }
+
+    matr_mult_csr_V9_compact(&compact_a, &compact_b, matrix_result);
+    free_pointers(4, compact_a.colIndices, compact_a.rowPointers, compact_b.colIndices, compact_b.rowPointers);
+}
+
+void matr_mult_csr_V9_compact(
+    const CompactMatrix* const matrix_a, const CompactMatrix* const matrix_b, Matrix* const matrix_result
+    ) {
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+
+    // Check if multiplication is mathematically defined
+    if (matrix_a->noCols != matrix_b->noRows) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // Symbolic pass: exact row pointers and subarrays of size nnz(C)
+    double start = monotonic_seconds();
+    if (symbolic_multiply_compact(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+    } else {
+        // Numeric pass, no clean up needed afterwards
+        double numeric_start = monotonic_seconds();
+        int op_result = mult_config.precision == PRECISION_MIXED
+            ? multiply_V9_mixed(matrix_a, matrix_b, matrix_result)
+            : multiply_V9(matrix_a, matrix_b, matrix_result);
+        if (op_result == HEAP_MEMORY_ERROR) {
+            free(matrix_result->values);
+            free(matrix_result->colIndices);
+            free(matrix_result->rowPointers);
+            matrix_result->values = NULL;
+            matrix_result->colIndices = NULL;
+            matrix_result->rowPointers = NULL;
+            errno = HEAP_MEMORY_ERROR;
+        } else {
+            _record_two_phases(start, numeric_start);
+        }
+    }
+}
+
+void matr_mult_csr_V10(const void* a, const void* b, void* result) {
+    // Expand-sort-compress Gustavson
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // The result is exactly sized, no clean up needed afterwards
+    if (multiply_V10(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+    }
+}
+
+void matr_mult_csr_V11(const void* a, const void* b, void* result) {
+    // Column-tiled Gustavson
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // The result is shrunk to its size, no clean up needed afterwards
+    if (multiply_V11(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+    }
+}
+
+void matr_mult_csr_V12(const void* a, const void* b, void* result) {
+    // Hybrid of dense tiles and Gustavson
+    Matrix* matrix_a = (Matrix*) a;
+    Matrix* matrix_b = (Matrix*) b;
+    Matrix* matrix_result = (Matrix*) result;
+
+    matrix_result->values = NULL;
+    matrix_result->colIndices = NULL;
+    matrix_result->rowPointers = NULL;
+
+    // Check if multiplication is mathematically defined
+    if (!can_multiply(matrix_a, matrix_b)) {
+        errno = MATRIX_DIMENSION_ERROR;
+        return;
+    }
+
+    // The result is shrunk to its size, no clean up needed afterwards
+    if (multiply_V12(matrix_a, matrix_b, matrix_result) == HEAP_MEMORY_ERROR) {
+        errno = HEAP_MEMORY_ERROR;
+    }
+}
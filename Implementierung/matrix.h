@@ -5,20 +5,28 @@
 #include <stddef.h>
 
 #include "csrmatrix.h"
+#include "config.h"
+#include "matrixutils.h"
 
 // Define constants
 #define MATRIX_DIMENSION_ERROR -2  // matrices cannot be multiplied
 #define MATRIX_CONVERSION_ERROR -3  // error converting CSR to 2D-array in V4
 
-#define MIN_THREADS 2
-#define THREAD_COND_MIN_VALUES 40
-#define THREAD_COND_MIN_ROWS 4
-
 /*
 Implementation V0, Multithreading (Hauptimplementierung)
 
-The main implementation uses multithreading when it's favourable. Otherwise,
-matr_mult_csr_V5() is called, which uses size prediction.
+The main implementation uses multithreading when it's favourable, otherwise all rows
+are multiplied on the calling thread. The number of threads is decided by
+choose_thread_count() and stored in last_thread_decision.
+
+Every row of the result gets a slot of min(flops, noCols of B) entries and is
+multiplied with the kernel of its row bin (see choose_row_bin()): short rows with a
+linear list, medium rows with a hash table, rows that fill a large part of the
+result row with the dense SIMD accumulator and very long rows with expand-sort-compress.
+Every chunk of rows is written compactly, the chunks are then moved together (see
+_multiply_row_bins()) and the arrays shrunk to the size of the result. The time of the
+symbolic, numeric and compaction phase is stored in last_multiply_phases, with
+mult_config.stats the counters of MultiplyStats in last_multiply_stats.
 
 If an error occurs while initializing the subarrays, they are all initialized
 to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
@@ -28,9 +36,262 @@ Sets errno to:
     MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
     HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
     THREAD_START_ERROR if one of the threads cannot be created/started.
+
+If the thread pool was created with thread_pool_init(), the threads of the pool are
+reused instead of creating new threads for every call.
+
+The rows are distributed to the threads according to mult_config (see config.h). By
+default, they pull chunks of rows with the same number of estimated flops from an atomic
+counter, so the runtime follows the total work instead of the heaviest slice.
 */
 void matr_mult_csr(const void* a, const void* b, void* result);
 
+/*
+matr_mult_csr() for repeated multiplications: every buffer, including the subarrays of
+the result, comes from the workspace (see MultiplyWorkspace in matrixutils.h). Once the
+workspace has grown to the size of the inputs and the thread pool exists (see
+thread_pool_init()), a multiplication doesn't allocate any memory. Without the pool, a
+threaded multiplication still mallocs the handles of its threads and creates them (see
+start_threads()), only the buffers are reused. The scratch of the row bins is kept in the
+workspace as well, and the result arrays are not shrunk. With --numa replicate, B is still
+copied to every node on every call, so its values may change between two calls.
+
+The result is only valid until the next multiplication with the same workspace or
+free_multiply_workspace(). It must never be free'd, free_csr_matrix() would free the
+buffers of the workspace. On error, its subarrays are NULL pointers.
+
+Sets errno and last_multiply_phases like matr_mult_csr().
+*/
+void matr_mult_csr_ws(const void* a, const void* b, void* result, MultiplyWorkspace* const workspace);
+
+/*
+Multiplication for inputs whose sparsity patterns stay fixed while their values change
+(e.g. the steps of an iterative solver). The structure of the result is computed once
+into the plan (see MultiplyPlan in matrixutils.h), later calls only do the numeric work.
+The result is the same as the one of V6.
+
+The plan is recreated automatically if the dimensions or nnz of A or B differ from the
+ones it was created for. A changed pattern with the same nnz is not detected, the plan
+has to be free'd with free_multiply_plan() then. The subarrays of the result belong to
+the result, free_csr_matrix() can be called as usual. Creating the plan is recorded as the
+symbolic phase in last_multiply_phases.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the plan or the result cannot be malloc'ed.
+*/
+void matr_mult_csr_planned(const void* a, const void* b, void* result, MultiplyPlan* const plan);
+
+/*
+Multiplies the chain operands[0] * operands[1] * ... * operands[count - 1] (e.g. R^T * A * P
+or A^k) in the order of the least estimated flops (see choose_chain_order()). The order is
+chosen on the first call and kept in chain, like the structure in a MultiplyPlan: a chain
+of other operands with the same count needs free_multiply_chain() first.
+
+Intermediate products stay in memory, in the workspaces of the chain (see matr_mult_csr_ws()).
+A workspace is reused as soon as its product has been multiplied, so a chain evaluated left
+to right only needs two. The last multiplication is done by matr_mult_csr(), so the subarrays
+of the result belong to the result and free_csr_matrix() can be called as usual.
+
+errno should be set to 0 before calling this function in order to check if
+the matrices were succesfully multiplied.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if there are less than two operands or two neighbours cannot be multiplied.
+    HEAP_MEMORY_ERROR if the order, a workspace or the result cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+void matr_mult_chain(
+    const Matrix* const* const operands, const unsigned int count, Matrix* const result,
+    MultiplyChain* const chain
+    );
+
+/*
+Multiplies count independent products results[i] = matrices_a[i] * matrices_b[i] at once, for
+many small products where a single matr_mult_csr() would run on one thread. The products are
+grouped into tasks of about the same work (nnz and rows of A), BATCH_TASKS_PER_THREAD per
+thread, which run on the thread pool if it exists, otherwise on newly started threads. A
+batch with too little work runs on the calling thread. Every task multiplies its products one
+after another with the loop of V6, so every product gets the same result as with V6.
+
+The subarrays of all results come from the slab of the batch (see MultiplyBatch in
+matrixutils.h), which only grows. Every product gets room for an upper bound of its nnz
+there, so a single numeric pass is enough. A batch that fits into the slab doesn't allocate any
+memory if it runs on the calling thread or on the thread pool, otherwise only its threads are
+started. The results are only valid until the next call with the same batch or
+free_multiply_batch(), they must never be free'd. On error, all subarrays are NULL pointers.
+
+errno should be set to 0 before calling this function in order to check if
+the matrices were succesfully multiplied.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if one of the products is mathematically not defined (nothing is multiplied).
+    HEAP_MEMORY_ERROR if the slab, the tasks or their scratch cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+void matr_mult_csr_batch(
+    const Matrix* const* const matrices_a, const Matrix* const* const matrices_b, Matrix* const results,
+    const uint64_t count, MultiplyBatch* const batch
+    );
+
+/*
+Runs fn (batch_bound_task() or batch_numeric_task()) on task_count tasks, on the calling thread
+if there is only one, otherwise like _run_multiply_chunks().
+
+This function is called in matr_mult_csr_batch() and should not be called outside of it.
+
+Return values:
+    0 on success.
+    THREAD_START_ERROR or HEAP_MEMORY_ERROR if the threads could not be started.
+*/
+int _run_batch_tasks(
+    const unsigned int thread_count, void* (*fn)(void* arg), struct BatchTask** const tasks,
+    const uint64_t task_count
+    );
+
+/*
+Empties the subarrays of the first count results of matr_mult_csr_batch() after an error.
+
+This function is called in matr_mult_csr_batch() and should not be called outside of it.
+*/
+void _clear_batch_results(Matrix* const results, const uint64_t count);
+
+/*
+Multiplies the sparse CSR matrix a with the dense matrix b (SpMM) into the dense result,
+whose values are allocated here (see init_dense_matrix() in utils.h) and must be free'd
+with free_dense_matrix() or free(). If b has a single column it is a vector and the product
+is computed with the SpMV kernels instead. The fastest kernel the CPU supports is used (see
+best_spmm_kernel() and best_spmv_kernel() in matrixutils.h).
+
+The rows of A are cut into DYNAMIC_CHUNKS_PER_THREAD chunks per thread with about the same
+number of values and rows, which run on the thread pool if it exists, otherwise on newly
+started threads. A product with too few flops runs on the calling thread (see the cost model
+in config.h). On error, the values of the result are a NULL pointer.
+
+errno should be set to 0 before calling this function in order to check if
+the matrices were succesfully multiplied.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the result or the chunks cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+void matr_mult_spmm(const Matrix* const a, const DenseMatrix* const b, DenseMatrix* const result);
+
+/*
+Multiplies A and B like matr_mult_csr(), but only computes the values of C that are in the
+sparsity pattern of mask, C = (A*B) .* pattern(M). The values of mask are ignored. Products
+whose column is not in the mask row are skipped, and the result is allocated with the size
+nnz(M) right away instead of the bound of predict_values_dimension(), then shrunk to the
+values that are not zero. Every row of C has its columns in the order of the mask row.
+
+The rows of A are split into one chunk per thread with about the same flops, which run on the
+thread pool if it exists, otherwise on newly started threads. A product with too few flops
+runs on the calling thread (see the cost model in config.h). Every chunk needs an
+accumulator and a marker with noCols of B elements.
+
+errno should be set to 0 before calling this function in order to check if
+the matrices were succesfully multiplied.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if A*B is mathematically not defined or mask is not noRows of A x noCols of B.
+    HEAP_MEMORY_ERROR if the result or the scratch of the chunks cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+void matr_mult_csr_masked(const void* a, const void* b, const void* mask, void* result);
+
+/*
+Same as matr_mult_csr_masked() with the complemented mask: only the values of C that are
+NOT in the pattern of mask are computed, C = (A*B) .* !pattern(M). Products whose column is
+in the mask row are skipped. Every row gets room for its flops, but at most for the columns
+that are not in its mask row. The columns of a row are in the order they were found, like
+in V6.
+*/
+void matr_mult_csr_masked_complement(const void* a, const void* b, const void* mask, void* result);
+
+/*
+Implementation of matr_mult_csr_masked() and matr_mult_csr_masked_complement(), complement
+selects the second one.
+
+This function is called in matr_mult_csr_masked() and matr_mult_csr_masked_complement() and should
+not be called outside of them.
+*/
+void _matr_mult_masked(
+    const Matrix* const matrix_a, const Matrix* const matrix_b, const Matrix* const mask,
+    Matrix* const matrix_result, const int complement
+    );
+
+/*
+Multiplies the subchain of the operands first to last into a free workspace of the chain and
+stores the product in *product and the index of its workspace in *slot (-1 if the subchain is
+a single operand, which is not copied). The workspaces of both factors are free again
+afterwards.
+
+This function is called in matr_mult_chain() and should not be called outside of it.
+
+Return values:
+    0 on success.
+    -1 if a multiplication failed, errno is set like in matr_mult_csr_ws().
+*/
+int _multiply_chain_range(
+    const Matrix* const* const operands, MultiplyChain* const chain, const unsigned int first,
+    const unsigned int last, const Matrix** const product, int* const slot
+    );
+
+/*
+Runs fn on chunk_count chunks (multiply_main_implementation() or copy_chunk_segment()) on
+thread_count threads of the thread pool if it exists (the calling thread included, see
+thread_pool_run()), otherwise on thread_count newly started threads.
+
+This function is called in matr_mult_csr() and matr_mult_csr_ws() and should not be called
+outside of them.
+
+Return values:
+    0 on success.
+    THREAD_START_ERROR or HEAP_MEMORY_ERROR if the threads could not be started.
+*/
+int _run_multiply_chunks(
+    const unsigned int thread_count, void* (*fn)(void* arg), struct MultiplyArg** const arguments,
+    const unsigned int chunk_count
+    );
+
+/*
+Returns the number of RowScratch structs needed by thread_count threads, one for every
+thread that can run a chunk at the same time (including the calling thread of the pool, and
+never more than the size of the pool plus one).
+
+This function is called in matr_mult_csr() and matr_mult_csr_ws() and should not be called
+outside of them.
+*/
+unsigned int _row_scratch_count(const unsigned int thread_count);
+
+/*
+Multiplies every row of A into its slot of matrix_result (see fill_row_offsets()) with the
+row bins, on the calling thread if thread_count is below MIN_THREADS, otherwise in
+chunk_count chunks. Every chunk writes its rows compactly from the start of its slots, so
+if the chunks lie one after another the result is used in place. Otherwise the chunks are
+copied in parallel into exactly sized arrays, malloc'ed or, if workspace is not NULL, the
+compact arrays of the workspace, and the slot arrays of matrix_result are free'd
+(workspace == NULL) or left to the workspace. valuesSize is set to the nnz of the result.
+arguments must hold at least chunk_count MultiplyArgs.
+
+This function is called in matr_mult_csr() and matr_mult_csr_ws() and should not be called
+outside of them.
+
+Return values:
+    0 on success.
+    THREAD_START_ERROR if the threads could not be started.
+    HEAP_MEMORY_ERROR if the threads or the scratch of a bin could not be malloc'ed.
+*/
+int _multiply_row_bins(
+    const unsigned int thread_count, Matrix* const matrix_a, Matrix* const matrix_b, Matrix* const matrix_result,
+    const uint64_t* const row_flops, RowScratch* const scratch, const unsigned int scratch_count,
+    struct MultiplyArg** const arguments, const unsigned int chunk_count, MultiplyWorkspace* const workspace
+    );
+
 /*
 Implementation V1 converts the matrices into a 2D array and then multiplies
 them using standard matrix multiplication. The resulting 2D array is then
@@ -113,4 +374,168 @@ Sets errno to:
 */
 void matr_mult_csr_V5(const void* a, const void* b, void* result);
 
+/*
+V6 uses a two-phase Gustavson's algorithm. A symbolic pass first counts the exact
+number of non-zero values in every row of the result, which gives the row pointers.
+A numeric pass then fills in values and colIndices. The memory usage is
+O(nnz(C)) and no clean up of the result is needed.
+
+The value type is set by mult_config.precision (also for V7 - V9): PRECISION_MIXED
+accumulates the float values in doubles, for PRECISION_DOUBLE the given matrices
+are DoubleMatrix structs. The times of both passes are stored in last_multiply_phases
+(also by V7 - V11).
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V6(const void* a, const void* b, void* result);
+
+/*
+Stores the phases of V6 - V9 in last_multiply_phases: the symbolic pass from start to
+numeric_start, the numeric pass from there until now. There is no compaction, the symbolic
+pass gives the exact size of C.
+
+This function is called in matr_mult_csr_V6() - matr_mult_csr_V9() and should not be called
+outside of them.
+*/
+void _record_two_phases(const double start, const double numeric_start);
+
+/*
+V6 - V8 for --precision double, the given matrices are DoubleMatrix structs. If
+accumulate_row is NULL, the numeric pass of V6 is used, otherwise the given row kernel.
+
+This function is called in matr_mult_csr_V6() - matr_mult_csr_V8() and should not be called
+outside of them. Sets errno like matr_mult_csr_V6().
+*/
+void _matr_mult_csr_double(const void* a, const void* b, void* result, accumulate_row_double_fn accumulate_row);
+
+/*
+V7 is V6 with an AVX2 numeric pass: the dense row accumulator is gathered 4 values
+at a time and updated with FMA. If the CPU doesn't support AVX2/FMA, V6 is called.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V7(const void* a, const void* b, void* result);
+
+/*
+V8 is V6 with an AVX-512 numeric pass: the dense row accumulator is gathered and
+scattered 8 values at a time, conflicting lanes are detected with vpconflictq.
+If the CPU doesn't support AVX-512F/CD, V6 is called.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V8(const void* a, const void* b, void* result);
+
+/*
+V9 is V6 on 32-bit indices. The index arrays of A and B are narrowed to a CompactMatrix
+and multiplied with kernels specialised for uint32_t indices, the result has 64-bit
+indices as usual. If the indices of A or B don't fit into 32 bits, V6 is called.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V9(const void* a, const void* b, void* result);
+
+/*
+V9 on matrices that are already narrowed with narrow_csr_matrix(), for repeated
+multiplications of the same A and B: matr_mult_csr_V9() narrows both matrices on every
+call. Only --precision float and mixed are supported, the result has 64-bit indices.
+
+Sets errno like matr_mult_csr_V9().
+*/
+void matr_mult_csr_V9_compact(
+    const CompactMatrix* const matrix_a, const CompactMatrix* const matrix_b, Matrix* const matrix_result
+    );
+
+/*
+V10 uses expand-sort-compress (see multiply_V10()): the products of a tile of rows are
+radix sorted by row and column and equal columns are summed. It needs no accumulator of
+the width of B, so it suits very wide matrices and rows with few products. The columns
+of every row of the result are sorted.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V10(const void* a, const void* b, void* result);
+
+/*
+V11 is Gustavson tiled by columns of B (see multiply_V11()): all rows of A are multiplied
+with one panel of columns at a time, the accumulator of a panel fits into the L2 cache. It
+suits products whose B has so many columns that a dense accumulator row misses the cache
+on every scatter.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V11(const void* a, const void* b, void* result);
+
+/*
+V12 is a hybrid of dense tiles and Gustavson (see multiply_V12()): the tiles of A and B
+with at least DENSE_TILE_SIZE * DENSE_TILE_SIZE / 4 values are multiplied as dense blocks by
+an AVX kernel, the other values row by row. It suits matrices with dense blocks (like dense
+diagonal blocks), which V1 can only multiply by converting the whole matrices.
+
+errno should be set to 0 before calling this function in order to check if
+the matrix was succesfully multiplied.
+
+If an error occurs while initializing the subarrays, they are all initialized
+to be a NULL pointer. Thus, free() and free_csr_matrix() can be called with no
+worries about double freeing a pointer.
+
+Sets errno to:
+    MATRIX_DIMENSION_ERROR if the multiplication is mathematically not defined.
+    HEAP_MEMORY_ERROR if the matrix cannot be malloc'ed.
+*/
+void matr_mult_csr_V12(const void* a, const void* b, void* result);
+
 #endif
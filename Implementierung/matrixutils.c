@@ -3,6 +3,9 @@ This file contains the definitions of helper functions used in matrix multiplica
 These functions are called in the main multiplication functions.
 */
 
+// We need this for sched_getaffinity() and CPU_COUNT
+#define _GNU_SOURCE
+
 // Default C library
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,9 +16,15 @@ These functions are called in the main multiplication functions.
 #include <emmintrin.h>
 // Threading
 #include <pthread.h>
+#include <sched.h>
+// System info for threading
+#include <sys/sysinfo.h>
+#include <unistd.h>
 
 // Our headers
 #include "matrixutils.h"
+#include "matrix.h"
+#include "numautils.h"
 #include "utils.h"
 #include "constants.h"
 
@@ -28,45 +37,379 @@ void* multiply_main_implementation(void* void_arg) {
     // Extract info from the given argument
     struct MultiplyArg* arg = (struct MultiplyArg*) void_arg;  // to fit thread creation signature
     Matrix* matrix_a = arg->matrix_a;
-    Matrix* matrix_b = arg->matrix_b;
     Matrix* matrix_result = arg->matrix_result;
-    uint64_t start_row = arg->start_row;
-    uint64_t end_row = arg->end_row;
+    struct RowBins* bins = arg->bins;
+    // The copy of B on the node of this thread, if B is replicated
+    Matrix* matrix_b = bins->replicas != NULL ? &bins->replicas[numa_current_node()] : arg->matrix_b;
+    uint64_t noCols = matrix_b->noCols;
+
+    RowScratch* scratch = _claim_row_scratch(bins->scratch, bins->scratchCount);
+    double chunk_start = STATS_ENABLED() ? monotonic_seconds() : 0;
+    uint64_t position = arg->start_row < arg->end_row ? matrix_result->rowPointers[arg->start_row] : 0;
+    arg->slot = position;
+    for (uint64_t rowA = arg->start_row; rowA < arg->end_row; rowA++) {
+        uint64_t flops = bins->rowFlops[rowA + 1] - bins->rowFlops[rowA];
+        uint64_t bound = flops < noCols ? flops : noCols;
+        int bin = choose_row_bin(bound, noCols);
+        if (_reserve_row_scratch(scratch, bin, noCols, flops) == HEAP_MEMORY_ERROR) {
+            __atomic_store_n(&bins->error, HEAP_MEMORY_ERROR, __ATOMIC_RELAXED);
+            break;
+        }
 
-    // Iterating the rows of A / rowA := row index of A
-    matrix_result->rowPointers[0] = 0;
-    for (uint64_t rowA = start_row; rowA < end_row; rowA++) {
-        // Getting the row start and end
-        uint64_t rowABeg = matrix_a->rowPointers[rowA];
-        uint64_t rowAEnd = matrix_a->rowPointers[rowA + 1];
+        // Right behind the previous row, at most at the slot of the row (see fill_row_offsets())
+        float* values = matrix_result->values + position;
+        uint64_t* colIndices = matrix_result->colIndices + position;
+        uint64_t count;
+        switch (bin) {
+            case ROW_BIN_LIST:
+                count = _multiply_row_list(matrix_a, matrix_b, rowA, values, colIndices);
+                break;
+            case ROW_BIN_DENSE:
+                count = _multiply_row_dense(
+                    matrix_a, matrix_b, rowA, values, colIndices,
+                    scratch->accumulator, scratch->flags, bins->accumulateRow
+                    );
+                break;
+            case ROW_BIN_HASH:
+                count = _multiply_row_hash(
+                    matrix_a, matrix_b, rowA, values, colIndices, bound, scratch->hashKeys, scratch->hashPositions
+                    );
+                break;
+            case ROW_BIN_ESC:
+            default:
+                count = _multiply_row_esc(
+                    matrix_a, matrix_b, rowA, values, colIndices,
+                    scratch->escKeys, scratch->escValues, scratch->escCapacity
+                    );
+                break;
+        }
+        matrix_result->rowPointers[rowA] = position;
+        position += count;
+    }
+    arg->nnz = position - arg->slot;
+    if (STATS_ENABLED()) {
+        count_worker_chunk(
+            (unsigned int) (scratch - bins->scratch), monotonic_seconds() - chunk_start, arg->end_row - arg->start_row
+            );
+    }
+    __atomic_store_n(&scratch->busy, 0, __ATOMIC_RELEASE);
 
-        // Iterating over the columns of A in line rowA
-        for (uint64_t indexA = rowABeg; indexA < rowAEnd; indexA++) {
-            float valueA = matrix_a->values[indexA];
+    return NULL;  // this is required for pthread_create()
+}
 
-            // rowB = columnA th row of B
-            uint64_t rowBBeg = matrix_b->rowPointers[matrix_a->colIndices[indexA]];
-            uint64_t rowBEnd = matrix_b->rowPointers[matrix_a->colIndices[indexA] + 1];
+int choose_row_bin(const uint64_t bound, const uint64_t noCols) {
+    if (bound <= ROW_BIN_LIST_MAX) {
+        return ROW_BIN_LIST;
+    }
+    // The row touches a large part of the accumulator, or the accumulator is small anyway
+    if (noCols / ROW_BIN_DENSE_RATIO <= bound) {
+        return ROW_BIN_DENSE;
+    }
+    return bound <= ROW_BIN_HASH_MAX ? ROW_BIN_HASH : ROW_BIN_ESC;
+}
 
-            float valueB = 0;
-            float valueC = 0;
+uint64_t fill_row_offsets(
+    const uint64_t noRows, const uint64_t noCols, const uint64_t* const restrict row_flops,
+    uint64_t* const restrict rowPointers, uint64_t* const restrict bin_rows
+    ) {
+    memset(bin_rows, 0, sizeof(uint64_t) * ROW_BIN_COUNT);
+    rowPointers[0] = 0;
+    for (uint64_t row = 0; row < noRows; row++) {
+        uint64_t flops = row_flops[row + 1] - row_flops[row];
+        uint64_t bound = flops < noCols ? flops : noCols;
+        bin_rows[choose_row_bin(bound, noCols)]++;
+        rowPointers[row + 1] = rowPointers[row] + bound;
+    }
+    return rowPointers[noRows];
+}
 
-            uint64_t columnB = 0;
-            uint64_t indexB = rowBBeg;
-            // Iterating over the columns of B                 
-            for (indexB = rowBBeg; indexB < rowBEnd; indexB++) {
-                valueB = matrix_b->values[indexB];
-                // Actual multiplication of the values
-                valueC = valueA * valueB;
-                columnB = matrix_b->colIndices[indexB];
-                // Adding the valueC to the exsting value in Matrix C
-                matrix_result->values[rowA * matrix_result->noCols + columnB] += valueC;
-                // Updating colIndices
-                matrix_result->colIndices[rowA * matrix_b->noCols + columnB] = columnB;
+// Index of the scratch the thread claimed last, see _claim_row_scratch()
+static _Thread_local unsigned int last_scratch = 0;
+
+RowScratch* _claim_row_scratch(RowScratch* const scratch, const unsigned int count) {
+    while (1) {
+        for (unsigned int n = 0; n < count; n++) {
+            unsigned int i = (last_scratch + n) % count;
+            if (!__atomic_load_n(&scratch[i].busy, __ATOMIC_RELAXED) &&
+                !__atomic_exchange_n(&scratch[i].busy, 1, __ATOMIC_ACQUIRE)) {
+                last_scratch = i;
+                return &scratch[i];
             }
         }
-        // Updating row pointer -> end of this row => rowA +1 Eintrag (0. -> 1. , 1. -> 2.)
-        matrix_result->rowPointers[rowA + 1] = (rowA + 1) * matrix_result->noCols;
+    }
+}
+
+int _reserve_row_scratch(RowScratch* const scratch, const int bin, const uint64_t noCols, const uint64_t flops) {
+    switch (bin) {
+        case ROW_BIN_DENSE:
+            if (scratch->denseCapacity < noCols) {
+                // Zeroed, the kernel keeps them clean afterwards
+                free_pointers(2, scratch->accumulator, scratch->flags);
+                scratch->denseCapacity = 0;
+                scratch->accumulator = calloc(noCols, sizeof(float));
+                scratch->flags = calloc(noCols, sizeof(uint8_t));
+                if (scratch->accumulator == NULL || scratch->flags == NULL) {
+                    return HEAP_MEMORY_ERROR;
+                }
+                scratch->denseCapacity = noCols;
+                if (STATS_ENABLED()) {
+                    count_allocated_bytes((sizeof(float) + sizeof(uint8_t)) * noCols);
+                }
+            }
+            return 0;
+        case ROW_BIN_HASH:
+            if (scratch->hashKeys == NULL || scratch->hashPositions == NULL) {
+                free_pointers(2, scratch->hashKeys, scratch->hashPositions);
+                scratch->hashKeys = malloc_safe(sizeof(uint64_t), ROW_BIN_HASH_SIZE);
+                scratch->hashPositions = malloc_safe(sizeof(uint64_t), ROW_BIN_HASH_SIZE);
+                if (scratch->hashKeys == NULL || scratch->hashPositions == NULL) {
+                    return HEAP_MEMORY_ERROR;
+                }
+                if (STATS_ENABLED()) {
+                    count_allocated_bytes(2 * sizeof(uint64_t) * ROW_BIN_HASH_SIZE);
+                }
+            }
+            return 0;
+        case ROW_BIN_ESC:
+            if (scratch->escCapacity < flops) {
+                // Grow geometrically, the rows of the bin have different lengths
+                uint64_t capacity = scratch->escCapacity * 2 > flops ? scratch->escCapacity * 2 : flops;
+                free_pointers(2, scratch->escKeys, scratch->escValues);
+                scratch->escCapacity = 0;
+                scratch->escKeys = malloc_safe(2 * sizeof(uint64_t), capacity);
+                scratch->escValues = malloc_safe(2 * sizeof(float), capacity);
+                if (scratch->escKeys == NULL || scratch->escValues == NULL) {
+                    return HEAP_MEMORY_ERROR;
+                }
+                scratch->escCapacity = capacity;
+                if (STATS_ENABLED()) {
+                    count_allocated_bytes(2 * (sizeof(uint64_t) + sizeof(float)) * capacity);
+                }
+            }
+            return 0;
+        default:  // the list lives in the slot of the row
+            return 0;
+    }
+}
+
+void free_row_scratch(RowScratch* const scratch, const unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        free_pointers(
+            6, scratch[i].accumulator, scratch[i].flags, scratch[i].hashKeys, scratch[i].hashPositions,
+            scratch[i].escKeys, scratch[i].escValues
+            );
+        memset(&scratch[i], 0, sizeof(RowScratch));
+    }
+}
+
+uint64_t _multiply_row_list(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices
+    ) {
+    uint64_t size = 0;
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        float valueA = matrix_a->values[indexA];
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+            // The list is the slot itself, it has at most ROW_BIN_LIST_MAX entries
+            uint64_t columnB = matrix_b->colIndices[indexB];
+            uint64_t i = 0;
+            while (i < size && colIndices[i] != columnB) {
+                i++;
+            }
+            if (i == size) {
+                colIndices[size] = columnB;
+                values[size++] = valueA * matrix_b->values[indexB];
+            } else {
+                values[i] += valueA * matrix_b->values[indexB];
+            }
+        }
+    }
+    return _drop_zero_values(values, colIndices, size);
+}
+
+uint64_t _multiply_row_hash(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices, const uint64_t bound,
+    uint64_t* const restrict keys, uint64_t* const restrict positions
+    ) {
+    // Power of two with at least twice as many entries as the row can have
+    unsigned int bits = 64 - __builtin_clzll(bound) + 1;
+    uint64_t mask = ((uint64_t) 1 << bits) - 1;
+    memset(keys, 0xff, sizeof(uint64_t) << bits);  // no column is the largest index
+
+    uint64_t size = 0;
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        float valueA = matrix_a->values[indexA];
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+            // Fibonacci hashing, the top bits of the product are well mixed
+            uint64_t columnB = matrix_b->colIndices[indexB];
+            uint64_t slot = (columnB * 0x9e3779b97f4a7c15ull) >> (64 - bits);
+            while (keys[slot] != columnB && keys[slot] != UINT64_MAX) {
+                slot = (slot + 1) & mask;
+            }
+            if (keys[slot] == UINT64_MAX) {
+                // First product for this column, the table stores where its value is
+                keys[slot] = columnB;
+                positions[slot] = size;
+                colIndices[size] = columnB;
+                values[size++] = valueA * matrix_b->values[indexB];
+            } else {
+                values[positions[slot]] += valueA * matrix_b->values[indexB];
+            }
+        }
+    }
+    return _drop_zero_values(values, colIndices, size);
+}
+
+uint64_t _multiply_row_dense(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices,
+    float* const restrict accumulator, uint8_t* const restrict flags, accumulate_row_fn accumulate_row
+    ) {
+    // Collect the columns of the row, the products are accumulated by the row kernel
+    uint64_t size = 0;
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+            uint64_t columnB = matrix_b->colIndices[indexB];
+            if (!flags[columnB]) {
+                flags[columnB] = 1;
+                colIndices[size++] = columnB;
+            }
+        }
+    }
+
+    accumulate_row(matrix_a, matrix_b, rowA, accumulator);
+
+    // Gather the row and leave the accumulator and the flags clean for the next row
+    uint64_t nnz = 0;
+    for (uint64_t i = 0; i < size; i++) {
+        uint64_t columnC = colIndices[i];
+        float valueC = accumulator[columnC];
+        accumulator[columnC] = 0;
+        flags[columnC] = 0;
+        if (valueC != 0) {
+            values[nnz] = valueC;
+            colIndices[nnz++] = columnC;
+        }
+    }
+    return nnz;
+}
+
+uint64_t _multiply_row_esc(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices,
+    uint64_t* const restrict keys, float* const restrict esc_values, const uint64_t capacity
+    ) {
+    // Expand, the key of a product is its column
+    uint64_t products = 0;
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        float valueA = matrix_a->values[indexA];
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+            keys[products] = matrix_b->colIndices[indexB];
+            esc_values[products++] = valueA * matrix_b->values[indexB];
+        }
+    }
+
+    // Sort
+    unsigned int col_bits = matrix_b->noCols > 1 ? 64 - __builtin_clzll(matrix_b->noCols - 1) : 0;
+    uint64_t* sorted_keys = keys;
+    float* sorted_values = esc_values;
+    _esc_sort(&sorted_keys, &sorted_values, products, col_bits, keys + capacity, esc_values + capacity);
+
+    // Compress
+    uint64_t nnz = 0;
+    uint64_t i = 0;
+    while (i < products) {
+        uint64_t key = sorted_keys[i];
+        float sum = sorted_values[i++];
+        while (i < products && sorted_keys[i] == key) {
+            sum += sorted_values[i++];
+        }
+        if (sum != 0) {
+            values[nnz] = sum;
+            colIndices[nnz++] = key;
+        }
+    }
+    return nnz;
+}
+
+uint64_t _drop_zero_values(float* const restrict values, uint64_t* const restrict colIndices, const uint64_t size) {
+    uint64_t nnz = 0;
+    for (uint64_t i = 0; i < size; i++) {
+        if (values[i] != 0) {
+            values[nnz] = values[i];
+            colIndices[nnz++] = colIndices[i];
+        }
+    }
+    return nnz;
+}
+
+uint64_t compact_row_slots(Matrix* const matrix, const uint64_t* const row_nnz) {
+    // Rows only move to the front, so every row can be moved in place
+    uint64_t nnz = 0;
+    for (uint64_t row = 0; row < matrix->noRows; row++) {
+        uint64_t slot = matrix->rowPointers[row];
+        if (slot != nnz) {
+            memmove(matrix->values + nnz, matrix->values + slot, sizeof(float) * row_nnz[row]);
+            memmove(matrix->colIndices + nnz, matrix->colIndices + slot, sizeof(uint64_t) * row_nnz[row]);
+        }
+        matrix->rowPointers[row] = nnz;
+        nnz += row_nnz[row];
+    }
+    matrix->rowPointers[matrix->noRows] = nnz;
+    return nnz;
+}
+
+void* copy_chunk_segment(void* void_arg) {
+    struct MultiplyArg* arg = (struct MultiplyArg*) void_arg;  // to fit thread creation signature
+    Matrix* matrix_result = arg->matrix_result;
+    struct RowBins* bins = arg->bins;
+
+    memcpy(bins->values + arg->offset, matrix_result->values + arg->slot, sizeof(float) * arg->nnz);
+    memcpy(bins->colIndices + arg->offset, matrix_result->colIndices + arg->slot, sizeof(uint64_t) * arg->nnz);
+    for (uint64_t row = arg->start_row; row < arg->end_row; row++) {
+        matrix_result->rowPointers[row] = matrix_result->rowPointers[row] - arg->slot + arg->offset;
+    }
+
+    return NULL;  // this is required for pthread_create()
+}
+
+void begin_multiply_stats(void) {
+    memset(&last_multiply_stats, 0, sizeof(MultiplyStats));
+}
+
+void count_allocated_bytes(const uint64_t bytes) {
+    __atomic_fetch_add(&last_multiply_stats.bytes_allocated, bytes, __ATOMIC_RELAXED);
+}
+
+void count_worker_chunk(const unsigned int worker, const double busy, const uint64_t rows) {
+    // Only the thread holding the slot writes its counters, shared counters would need atomics
+    if (worker >= MULTIPLY_STATS_MAX_WORKERS) {
+        return;
+    }
+    WorkerStats* stats = &last_multiply_stats.workers[worker];
+    stats->busy += busy;
+    stats->rows += rows;
+    stats->chunks++;
+}
+
+void finish_multiply_stats(const uint64_t nnz) {
+    last_multiply_stats.nnz = nnz;
+    last_multiply_stats.phases = last_multiply_phases;
+    last_multiply_stats.recorded = 1;
+}
+
+void* multiply_queue_worker(void* void_queue) {
+    struct MultiplyQueue* queue = (struct MultiplyQueue*) void_queue;  // to fit thread creation signature
+
+    // Pull chunks until every chunk has been handed out
+    unsigned int chunk;
+    while ((chunk = __atomic_fetch_add(&queue->next_chunk, 1, __ATOMIC_RELAXED)) < queue->chunk_count) {
+        queue->fn(queue->chunks[chunk]);
     }
 
     return NULL;  // this is required for pthread_create()
@@ -155,6 +498,7 @@ Matrix* ordinary_to_csr(const uint64_t noRows, const uint64_t noCols, float** or
     csr->colIndices = colIndices;
     csr->rowPointers = rowPointers;
     csr->rowPointersSize = noRows + 1;
+    csr->mapping = NULL;
 
     return csr;
 }
@@ -209,10 +553,7 @@ int multiply_V3(
     ) {
     // Iterating the rows of A / rowA := row index of A
     matrix_result->rowPointers[0] = 0;
-    float* values_to_add = malloc(sizeof(float) * 4);  // holds 4 float values for SIMD
-    if (values_to_add == NULL) {
-        return HEAP_MEMORY_ERROR;
-    }
+    float values_to_add[4];  // holds 4 float values for SIMD
 
     for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
         // Getting the row start and end
@@ -282,11 +623,10 @@ int multiply_V3(
         matrix_result->rowPointers[rowA + 1] = (rowA + 1) * matrix_result->noCols;
     }
 
-    free(values_to_add);  // free SIMD array
-
     return 0;
 }
 
+__attribute__((target("avx")))
 int multiply_V4(
     const Matrix* const restrict matrix_a, 
     const Matrix* const restrict matrix_b, 
@@ -294,10 +634,7 @@ int multiply_V4(
     ) {
     // Iterating the rows of A / rowA := row index of A
     matrix_result->rowPointers[0] = 0;
-    float* values_to_add = malloc(sizeof(float) * 8);  // holds 8 float values for SIMD
-    if (values_to_add == NULL) {
-        return HEAP_MEMORY_ERROR;
-    }
+    float values_to_add[8];  // holds 8 float values for SIMD
 
     for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
         // Getting the row start and end
@@ -365,17 +702,30 @@ int multiply_V4(
         matrix_result->rowPointers[rowA + 1] = (rowA + 1) * matrix_result->noCols;
     }
 
-    free(values_to_add);  // free SIMD array
-
     return 0;
 }
 
-void multiply_V5(
+int multiply_V5(
     const Matrix* const restrict matrix_a, 
     const Matrix* const restrict matrix_b, 
     Matrix* const restrict matrix_result
     ) {
     // Gustafson with size prediction
+    // Every row is accumulated in a dense sparse accumulator (SPA), the touched columns
+    // are collected in the row's part of colIndices, which makes a row cost O(flops)
+    float* accumulator = calloc(matrix_b->noCols, sizeof(float));
+    if (accumulator == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // marker[col] holds the last row in which col was touched
+    uint64_t* marker = malloc_safe(sizeof(uint64_t), matrix_b->noCols);
+    if (marker == NULL) {
+        free(accumulator);
+        return HEAP_MEMORY_ERROR;
+    }
+    memset(marker, 0xff, sizeof(uint64_t) * matrix_b->noCols);  // no row is UINT64_MAX
+
     uint64_t valuesBegPtr = 0;
     uint64_t valuesEndPtr = 0; 
     // Iterating the rows of A / rowA := row index of A
@@ -393,165 +743,2131 @@ void multiply_V5(
             uint64_t rowBBeg = matrix_b->rowPointers[matrix_a->colIndices[indexA]];
             uint64_t rowBEnd = matrix_b->rowPointers[matrix_a->colIndices[indexA]+1];
 
-            float valueB = 0;  
-            float valueC = 0; 
-
-            uint64_t columnB = 0; 
-            uint64_t indexB = rowBBeg;
-
             // Iterating over the columns of B                 
-            for (indexB = rowBBeg; indexB < rowBEnd; indexB++) {
-                valueB = matrix_b->values[indexB];
-                // Actual multiplication of the values
-                valueC = valueA * valueB;
-                columnB = matrix_b->colIndices[indexB];
-
-                for (uint64_t i = valuesBegPtr; i < matrix_result->valuesSize; i++) {
-                    if (matrix_result->values[i] == 0){
-                        // Füge Element ein 
-                        matrix_result->values[i] = valueC; 
-                        matrix_result->colIndices[i] = columnB; 
-                        valuesEndPtr = i+1;  
-                        break; 
-                    } else if(matrix_result->colIndices[i] == columnB){
-                        matrix_result->values[i] += valueC; 
-                        break;
-                    }       
+            for (uint64_t indexB = rowBBeg; indexB < rowBEnd; indexB++) {
+                uint64_t columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA) {
+                    // First product for this column in the current row, only the bound and
+                    // exact estimators guarantee a free slot, a sampled estimate may run out
+                    marker[columnB] = rowA;
+                    if (valuesEndPtr == matrix_result->valuesSize) {
+                        uint64_t capacity = matrix_result->valuesSize ? 2 * matrix_result->valuesSize : 1;
+                        // On error the arrays are NULL or valid, free_csr_matrix() handles both in main.c
+                        if (_grow_result_arrays(&matrix_result->values, &matrix_result->colIndices, capacity) == HEAP_MEMORY_ERROR) {
+                            free(accumulator);
+                            free(marker);
+                            return HEAP_MEMORY_ERROR;
+                        }
+                        matrix_result->valuesSize = capacity;
+                    }
+                    matrix_result->colIndices[valuesEndPtr++] = columnB;
                 }
+                accumulator[columnB] += valueA * matrix_b->values[indexB];
+            }
+        }
 
-            }             
+        // Gather the row from the accumulator, exact zeros (cancellation) are dropped
+        uint64_t rowEnd = valuesEndPtr;
+        valuesEndPtr = valuesBegPtr;
+        for (uint64_t i = valuesBegPtr; i < rowEnd; i++) {
+            uint64_t columnC = matrix_result->colIndices[i];
+            float valueC = accumulator[columnC];
+            accumulator[columnC] = 0;
+            if (valueC != 0) {
+                matrix_result->values[valuesEndPtr] = valueC;
+                matrix_result->colIndices[valuesEndPtr++] = columnC;
+            }
         }
+
         // Updating row pointer -> end of this row => rowA +1 Eintrag (0. -> 1. , 1. -> 2.)
         matrix_result->rowPointers[rowA+1] = valuesEndPtr; 
         // Updating the beg Ptr
         valuesBegPtr = valuesEndPtr; 
     }
-}
 
-// OTHER HELPER FUNCTIONS BELOW //
-// ---------------------------- //
+    free(accumulator);
+    free(marker);
 
-int start_threads(
-    const unsigned int thread_count, pthread_t** threads, struct MultiplyArg*** arguments,
-    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result
-    ) {
-    // Create the multiplication arguments
-    if (!thread_count) {  // this is required to avoid a maybe uninitialized warning from gcc
-        return THREAD_START_ERROR;
-    }
+    return 0;
+}
 
-    *arguments = malloc(sizeof(struct MultiplyArg*) * thread_count);  // no need to check for overflow, thread_count is a small number
-    if (*arguments == NULL) {
-        return HEAP_MEMORY_ERROR;
+void accumulate_row_scalar(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    ) {
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        float valueA = matrix_a->values[indexA];
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+            accumulator[matrix_b->colIndices[indexB]] += valueA * matrix_b->values[indexB];
+        }
     }
+}
 
-    uint64_t prev = 0;
-    uint64_t step = matrix_a->noRows / thread_count;
-    unsigned int rest = matrix_a->noRows % thread_count;  // rest is also in this range so unsigned int
-
-    for (unsigned int i = 0; i < thread_count; i++) {
-        struct MultiplyArg* arg = malloc(sizeof(struct MultiplyArg));
-        if (arg == NULL) {
-            for (unsigned int j = 0; j < i; j++) {
-                free((*arguments)[j]);
+__attribute__((target("avx2,fma")))
+void accumulate_row_avx2(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    ) {
+    float sums[4];  // lanes to write back, AVX2 has no scatter
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m128 valueA = _mm_set1_ps(matrix_a->values[indexA]);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        for (; indexB + 4 <= rowBEnd; indexB += 4) {
+            __m256i columns = _mm256_loadu_si256((const __m256i*) (matrix_b->colIndices + indexB));
+            // AVX2 has no vpconflictq, every lane is compared with the lanes 1 and 2 further
+            __m256i conflicts = _mm256_or_si256(
+                _mm256_cmpeq_epi64(columns, _mm256_permute4x64_epi64(columns, _MM_SHUFFLE(0, 3, 2, 1))),
+                _mm256_cmpeq_epi64(columns, _mm256_permute4x64_epi64(columns, _MM_SHUFFLE(1, 0, 3, 2)))
+                );
+            if (!_mm256_testz_si256(conflicts, conflicts)) {
+                // Two lanes hit the same column (not a valid CSR row), writing back would lose one of them
+                for (uint64_t i = indexB; i < indexB + 4; i++) {
+                    float* valueC = accumulator + matrix_b->colIndices[i];
+                    _mm_store_ss(valueC, _mm_fmadd_ss(valueA, _mm_load_ss(matrix_b->values + i), _mm_load_ss(valueC)));
+                }
+                continue;
             }
-            free(*arguments);
-            return HEAP_MEMORY_ERROR;
+            __m128 valuesC = _mm256_i64gather_ps(accumulator, columns, sizeof(float));
+            valuesC = _mm_fmadd_ps(valueA, _mm_loadu_ps(matrix_b->values + indexB), valuesC);
+            _mm_storeu_ps(sums, valuesC);
+            accumulator[matrix_b->colIndices[indexB]] = sums[0];
+            accumulator[matrix_b->colIndices[indexB + 1]] = sums[1];
+            accumulator[matrix_b->colIndices[indexB + 2]] = sums[2];
+            accumulator[matrix_b->colIndices[indexB + 3]] = sums[3];
         }
 
-        arg->matrix_a = matrix_a;
-        arg->matrix_b = matrix_b;
-        arg->matrix_result = matrix_result;
-
-        arg->start_row = prev;
-        if (i < rest) {
-            prev += step + 1;
-            arg->end_row = prev;
-        } else {
-            prev += step;
-            arg->end_row = prev;
+        // Remaining products, also fused so that every product is rounded the same way
+        for (; indexB < rowBEnd; indexB++) {
+            float* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_ss(valueC, _mm_fmadd_ss(valueA, _mm_load_ss(matrix_b->values + indexB), _mm_load_ss(valueC)));
         }
-        
-
-        (*arguments)[i] = arg;
-    }
-    (*arguments)[thread_count-1]->end_row = matrix_a->noRows;
-
-    // Create the threads
-    *threads = malloc(sizeof(pthread_t) * thread_count);
-    if (*threads == NULL) {
-        return HEAP_MEMORY_ERROR;
     }
+}
 
-    pthread_t thread;
-    for (unsigned int i = 0; i < thread_count; i++) {
-        if (pthread_create(&thread, NULL, &multiply_main_implementation, (*arguments)[i])) {
-            // Error creating thread, join previous threads and clean up memory
-            for (unsigned int j = 0; j < i; j++) {
-                pthread_join((*threads)[j], NULL);
-            }
-
-            for (unsigned int j = 0; j < thread_count; j++) {
-                free((*arguments)[j]);
+__attribute__((target("avx512f,avx512cd,fma")))
+void accumulate_row_avx512(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    ) {
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m256 valueA = _mm256_set1_ps(matrix_a->values[indexA]);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        for (; indexB + 8 <= rowBEnd; indexB += 8) {
+            __m512i columns = _mm512_loadu_si512(matrix_b->colIndices + indexB);
+            __m512i conflicts = _mm512_conflict_epi64(columns);
+            if (_mm512_test_epi64_mask(conflicts, conflicts)) {
+                // Two lanes hit the same column (not a valid CSR row), a scatter would lose one of them
+                for (uint64_t i = indexB; i < indexB + 8; i++) {
+                    accumulator[matrix_b->colIndices[i]] += matrix_a->values[indexA] * matrix_b->values[i];
+                }
+                continue;
             }
-            free(*arguments);
+            __m256 valuesC = _mm512_i64gather_ps(columns, accumulator, sizeof(float));
+            valuesC = _mm256_fmadd_ps(valueA, _mm256_loadu_ps(matrix_b->values + indexB), valuesC);
+            _mm512_i64scatter_ps(accumulator, columns, valuesC, sizeof(float));
+        }
 
-            return THREAD_START_ERROR;
-        } else {
-            (*threads)[i] = thread;
+        // Remaining products, also fused so that every product is rounded the same way
+        __m128 valueA1 = _mm256_castps256_ps128(valueA);
+        for (; indexB < rowBEnd; indexB++) {
+            float* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_ss(valueC, _mm_fmadd_ss(valueA1, _mm_load_ss(matrix_b->values + indexB), _mm_load_ss(valueC)));
         }
     }
-
-    return 0;
 }
 
-int can_multiply(const Matrix* const a, const Matrix* const b) {
-    return (a->noCols == b->noRows) && (a->noCols >= 1 && a->noRows >= 1) && (b->noCols >= 1 && b->noRows >= 1);
-}
+__attribute__((target("avx2,fma")))
+void accumulate_row_avx2_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    ) {
+    double sums[4];  // lanes to write back, AVX2 has no scatter
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m256d valueA = _mm256_set1_pd(matrix_a->values[indexA]);
+        __m128d valueA1 = _mm256_castpd256_pd128(valueA);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        // The columns of a row of B are distinct, so the 4 lanes never hit the same entry
+        for (; indexB + 4 <= rowBEnd; indexB += 4) {
+            __m256i columns = _mm256_loadu_si256((const __m256i*) (matrix_b->colIndices + indexB));
+            __m256d valuesC = _mm256_i64gather_pd(accumulator, columns, sizeof(double));
+            valuesC = _mm256_fmadd_pd(valueA, _mm256_cvtps_pd(_mm_loadu_ps(matrix_b->values + indexB)), valuesC);
+            _mm256_storeu_pd(sums, valuesC);
+            accumulator[matrix_b->colIndices[indexB]] = sums[0];
+            accumulator[matrix_b->colIndices[indexB + 1]] = sums[1];
+            accumulator[matrix_b->colIndices[indexB + 2]] = sums[2];
+            accumulator[matrix_b->colIndices[indexB + 3]] = sums[3];
+        }
 
-int clean_up_csr(Matrix* const matrix) {
-    uint64_t non_zero_values;  // count the non zero values
-    if (_clean_up_matrix_arrays(matrix, &non_zero_values) == HEAP_MEMORY_ERROR) {
-        return HEAP_MEMORY_ERROR;
+        for (; indexB < rowBEnd; indexB++) {
+            double* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_sd(valueC, _mm_fmadd_sd(valueA1, _mm_set_sd(matrix_b->values[indexB]), _mm_load_sd(valueC)));
+        }
     }
+}
 
-    if (non_zero_values > 0) {
-        // Don't free arrays on error, free_csr_matrix() does that in main.c, no need for realloc_safe()
-        uint64_t alloc_size;
-        if (__builtin_umull_overflow(non_zero_values, sizeof(float), &alloc_size)) {
-            return HEAP_MEMORY_ERROR;
+__attribute__((target("avx512f,avx512cd,fma")))
+void accumulate_row_avx512_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    ) {
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m512d valueA = _mm512_set1_pd(matrix_a->values[indexA]);
+        __m128d valueA1 = _mm512_castpd512_pd128(valueA);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        for (; indexB + 8 <= rowBEnd; indexB += 8) {
+            __m512i columns = _mm512_loadu_si512(matrix_b->colIndices + indexB);
+            __m512i conflicts = _mm512_conflict_epi64(columns);
+            if (_mm512_test_epi64_mask(conflicts, conflicts)) {
+                // Two lanes hit the same column (not a valid CSR row), a scatter would lose one of them
+                for (uint64_t i = indexB; i < indexB + 8; i++) {
+                    accumulator[matrix_b->colIndices[i]] += (double) matrix_a->values[indexA] * matrix_b->values[i];
+                }
+                continue;
+            }
+            __m512d valuesC = _mm512_i64gather_pd(columns, accumulator, sizeof(double));
+            valuesC = _mm512_fmadd_pd(valueA, _mm512_cvtps_pd(_mm256_loadu_ps(matrix_b->values + indexB)), valuesC);
+            _mm512_i64scatter_pd(accumulator, columns, valuesC, sizeof(double));
         }
 
-        float* tmp_values = matrix->values;
-        matrix->values = realloc(matrix->values,  alloc_size);
-        if (matrix->values == NULL) {
-            matrix->values = tmp_values;
-            return HEAP_MEMORY_ERROR;
+        for (; indexB < rowBEnd; indexB++) {
+            double* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_sd(valueC, _mm_fmadd_sd(valueA1, _mm_set_sd(matrix_b->values[indexB]), _mm_load_sd(valueC)));
         }
+    }
+}
 
-        
-        if (__builtin_umull_overflow(non_zero_values, sizeof(uint64_t), &alloc_size)) {
-            return HEAP_MEMORY_ERROR;
+__attribute__((target("avx2,fma")))
+void accumulate_row_avx2_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    ) {
+    double sums[4];  // lanes to write back, AVX2 has no scatter
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m256d valueA = _mm256_set1_pd(matrix_a->values[indexA]);
+        __m128d valueA1 = _mm256_castpd256_pd128(valueA);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        // The columns of a row of B are distinct, so the 4 lanes never hit the same entry
+        for (; indexB + 4 <= rowBEnd; indexB += 4) {
+            __m256i columns = _mm256_loadu_si256((const __m256i*) (matrix_b->colIndices + indexB));
+            __m256d valuesC = _mm256_i64gather_pd(accumulator, columns, sizeof(double));
+            valuesC = _mm256_fmadd_pd(valueA, _mm256_loadu_pd(matrix_b->values + indexB), valuesC);
+            _mm256_storeu_pd(sums, valuesC);
+            accumulator[matrix_b->colIndices[indexB]] = sums[0];
+            accumulator[matrix_b->colIndices[indexB + 1]] = sums[1];
+            accumulator[matrix_b->colIndices[indexB + 2]] = sums[2];
+            accumulator[matrix_b->colIndices[indexB + 3]] = sums[3];
         }
 
-        uint64_t* tmp_col_indices = matrix->colIndices;
-        matrix->colIndices = realloc(matrix->colIndices, alloc_size);
-        if (matrix->colIndices == NULL) {
-            // don't free arrays on error, free_csr_matrix() does that in main.c
-            matrix->colIndices = tmp_col_indices;
-            return HEAP_MEMORY_ERROR;
+        for (; indexB < rowBEnd; indexB++) {
+            double* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_sd(valueC, _mm_fmadd_sd(valueA1, _mm_load_sd(matrix_b->values + indexB), _mm_load_sd(valueC)));
         }
     }
-
-    matrix->valuesSize = non_zero_values;  // this ensures an empty line is printed when nnz = 0
-
-    return 0;
 }
 
-int _clean_up_matrix_arrays(Matrix* matrix, uint64_t* non_zero_values) {
-    *non_zero_values = 0;
-    uint64_t removed = 0;  // how many zero values were removed?
-    uint64_t row_beg = matrix->rowPointers[0];
+__attribute__((target("avx512f,avx512cd,fma")))
+void accumulate_row_avx512_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    ) {
+    for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+        __m512d valueA = _mm512_set1_pd(matrix_a->values[indexA]);
+        __m128d valueA1 = _mm512_castpd512_pd128(valueA);
+        uint64_t rowB = matrix_a->colIndices[indexA];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        uint64_t indexB = matrix_b->rowPointers[rowB];
+
+        for (; indexB + 8 <= rowBEnd; indexB += 8) {
+            __m512i columns = _mm512_loadu_si512(matrix_b->colIndices + indexB);
+            __m512i conflicts = _mm512_conflict_epi64(columns);
+            if (_mm512_test_epi64_mask(conflicts, conflicts)) {
+                // Two lanes hit the same column (not a valid CSR row), a scatter would lose one of them
+                for (uint64_t i = indexB; i < indexB + 8; i++) {
+                    accumulator[matrix_b->colIndices[i]] += (double) matrix_a->values[indexA] * matrix_b->values[i];
+                }
+                continue;
+            }
+            __m512d valuesC = _mm512_i64gather_pd(columns, accumulator, sizeof(double));
+            valuesC = _mm512_fmadd_pd(valueA, _mm512_loadu_pd(matrix_b->values + indexB), valuesC);
+            _mm512_i64scatter_pd(accumulator, columns, valuesC, sizeof(double));
+        }
+
+        for (; indexB < rowBEnd; indexB++) {
+            double* valueC = accumulator + matrix_b->colIndices[indexB];
+            _mm_store_sd(valueC, _mm_fmadd_sd(valueA1, _mm_load_sd(matrix_b->values + indexB), _mm_load_sd(valueC)));
+        }
+    }
+}
+
+static accumulate_row_fn best_kernel = NULL;  // resolved on the first call of best_row_kernel()
+
+accumulate_row_fn best_row_kernel(void) {
+    accumulate_row_fn kernel = __atomic_load_n(&best_kernel, __ATOMIC_ACQUIRE);
+    if (kernel != NULL) {
+        return kernel;
+    }
+
+    // Every thread resolving at the same time finds the same kernel, so racing is harmless
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("fma")) {
+        kernel = &accumulate_row_avx512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernel = &accumulate_row_avx2;
+    } else {
+        kernel = &accumulate_row_scalar;  // SSE2 is part of x86-64, the compiler already uses it here
+    }
+    __atomic_store_n(&best_kernel, kernel, __ATOMIC_RELEASE);
+    return kernel;
+}
+
+const char* row_kernel_name(accumulate_row_fn kernel) {
+    if (kernel == &accumulate_row_avx512) {
+        return "AVX-512";
+    }
+    if (kernel == &accumulate_row_avx2) {
+        return "AVX2";
+    }
+    return "scalar";
+}
+
+int multiply_V7(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    ) {
+    // Two-phase Gustavson, AVX2 gather + FMA
+    return multiply_with_row_kernel(matrix_a, matrix_b, matrix_result, &accumulate_row_avx2);
+}
+
+int multiply_V8(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    ) {
+    // Two-phase Gustavson, AVX-512 gather + conflict-checked scatter + FMA
+    return multiply_with_row_kernel(matrix_a, matrix_b, matrix_result, &accumulate_row_avx512);
+}
+
+void _shrink_result_arrays(void** values, const size_t value_size, uint64_t** colIndices, const uint64_t size) {
+    if (size) {
+        void* tmp_values = realloc(*values, value_size * size);
+        if (tmp_values != NULL) {  // on failure the larger array is still valid
+            *values = tmp_values;
+        }
+        uint64_t* tmp_col_indices = realloc(*colIndices, sizeof(uint64_t) * size);
+        if (tmp_col_indices != NULL) {
+            *colIndices = tmp_col_indices;
+        }
+    }
+}
+
+// The two-phase Gustavson kernels are generated from csrtemplate.h
+// V6 - V8: 64-bit indices, float values and accumulator
+#define CSR_MATRIX Matrix
+#define CSR_INDEX uint64_t
+#define CSR_RESULT Matrix
+#define CSR_VALUE float
+#define CSR_ACCUM float
+#define CSR_SYMBOLIC symbolic_multiply
+#define CSR_NUMERIC multiply_V6
+#define CSR_KERNEL_DRIVER multiply_with_row_kernel
+#define CSR_ROW_FN accumulate_row_fn
+#include "csrtemplate.h"
+
+void init_multiply_plan(MultiplyPlan* const plan, const int scatter_flag) {
+    memset(plan, 0, sizeof(MultiplyPlan));
+    plan->scatterFlag = scatter_flag;
+}
+
+void free_multiply_plan(MultiplyPlan* const plan) {
+    free_pointers(3, plan->rowPointers, plan->colIndices, plan->scatter);
+    init_multiply_plan(plan, plan->scatterFlag);
+}
+
+void init_multiply_chain(MultiplyChain* const chain) {
+    memset(chain, 0, sizeof(MultiplyChain));
+}
+
+void free_multiply_chain(MultiplyChain* const chain) {
+    if (chain->workspaces != NULL) {
+        for (unsigned int i = 0; i + 1 < chain->count; i++) {
+            free_multiply_workspace(&chain->workspaces[i]);
+        }
+    }
+    free_pointers(
+        6, chain->split, chain->nnz, chain->flops, chain->workspaces, chain->products, chain->busy
+        );
+    init_multiply_chain(chain);
+}
+
+int choose_chain_order(const Matrix* const* const operands, const unsigned int count, MultiplyChain* const chain) {
+    free_multiply_chain(chain);
+
+    const uint64_t cells = (uint64_t) count * count;
+    chain->split = malloc_safe(sizeof(unsigned int), cells);
+    chain->nnz = malloc_safe(sizeof(double), cells);
+    chain->flops = malloc_safe(sizeof(double), cells);
+    chain->workspaces = malloc_safe(sizeof(MultiplyWorkspace), count - 1);
+    chain->products = calloc(count - 1, sizeof(Matrix));
+    chain->busy = calloc(count - 1, sizeof(int));
+    double* pair_flops = malloc_safe(sizeof(double), count - 1);  // exact flops of operands k and k+1
+    if (chain->split == NULL || chain->nnz == NULL || chain->flops == NULL || chain->workspaces == NULL
+            || chain->products == NULL || chain->busy == NULL || pair_flops == NULL) {
+        free(pair_flops);
+        free_multiply_chain(chain);
+        return HEAP_MEMORY_ERROR;
+    }
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        init_multiply_workspace(&chain->workspaces[i]);
+    }
+    chain->count = count;
+
+    for (unsigned int k = 0; k < count; k++) {
+        chain->split[k * count + k] = k;
+        chain->nnz[k * count + k] = (double) operands[k]->rowPointers[operands[k]->noRows];
+        chain->flops[k * count + k] = 0;
+    }
+    for (unsigned int k = 0; k + 1 < count; k++) {
+        uint64_t* row_flops;
+        if (compute_row_flops(operands[k], operands[k + 1], &row_flops) == HEAP_MEMORY_ERROR) {
+            free(pair_flops);
+            free_multiply_chain(chain);
+            return HEAP_MEMORY_ERROR;
+        }
+        pair_flops[k] = (double) row_flops[operands[k]->noRows];
+        free(row_flops);
+    }
+
+    // Subchains by increasing length, so both factors of every split are known
+    for (unsigned int length = 2; length <= count; length++) {
+        for (unsigned int first = 0; first + length <= count; first++) {
+            const unsigned int last = first + length - 1;
+            double best_flops = -1;
+            double best_step = 0;
+            for (unsigned int k = first; k < last; k++) {
+                const double nnz_k = chain->nnz[k * count + k];
+                const double nnz_next = chain->nnz[(k + 1) * count + k + 1];
+                const double scale_left = nnz_k > 0 ? chain->nnz[first * count + k] / nnz_k : 0;
+                const double scale_right = nnz_next > 0 ? chain->nnz[(k + 1) * count + last] / nnz_next : 0;
+                const double step = pair_flops[k] * scale_left * scale_right;
+                const double flops = chain->flops[first * count + k] + chain->flops[(k + 1) * count + last] + step;
+                if (best_flops < 0 || flops < best_flops) {
+                    best_flops = flops;
+                    best_step = step;
+                    chain->split[first * count + last] = k;
+                }
+            }
+            const double entries = (double) operands[first]->noRows * (double) operands[last]->noCols;
+            chain->nnz[first * count + last] = best_step > 0 ? best_step * entries / (best_step + entries) : 0;
+            chain->flops[first * count + last] = best_flops;
+        }
+    }
+
+    free(pair_flops);
+    return 0;
+}
+
+void init_multiply_batch(MultiplyBatch* const batch) {
+    memset(batch, 0, sizeof(MultiplyBatch));
+}
+
+void free_multiply_batch(MultiplyBatch* const batch) {
+    free_pointers(4, batch->slab, batch->markers, batch->accumulators, batch->tasks);
+    init_multiply_batch(batch);
+}
+
+void* batch_bound_task(void* void_task) {
+    struct BatchTask* task = (struct BatchTask*) void_task;
+
+    for (uint64_t i = task->first; i < task->last; i++) {
+        const Matrix* matrix_a = task->matricesA[i];
+        const Matrix* matrix_b = task->matricesB[i];
+        uint64_t bound = 0;
+        for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+            uint64_t flops = 0;
+            for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+                uint64_t rowB = matrix_a->colIndices[indexA];
+                flops += matrix_b->rowPointers[rowB + 1] - matrix_b->rowPointers[rowB];
+            }
+            bound += flops < matrix_b->noCols ? flops : matrix_b->noCols;
+        }
+        task->results[i].valuesSize = bound;
+    }
+
+    return NULL;
+}
+
+void* batch_numeric_task(void* void_task) {
+    struct BatchTask* task = (struct BatchTask*) void_task;
+
+    for (uint64_t i = task->first; i < task->last; i++) {
+        Matrix* result = &task->results[i];
+        result->valuesSize = _multiply_V6(
+            task->matricesA[i], task->matricesB[i], result, task->accumulator, task->marker
+            );
+    }
+
+    return NULL;
+}
+
+void spmm_rows_scalar(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        float* rowC = matrix_result->values + rowA * matrix_result->stride;
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            float valueA = matrix_a->values[indexA];
+            const float* rowB = matrix_b->values + matrix_a->colIndices[indexA] * matrix_b->stride;
+            for (uint64_t col = 0; col < matrix_b->noCols; col++) {
+                rowC[col] += valueA * rowB[col];
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void spmm_rows_avx2(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    // The strides are multiples of 16 floats, so the last block always has 16 columns
+    const uint64_t stride = matrix_b->stride;
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        const uint64_t rowStart = matrix_a->rowPointers[rowA];
+        const uint64_t rowEnd = matrix_a->rowPointers[rowA + 1];
+        float* rowC = matrix_result->values + rowA * matrix_result->stride;
+
+        uint64_t col = 0;
+        for (; col + 32 <= stride; col += 32) {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            __m256 sum2 = _mm256_setzero_ps();
+            __m256 sum3 = _mm256_setzero_ps();
+            for (uint64_t indexA = rowStart; indexA < rowEnd; indexA++) {
+                __m256 valueA = _mm256_set1_ps(matrix_a->values[indexA]);
+                const float* rowB = matrix_b->values + matrix_a->colIndices[indexA] * stride + col;
+                sum0 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB), sum0);
+                sum1 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB + 8), sum1);
+                sum2 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB + 16), sum2);
+                sum3 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB + 24), sum3);
+            }
+            _mm256_store_ps(rowC + col, sum0);
+            _mm256_store_ps(rowC + col + 8, sum1);
+            _mm256_store_ps(rowC + col + 16, sum2);
+            _mm256_store_ps(rowC + col + 24, sum3);
+        }
+
+        if (col < stride) {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            for (uint64_t indexA = rowStart; indexA < rowEnd; indexA++) {
+                __m256 valueA = _mm256_set1_ps(matrix_a->values[indexA]);
+                const float* rowB = matrix_b->values + matrix_a->colIndices[indexA] * stride + col;
+                sum0 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB), sum0);
+                sum1 = _mm256_fmadd_ps(valueA, _mm256_load_ps(rowB + 8), sum1);
+            }
+            _mm256_store_ps(rowC + col, sum0);
+            _mm256_store_ps(rowC + col + 8, sum1);
+        }
+    }
+}
+
+__attribute__((target("avx512f,fma")))
+void spmm_rows_avx512(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    // The strides are multiples of 16 floats, one register per block of 16 columns
+    const uint64_t stride = matrix_b->stride;
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        const uint64_t rowStart = matrix_a->rowPointers[rowA];
+        const uint64_t rowEnd = matrix_a->rowPointers[rowA + 1];
+        float* rowC = matrix_result->values + rowA * matrix_result->stride;
+
+        uint64_t col = 0;
+        for (; col + 64 <= stride; col += 64) {
+            __m512 sum0 = _mm512_setzero_ps();
+            __m512 sum1 = _mm512_setzero_ps();
+            __m512 sum2 = _mm512_setzero_ps();
+            __m512 sum3 = _mm512_setzero_ps();
+            for (uint64_t indexA = rowStart; indexA < rowEnd; indexA++) {
+                __m512 valueA = _mm512_set1_ps(matrix_a->values[indexA]);
+                const float* rowB = matrix_b->values + matrix_a->colIndices[indexA] * stride + col;
+                sum0 = _mm512_fmadd_ps(valueA, _mm512_load_ps(rowB), sum0);
+                sum1 = _mm512_fmadd_ps(valueA, _mm512_load_ps(rowB + 16), sum1);
+                sum2 = _mm512_fmadd_ps(valueA, _mm512_load_ps(rowB + 32), sum2);
+                sum3 = _mm512_fmadd_ps(valueA, _mm512_load_ps(rowB + 48), sum3);
+            }
+            _mm512_store_ps(rowC + col, sum0);
+            _mm512_store_ps(rowC + col + 16, sum1);
+            _mm512_store_ps(rowC + col + 32, sum2);
+            _mm512_store_ps(rowC + col + 48, sum3);
+        }
+
+        for (; col < stride; col += 16) {
+            __m512 sum = _mm512_setzero_ps();
+            for (uint64_t indexA = rowStart; indexA < rowEnd; indexA++) {
+                __m512 valueA = _mm512_set1_ps(matrix_a->values[indexA]);
+                const float* rowB = matrix_b->values + matrix_a->colIndices[indexA] * stride + col;
+                sum = _mm512_fmadd_ps(valueA, _mm512_load_ps(rowB), sum);
+            }
+            _mm512_store_ps(rowC + col, sum);
+        }
+    }
+}
+
+void spmv_rows_scalar(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        float sum = 0;
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            sum += matrix_a->values[indexA] * matrix_b->values[matrix_a->colIndices[indexA]];
+        }
+        matrix_result->values[rowA] = sum;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void spmv_rows_avx2(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        const uint64_t rowEnd = matrix_a->rowPointers[rowA + 1];
+        uint64_t indexA = matrix_a->rowPointers[rowA];
+
+        __m128 sums = _mm_setzero_ps();
+        for (; indexA + 4 <= rowEnd; indexA += 4) {
+            __m256i columns = _mm256_loadu_si256((const __m256i*) (matrix_a->colIndices + indexA));
+            __m128 valuesB = _mm256_i64gather_ps(matrix_b->values, columns, sizeof(float));
+            sums = _mm_fmadd_ps(_mm_loadu_ps(matrix_a->values + indexA), valuesB, sums);
+        }
+        sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+        sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+
+        float sum = _mm_cvtss_f32(sums);
+        for (; indexA < rowEnd; indexA++) {
+            sum += matrix_a->values[indexA] * matrix_b->values[matrix_a->colIndices[indexA]];
+        }
+        matrix_result->values[rowA] = sum;
+    }
+}
+
+__attribute__((target("avx512f,fma")))
+void spmv_rows_avx512(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    ) {
+    for (uint64_t rowA = first_row; rowA < last_row; rowA++) {
+        const uint64_t rowEnd = matrix_a->rowPointers[rowA + 1];
+        uint64_t indexA = matrix_a->rowPointers[rowA];
+
+        __m256 sums = _mm256_setzero_ps();
+        for (; indexA + 8 <= rowEnd; indexA += 8) {
+            __m512i columns = _mm512_loadu_si512(matrix_a->colIndices + indexA);
+            __m256 valuesB = _mm512_i64gather_ps(columns, matrix_b->values, sizeof(float));
+            sums = _mm256_fmadd_ps(_mm256_loadu_ps(matrix_a->values + indexA), valuesB, sums);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+
+        float sum = _mm_cvtss_f32(half);
+        for (; indexA < rowEnd; indexA++) {
+            sum += matrix_a->values[indexA] * matrix_b->values[matrix_a->colIndices[indexA]];
+        }
+        matrix_result->values[rowA] = sum;
+    }
+}
+
+static dense_rows_fn best_spmm = NULL;  // resolved on the first call of best_spmm_kernel()
+static dense_rows_fn best_spmv = NULL;  // resolved on the first call of best_spmv_kernel()
+
+dense_rows_fn _best_dense_kernel(
+    dense_rows_fn* const cached, dense_rows_fn avx512, dense_rows_fn avx2, dense_rows_fn scalar
+    ) {
+    dense_rows_fn kernel = __atomic_load_n(cached, __ATOMIC_ACQUIRE);
+    if (kernel != NULL) {
+        return kernel;
+    }
+
+    // Same as best_row_kernel(), racing threads find the same kernel
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+        kernel = avx512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernel = avx2;
+    } else {
+        kernel = scalar;
+    }
+    __atomic_store_n(cached, kernel, __ATOMIC_RELEASE);
+    return kernel;
+}
+
+dense_rows_fn best_spmm_kernel(void) {
+    return _best_dense_kernel(&best_spmm, &spmm_rows_avx512, &spmm_rows_avx2, &spmm_rows_scalar);
+}
+
+dense_rows_fn best_spmv_kernel(void) {
+    return _best_dense_kernel(&best_spmv, &spmv_rows_avx512, &spmv_rows_avx2, &spmv_rows_scalar);
+}
+
+const char* dense_kernel_name(dense_rows_fn kernel) {
+    if (kernel == &spmm_rows_avx512 || kernel == &spmv_rows_avx512) {
+        return "AVX-512";
+    }
+    if (kernel == &spmm_rows_avx2 || kernel == &spmv_rows_avx2) {
+        return "AVX2";
+    }
+    return "scalar";
+}
+
+void* dense_rows_task(void* void_arg) {
+    struct DenseRowsArg* arg = (struct DenseRowsArg*) void_arg;
+    arg->kernel(arg->matrix_a, arg->matrix_b, arg->matrix_result, arg->first_row, arg->last_row);
+    return NULL;
+}
+
+uint64_t find_chunk_end(
+    const uint64_t* const prefix, const uint64_t noRows, const uint64_t first_row, const uint64_t weight
+    ) {
+    // First row r after first_row with prefix[r] + r >= weight
+    uint64_t low = first_row;
+    uint64_t high = noRows;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (prefix[middle] + middle < weight) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+uint64_t fill_complement_offsets(
+    const Matrix* const restrict mask, const uint64_t noCols, const uint64_t* const restrict row_flops,
+    uint64_t* const restrict rowPointers
+    ) {
+    rowPointers[0] = 0;
+    for (uint64_t row = 0; row < mask->noRows; row++) {
+        uint64_t flops = row_flops[row + 1] - row_flops[row];
+        uint64_t open = noCols - (mask->rowPointers[row + 1] - mask->rowPointers[row]);
+        rowPointers[row + 1] = rowPointers[row] + (flops < open ? flops : open);
+    }
+    return rowPointers[mask->noRows];
+}
+
+void* masked_rows_task(void* void_arg) {
+    struct MaskedRowsArg* arg = (struct MaskedRowsArg*) void_arg;
+    const Matrix* matrix_a = arg->matrix_a;
+    const Matrix* matrix_b = arg->matrix_b;
+    const Matrix* mask = arg->mask;
+    Matrix* matrix_result = arg->matrix_result;
+    float* accumulator = arg->accumulator;
+    uint64_t* marker = arg->marker;
+
+    for (uint64_t rowA = arg->first_row; rowA < arg->last_row; rowA++) {
+        const uint64_t maskBeg = mask->rowPointers[rowA];
+        const uint64_t maskEnd = mask->rowPointers[rowA + 1];
+        const uint64_t maskStamp = 2 * rowA + 1;  // marker of the columns of the mask row
+        const uint64_t seenStamp = 2 * rowA + 2;  // marker of the columns of C found in this row
+        uint64_t rowCBeg = matrix_result->rowPointers[rowA];
+        uint64_t rowCEnd = rowCBeg;
+
+        // Nothing of an empty mask row is kept
+        if (!arg->complement && maskBeg == maskEnd) {
+            arg->rowNnz[rowA] = 0;
+            continue;
+        }
+        for (uint64_t indexM = maskBeg; indexM < maskEnd; indexM++) {
+            marker[mask->colIndices[indexM]] = maskStamp;
+        }
+
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            float valueA = matrix_a->values[indexA];
+            uint64_t rowB = matrix_a->colIndices[indexA];
+
+            if (arg->complement) {
+                // Columns of the mask row are skipped, the others are collected like in V6
+                for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                    uint64_t columnB = matrix_b->colIndices[indexB];
+                    if (marker[columnB] == maskStamp) {
+                        continue;
+                    }
+                    if (marker[columnB] != seenStamp) {
+                        marker[columnB] = seenStamp;
+                        matrix_result->colIndices[rowCEnd++] = columnB;
+                    }
+                    accumulator[columnB] += valueA * matrix_b->values[indexB];
+                }
+            } else {
+                // Only the columns of the mask row are accumulated
+                for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                    uint64_t columnB = matrix_b->colIndices[indexB];
+                    if (marker[columnB] == maskStamp) {
+                        accumulator[columnB] += valueA * matrix_b->values[indexB];
+                    }
+                }
+            }
+        }
+
+        // Gather the row from the accumulator and reset it, exact zeros are dropped like in V6
+        uint64_t valuesEnd = rowCBeg;
+        if (arg->complement) {
+            for (uint64_t i = rowCBeg; i < rowCEnd; i++) {
+                uint64_t columnC = matrix_result->colIndices[i];
+                float valueC = accumulator[columnC];
+                accumulator[columnC] = 0;
+                if (valueC != 0) {
+                    matrix_result->values[valuesEnd] = valueC;
+                    matrix_result->colIndices[valuesEnd++] = columnC;
+                }
+            }
+        } else {
+            for (uint64_t indexM = maskBeg; indexM < maskEnd; indexM++) {
+                uint64_t columnC = mask->colIndices[indexM];
+                float valueC = accumulator[columnC];
+                accumulator[columnC] = 0;
+                if (valueC != 0) {
+                    matrix_result->values[valuesEnd] = valueC;
+                    matrix_result->colIndices[valuesEnd++] = columnC;
+                }
+            }
+        }
+        arg->rowNnz[rowA] = valuesEnd - rowCBeg;
+    }
+
+    return NULL;
+}
+
+int multiply_plan_matches(
+    const MultiplyPlan* const plan, const Matrix* const matrix_a, const Matrix* const matrix_b
+    ) {
+    return plan->rowPointers != NULL &&
+        plan->rowsA == matrix_a->noRows && plan->colsA == matrix_a->noCols &&
+        plan->valuesSizeA == matrix_a->valuesSize &&
+        plan->rowsB == matrix_b->noRows && plan->colsB == matrix_b->noCols &&
+        plan->valuesSizeB == matrix_b->valuesSize;
+}
+
+int create_multiply_plan(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    MultiplyPlan* const restrict plan
+    ) {
+    free_multiply_plan(plan);
+
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    uint64_t* marker = malloc_safe(sizeof(uint64_t), matrix_b->noCols);
+    if (rowPointers == NULL || marker == NULL) {
+        free_pointers(2, rowPointers, marker);
+        return HEAP_MEMORY_ERROR;
+    }
+    _symbolic_multiply(matrix_a, matrix_b, rowPointers, marker);
+
+    // At least one element, so that an empty result is not mistaken for an error
+    uint64_t valuesSize = rowPointers[matrix_a->noRows];
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), valuesSize ? valuesSize : 1);
+
+    // position[col] is the index of col in the current row of C, only needed for the scatter map
+    uint64_t productCount = 0;
+    uint64_t* scatter = NULL;
+    uint64_t* position = NULL;
+    if (plan->scatterFlag && colIndices != NULL) {
+        for (uint64_t indexA = 0; indexA < matrix_a->valuesSize; indexA++) {
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            productCount += matrix_b->rowPointers[rowB + 1] - matrix_b->rowPointers[rowB];
+        }
+        scatter = malloc_safe(sizeof(uint64_t), productCount ? productCount : 1);
+        position = malloc_safe(sizeof(uint64_t), matrix_b->noCols);
+        if (scatter == NULL || position == NULL) {
+            free_pointers(2, scatter, position);
+            free(colIndices);
+            colIndices = NULL;
+        }
+    }
+    if (colIndices == NULL) {
+        free_pointers(2, rowPointers, marker);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // Second pass over the products: the columns of every row in the order of V6
+    memset(marker, 0xff, sizeof(uint64_t) * matrix_b->noCols);
+    uint64_t product = 0;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t rowCEnd = rowPointers[rowA];
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                uint64_t columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA) {
+                    marker[columnB] = rowA;
+                    if (scatter != NULL) {
+                        position[columnB] = rowCEnd;
+                    }
+                    colIndices[rowCEnd++] = columnB;
+                }
+                if (scatter != NULL) {
+                    scatter[product++] = position[columnB];
+                }
+            }
+        }
+    }
+    free_pointers(2, marker, position);
+
+    plan->rowsA = matrix_a->noRows;
+    plan->colsA = matrix_a->noCols;
+    plan->valuesSizeA = matrix_a->valuesSize;
+    plan->rowsB = matrix_b->noRows;
+    plan->colsB = matrix_b->noCols;
+    plan->valuesSizeB = matrix_b->valuesSize;
+    plan->rowPointers = rowPointers;
+    plan->colIndices = colIndices;
+    plan->scatter = scatter;
+    plan->productCount = productCount;
+
+    return 0;
+}
+
+int multiply_planned(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result,
+    const MultiplyPlan* const restrict plan
+    ) {
+    uint64_t valuesSize = plan->rowPointers[matrix_a->noRows];
+    uint64_t allocSize = valuesSize ? valuesSize : 1;
+    float* values = malloc_safe(sizeof(float), allocSize);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), allocSize);
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    // Without the scatter map the products are accumulated densely like in V6
+    float* accumulator = plan->scatter == NULL ? calloc(matrix_b->noCols, sizeof(float)) : NULL;
+    if (values == NULL || colIndices == NULL || rowPointers == NULL || (plan->scatter == NULL && accumulator == NULL)) {
+        free_pointers(4, values, colIndices, rowPointers, accumulator);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    uint64_t valuesEndPtr = 0;
+    rowPointers[0] = 0;
+    if (plan->scatter != NULL) {
+        // Every product goes straight to its value of C
+        memset(values, 0, sizeof(float) * valuesSize);
+        const uint64_t* scatter = plan->scatter;
+        for (uint64_t indexA = 0; indexA < matrix_a->valuesSize; indexA++) {
+            float valueA = matrix_a->values[indexA];
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                values[*scatter++] += valueA * matrix_b->values[indexB];
+            }
+        }
+
+        // Drop cancelled values in place, valuesEndPtr never overtakes i
+        for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+            for (uint64_t i = plan->rowPointers[rowA]; i < plan->rowPointers[rowA + 1]; i++) {
+                if (values[i] != 0) {
+                    values[valuesEndPtr] = values[i];
+                    colIndices[valuesEndPtr++] = plan->colIndices[i];
+                }
+            }
+            rowPointers[rowA + 1] = valuesEndPtr;
+        }
+    } else {
+        for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+            for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+                float valueA = matrix_a->values[indexA];
+                uint64_t rowB = matrix_a->colIndices[indexA];
+                for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                    accumulator[matrix_b->colIndices[indexB]] += valueA * matrix_b->values[indexB];
+                }
+            }
+
+            // The columns of the row come from the plan, no marker is needed
+            for (uint64_t i = plan->rowPointers[rowA]; i < plan->rowPointers[rowA + 1]; i++) {
+                uint64_t columnC = plan->colIndices[i];
+                float valueC = accumulator[columnC];
+                accumulator[columnC] = 0;
+                if (valueC != 0) {
+                    values[valuesEndPtr] = valueC;
+                    colIndices[valuesEndPtr++] = columnC;
+                }
+            }
+            rowPointers[rowA + 1] = valuesEndPtr;
+        }
+        free(accumulator);
+    }
+
+    // Only shrink if values cancelled out
+    if (valuesEndPtr < valuesSize) {
+        _shrink_result_arrays((void**) &values, sizeof(float), &colIndices, valuesEndPtr);
+    }
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = matrix_b->noCols;
+    matrix_result->values = values;
+    matrix_result->valuesSize = valuesEndPtr;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    return 0;
+}
+
+// V6 - V8 with PRECISION_MIXED: float values, double accumulator
+#define CSR_MATRIX Matrix
+#define CSR_INDEX uint64_t
+#define CSR_RESULT Matrix
+#define CSR_VALUE float
+#define CSR_ACCUM double
+#define CSR_NUMERIC multiply_V6_mixed
+#define CSR_KERNEL_DRIVER multiply_with_row_kernel_mixed
+#define CSR_ROW_FN accumulate_row_mixed_fn
+#include "csrtemplate.h"
+
+// V6 - V8 with PRECISION_DOUBLE: double values and accumulator
+#define CSR_MATRIX DoubleMatrix
+#define CSR_INDEX uint64_t
+#define CSR_RESULT DoubleMatrix
+#define CSR_VALUE double
+#define CSR_ACCUM double
+#define CSR_SYMBOLIC symbolic_multiply_double
+#define CSR_NUMERIC multiply_V6_double
+#define CSR_KERNEL_DRIVER multiply_with_row_kernel_double
+#define CSR_ROW_FN accumulate_row_double_fn
+#include "csrtemplate.h"
+
+// V9: 32-bit indices, float values and accumulator
+#define CSR_MATRIX CompactMatrix
+#define CSR_INDEX uint32_t
+#define CSR_RESULT Matrix
+#define CSR_VALUE float
+#define CSR_ACCUM float
+#define CSR_SYMBOLIC symbolic_multiply_compact
+#define CSR_NUMERIC multiply_V9
+#include "csrtemplate.h"
+
+// V9 with PRECISION_MIXED
+#define CSR_MATRIX CompactMatrix
+#define CSR_INDEX uint32_t
+#define CSR_RESULT Matrix
+#define CSR_VALUE float
+#define CSR_ACCUM double
+#define CSR_NUMERIC multiply_V9_mixed
+#include "csrtemplate.h"
+
+int multiply_V10(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    ) {
+    // Expand-sort-compress Gustavson, the products of a tile of rows are sorted by (row, column)
+    double start = monotonic_seconds();
+    uint64_t* row_flops;
+    if (compute_row_flops(matrix_a, matrix_b, &row_flops) == HEAP_MEMORY_ERROR) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // A row with more products than a tile gets a tile of its own
+    uint64_t tile_capacity = ESC_TILE_PRODUCTS;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t flops = row_flops[rowA + 1] - row_flops[rowA];
+        tile_capacity = flops > tile_capacity ? flops : tile_capacity;
+    }
+
+    // The key of a product is (row in the tile << col_bits) | column
+    unsigned int col_bits = matrix_b->noCols > 1 ? 64 - __builtin_clzll(matrix_b->noCols - 1) : 0;
+    uint64_t max_tile_rows = col_bits == 0 ? UINT64_MAX : col_bits < 64 ? (uint64_t) 1 << (64 - col_bits) : 1;
+
+    // Two buffers each for the keys and values, the radix sort moves between them
+    uint64_t* keys = malloc_safe(2 * sizeof(uint64_t), tile_capacity);
+    float* values = malloc_safe(2 * sizeof(float), tile_capacity);
+    // The result grows like a vector, the hint is only the first capacity
+    uint64_t capacity = matrix_a->valuesSize + matrix_b->valuesSize + 1;
+    float* result_values = malloc_safe(sizeof(float), capacity);
+    uint64_t* result_col_indices = malloc_safe(sizeof(uint64_t), capacity);
+    uint64_t* result_row_pointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    if (keys == NULL || values == NULL || result_values == NULL || result_col_indices == NULL || result_row_pointers == NULL) {
+        free_pointers(6, row_flops, keys, values, result_values, result_col_indices, result_row_pointers);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // The products per row and the tiles are the symbolic phase, expand-sort-compress the numeric
+    double numeric_start = monotonic_seconds();
+    uint64_t nnz = 0;
+    result_row_pointers[0] = 0;
+    uint64_t rowA = 0;
+    while (rowA < matrix_a->noRows) {
+        // Take rows as long as their products fit into the tile
+        uint64_t tile_beg = rowA++;
+        while (rowA < matrix_a->noRows && rowA - tile_beg < max_tile_rows &&
+            row_flops[rowA + 1] - row_flops[tile_beg] <= tile_capacity) {
+            rowA++;
+        }
+        uint64_t products = row_flops[rowA] - row_flops[tile_beg];
+
+        // Expand
+        uint64_t product = 0;
+        for (uint64_t row = tile_beg; row < rowA; row++) {
+            uint64_t tile_row = (row - tile_beg) << (col_bits & 63);  // col_bits is 64 only for single row tiles
+            for (uint64_t indexA = matrix_a->rowPointers[row]; indexA < matrix_a->rowPointers[row + 1]; indexA++) {
+                float valueA = matrix_a->values[indexA];
+                uint64_t rowB = matrix_a->colIndices[indexA];
+                for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                    keys[product] = tile_row | matrix_b->colIndices[indexB];
+                    values[product++] = valueA * matrix_b->values[indexB];
+                }
+            }
+        }
+
+        // Sort, stable so the products of a column are summed in the same order as in V6
+        unsigned int key_bits = col_bits + (rowA - tile_beg > 1 ? 64 - __builtin_clzll(rowA - tile_beg - 1) : 0);
+        uint64_t* sorted_keys = keys;
+        float* sorted_values = values;
+        _esc_sort(&sorted_keys, &sorted_values, products, key_bits, keys + tile_capacity, values + tile_capacity);
+
+        // A tile can't have more distinct columns than products
+        if (nnz + products > capacity) {
+            uint64_t new_capacity = capacity * 2 > nnz + products ? capacity * 2 : nnz + products;
+            if (_grow_result_arrays(&result_values, &result_col_indices, new_capacity) == HEAP_MEMORY_ERROR) {
+                free_pointers(6, row_flops, keys, values, result_values, result_col_indices, result_row_pointers);
+                return HEAP_MEMORY_ERROR;
+            }
+            capacity = new_capacity;
+        }
+
+        // Compress: sum the runs of equal keys, the rows of the tile come out one after another
+        uint64_t col_mask = col_bits < 64 ? ((uint64_t) 1 << col_bits) - 1 : UINT64_MAX;
+        uint64_t i = 0;
+        for (uint64_t row = tile_beg; row < rowA; row++) {
+            uint64_t tile_row = row - tile_beg;
+            while (i < products && (col_bits < 64 ? sorted_keys[i] >> col_bits : 0) == tile_row) {
+                uint64_t key = sorted_keys[i];
+                float sum = sorted_values[i++];
+                while (i < products && sorted_keys[i] == key) {
+                    sum += sorted_values[i++];
+                }
+                if (sum != 0) {
+                    result_values[nnz] = sum;
+                    result_col_indices[nnz++] = key & col_mask;
+                }
+            }
+            result_row_pointers[row + 1] = nnz;
+        }
+    }
+    free_pointers(3, row_flops, keys, values);
+
+    // Shrink to the final size, keep one element so an empty result is not mistaken for an error
+    double compaction_start = monotonic_seconds();
+    _shrink_result_arrays((void**) &result_values, sizeof(float), &result_col_indices, nnz ? nnz : 1);
+    last_multiply_phases.symbolic = numeric_start - start;
+    last_multiply_phases.numeric = compaction_start - numeric_start;
+    last_multiply_phases.compaction = monotonic_seconds() - compaction_start;
+    last_multiply_phases.recorded = 1;
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = matrix_b->noCols;
+    matrix_result->values = result_values;
+    matrix_result->valuesSize = nnz;
+    matrix_result->colIndices = result_col_indices;
+    matrix_result->rowPointers = result_row_pointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    return 0;
+}
+
+void _esc_sort(
+    uint64_t** const keys, float** const values, const uint64_t size, const unsigned int key_bits,
+    uint64_t* restrict keys_tmp, float* restrict values_tmp
+    ) {
+    uint64_t* restrict src_keys = *keys;
+    float* restrict src_values = *values;
+
+    if (size < ESC_INSERTION_SORT) {
+        // Stable insertion sort, the radix passes don't pay off for a few products
+        for (uint64_t i = 1; i < size; i++) {
+            uint64_t key = src_keys[i];
+            float value = src_values[i];
+            uint64_t j = i;
+            while (j > 0 && src_keys[j - 1] > key) {
+                src_keys[j] = src_keys[j - 1];
+                src_values[j] = src_values[j - 1];
+                j--;
+            }
+            src_keys[j] = key;
+            src_values[j] = value;
+        }
+        return;
+    }
+
+    // LSD radix sort, one byte per pass
+    for (unsigned int shift = 0; shift < key_bits; shift += 8) {
+        uint64_t counts[256] = {0};
+        for (uint64_t i = 0; i < size; i++) {
+            counts[(src_keys[i] >> shift) & 0xff]++;
+        }
+        if (counts[(src_keys[0] >> shift) & 0xff] == size) {
+            continue;  // every key has the same byte, nothing to move
+        }
+
+        // Prefix sum gives the first position of every byte value
+        uint64_t position = 0;
+        for (unsigned int digit = 0; digit < 256; digit++) {
+            uint64_t count = counts[digit];
+            counts[digit] = position;
+            position += count;
+        }
+
+        for (uint64_t i = 0; i < size; i++) {
+            uint64_t destination = counts[(src_keys[i] >> shift) & 0xff]++;
+            keys_tmp[destination] = src_keys[i];
+            values_tmp[destination] = src_values[i];
+        }
+
+        // The sorted arrays of this pass are the input of the next one
+        uint64_t* swap_keys = src_keys;
+        src_keys = keys_tmp;
+        keys_tmp = swap_keys;
+        float* swap_values = src_values;
+        src_values = values_tmp;
+        values_tmp = swap_values;
+    }
+
+    *keys = src_keys;
+    *values = src_values;
+}
+
+int _grow_result_arrays(float** values, uint64_t** colIndices, const uint64_t capacity) {
+    // realloc_safe() frees the array on error, the caller frees the other one
+    *values = realloc_safe(*values, sizeof(float), capacity);
+    if (*values == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    *colIndices = realloc_safe(*colIndices, sizeof(uint64_t), capacity);
+    if (*colIndices == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    return 0;
+}
+
+int multiply_V11(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    ) {
+    // Column-tiled Gustavson, all rows of A are multiplied with one panel of columns of B at a time
+    double start = monotonic_seconds();
+    uint64_t noCols = matrix_b->noCols;
+    uint64_t panel_cols = l2_cache_size() / COLUMN_PANEL_CACHE_SHARE / (sizeof(float) + sizeof(uint8_t));
+    panel_cols = panel_cols < noCols ? panel_cols : noCols;
+    panel_cols = panel_cols > 0 ? panel_cols : 1;
+
+    // Every row of C gets a slot of its upper bound like in matr_mult_csr()
+    uint64_t* row_flops;
+    if (compute_row_flops(matrix_a, matrix_b, &row_flops) == HEAP_MEMORY_ERROR) {
+        return HEAP_MEMORY_ERROR;
+    }
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    if (rowPointers == NULL) {
+        free(row_flops);
+        return HEAP_MEMORY_ERROR;
+    }
+    uint64_t bin_rows[ROW_BIN_COUNT];
+    uint64_t slots = fill_row_offsets(matrix_a->noRows, noCols, row_flops, rowPointers, bin_rows);
+    free(row_flops);
+
+    Matrix panel_b;
+    uint64_t* cursors = malloc_safe(sizeof(uint64_t), matrix_b->noRows);
+    uint64_t* row_nnz = calloc(matrix_a->noRows + 1, sizeof(uint64_t));
+    float* accumulator = calloc(panel_cols, sizeof(float));
+    uint8_t* flags = calloc(panel_cols, sizeof(uint8_t));
+    float* values = malloc_safe(sizeof(float), slots ? slots : 1);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), slots ? slots : 1);
+    if (cursors == NULL || row_nnz == NULL || accumulator == NULL || flags == NULL || values == NULL ||
+        colIndices == NULL || _order_rows_by_panel(matrix_b, panel_cols, &panel_b) == HEAP_MEMORY_ERROR) {
+        free_pointers(7, rowPointers, cursors, row_nnz, accumulator, flags, values, colIndices);
+        return HEAP_MEMORY_ERROR;
+    }
+    // The cursor of a row of B is its first entry in the current panel
+    memcpy(cursors, panel_b.rowPointers, sizeof(uint64_t) * matrix_b->noRows);
+    double numeric_start = monotonic_seconds();  // the row slots and the panels are the symbolic phase
+
+    for (uint64_t panel_beg = 0; panel_beg < noCols; panel_beg += panel_cols) {
+        uint64_t panel_end = noCols - panel_beg > panel_cols ? panel_beg + panel_cols : noCols;
+
+        for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+            // The part of the row in this panel follows its parts of the previous panels
+            float* rowValues = values + rowPointers[rowA] + row_nnz[rowA];
+            uint64_t* rowColIndices = colIndices + rowPointers[rowA] + row_nnz[rowA];
+            uint64_t size = 0;
+            for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+                float valueA = matrix_a->values[indexA];
+                uint64_t rowB = matrix_a->colIndices[indexA];
+                uint64_t rowBEnd = panel_b.rowPointers[rowB + 1];
+                uint64_t indexB = cursors[rowB];
+                for (; indexB < rowBEnd && panel_b.colIndices[indexB] < panel_end; indexB++) {
+                    uint64_t local = panel_b.colIndices[indexB] - panel_beg;
+                    if (!flags[local]) {
+                        flags[local] = 1;
+                        rowColIndices[size++] = panel_b.colIndices[indexB];
+                    }
+                    accumulator[local] += valueA * panel_b.values[indexB];
+                }
+            }
+
+            // Gather and leave the accumulator and the flags clean for the next row
+            uint64_t nnz = 0;
+            for (uint64_t i = 0; i < size; i++) {
+                uint64_t columnC = rowColIndices[i];
+                float valueC = accumulator[columnC - panel_beg];
+                accumulator[columnC - panel_beg] = 0;
+                flags[columnC - panel_beg] = 0;
+                if (valueC != 0) {
+                    rowValues[nnz] = valueC;
+                    rowColIndices[nnz++] = columnC;
+                }
+            }
+            row_nnz[rowA] += nnz;
+        }
+
+        // Move the cursors behind this panel
+        for (uint64_t rowB = 0; rowB < matrix_b->noRows; rowB++) {
+            uint64_t indexB = cursors[rowB];
+            while (indexB < panel_b.rowPointers[rowB + 1] && panel_b.colIndices[indexB] < panel_end) {
+                indexB++;
+            }
+            cursors[rowB] = indexB;
+        }
+    }
+    if (panel_b.values != matrix_b->values) {
+        free_pointers(2, panel_b.values, panel_b.colIndices);
+    }
+    free_pointers(3, cursors, accumulator, flags);
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = noCols;
+    matrix_result->values = values;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    // Stitch the parts of every row together and give the unused part of the slots back
+    double compaction_start = monotonic_seconds();
+    matrix_result->valuesSize = compact_row_slots(matrix_result, row_nnz);
+    free(row_nnz);
+    _shrink_result_arrays(
+        (void**) &matrix_result->values, sizeof(float), &matrix_result->colIndices,
+        matrix_result->valuesSize ? matrix_result->valuesSize : 1
+        );
+    last_multiply_phases.symbolic = numeric_start - start;
+    last_multiply_phases.numeric = compaction_start - numeric_start;
+    last_multiply_phases.compaction = monotonic_seconds() - compaction_start;
+    last_multiply_phases.recorded = 1;
+
+    return 0;
+}
+
+int _order_rows_by_panel(const Matrix* const matrix_b, const uint64_t panel_cols, Matrix* const panel_b) {
+    *panel_b = *matrix_b;
+
+    // Nothing to do if the entries of every row are already in the order of their panels
+    uint64_t longest_row = 0;
+    int ordered = 1;
+    for (uint64_t rowB = 0; rowB < matrix_b->noRows; rowB++) {
+        uint64_t rowBBeg = matrix_b->rowPointers[rowB];
+        uint64_t rowBEnd = matrix_b->rowPointers[rowB + 1];
+        longest_row = rowBEnd - rowBBeg > longest_row ? rowBEnd - rowBBeg : longest_row;
+        for (uint64_t indexB = rowBBeg + 1; indexB < rowBEnd && ordered; indexB++) {
+            ordered = matrix_b->colIndices[indexB - 1] / panel_cols <= matrix_b->colIndices[indexB] / panel_cols;
+        }
+    }
+    if (ordered) {
+        return 0;
+    }
+
+    // Sort a copy of every row by column, the column is the key
+    uint64_t nnz = matrix_b->rowPointers[matrix_b->noRows];
+    float* values = malloc_safe(sizeof(float), nnz);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), nnz);
+    uint64_t* keys = malloc_safe(2 * sizeof(uint64_t), longest_row);
+    float* row_values = malloc_safe(2 * sizeof(float), longest_row);
+    if (values == NULL || colIndices == NULL || keys == NULL || row_values == NULL) {
+        free_pointers(4, values, colIndices, keys, row_values);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    unsigned int col_bits = matrix_b->noCols > 1 ? 64 - __builtin_clzll(matrix_b->noCols - 1) : 0;
+    for (uint64_t rowB = 0; rowB < matrix_b->noRows; rowB++) {
+        uint64_t rowBBeg = matrix_b->rowPointers[rowB];
+        uint64_t size = matrix_b->rowPointers[rowB + 1] - rowBBeg;
+        memcpy(keys, matrix_b->colIndices + rowBBeg, sizeof(uint64_t) * size);
+        memcpy(row_values, matrix_b->values + rowBBeg, sizeof(float) * size);
+
+        uint64_t* sorted_keys = keys;
+        float* sorted_values = row_values;
+        _esc_sort(&sorted_keys, &sorted_values, size, col_bits, keys + longest_row, row_values + longest_row);
+        memcpy(colIndices + rowBBeg, sorted_keys, sizeof(uint64_t) * size);
+        memcpy(values + rowBBeg, sorted_values, sizeof(float) * size);
+    }
+    free_pointers(2, keys, row_values);
+
+    panel_b->values = values;
+    panel_b->colIndices = colIndices;
+    return 0;
+}
+
+int multiply_V12(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    ) {
+    // Hybrid of dense tiles and Gustavson, the tiles give Ad*Bd, the rows Ad*Bs + As*B
+    const uint64_t tile_elements = DENSE_TILE_SIZE * DENSE_TILE_SIZE;
+    uint64_t noCols = matrix_b->noCols;
+    DenseTiles tiles_a;
+    DenseTiles tiles_b;
+    if (find_dense_tiles(matrix_a, &tiles_a) == HEAP_MEMORY_ERROR) {
+        return HEAP_MEMORY_ERROR;
+    }
+    if (find_dense_tiles(matrix_b, &tiles_b) == HEAP_MEMORY_ERROR) {
+        free_dense_tiles(&tiles_a);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // Without dense tiles on both sides, every value of A is multiplied with all of B
+    const int hybrid = tiles_a.count && tiles_b.count;
+    Matrix remainder_b = *matrix_b;
+    if (hybrid && sparse_remainder(matrix_b, &tiles_b, &remainder_b) == HEAP_MEMORY_ERROR) {
+        free_dense_tiles(&tiles_a);
+        free_dense_tiles(&tiles_b);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // Every row of C gets a slot of its upper bound like in matr_mult_csr(), the products
+    // of the tiles are products of A*B as well
+    uint64_t* row_flops = NULL;
+    uint64_t* rowPointers = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    uint64_t slots = 0;
+    if (rowPointers != NULL && compute_row_flops(matrix_a, matrix_b, &row_flops) == 0) {
+        uint64_t bin_rows[ROW_BIN_COUNT];
+        slots = fill_row_offsets(matrix_a->noRows, noCols, row_flops, rowPointers, bin_rows);
+        free(row_flops);
+    } else {
+        free(rowPointers);
+        rowPointers = NULL;
+    }
+
+    // A tile row of C has at most one tile per tile column of B that has a dense tile
+    uint64_t tiles_c_capacity = tiles_b.count < tiles_b.noTileCols ? tiles_b.count : tiles_b.noTileCols;
+    float* tiles_c = hybrid ? aligned_alloc(DENSE_ALIGNMENT, tiles_c_capacity * tile_elements * sizeof(float)) : NULL;
+    uint64_t* tile_cols_c = malloc_safe(sizeof(uint64_t), tiles_c_capacity ? tiles_c_capacity : 1);
+    uint64_t* tile_slots_c = malloc_safe(sizeof(uint64_t), tiles_b.noTileCols ? tiles_b.noTileCols : 1);
+    uint8_t* dense_a = calloc(tiles_a.noTileCols ? tiles_a.noTileCols : 1, sizeof(uint8_t));
+    uint64_t* row_nnz = calloc(matrix_a->noRows + 1, sizeof(uint64_t));
+    float* accumulator = calloc(noCols ? noCols : 1, sizeof(float));
+    uint8_t* flags = calloc(noCols ? noCols : 1, sizeof(uint8_t));
+    float* values = malloc_safe(sizeof(float), slots ? slots : 1);
+    uint64_t* colIndices = malloc_safe(sizeof(uint64_t), slots ? slots : 1);
+    if (rowPointers == NULL || (hybrid && tiles_c == NULL) || tile_cols_c == NULL || tile_slots_c == NULL ||
+        dense_a == NULL || row_nnz == NULL || accumulator == NULL || flags == NULL || values == NULL ||
+        colIndices == NULL) {
+        free_pointers(10, rowPointers, tiles_c, tile_cols_c, tile_slots_c, dense_a, row_nnz, accumulator, flags,
+            values, colIndices);
+        if (hybrid) {
+            free_pointers(3, remainder_b.values, remainder_b.colIndices, remainder_b.rowPointers);
+        }
+        free_dense_tiles(&tiles_a);
+        free_dense_tiles(&tiles_b);
+        return HEAP_MEMORY_ERROR;
+    }
+    memset(tile_slots_c, 0xff, sizeof(uint64_t) * tiles_b.noTileCols);  // no tile is in slot UINT64_MAX
+
+    tile_kernel_fn kernel = best_tile_kernel();
+    for (uint64_t tileRow = 0; tileRow * DENSE_TILE_SIZE < matrix_a->noRows; tileRow++) {
+        // Multiply the dense tiles of this tile row of A with the dense tiles of B
+        uint64_t tile_count_c = 0;
+        for (uint64_t tileA = tiles_a.tilePointers[tileRow]; hybrid && tileA < tiles_a.tilePointers[tileRow + 1]; tileA++) {
+            uint64_t tileColA = tiles_a.tileCols[tileA];
+            dense_a[tileColA] = 1;
+            for (uint64_t tileB = tiles_b.tilePointers[tileColA]; tileB < tiles_b.tilePointers[tileColA + 1]; tileB++) {
+                uint64_t tileColB = tiles_b.tileCols[tileB];
+                if (tile_slots_c[tileColB] == UINT64_MAX) {
+                    // First product for this tile of C
+                    tile_slots_c[tileColB] = tile_count_c;
+                    tile_cols_c[tile_count_c] = tileColB;
+                    memset(tiles_c + tile_count_c * tile_elements, 0, tile_elements * sizeof(float));
+                    tile_count_c++;
+                }
+                kernel(
+                    tiles_a.values + tileA * tile_elements, tiles_b.values + tileB * tile_elements,
+                    tiles_c + tile_slots_c[tileColB] * tile_elements
+                    );
+            }
+        }
+
+        uint64_t rowEnd = (tileRow + 1) * DENSE_TILE_SIZE < matrix_a->noRows ? (tileRow + 1) * DENSE_TILE_SIZE : matrix_a->noRows;
+        for (uint64_t rowA = tileRow * DENSE_TILE_SIZE; rowA < rowEnd; rowA++) {
+            float* rowValues = values + rowPointers[rowA];
+            uint64_t* rowColIndices = colIndices + rowPointers[rowA];
+            uint64_t size = 0;
+            for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+                float valueA = matrix_a->values[indexA];
+                uint64_t rowB = matrix_a->colIndices[indexA];
+
+                // A value in a dense tile only needs the values of B outside of the dense tiles
+                const Matrix* part_b = dense_a[rowB / DENSE_TILE_SIZE] ? &remainder_b : matrix_b;
+                for (uint64_t indexB = part_b->rowPointers[rowB]; indexB < part_b->rowPointers[rowB + 1]; indexB++) {
+                    uint64_t columnB = part_b->colIndices[indexB];
+                    if (!flags[columnB]) {
+                        flags[columnB] = 1;
+                        rowColIndices[size++] = columnB;
+                    }
+                    accumulator[columnB] += valueA * part_b->values[indexB];
+                }
+            }
+
+            // Add the row of every tile of C, its zeros are columns without products
+            uint64_t tileRowOffset = (rowA - tileRow * DENSE_TILE_SIZE) * DENSE_TILE_SIZE;
+            for (uint64_t tileC = 0; tileC < tile_count_c; tileC++) {
+                const float* tileRowC = tiles_c + tileC * tile_elements + tileRowOffset;
+                uint64_t firstCol = tile_cols_c[tileC] * DENSE_TILE_SIZE;
+                uint64_t width = noCols - firstCol < DENSE_TILE_SIZE ? noCols - firstCol : DENSE_TILE_SIZE;
+                for (uint64_t col = 0; col < width; col++) {
+                    if (tileRowC[col] != 0) {
+                        uint64_t columnC = firstCol + col;
+                        if (!flags[columnC]) {
+                            flags[columnC] = 1;
+                            rowColIndices[size++] = columnC;
+                        }
+                        accumulator[columnC] += tileRowC[col];
+                    }
+                }
+            }
+
+            // Gather and leave the accumulator and the flags clean for the next row
+            uint64_t nnz = 0;
+            for (uint64_t i = 0; i < size; i++) {
+                uint64_t columnC = rowColIndices[i];
+                float valueC = accumulator[columnC];
+                accumulator[columnC] = 0;
+                flags[columnC] = 0;
+                if (valueC != 0) {
+                    rowValues[nnz] = valueC;
+                    rowColIndices[nnz++] = columnC;
+                }
+            }
+            row_nnz[rowA] = nnz;
+        }
+
+        // Leave the tile lookups clean for the next tile row
+        for (uint64_t tileA = tiles_a.tilePointers[tileRow]; hybrid && tileA < tiles_a.tilePointers[tileRow + 1]; tileA++) {
+            dense_a[tiles_a.tileCols[tileA]] = 0;
+        }
+        for (uint64_t tileC = 0; tileC < tile_count_c; tileC++) {
+            tile_slots_c[tile_cols_c[tileC]] = UINT64_MAX;
+        }
+    }
+    if (hybrid) {
+        free_pointers(3, remainder_b.values, remainder_b.colIndices, remainder_b.rowPointers);
+    }
+    free_dense_tiles(&tiles_a);
+    free_dense_tiles(&tiles_b);
+    free_pointers(6, tiles_c, tile_cols_c, tile_slots_c, dense_a, accumulator, flags);
+
+    matrix_result->noRows = matrix_a->noRows;
+    matrix_result->noCols = noCols;
+    matrix_result->values = values;
+    matrix_result->colIndices = colIndices;
+    matrix_result->rowPointers = rowPointers;
+    matrix_result->rowPointersSize = matrix_a->noRows + 1;
+
+    // Move the rows to the front of their slots and give the unused part back
+    matrix_result->valuesSize = compact_row_slots(matrix_result, row_nnz);
+    free(row_nnz);
+    _shrink_result_arrays(
+        (void**) &matrix_result->values, sizeof(float), &matrix_result->colIndices,
+        matrix_result->valuesSize ? matrix_result->valuesSize : 1
+        );
+
+    return 0;
+}
+
+int find_dense_tiles(const Matrix* const restrict matrix, DenseTiles* const restrict tiles) {
+    const uint64_t tile_elements = DENSE_TILE_SIZE * DENSE_TILE_SIZE;
+    tiles->noTileRows = matrix->noRows / DENSE_TILE_SIZE + (matrix->noRows % DENSE_TILE_SIZE != 0);
+    tiles->noTileCols = matrix->noCols / DENSE_TILE_SIZE + (matrix->noCols % DENSE_TILE_SIZE != 0);
+    tiles->count = 0;
+    tiles->tileCols = NULL;
+    tiles->values = NULL;
+
+    // counts[t] is the number of values of the current tile row in tile column t
+    tiles->tilePointers = malloc_safe(sizeof(uint64_t), tiles->noTileRows + 1);
+    uint64_t* counts = calloc(tiles->noTileCols ? tiles->noTileCols : 1, sizeof(uint64_t));
+    uint64_t* slots = malloc_safe(sizeof(uint64_t), tiles->noTileCols ? tiles->noTileCols : 1);
+    if (tiles->tilePointers == NULL || counts == NULL || slots == NULL) {
+        free_pointers(3, tiles->tilePointers, counts, slots);
+        tiles->tilePointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+    memset(slots, 0xff, sizeof(uint64_t) * tiles->noTileCols);  // no tile is in slot UINT64_MAX
+
+    // The values of a tile row are consecutive, a tile is dense once its count reaches the minimum
+    tiles->tilePointers[0] = 0;
+    for (uint64_t tileRow = 0; tileRow < tiles->noTileRows; tileRow++) {
+        uint64_t rowEnd = (tileRow + 1) * DENSE_TILE_SIZE < matrix->noRows ? (tileRow + 1) * DENSE_TILE_SIZE : matrix->noRows;
+        uint64_t valuesBeg = matrix->rowPointers[tileRow * DENSE_TILE_SIZE];
+        uint64_t valuesEnd = matrix->rowPointers[rowEnd];
+        for (uint64_t index = valuesBeg; index < valuesEnd; index++) {
+            tiles->count += ++counts[matrix->colIndices[index] / DENSE_TILE_SIZE] == DENSE_TILE_MIN_NNZ;
+        }
+        for (uint64_t index = valuesBeg; index < valuesEnd; index++) {
+            counts[matrix->colIndices[index] / DENSE_TILE_SIZE] = 0;
+        }
+        tiles->tilePointers[tileRow + 1] = tiles->count;
+    }
+
+    if (tiles->count) {
+        // The size of a tile is a multiple of DENSE_ALIGNMENT, as aligned_alloc() requires
+        tiles->tileCols = malloc_safe(sizeof(uint64_t), tiles->count);
+        tiles->values = aligned_alloc(DENSE_ALIGNMENT, tiles->count * tile_elements * sizeof(float));
+        if (tiles->tileCols == NULL || tiles->values == NULL) {
+            free_pointers(2, counts, slots);
+            free_dense_tiles(tiles);
+            return HEAP_MEMORY_ERROR;
+        }
+        memset(tiles->values, 0, tiles->count * tile_elements * sizeof(float));
+    }
+
+    // Count again and copy the values of the dense tiles into their blocks
+    for (uint64_t tileRow = 0; tiles->count && tileRow < tiles->noTileRows; tileRow++) {
+        uint64_t rowBeg = tileRow * DENSE_TILE_SIZE;
+        uint64_t rowEnd = rowBeg + DENSE_TILE_SIZE < matrix->noRows ? rowBeg + DENSE_TILE_SIZE : matrix->noRows;
+        uint64_t next = tiles->tilePointers[tileRow];
+        for (uint64_t index = matrix->rowPointers[rowBeg]; index < matrix->rowPointers[rowEnd]; index++) {
+            counts[matrix->colIndices[index] / DENSE_TILE_SIZE]++;
+        }
+        for (uint64_t row = rowBeg; row < rowEnd; row++) {
+            for (uint64_t index = matrix->rowPointers[row]; index < matrix->rowPointers[row + 1]; index++) {
+                uint64_t column = matrix->colIndices[index];
+                uint64_t tileCol = column / DENSE_TILE_SIZE;
+                if (counts[tileCol] < DENSE_TILE_MIN_NNZ) {
+                    continue;
+                }
+                if (slots[tileCol] == UINT64_MAX) {
+                    slots[tileCol] = next;
+                    tiles->tileCols[next++] = tileCol;
+                }
+                float* tile = tiles->values + slots[tileCol] * tile_elements;
+                tile[(row - rowBeg) * DENSE_TILE_SIZE + column % DENSE_TILE_SIZE] = matrix->values[index];
+            }
+        }
+        for (uint64_t index = matrix->rowPointers[rowBeg]; index < matrix->rowPointers[rowEnd]; index++) {
+            counts[matrix->colIndices[index] / DENSE_TILE_SIZE] = 0;
+            slots[matrix->colIndices[index] / DENSE_TILE_SIZE] = UINT64_MAX;
+        }
+    }
+
+    free_pointers(2, counts, slots);
+    return 0;
+}
+
+void free_dense_tiles(DenseTiles* const tiles) {
+    free_pointers(3, tiles->tilePointers, tiles->tileCols, tiles->values);
+    tiles->tilePointers = NULL;
+    tiles->tileCols = NULL;
+    tiles->values = NULL;
+}
+
+int sparse_remainder(
+    const Matrix* const restrict matrix, const DenseTiles* const restrict tiles, Matrix* const restrict remainder
+    ) {
+    *remainder = *matrix;
+    remainder->values = malloc_safe(sizeof(float), matrix->valuesSize ? matrix->valuesSize : 1);
+    remainder->colIndices = malloc_safe(sizeof(uint64_t), matrix->valuesSize ? matrix->valuesSize : 1);
+    remainder->rowPointers = malloc_safe(sizeof(uint64_t), matrix->noRows + 1);
+    uint8_t* dense = calloc(tiles->noTileCols ? tiles->noTileCols : 1, sizeof(uint8_t));
+    if (remainder->values == NULL || remainder->colIndices == NULL || remainder->rowPointers == NULL || dense == NULL) {
+        free_pointers(4, remainder->values, remainder->colIndices, remainder->rowPointers, dense);
+        remainder->values = NULL;
+        remainder->colIndices = NULL;
+        remainder->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    uint64_t size = 0;
+    remainder->rowPointers[0] = 0;
+    for (uint64_t tileRow = 0; tileRow < tiles->noTileRows; tileRow++) {
+        // Flag the dense tiles of this tile row and copy the values of all other tiles
+        for (uint64_t tile = tiles->tilePointers[tileRow]; tile < tiles->tilePointers[tileRow + 1]; tile++) {
+            dense[tiles->tileCols[tile]] = 1;
+        }
+        uint64_t rowEnd = (tileRow + 1) * DENSE_TILE_SIZE < matrix->noRows ? (tileRow + 1) * DENSE_TILE_SIZE : matrix->noRows;
+        for (uint64_t row = tileRow * DENSE_TILE_SIZE; row < rowEnd; row++) {
+            for (uint64_t index = matrix->rowPointers[row]; index < matrix->rowPointers[row + 1]; index++) {
+                if (!dense[matrix->colIndices[index] / DENSE_TILE_SIZE]) {
+                    remainder->values[size] = matrix->values[index];
+                    remainder->colIndices[size++] = matrix->colIndices[index];
+                }
+            }
+            remainder->rowPointers[row + 1] = size;
+        }
+        for (uint64_t tile = tiles->tilePointers[tileRow]; tile < tiles->tilePointers[tileRow + 1]; tile++) {
+            dense[tiles->tileCols[tile]] = 0;
+        }
+    }
+    remainder->valuesSize = size;
+
+    free(dense);
+    return 0;
+}
+
+void tile_kernel_scalar(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
+    ) {
+    for (uint64_t row = 0; row < DENSE_TILE_SIZE; row++) {
+        float* rowC = tile_c + row * DENSE_TILE_SIZE;
+        for (uint64_t k = 0; k < DENSE_TILE_SIZE; k++) {
+            float valueA = tile_a[row * DENSE_TILE_SIZE + k];
+            const float* rowB = tile_b + k * DENSE_TILE_SIZE;
+            for (uint64_t col = 0; col < DENSE_TILE_SIZE; col++) {
+                rowC[col] += valueA * rowB[col];
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void tile_kernel_avx2(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
+    ) {
+    // A block of 4 rows and 16 columns of C stays in 8 registers for the whole k loop
+    for (uint64_t row = 0; row < DENSE_TILE_SIZE; row += 4) {
+        const float* rowA = tile_a + row * DENSE_TILE_SIZE;
+        for (uint64_t col = 0; col < DENSE_TILE_SIZE; col += 16) {
+            float* blockC = tile_c + row * DENSE_TILE_SIZE + col;
+            __m256 sum00 = _mm256_load_ps(blockC);
+            __m256 sum01 = _mm256_load_ps(blockC + 8);
+            __m256 sum10 = _mm256_load_ps(blockC + DENSE_TILE_SIZE);
+            __m256 sum11 = _mm256_load_ps(blockC + DENSE_TILE_SIZE + 8);
+            __m256 sum20 = _mm256_load_ps(blockC + 2 * DENSE_TILE_SIZE);
+            __m256 sum21 = _mm256_load_ps(blockC + 2 * DENSE_TILE_SIZE + 8);
+            __m256 sum30 = _mm256_load_ps(blockC + 3 * DENSE_TILE_SIZE);
+            __m256 sum31 = _mm256_load_ps(blockC + 3 * DENSE_TILE_SIZE + 8);
+            for (uint64_t k = 0; k < DENSE_TILE_SIZE; k++) {
+                const float* rowB = tile_b + k * DENSE_TILE_SIZE + col;
+                __m256 valuesB0 = _mm256_load_ps(rowB);
+                __m256 valuesB1 = _mm256_load_ps(rowB + 8);
+                __m256 valueA = _mm256_broadcast_ss(rowA + k);
+                sum00 = _mm256_fmadd_ps(valueA, valuesB0, sum00);
+                sum01 = _mm256_fmadd_ps(valueA, valuesB1, sum01);
+                valueA = _mm256_broadcast_ss(rowA + DENSE_TILE_SIZE + k);
+                sum10 = _mm256_fmadd_ps(valueA, valuesB0, sum10);
+                sum11 = _mm256_fmadd_ps(valueA, valuesB1, sum11);
+                valueA = _mm256_broadcast_ss(rowA + 2 * DENSE_TILE_SIZE + k);
+                sum20 = _mm256_fmadd_ps(valueA, valuesB0, sum20);
+                sum21 = _mm256_fmadd_ps(valueA, valuesB1, sum21);
+                valueA = _mm256_broadcast_ss(rowA + 3 * DENSE_TILE_SIZE + k);
+                sum30 = _mm256_fmadd_ps(valueA, valuesB0, sum30);
+                sum31 = _mm256_fmadd_ps(valueA, valuesB1, sum31);
+            }
+            _mm256_store_ps(blockC, sum00);
+            _mm256_store_ps(blockC + 8, sum01);
+            _mm256_store_ps(blockC + DENSE_TILE_SIZE, sum10);
+            _mm256_store_ps(blockC + DENSE_TILE_SIZE + 8, sum11);
+            _mm256_store_ps(blockC + 2 * DENSE_TILE_SIZE, sum20);
+            _mm256_store_ps(blockC + 2 * DENSE_TILE_SIZE + 8, sum21);
+            _mm256_store_ps(blockC + 3 * DENSE_TILE_SIZE, sum30);
+            _mm256_store_ps(blockC + 3 * DENSE_TILE_SIZE + 8, sum31);
+        }
+    }
+}
+
+__attribute__((target("avx512f,fma")))
+void tile_kernel_avx512(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
+    ) {
+    // A block of 4 rows and 32 columns of C stays in 8 registers for the whole k loop
+    for (uint64_t row = 0; row < DENSE_TILE_SIZE; row += 4) {
+        const float* rowA = tile_a + row * DENSE_TILE_SIZE;
+        for (uint64_t col = 0; col < DENSE_TILE_SIZE; col += 32) {
+            float* blockC = tile_c + row * DENSE_TILE_SIZE + col;
+            __m512 sum00 = _mm512_load_ps(blockC);
+            __m512 sum01 = _mm512_load_ps(blockC + 16);
+            __m512 sum10 = _mm512_load_ps(blockC + DENSE_TILE_SIZE);
+            __m512 sum11 = _mm512_load_ps(blockC + DENSE_TILE_SIZE + 16);
+            __m512 sum20 = _mm512_load_ps(blockC + 2 * DENSE_TILE_SIZE);
+            __m512 sum21 = _mm512_load_ps(blockC + 2 * DENSE_TILE_SIZE + 16);
+            __m512 sum30 = _mm512_load_ps(blockC + 3 * DENSE_TILE_SIZE);
+            __m512 sum31 = _mm512_load_ps(blockC + 3 * DENSE_TILE_SIZE + 16);
+            for (uint64_t k = 0; k < DENSE_TILE_SIZE; k++) {
+                const float* rowB = tile_b + k * DENSE_TILE_SIZE + col;
+                __m512 valuesB0 = _mm512_load_ps(rowB);
+                __m512 valuesB1 = _mm512_load_ps(rowB + 16);
+                __m512 valueA = _mm512_set1_ps(rowA[k]);
+                sum00 = _mm512_fmadd_ps(valueA, valuesB0, sum00);
+                sum01 = _mm512_fmadd_ps(valueA, valuesB1, sum01);
+                valueA = _mm512_set1_ps(rowA[DENSE_TILE_SIZE + k]);
+                sum10 = _mm512_fmadd_ps(valueA, valuesB0, sum10);
+                sum11 = _mm512_fmadd_ps(valueA, valuesB1, sum11);
+                valueA = _mm512_set1_ps(rowA[2 * DENSE_TILE_SIZE + k]);
+                sum20 = _mm512_fmadd_ps(valueA, valuesB0, sum20);
+                sum21 = _mm512_fmadd_ps(valueA, valuesB1, sum21);
+                valueA = _mm512_set1_ps(rowA[3 * DENSE_TILE_SIZE + k]);
+                sum30 = _mm512_fmadd_ps(valueA, valuesB0, sum30);
+                sum31 = _mm512_fmadd_ps(valueA, valuesB1, sum31);
+            }
+            _mm512_store_ps(blockC, sum00);
+            _mm512_store_ps(blockC + 16, sum01);
+            _mm512_store_ps(blockC + DENSE_TILE_SIZE, sum10);
+            _mm512_store_ps(blockC + DENSE_TILE_SIZE + 16, sum11);
+            _mm512_store_ps(blockC + 2 * DENSE_TILE_SIZE, sum20);
+            _mm512_store_ps(blockC + 2 * DENSE_TILE_SIZE + 16, sum21);
+            _mm512_store_ps(blockC + 3 * DENSE_TILE_SIZE, sum30);
+            _mm512_store_ps(blockC + 3 * DENSE_TILE_SIZE + 16, sum31);
+        }
+    }
+}
+
+static tile_kernel_fn best_tile = NULL;  // resolved on the first call of best_tile_kernel()
+
+tile_kernel_fn best_tile_kernel(void) {
+    tile_kernel_fn kernel = __atomic_load_n(&best_tile, __ATOMIC_ACQUIRE);
+    if (kernel != NULL) {
+        return kernel;
+    }
+
+    // Same as best_row_kernel(), racing threads find the same kernel
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+        kernel = &tile_kernel_avx512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernel = &tile_kernel_avx2;
+    } else {
+        kernel = &tile_kernel_scalar;
+    }
+    __atomic_store_n(&best_tile, kernel, __ATOMIC_RELEASE);
+    return kernel;
+}
+
+// OTHER HELPER FUNCTIONS BELOW //
+// ---------------------------- //
+
+struct MultiplyArg** alloc_multiply_args(const unsigned int chunk_count) {
+    // One block: the pointer array first, the MultiplyArgs it points to behind it
+    uint64_t element_size = sizeof(struct MultiplyArg*) + sizeof(struct MultiplyArg);
+    struct MultiplyArg** arguments = malloc_safe(element_size, chunk_count);
+    if (arguments == NULL) {
+        return NULL;
+    }
+
+    struct MultiplyArg* args = (struct MultiplyArg*) (arguments + chunk_count);
+    for (unsigned int i = 0; i < chunk_count; i++) {
+        arguments[i] = &args[i];
+    }
+
+    return arguments;
+}
+
+void fill_multiply_args(
+    const unsigned int thread_count, struct MultiplyArg** const arguments,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result
+    ) {
+    uint64_t prev = 0;
+    uint64_t step = matrix_a->noRows / thread_count;
+    unsigned int rest = matrix_a->noRows % thread_count;  // rest is also in this range so unsigned int
+
+    for (unsigned int i = 0; i < thread_count; i++) {
+        struct MultiplyArg* arg = arguments[i];
+        arg->matrix_a = matrix_a;
+        arg->matrix_b = matrix_b;
+        arg->matrix_result = matrix_result;
+
+        arg->start_row = prev;
+        if (i < rest) {
+            prev += step + 1;
+            arg->end_row = prev;
+        } else {
+            prev += step;
+            arg->end_row = prev;
+        }
+    }
+    arguments[thread_count-1]->end_row = matrix_a->noRows;
+}
+
+void fill_balanced_multiply_args(
+    const unsigned int chunk_count, struct MultiplyArg** const arguments,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops
+    ) {
+    uint64_t total_flops = row_flops[matrix_a->noRows];
+    uint64_t row = 0;
+    for (unsigned int i = 0; i < chunk_count; i++) {
+        struct MultiplyArg* arg = arguments[i];
+        arg->matrix_a = matrix_a;
+        arg->matrix_b = matrix_b;
+        arg->matrix_result = matrix_result;
+
+        // The chunk ends at the first row whose flop prefix sum reaches the (i+1)-th share
+        arg->start_row = row;
+        uint64_t target = (uint64_t) (((unsigned __int128) total_flops * (i + 1)) / chunk_count);
+        while (row < matrix_a->noRows && row_flops[row] < target) {
+            row++;
+        }
+        arg->end_row = row;
+    }
+    arguments[chunk_count-1]->end_row = matrix_a->noRows;
+}
+
+unsigned int multiply_chunk_count(
+    const unsigned int thread_count, const MultiplyConfig* const config, const uint64_t rows
+    ) {
+    if (config->schedule == SCHEDULE_STATIC || config->schedule == SCHEDULE_BALANCED) {
+        // One chunk per thread
+        return thread_count;
+    }
+
+    uint64_t chunks;
+    if (config->chunk_size) {
+        // Fixed number of rows per chunk
+        chunks = rows / config->chunk_size + (rows % config->chunk_size != 0);
+    } else {
+        chunks = (uint64_t) thread_count * DYNAMIC_CHUNKS_PER_THREAD;
+        chunks = chunks > rows ? rows : chunks;
+    }
+    return chunks > MAX_CHUNKS ? MAX_CHUNKS : (unsigned int) chunks;
+}
+
+void fill_multiply_schedule(
+    const unsigned int chunk_count, const MultiplyConfig* const config,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops,
+    struct MultiplyArg** const arguments
+    ) {
+    if (config->schedule == SCHEDULE_STATIC || (config->schedule != SCHEDULE_BALANCED && config->chunk_size)) {
+        // Same number of rows for every chunk
+        fill_multiply_args(chunk_count, arguments, matrix_a, matrix_b, matrix_result);
+    } else {
+        // Flop-balanced chunks
+        fill_balanced_multiply_args(chunk_count, arguments, matrix_a, matrix_b, matrix_result, row_flops);
+    }
+}
+
+int create_multiply_schedule(
+    const unsigned int thread_count, const MultiplyConfig* const config,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops,
+    struct MultiplyArg*** arguments, unsigned int* chunk_count
+    ) {
+    *chunk_count = multiply_chunk_count(thread_count, config, matrix_a->noRows);
+    *arguments = alloc_multiply_args(*chunk_count);
+    if (*arguments == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    fill_multiply_schedule(*chunk_count, config, matrix_a, matrix_b, matrix_result, row_flops, *arguments);
+    return 0;
+}
+
+int start_threads(
+    const unsigned int thread_count, pthread_t** threads, struct MultiplyQueue* queue
+    ) {
+    if (!thread_count) {  // this is required to avoid a maybe uninitialized warning from gcc
+        return THREAD_START_ERROR;
+    }
+
+    // Create the threads
+    *threads = malloc(sizeof(pthread_t) * thread_count);
+    if (*threads == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    pthread_t thread;
+    for (unsigned int i = 0; i < thread_count; i++) {
+        if (pthread_create(&thread, NULL, &multiply_queue_worker, queue)) {
+            // Error creating thread, join previous threads and clean up memory
+            for (unsigned int j = 0; j < i; j++) {
+                pthread_join((*threads)[j], NULL);
+            }
+            free(*threads);
+
+            return THREAD_START_ERROR;
+        } else {
+            (*threads)[i] = thread;
+        }
+        if (mult_config.numa != NUMA_OFF) {
+            numa_pin_thread(thread, i);  // only a hint, an unpinned thread computes the same rows
+        }
+    }
+
+    return 0;
+}
+
+unsigned int available_cpus(void) {
+    // Only the CPUs in the affinity mask can run our threads (e.g. in a container)
+    cpu_set_t cpu_set;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        int count = CPU_COUNT(&cpu_set);
+        if (count > 0) {
+            return count;
+        }
+    }
+    return get_nprocs();
+}
+
+uint64_t l2_cache_size(void) {
+    long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? (uint64_t) size : DEFAULT_CACHE_SIZE;
+}
+
+unsigned int choose_thread_count(
+    const Matrix* const matrix_a, const Matrix* const matrix_b, const uint64_t flops,
+    const MultiplyConfig* const config, ThreadDecision* const decision
+    ) {
+    decision->available_threads = available_cpus();
+    decision->cache_size = l2_cache_size();
+    decision->flops = flops;
+    // A and B are streamed, every flop scatters into a float of C
+    decision->working_set = (matrix_a->valuesSize + matrix_b->valuesSize) * (sizeof(float) + sizeof(uint64_t))
+        + (matrix_a->rowPointersSize + matrix_b->rowPointersSize) * sizeof(uint64_t)
+        + flops * sizeof(float);
+    decision->overridden = config->thread_count != 0;
+
+    uint64_t thread_count;
+    if (decision->overridden) {
+        thread_count = config->thread_count;
+    } else {
+        // Every thread needs enough work to pay off, take the minimum of all conditions
+        thread_count = decision->available_threads;
+        uint64_t flop_weight = flops / THREAD_COND_MIN_FLOPS;
+        uint64_t elem_weight = matrix_a->valuesSize / THREAD_COND_MIN_VALUES;
+        uint64_t row_weight = matrix_a->noRows / THREAD_COND_MIN_ROWS;
+        // A thread should at least work on half of an L2 cache worth of data
+        uint64_t cache_weight = decision->working_set / (decision->cache_size / 2);
+
+        thread_count = flop_weight < thread_count ? flop_weight : thread_count;
+        thread_count = elem_weight < thread_count ? elem_weight : thread_count;
+        thread_count = row_weight < thread_count ? row_weight : thread_count;
+        thread_count = cache_weight < thread_count ? cache_weight : thread_count;
+    }
+
+    // More threads than rows can't be used
+    thread_count = thread_count > matrix_a->noRows ? matrix_a->noRows : thread_count;
+    thread_count = thread_count ? thread_count : 1;
+
+    decision->thread_count = (unsigned int) thread_count;
+    return decision->thread_count;
+}
+
+int compact_csr_fits(const Matrix* const matrix) {
+    return matrix->noRows < UINT32_MAX && matrix->noCols < UINT32_MAX && matrix->valuesSize < UINT32_MAX;
+}
+
+int narrow_csr_matrix(const Matrix* const restrict wide, CompactMatrix* const restrict compact) {
+    compact->noRows = wide->noRows;
+    compact->noCols = wide->noCols;
+    compact->values = wide->values;
+    compact->valuesSize = wide->valuesSize;
+    compact->rowPointersSize = wide->rowPointersSize;
+
+    // Allocate at least one element, the values array of an empty matrix is not NULL either
+    compact->colIndices = malloc_safe(sizeof(uint32_t), wide->valuesSize ? wide->valuesSize : 1);
+    compact->rowPointers = malloc_safe(sizeof(uint32_t), wide->rowPointersSize);
+    if (compact->colIndices == NULL || compact->rowPointers == NULL) {
+        free(compact->colIndices);
+        free(compact->rowPointers);
+        compact->colIndices = NULL;
+        compact->rowPointers = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    for (uint64_t i = 0; i < wide->valuesSize; i++) {
+        compact->colIndices[i] = (uint32_t) wide->colIndices[i];
+    }
+    for (uint64_t i = 0; i < wide->rowPointersSize; i++) {
+        compact->rowPointers[i] = (uint32_t) wide->rowPointers[i];
+    }
+
+    return 0;
+}
+
+int can_multiply(const Matrix* const a, const Matrix* const b) {
+    return (a->noCols == b->noRows) && (a->noCols >= 1 && a->noRows >= 1) && (b->noCols >= 1 && b->noRows >= 1);
+}
+
+int clean_up_csr(Matrix* const matrix) {
+    uint64_t non_zero_values;  // count the non zero values
+    if (_clean_up_matrix_arrays(matrix, &non_zero_values) == HEAP_MEMORY_ERROR) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    if (non_zero_values > 0) {
+        // Don't free arrays on error, free_csr_matrix() does that in main.c, no need for realloc_safe()
+        uint64_t alloc_size;
+        if (__builtin_umull_overflow(non_zero_values, sizeof(float), &alloc_size)) {
+            return HEAP_MEMORY_ERROR;
+        }
+
+        float* tmp_values = matrix->values;
+        matrix->values = realloc(matrix->values,  alloc_size);
+        if (matrix->values == NULL) {
+            matrix->values = tmp_values;
+            return HEAP_MEMORY_ERROR;
+        }
+
+        
+        if (__builtin_umull_overflow(non_zero_values, sizeof(uint64_t), &alloc_size)) {
+            return HEAP_MEMORY_ERROR;
+        }
+
+        uint64_t* tmp_col_indices = matrix->colIndices;
+        matrix->colIndices = realloc(matrix->colIndices, alloc_size);
+        if (matrix->colIndices == NULL) {
+            // don't free arrays on error, free_csr_matrix() does that in main.c
+            matrix->colIndices = tmp_col_indices;
+            return HEAP_MEMORY_ERROR;
+        }
+    }
+
+    matrix->valuesSize = non_zero_values;  // this ensures an empty line is printed when nnz = 0
+
+    return 0;
+}
+
+int _clean_up_matrix_arrays(Matrix* matrix, uint64_t* non_zero_values) {
+    *non_zero_values = 0;
+    uint64_t removed = 0;  // how many zero values were removed?
+    uint64_t row_beg = matrix->rowPointers[0];
     uint64_t row_end;
     for (uint64_t row = 1; row < matrix->rowPointersSize; row++) {
         // In the start of the iteration, row_beg is the old row_end
@@ -581,46 +2897,224 @@ int predict_values_dimension(
     const Matrix* const restrict matrix_b, 
     uint64_t* const values_size
     ) {
+    return estimate_values_dimension(matrix_a, matrix_b, SIZE_ESTIMATE_BOUND, values_size);
+}
+
+int estimate_values_dimension(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const int estimator,
+    uint64_t* const values_size
+    ) {
     *values_size = 0;
-    uint64_t rowBBeg;
-    uint64_t rowBEnd;
-    uint64_t maxValueSize = matrix_a->noRows * matrix_b->noCols;
+    const uint64_t noRows = matrix_a->noRows;
+
+    // A sample that would cover all rows is replaced by the exact count
+    const int exact_flag = estimator == SIZE_ESTIMATE_EXACT ||
+        (estimator == SIZE_ESTIMATE_SAMPLE && noRows <= SIZE_SAMPLE_ROWS);
+    uint64_t bound;
+    uint64_t nnz;
+    int estimate_result = _estimate_all_rows(matrix_a, matrix_b, exact_flag, &bound, &nnz);
+    if (estimate_result != 0) {
+        return estimate_result;
+    }
+    if (estimator != SIZE_ESTIMATE_SAMPLE || exact_flag) {
+        *values_size = exact_flag ? nnz : bound;
+        return 0;
+    }
 
-    // noCols of a = noRows of b
-    uint64_t* numValuesInColsA = calloc(matrix_a->noCols, sizeof(uint64_t));
-    if (numValuesInColsA == NULL) {
+    // Count the distinct columns of every step-th row, starting in the middle of the first step
+    uint64_t* marker = calloc(matrix_b->noCols, sizeof(uint64_t));
+    if (marker == NULL) {
         return HEAP_MEMORY_ERROR;
     }
-    uint64_t* numValuesInRowB = calloc(matrix_b->noRows, sizeof(uint64_t));
-    if (numValuesInRowB == NULL) {
-        free(numValuesInColsA);
+    const uint64_t step = noRows / SIZE_SAMPLE_ROWS;
+    struct SizeEstimateArg sample = {matrix_a, matrix_b, step / 2, noRows, step, marker, 0, 0};
+    size_estimate_task(&sample);
+    free(marker);
+
+    // Scale the share of the bound that the sample reached to all rows, with a margin on top
+    if (sample.bound == 0) {
+        *values_size = bound;  // the sample has no products, nothing to scale
+        return 0;
+    }
+    uint64_t estimate = (uint64_t) (((unsigned __int128) bound * sample.nnz + sample.bound - 1) / sample.bound);
+    estimate += estimate / SIZE_SAMPLE_MARGIN;
+    *values_size = estimate < bound ? estimate : bound;
+    return 0;
+}
+
+int _estimate_all_rows(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const int exact_flag,
+    uint64_t* const bound,
+    uint64_t* const nnz
+    ) {
+    const uint64_t noRows = matrix_a->noRows;
+    const uint64_t work = matrix_a->rowPointers[noRows] + noRows;
+
+    // Every chunk needs its own marker for the exact count, so there is one chunk per thread
+    unsigned int thread_count = mult_config.thread_count ? mult_config.thread_count : available_cpus();
+    uint64_t chunk_count = thread_count < noRows ? thread_count : noRows;
+    if (thread_count < MIN_THREADS || work / thread_count < THREAD_COND_MIN_FLOPS) {
+        chunk_count = 1;
+    }
+
+    struct SizeEstimateArg** arguments = malloc(
+        (sizeof(struct SizeEstimateArg*) + sizeof(struct SizeEstimateArg)) * chunk_count
+        );
+    uint64_t* markers = exact_flag ? calloc(chunk_count * matrix_b->noCols, sizeof(uint64_t)) : NULL;
+    if (arguments == NULL || (exact_flag && markers == NULL)) {
+        free_pointers(2, arguments, markers);
         return HEAP_MEMORY_ERROR;
     }
-    uint64_t numsSize = matrix_a->noCols;
 
-    for (uint64_t rowB = 0; rowB < matrix_b->noRows; rowB++) {
-        rowBBeg = matrix_b->rowPointers[rowB];
-        rowBEnd = matrix_b->rowPointers[rowB + 1];
-        // Calculating the nnz in rowB -> = rowEnd - rowBeg because CSR
-        numValuesInRowB[rowB] = (rowBEnd - rowBBeg);
+    // Every chunk gets about the same number of values and rows of A
+    struct SizeEstimateArg* chunks = (struct SizeEstimateArg*) (arguments + chunk_count);
+    uint64_t first_row = 0;
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        uint64_t last_row = i + 1 == chunk_count
+            ? noRows
+            : find_chunk_end(matrix_a->rowPointers, noRows, first_row, work * (i + 1) / chunk_count);
+        chunks[i] = (struct SizeEstimateArg) {
+            matrix_a, matrix_b, first_row, last_row, 1,
+            exact_flag ? markers + i * matrix_b->noCols : NULL, 0, 0
+            };
+        arguments[i] = &chunks[i];
+        first_row = last_row;
+    }
+
+    int run_result = 0;
+    if (chunk_count == 1) {
+        size_estimate_task(chunks);
+    } else {
+        // The queue of _run_multiply_chunks() only hands the pointers to size_estimate_task()
+        run_result = _run_multiply_chunks(
+            thread_count, &size_estimate_task, (struct MultiplyArg**) arguments, (unsigned int) chunk_count
+            );
+    }
+
+    *bound = 0;
+    *nnz = 0;
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        *bound += chunks[i].bound;
+        *nnz += chunks[i].nnz;
+    }
+    free_pointers(2, arguments, markers);
+    return run_result;
+}
+
+void* size_estimate_task(void* void_arg) {
+    struct SizeEstimateArg* arg = (struct SizeEstimateArg*) void_arg;
+    const Matrix* matrix_a = arg->matrix_a;
+    const Matrix* matrix_b = arg->matrix_b;
+    uint64_t* marker = arg->marker;
+
+    for (uint64_t rowA = arg->first_row; rowA < arg->last_row; rowA += arg->step) {
+        const uint64_t rowABeg = matrix_a->rowPointers[rowA];
+        const uint64_t rowAEnd = matrix_a->rowPointers[rowA + 1];
+
+        // The lengths of the rows of B come straight from its row pointers
+        uint64_t flops = 0;
+        for (uint64_t indexA = rowABeg; indexA < rowAEnd; indexA++) {
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            flops += matrix_b->rowPointers[rowB + 1] - matrix_b->rowPointers[rowB];
+        }
+        arg->bound += flops < matrix_b->noCols ? flops : matrix_b->noCols;
+        if (marker == NULL) {
+            continue;
+        }
+
+        // A single row of B can't meet itself, otherwise count the distinct columns
+        if (rowAEnd - rowABeg <= 1) {
+            arg->nnz += flops;
+            continue;
+        }
+        for (uint64_t indexA = rowABeg; indexA < rowAEnd; indexA++) {
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            for (uint64_t indexB = matrix_b->rowPointers[rowB]; indexB < matrix_b->rowPointers[rowB + 1]; indexB++) {
+                uint64_t columnB = matrix_b->colIndices[indexB];
+                if (marker[columnB] != rowA + 1) {
+                    marker[columnB] = rowA + 1;  // marker is zeroed, so rows are counted from 1
+                    arg->nnz++;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int compute_row_flops(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    uint64_t** const row_flops
+    ) {
+    *row_flops = malloc_safe(sizeof(uint64_t), matrix_a->noRows + 1);
+    if (*row_flops == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    fill_row_flops(matrix_a, matrix_b, *row_flops);
+    return 0;
+}
+
+void fill_row_flops(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    uint64_t* const restrict row_flops
+    ) {
+    row_flops[0] = 0;
+    for (uint64_t rowA = 0; rowA < matrix_a->noRows; rowA++) {
+        uint64_t flops = 0;
+        for (uint64_t indexA = matrix_a->rowPointers[rowA]; indexA < matrix_a->rowPointers[rowA + 1]; indexA++) {
+            uint64_t rowB = matrix_a->colIndices[indexA];
+            flops += matrix_b->rowPointers[rowB + 1] - matrix_b->rowPointers[rowB];
+        }
+        row_flops[rowA + 1] = row_flops[rowA] + flops;
     }
+}
+
+void init_multiply_workspace(MultiplyWorkspace* const workspace) {
+    memset(workspace, 0, sizeof(MultiplyWorkspace));
+}
 
-    // numValuesInColsA: Iteration of the nnz values in a  
-    for (uint64_t valuesIndex = 0; valuesIndex < matrix_a->valuesSize; valuesIndex++) {
-        uint64_t column = matrix_a->colIndices[valuesIndex];
-        // Updating the column count
-        numValuesInColsA[column]++;;
+void free_multiply_workspace(MultiplyWorkspace* const workspace) {
+    if (workspace->scratch != NULL) {
+        free_row_scratch(workspace->scratch, (unsigned int) workspace->scratchCapacity);
     }
+    free_pointers(
+        8, workspace->values, workspace->colIndices, workspace->rowPointers, workspace->rowFlops,
+        workspace->compactValues, workspace->compactColIndices, workspace->scratch, workspace->chunks
+        );
+    init_multiply_workspace(workspace);
+}
 
-    for (uint64_t index = 0; index < numsSize; index++) {
-        *values_size += numValuesInRowB[index] * numValuesInColsA[index];
+int _reserve_workspace_array(
+    void** const array, uint64_t* const capacity, const size_t element_size,
+    const uint64_t count, const int zeroed
+    ) {
+    if (count <= *capacity) {
+        return 0;
     }
 
-    free(numValuesInColsA);
-    free(numValuesInRowB);
+    // Grow geometrically, so a slowly growing input doesn't reallocate every time
+    uint64_t new_capacity = *capacity > UINT64_MAX / 2 ? count : *capacity * 2;
+    new_capacity = new_capacity < count ? count : new_capacity;
+
+    // The old contents are not needed, free first to keep the peak memory low
+    free(*array);
+    *array = zeroed ? calloc(new_capacity, element_size) : malloc_safe(element_size, new_capacity);
+    if (*array == NULL) {
+        *capacity = 0;
+        return HEAP_MEMORY_ERROR;
+    }
+    if (STATS_ENABLED()) {
+        count_allocated_bytes(element_size * new_capacity);
+    }
 
-    // Check if the prediction is greater than the maximum
-    *values_size = *values_size > maxValueSize ? maxValueSize : *values_size;
+    *capacity = new_capacity;
     return 0;
 }
 
@@ -630,9 +3124,13 @@ int init_empty_csr_matrix(
     ) {
     uint64_t valuesSize;
     if (predict_flag) {
-        // Predict size mathematically (upper limit)
-        if (predict_values_dimension(matrix_a, matrix_b, &valuesSize) == HEAP_MEMORY_ERROR) {
-            return HEAP_MEMORY_ERROR;
+        // Estimate the size with the chosen SIZE_ESTIMATE_* estimator
+        int error = estimate_values_dimension(matrix_a, matrix_b, predict_flag, &valuesSize);
+        if (error) {
+            result->values = NULL;
+            result->colIndices = NULL;
+            result->rowPointers = NULL;
+            return error;
         }
     } else {
         // Set values array size to maximum number of elements in the matrix
@@ -8,19 +8,185 @@
 // Our headers
 #include "csrmatrix.h"
 #include "utils.h"
+#include "config.h"
 
 // Define constants
 #define THREAD_START_ERROR -5  // error starting threads (-5 to fit in with matrix.h error codes)
 
 // Flags for size prediction in init_empty_csr_matrix()
-#define PREDICT_SIZE 1
+#define PREDICT_SIZE SIZE_ESTIMATE_BOUND  // any other SIZE_ESTIMATE_* can be passed as well
 #define NO_PREDICTION 0
 
 
+/*
+Function type of the kernels that accumulate all products of row rowA of A*B into a dense
+accumulator of size noCols of B (accumulator[col] += a_ik * b_kj).
+*/
+typedef void (*accumulate_row_fn)(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    );
+
+/*
+Row kernels with a double accumulator, for PRECISION_MIXED (float values) and
+PRECISION_DOUBLE (double values). Same as accumulate_row_fn otherwise.
+*/
+typedef void (*accumulate_row_mixed_fn)(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+typedef void (*accumulate_row_double_fn)(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+
+/*
+The RowScratch struct holds the accumulators of one thread of matr_mult_csr(). The arrays
+are allocated on the first row of their bin (see _reserve_row_scratch()) and are clean
+between rows: the accumulator is zeroed and no flag is set.
+
+busy is set while a chunk works with the scratch, see _claim_row_scratch().
+*/
+typedef struct RowScratch {
+    int busy;
+    float* accumulator;  // ROW_BIN_DENSE, denseCapacity elements
+    uint8_t* flags;  // ROW_BIN_DENSE, flags[col] is set if col is in the current row
+    uint64_t denseCapacity;
+    uint64_t* hashKeys;  // ROW_BIN_HASH, ROW_BIN_HASH_SIZE elements
+    uint64_t* hashPositions;
+    uint64_t* escKeys;  // ROW_BIN_ESC, 2 * escCapacity elements (for the radix sort)
+    float* escValues;
+    uint64_t escCapacity;
+} RowScratch;
+
+// Hash table size of ROW_BIN_HASH, at least twice the largest row of the bin
+#define ROW_BIN_HASH_SIZE (4 * (uint64_t) ROW_BIN_HASH_MAX)
+
+/*
+The RowBins struct is shared by all chunks of a multiplication with matr_mult_csr().
+rowFlops is the flop prefix sum from compute_row_flops(), the row bins are chosen from it.
+scratch are the scratchCount RowScratch structs, at least one per thread.
+error is set to HEAP_MEMORY_ERROR if a scratch array could not be allocated.
+replicas are the copies of B for every NUMA node (see numa_replicate_matrix()), or NULL
+if all threads read the B of their chunk.
+values and colIndices are the compact arrays of C that copy_chunk_segment() copies into.
+*/
+struct RowBins {
+    const uint64_t* rowFlops;
+    RowScratch* scratch;
+    unsigned int scratchCount;
+    accumulate_row_fn accumulateRow;
+    int error;
+    Matrix* replicas;
+    float* values;
+    uint64_t* colIndices;
+};
+
+/*
+Kernel of matr_mult_spmm(): computes the rows first_row to last_row - 1 of the dense C = A*B.
+The SpMM kernels walk the stride of B and C, the SpMV kernels take B and C as vectors
+(one column, stride 1).
+*/
+typedef void (*dense_rows_fn)(
+    const Matrix* const restrict matrix_a,
+    const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result,
+    const uint64_t first_row,
+    const uint64_t last_row
+    );
+
+/*
+The DenseRowsArg struct is passed to dense_rows_task(), one for every chunk of rows of
+matr_mult_spmm(). The chunks have about the same number of values of A.
+*/
+struct DenseRowsArg {
+    const Matrix* matrix_a;
+    const DenseMatrix* matrix_b;
+    DenseMatrix* matrix_result;
+    uint64_t first_row;
+    uint64_t last_row;
+    dense_rows_fn kernel;
+};
+
+/*
+Micro-kernel of multiply_V12(): adds the product of two dense tiles to a third one
+(C += A*B). All tiles have DENSE_TILE_SIZE rows and columns, stored row-major without
+padding and aligned to DENSE_ALIGNMENT.
+*/
+typedef void (*tile_kernel_fn)(
+    const float* const restrict tile_a,
+    const float* const restrict tile_b,
+    float* const restrict tile_c
+    );
+
+/*
+The dense tiles of a matrix, found by find_dense_tiles(). The matrix is cut into tiles of
+DENSE_TILE_SIZE rows and columns, noTileRows x noTileCols of them (the last ones can be
+smaller). Only the tiles with at least DENSE_TILE_MIN_NNZ values are stored: the dense tiles
+of tile row t are tileCols[tilePointers[t]] to tileCols[tilePointers[t + 1] - 1], in the
+order of their first value, like a CSR matrix of tiles. Tile i is stored at
+values + i * DENSE_TILE_SIZE * DENSE_TILE_SIZE (see tile_kernel_fn), the elements outside of
+the matrix are zero. values is NULL if count is 0.
+*/
+typedef struct DenseTiles {
+    uint64_t noTileRows;
+    uint64_t noTileCols;
+    uint64_t count;
+    uint64_t* tilePointers;
+    uint64_t* tileCols;
+    float* values;
+} DenseTiles;
+
+/*
+The SizeEstimateArg struct is passed to size_estimate_task(), one for every chunk of rows of
+estimate_values_dimension(). Every step-th row from first_row to last_row - 1 is counted.
+marker (noCols of B elements, zeroed before the first chunk) is NULL if only the bound is
+needed. The task adds the bound of the rows to bound and their distinct columns to nnz.
+*/
+struct SizeEstimateArg {
+    const Matrix* matrix_a;
+    const Matrix* matrix_b;
+    uint64_t first_row;
+    uint64_t last_row;
+    uint64_t step;
+    uint64_t* marker;
+    uint64_t bound;
+    uint64_t nnz;
+};
+
+/*
+The MaskedRowsArg struct is passed to masked_rows_task(), one for every chunk of rows of
+matr_mult_csr_masked() and matr_mult_csr_masked_complement(). Every chunk has its own
+accumulator and marker (noCols of B elements each). rowNnz (noRows of A elements) receives
+the number of values of every row of C.
+*/
+struct MaskedRowsArg {
+    const Matrix* matrix_a;
+    const Matrix* matrix_b;
+    const Matrix* mask;
+    Matrix* matrix_result;
+    uint64_t first_row;
+    uint64_t last_row;
+    int complement;
+    float* accumulator;
+    uint64_t* marker;
+    uint64_t* rowNnz;
+};
+
 /*
 The MultiplyArg struct is passed to multiply_main_implementation() as an argument. As a 
 POSIX thread can only take in a single argument for the function, this struct is used to 
 give the function the necessary arguments, such as the matrices and the row information.
+
+slot and nnz are set by multiply_main_implementation(): the values of the chunk are
+compact at [slot, slot + nnz) of the result arrays. offset is the position of the chunk in
+the compact C, see copy_chunk_segment().
 */
 struct MultiplyArg {
     Matrix* matrix_a;
@@ -28,16 +194,291 @@ struct MultiplyArg {
     Matrix* matrix_result;
     uint64_t start_row;
     uint64_t end_row;
+    struct RowBins* bins;
+    uint64_t slot;
+    uint64_t nnz;
+    uint64_t offset;
+};
+
+/*
+The MultiplyQueue struct is passed to multiply_queue_worker() by every thread started in
+start_threads(). The threads pull the chunks (MultiplyArgs) one after another by
+atomically incrementing next_chunk, so a thread that is done early takes over more rows.
+fn is run on every chunk (multiply_main_implementation() or copy_chunk_segment()).
+*/
+struct MultiplyQueue {
+    void* (*fn)(void* arg);
+    struct MultiplyArg** chunks;
+    unsigned int chunk_count;
+    unsigned int next_chunk;
+};
+
+/*
+The MultiplyWorkspace struct holds every buffer of a multiplication with matr_mult_csr_ws()
+so repeated multiplications reuse them instead of calling malloc/calloc/realloc every time.
+The buffers only grow (to the largest multiplication so far) and are free'd together with
+free_multiply_workspace(). Every Capacity is the number of elements of the buffer before it.
+
+values, colIndices and rowPointers are the subarrays of the result matrix, which only points
+into them. The rows are multiplied into the slots of values and colIndices. If the chunks
+don't end up adjacent, they are copied to compactValues and compactColIndices and the
+result points there instead. The scratch structs keep their accumulators between
+multiplications.
+*/
+typedef struct MultiplyWorkspace {
+    float* values;
+    uint64_t valuesCapacity;
+    uint64_t* colIndices;
+    uint64_t colIndicesCapacity;
+    uint64_t* rowPointers;
+    uint64_t rowPointersCapacity;
+    uint64_t* rowFlops;  // flop prefix sum, see compute_row_flops()
+    uint64_t rowFlopsCapacity;
+    float* compactValues;
+    uint64_t compactValuesCapacity;
+    uint64_t* compactColIndices;
+    uint64_t compactColIndicesCapacity;
+    RowScratch* scratch;
+    uint64_t scratchCapacity;
+    struct MultiplyArg** chunks;  // from alloc_multiply_args()
+    uint64_t chunksCapacity;
+} MultiplyWorkspace;
+
+/*
+The MultiplyPlan struct holds the structure of C = A*B for inputs whose sparsity patterns
+stay the same while their values change, see matr_mult_csr_planned(). It is computed once
+by create_multiply_plan(), then every multiplication only does the numeric work.
+
+rowPointers and colIndices are the structure of C (before zeros from numerical cancellation
+are dropped). If scatterFlag is set, scatter holds for every product a_ik * b_kj (in the
+order of the rows of A, their values and the rows of B) the index of its value in C, so the
+numeric pass needs no accumulator.
+
+The plan belongs to the dimensions and nnz of A and B it was created for (the rows, cols
+and valuesSize fields). It is not valid if rowPointers is NULL.
+*/
+typedef struct MultiplyPlan {
+    int scatterFlag;
+    uint64_t rowsA;
+    uint64_t colsA;
+    uint64_t valuesSizeA;
+    uint64_t rowsB;
+    uint64_t colsB;
+    uint64_t valuesSizeB;
+    uint64_t* rowPointers;  // noRows of A + 1 elements
+    uint64_t* colIndices;  // rowPointers[noRows of A] elements
+    uint64_t* scatter;  // productCount elements, NULL without scatterFlag
+    uint64_t productCount;
+} MultiplyPlan;
+
+/*
+The MultiplyChain struct holds the multiplication order of a chain of count matrices
+(see matr_mult_chain()) and the workspaces of its intermediate products.
+
+The entries of split, nnz and flops belong to the subchain of the operands first to last at
+index first * count + last. split is the last operand of the left factor of the subchain,
+nnz the estimated nnz of its product and flops the estimated flops of multiplying it in the
+chosen order (see choose_chain_order()).
+
+The count - 1 workspaces are shared by the intermediate products: products[i] is the
+product in workspaces[i], busy[i] is set while it still has to be multiplied. The chain is
+not valid if count is 0.
+*/
+typedef struct MultiplyChain {
+    unsigned int count;
+    unsigned int* split;
+    double* nnz;
+    double* flops;
+    MultiplyWorkspace* workspaces;
+    Matrix* products;
+    int* busy;
+} MultiplyChain;
+
+/*
+The MultiplyBatch struct holds the memory of a batch of independent products multiplied with
+matr_mult_csr_batch(). Like a MultiplyWorkspace, the buffers only grow and are free'd together
+with free_multiply_batch(), so a batch of the same size as before doesn't allocate any buffers.
+
+slab holds the subarrays of all results: the row pointers of every product one after another,
+then the column indices and then the values of every product. Every product gets room for
+the upper bound of its non-zero values (see batch_bound_task()). slabCapacity is its size in
+bytes. markers and accumulators are the scratch arrays of the tasks (the accumulators are
+always zeroed between multiplications), tasks the tasks of the last batch (see struct BatchTask).
+*/
+typedef struct MultiplyBatch {
+    void* slab;
+    uint64_t slabCapacity;
+    uint64_t* markers;
+    uint64_t markersCapacity;
+    float* accumulators;
+    uint64_t accumulatorsCapacity;
+    struct BatchTask** tasks;  // pointer array followed by the tasks, like alloc_multiply_args()
+    uint64_t tasksCapacity;
+} MultiplyBatch;
+
+/*
+The BatchTask struct is passed to batch_bound_task() and batch_numeric_task(). A task
+multiplies the products first to last - 1 of the batch one after another on one thread.
+marker and accumulator are the scratch of the task, with room for scratchSize elements (the
+noCols of the widest B of its products).
+*/
+struct BatchTask {
+    const Matrix* const* matricesA;
+    const Matrix* const* matricesB;
+    Matrix* results;
+    uint64_t first;
+    uint64_t last;
+    uint64_t scratchSize;
+    uint64_t* marker;
+    float* accumulator;
 };
 
 /*
 This is the main implementation of the multiplication algorithm. It is called by each thread 
-created in matr_mult_csr. It uses the same algorithm as version 2 (Gustavson's with no size 
-prediction), but the function signature is changed to take in a single argument (a struct 
-MultiplyArg), so that threads can call this function.
+created in matr_mult_csr (or once on the calling thread). The function signature takes in a
+single argument (a struct MultiplyArg), so that threads can call this function.
+
+Every row of the chunk is multiplied with the accumulator of its bin (see choose_row_bin()).
+rowPointers[row] is the offset of the slot of the row, which has room for the upper bound of
+the row (see fill_row_offsets()). The row is written right behind the previous row of the
+chunk instead, which never is behind its own slot, so the chunk ends up compact without a
+separate pass. rowPointers of the rows of the chunk are set to their compact offsets, slot
+and nnz of the MultiplyArg to the compact range of the chunk.
 */
 void* multiply_main_implementation(void* void_arg);
 
+/*
+Returns the row bin (ROW_BIN_*, see config.h) of a row of C with at most bound non-zero
+values, noCols is noCols of B.
+*/
+int choose_row_bin(const uint64_t bound, const uint64_t noCols);
+
+/*
+Stores the slot offsets of the rows of C in rowPointers (noRows + 1 elements): the slot of
+a row has room for its flops, but at most noCols values. row_flops is the prefix sum from
+compute_row_flops(). The number of rows in every bin is stored in bin_rows.
+
+Return value: The total size of the slots, the size of values and colIndices of the result.
+*/
+uint64_t fill_row_offsets(
+    const uint64_t noRows, const uint64_t noCols, const uint64_t* const restrict row_flops,
+    uint64_t* const restrict rowPointers, uint64_t* const restrict bin_rows
+    );
+
+/*
+Claims one of the count scratch structs that no other chunk uses right now. There are
+at least as many scratch structs as chunks that can run at the same time, so this
+function never waits. A thread first tries the scratch it claimed last, so the arrays
+it allocated (and first touched) stay with it, on its NUMA node if it is pinned.
+
+This function is called in multiply_main_implementation().
+*/
+RowScratch* _claim_row_scratch(RowScratch* const scratch, const unsigned int count);
+
+/*
+Allocates the arrays of the scratch that a row of the given bin needs, noCols is noCols of B
+and flops are the flops of the row. Arrays that are large enough are kept.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if an array cannot be allocated.
+*/
+int _reserve_row_scratch(RowScratch* const scratch, const int bin, const uint64_t noCols, const uint64_t flops);
+
+/*
+Frees the arrays of count scratch structs, the structs themselves are kept.
+*/
+void free_row_scratch(RowScratch* const scratch, const unsigned int count);
+
+/*
+Accumulators of the row bins. Each multiplies row rowA of A with B into values/colIndices,
+the slot of the row, and returns the number of non-zero values written. Exact zeros from
+numerical cancellation are dropped. The list, hash and dense kernels write the columns in
+the order of their first product like V6, the ESC kernel writes them sorted.
+
+The hash table (keys, positions) has room for ROW_BIN_HASH_SIZE entries, bound is the
+upper bound of the row. The dense kernel uses the clean accumulator and flags of noCols of
+B elements. The ESC kernel sorts with _esc_sort() in keys/esc_values of 2 * capacity
+elements, capacity must be at least the flops of the row.
+
+These functions are called in multiply_main_implementation().
+*/
+uint64_t _multiply_row_list(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices
+    );
+uint64_t _multiply_row_hash(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices, const uint64_t bound,
+    uint64_t* const restrict keys, uint64_t* const restrict positions
+    );
+uint64_t _multiply_row_dense(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices,
+    float* const restrict accumulator, uint8_t* const restrict flags, accumulate_row_fn accumulate_row
+    );
+uint64_t _multiply_row_esc(
+    const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, const uint64_t rowA,
+    float* const restrict values, uint64_t* const restrict colIndices,
+    uint64_t* const restrict keys, float* const restrict esc_values, const uint64_t capacity
+    );
+
+/*
+Drops the exact zeros of the size values of a row and moves the rest (and their columns)
+to the front.
+
+Return value: The number of non-zero values.
+*/
+uint64_t _drop_zero_values(float* const restrict values, uint64_t* const restrict colIndices, const uint64_t size);
+
+/*
+Moves the rows of C from their slots (see fill_row_offsets()) to the front of the arrays,
+so rowPointers become the CSR row pointers. row_nnz is the number of values of every row.
+
+This function is called in multiply_V11().
+
+Return value: The number of non-zero values of C.
+*/
+uint64_t compact_row_slots(Matrix* const matrix, const uint64_t* const row_nnz);
+
+/*
+Copies the compact values of a chunk (struct MultiplyArg, see multiply_main_implementation())
+to offset in the values and colIndices of its RowBins and moves the rowPointers of its rows
+along. The chunks copy to disjoint ranges, so they run in parallel like the multiplication.
+*/
+void* copy_chunk_segment(void* void_arg);
+
+/*
+This function is run by every thread created in start_threads(). It takes in a single
+struct MultiplyQueue and calls the fn of the queue on chunks of the queue until there
+are none left.
+*/
+void* multiply_queue_worker(void* void_queue);
+
+/*
+Zeroes last_multiply_stats at the start of a multiplication. The counter functions below
+are only called if STATS_ENABLED(), so they compile out with MULTIPLY_STATS 0.
+*/
+void begin_multiply_stats(void);
+
+/*
+Adds bytes to bytes_allocated of last_multiply_stats. Atomic, the threads of a
+multiplication count the scratch they allocate.
+*/
+void count_allocated_bytes(const uint64_t bytes);
+
+/*
+Adds a chunk of rows rows, which took busy seconds, to the counters of worker (a RowScratch
+slot, see WorkerStats). Workers from MULTIPLY_STATS_MAX_WORKERS on are not counted.
+*/
+void count_worker_chunk(const unsigned int worker, const double busy, const uint64_t rows);
+
+/*
+Stores nnz(C) and the phases (last_multiply_phases) in last_multiply_stats at the end of a
+successful multiplication and marks the stats as recorded.
+*/
+void finish_multiply_stats(const uint64_t nnz);
+
 /*
 Converts a given Matrix (in CSR format) into a 2D-array of its values.
 
@@ -74,9 +515,7 @@ The function uses Gustafson's algorithm with SIMD, specifically 128-bit SSE regi
 However, unlike the main implementation, the size of the values array is not predicted,
 as it does not fit in with the SIMD usage.
 
-Return values:
-    0 on success.
-    HEAP_MEMORY_ERROR if the array used for SIMD cannot be malloc'ed.
+Return value: Always 0, the array used for SIMD is on the stack.
 */
 int multiply_V3(
     const Matrix* const restrict matrix_a, 
@@ -91,9 +530,7 @@ The function uses, similar to version 1, Gustafson's algorithm with SIMD. But th
 used here are 256 bit AVX registers. The function defaults to version 1 if the computer
 architecture does not support AVX. The size of the values array is not predicted.
 
-Return values:
-    0 on success.
-    HEAP_MEMORY_ERROR if the array used for SIMD cannot be malloc'ed.
+Return value: Always 0, the array used for SIMD is on the stack.
 */
 int multiply_V4(
     const Matrix* const restrict matrix_a, 
@@ -105,71 +542,979 @@ int multiply_V4(
 This is the version 5 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V5().
 
 The function uses Gustafson's algorithm to multiply the matrices. The size of the values array 
-is also predicted using an algorithm, drastically decreasing memory usage.
+is also predicted using an algorithm, drastically decreasing memory usage. If the prediction
+is too low (SIZE_ESTIMATE_SAMPLE), values and colIndices are grown to twice their size,
+valuesSize is their capacity.
+
+Every row is accumulated in a dense accumulator of size noCols of B, which is reused for
+all rows. The touched columns are collected directly in the row's part of colIndices, so
+a row costs O(flops) instead of O(nnz_row(C)^2). Values that cancel out to exactly zero
+are not stored.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed, or the
+    result cannot grow.
 */
-void multiply_V5(
+int multiply_V5(
     const Matrix* const restrict matrix_a, 
     const Matrix* const restrict matrix_b, 
     Matrix* const restrict matrix_result
     );
 
+/*
+Symbolic pass of the two-phase Gustavson algorithm, called in matr_mult_csr_V6().
+
+Counts the exact number of non-zero values in every row of the result matrix (using a
+marker array of size noCols of B) and builds the row pointers from a prefix sum of these
+counts. Memory for values and colIndices is then allocated with exactly that size, so
+the memory usage is O(nnz(C)) instead of O(noRows * noCols).
+
+If an error occurs, the subarrays of the result are all set to NULL.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if one of the subarrays or the marker array cannot be malloc'ed.
+*/
+int symbolic_multiply(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
 
 /*
-This function, called in matr_mult_csr(), starts threads that then multiply the rows
-assigned to them. Each thread calls multiply_main_implementation().
+This is version 6 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V6().
+
+Numeric pass of the two-phase Gustavson algorithm. The result matrix must have been
+initialized by symbolic_multiply(). Every row is accumulated in a dense array of size
+noCols of B and then gathered into values/colIndices. Values that cancel out to exactly
+zero are dropped while gathering, so no clean up step is needed afterwards.
 
 Return values:
-    0 if the threads all started with no error.
-    HEAP_MEMORY_ERROR if memory for the thread array or the argument array could not be allocated.
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed.
 */
-int start_threads(
-    const unsigned int thread_count, pthread_t** threads, struct MultiplyArg*** arguments,
-    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result
+int multiply_V6(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
     );
 
 /*
-Checks if multiplication of the given matrices (in CSR format) is mathematically defined.
+multiply_V6() for PRECISION_MIXED: the values are floats, but every row is accumulated
+in doubles and only rounded to float once per value of the result.
+*/
+int multiply_V6_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+symbolic_multiply() and multiply_V6() for PRECISION_DOUBLE.
+*/
+int symbolic_multiply_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    DoubleMatrix* const restrict matrix_result
+    );
+int multiply_V6_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    DoubleMatrix* const restrict matrix_result
+    );
+
+/*
+Symbolic pass of the two-phase Gustavson algorithm for input matrices with 32-bit
+indices, same as symbolic_multiply(). Called in matr_mult_csr_V9(). The result
+has 64-bit indices, so nnz(C) is not limited by the index width of A and B.
 
 Return values:
-    1 if they can be multiplied,
-    0 if not.
+    0 on success.
+    HEAP_MEMORY_ERROR if one of the subarrays or the marker array cannot be malloc'ed.
 */
-int can_multiply(const Matrix* const a, const Matrix* const b);
+int symbolic_multiply_compact(
+    const CompactMatrix* const restrict matrix_a,
+    const CompactMatrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
 
 /*
-Cleans up zero values in the given matrix, as the CSR format does not store them.
+This is version 9 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V9().
+
+Numeric pass of the two-phase Gustavson algorithm for input matrices with 32-bit indices,
+same as multiply_V6().
+Both are generated from csrtemplate.h. The result matrix must have been initialized by
+symbolic_multiply_compact().
 
 Return values:
     0 on success.
-    HEAP_MEMORY_ERROR when a malloc/realloc call returns a null pointer.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed.
 */
-int clean_up_csr(Matrix* const matrix);
+int multiply_V9(
+    const CompactMatrix* const restrict matrix_a,
+    const CompactMatrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
 
 /*
-This is a helper function is called in _clean_up_csr(). Used to clean up the zero values in the matrix.
+multiply_V9() for PRECISION_MIXED, see multiply_V6_mixed().
+*/
+int multiply_V9_mixed(
+    const CompactMatrix* const restrict matrix_a,
+    const CompactMatrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+This is version 10 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V10().
+
+Expand-sort-compress: the products of a tile of consecutive rows (ESC_TILE_PRODUCTS, see
+config.h) are expanded into (row, column) keys and values, sorted by key with _esc_sort()
+and compressed by summing the runs of equal keys. There is no accumulator of size noCols
+of B, so the work per row only depends on its products, which suits very wide B and rows
+with few products. The columns of every row of the result are sorted.
+
+The result arrays grow while the tiles are written and are shrunk to nnz(C) at the end.
+The products per row and the tiles are stored as the symbolic phase in last_multiply_phases,
+expand-sort-compress as the numeric phase and the shrinking as the compaction.
 
 Return values:
     0 on success.
-    HEAP_MEMORY_ERROR when a malloc call returns a null pointer.
+    HEAP_MEMORY_ERROR if the tile buffers or the result cannot be malloc'ed.
 */
-int _clean_up_matrix_arrays(Matrix* matrix, uint64_t* non_zero_values);
+int multiply_V10(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
 
 /*
-Predicts the amount of non-zero-values in the resulting CSR matrix.
-Usage of this function greatly decreases memory usage, as the memory for the
-array is dynamically allocated on the heap.
+Sorts size keys (of key_bits significant bits) and their values ascendingly by key. The sort
+is stable: equal keys keep the order of their products. Fewer than ESC_INSERTION_SORT keys
+are insertion sorted, otherwise an LSD radix sort with one byte per pass moves the elements
+between *keys, *values and keys_tmp, values_tmp (both of size elements). Passes in which every
+key has the same byte are skipped. *keys and *values point to the sorted arrays afterwards,
+which may be the tmp arrays.
 
-The prediction is stored in 'values_size'.
+This function is called in multiply_V10(), _multiply_row_esc() and _order_rows_by_panel().
+*/
+void _esc_sort(
+    uint64_t** const keys, float** const values, const uint64_t size, const unsigned int key_bits,
+    uint64_t* restrict keys_tmp, float* restrict values_tmp
+    );
 
-Return value: 
+/*
+Grows the values and colIndices arrays of a result that is built row by row to capacity
+elements.
+
+This function is called in multiply_V10().
+
+Return values:
     0 on success.
-    HEAP_MEMORY_ERROR if a malloc call fails.
+    HEAP_MEMORY_ERROR if realloc fails. The failed array is free'd and NULL, the other
+    one is still valid.
 */
-int predict_values_dimension(
-    const Matrix* const restrict matrix_a, 
-    const Matrix* const restrict matrix_b, 
-    uint64_t* const values_size
+int _grow_result_arrays(float** values, uint64_t** colIndices, const uint64_t capacity);
+
+/*
+This is version 11 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V11().
+
+Column-tiled Gustavson: the columns of B are split into panels whose dense accumulator (and
+flags) take 1/COLUMN_PANEL_CACHE_SHARE of the L2 cache (see config.h). All rows of A are
+multiplied with one panel before the next one, so the scatters into the accumulator stay in
+the cache even if B has millions of columns. A cursor per row of B marks its first entry in
+the current panel.
+
+Every row of C gets a slot of min(flops, noCols of B) entries like in matr_mult_csr(), the
+part of a row from a panel is appended to its parts from the previous panels. The slots are
+compacted and the arrays shrunk to nnz(C) at the end. The columns of a row are in the order
+of their panels, inside a panel in the order of their first product like V6. The slots and
+the panels of B are stored as the symbolic phase in last_multiply_phases, the panels as the
+numeric phase and the compaction of the slots as the compaction.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator, the cursors or the result cannot be malloc'ed.
+*/
+int multiply_V11(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+Sets panel_b to matrix_b with the entries of every row in the order of their panels of
+panel_cols columns. If matrix_b already is in that order, panel_b shares all of its arrays.
+Otherwise, values and colIndices of panel_b are sorted copies (by column) that have to be
+free'd by the caller, the row pointers are still shared.
+
+This function is called in multiply_V11().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the copies cannot be malloc'ed.
+*/
+int _order_rows_by_panel(const Matrix* const matrix_b, const uint64_t panel_cols, Matrix* const panel_b);
+
+/*
+This is version 12 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V12().
+
+Hybrid of dense tiles and Gustavson: the dense tiles of A and B (see find_dense_tiles()) are
+multiplied with the tile kernel of best_tile_kernel(), everything else row by row like in V6.
+With A = Ad + As and B = Bd + Bs (the values in dense tiles and the rest), a value of A in a
+dense tile is multiplied with Bs (see sparse_remainder()), every other value with all of B,
+which together with the tiles gives Ad*Bd + Ad*Bs + As*B = A*B.
+
+The tile rows of A are multiplied one after another. The tiles of C of a tile row are
+computed first, then every row of the tile row is accumulated from its products and the
+values of its row in the tiles of C. Products of dense tiles that are zero are dropped like
+cancelled values. If A or B has no dense tile, this is a plain Gustavson.
+
+Every row of C gets a slot of min(flops, noCols of B) entries like in matr_mult_csr(), the
+slots are compacted and the arrays shrunk to nnz(C) at the end. The columns of a row are in
+the order of their first product, followed by the columns from the tiles of C.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the tiles, the accumulator or the result cannot be malloc'ed.
+*/
+int multiply_V12(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+Finds the dense tiles of the given matrix (see struct DenseTiles) and copies their values
+into tiles. Every tile row is counted and then copied, so the values of the matrix are read
+twice. The arrays of tiles have to be free'd by the caller (see free_dense_tiles()).
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the tiles cannot be malloc'ed, all arrays of tiles are NULL then.
+*/
+int find_dense_tiles(const Matrix* const restrict matrix, DenseTiles* const restrict tiles);
+
+/*
+Frees the arrays of tiles from find_dense_tiles() and sets them to NULL.
+*/
+void free_dense_tiles(DenseTiles* const tiles);
+
+/*
+Sets remainder to a copy of matrix without its values in the dense tiles (Bs in
+multiply_V12()). Its arrays have to be free'd by the caller. values and colIndices have
+room for all values of matrix, they are only used while multiplying.
+
+This function is called in multiply_V12().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the copy cannot be malloc'ed, all arrays of remainder are NULL then.
+*/
+int sparse_remainder(
+    const Matrix* const restrict matrix, const DenseTiles* const restrict tiles, Matrix* const restrict remainder
+    );
+
+/*
+Tile kernels (see tile_kernel_fn). The scalar kernel runs i-k-j over the tiles, so the inner
+loop walks along a row of B and C. The AVX kernels keep a block of 4 rows of C in registers
+(16 columns with AVX2, 32 with AVX-512) while the whole row of A is added into it with FMA,
+so every element of C is loaded and stored once per tile. All kernels sum the products of an
+element in the order of k, the AVX kernels give the same results as each other.
+
+The CPU must support AVX2 and FMA for tile_kernel_avx2(), AVX-512F for tile_kernel_avx512().
+*/
+void tile_kernel_scalar(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
+    );
+void tile_kernel_avx2(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
     );
+void tile_kernel_avx512(
+    const float* const restrict tile_a, const float* const restrict tile_b, float* const restrict tile_c
+    );
+
+/*
+Returns the fastest tile kernel the CPU supports (AVX-512, then AVX2, then scalar). The CPU is
+checked on the first call only, like in best_row_kernel(). This function is thread safe.
+*/
+tile_kernel_fn best_tile_kernel(void);
+
+/*
+Shrinks the values (elements of value_size bytes) and colIndices arrays of a result matrix
+to 'size' elements after values cancelled out in a numeric pass. If realloc fails, the
+larger arrays are kept, they are still valid.
+
+This function is called in the kernels of csrtemplate.h and should not be called outside of them.
+*/
+void _shrink_result_arrays(void** values, const size_t value_size, uint64_t** colIndices, const uint64_t size);
+
+/*
+Checks if the indices of the given matrix fit into a CompactMatrix.
+
+Return values:
+    1 if noRows, noCols and valuesSize are all smaller than UINT32_MAX,
+    0 if not.
+*/
+int compact_csr_fits(const Matrix* const matrix);
+
+/*
+Narrows the indices of 'wide' into 'compact', compact_csr_fits(wide) must be true.
+Only colIndices and rowPointers are copied, compact->values points to the values of
+'wide', so only the index arrays of 'compact' must be freed afterwards.
+
+If an error occurs, the index arrays of 'compact' are NULL.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if one of the index arrays cannot be malloc'ed.
+*/
+int narrow_csr_matrix(const Matrix* const restrict wide, CompactMatrix* const restrict compact);
+
+
+/*
+Allocates chunk_count MultiplyArgs together with the array of pointers to them in a single
+block, so the whole schedule is free'd with one free() of the returned pointer array.
+
+Return value: The pointer array, or NULL if the block could not be allocated.
+*/
+struct MultiplyArg** alloc_multiply_args(const unsigned int chunk_count);
+
+/*
+Fills thread_count MultiplyArgs, the rows of A are split evenly between them.
+This function is called in fill_multiply_schedule() for SCHEDULE_STATIC and for
+SCHEDULE_DYNAMIC with a fixed chunk size (then thread_count is the number of chunks).
+*/
+void fill_multiply_args(
+    const unsigned int thread_count, struct MultiplyArg** const arguments,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result
+    );
+
+/*
+Fills chunk_count MultiplyArgs whose row ranges have (nearly) the same number of estimated
+flops. row_flops is the prefix sum of the flops per row computed by compute_row_flops().
+A single heavy row may leave some chunks empty.
+
+This function is called in fill_multiply_schedule().
+*/
+void fill_balanced_multiply_args(
+    const unsigned int chunk_count, struct MultiplyArg** const arguments,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops
+    );
+
+/*
+Returns the number of chunks the rows of A are split into by the scheduling strategy in
+config, see config.h. rows is noRows of A.
+
+SCHEDULE_STATIC and SCHEDULE_BALANCED create one chunk per thread, SCHEDULE_DYNAMIC creates
+more chunks than threads so that the threads can balance the load at runtime.
+*/
+unsigned int multiply_chunk_count(
+    const unsigned int thread_count, const MultiplyConfig* const config, const uint64_t rows
+    );
+
+/*
+Fills the chunk_count (see multiply_chunk_count()) MultiplyArgs in arguments with the row
+ranges of the scheduling strategy in config. row_flops is the flop prefix sum from
+compute_row_flops().
+
+This function is called in create_multiply_schedule() and matr_mult_csr_ws(), which keeps
+the arguments in a MultiplyWorkspace.
+*/
+void fill_multiply_schedule(
+    const unsigned int chunk_count, const MultiplyConfig* const config,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops,
+    struct MultiplyArg** const arguments
+    );
+
+/*
+Splits the rows of A into chunks according to the scheduling strategy in config, see config.h.
+The number of chunks is stored in chunk_count, every chunk is a MultiplyArg. row_flops is
+the flop prefix sum from compute_row_flops(). The arguments come from alloc_multiply_args()
+and are free'd with a single free().
+
+This function is called in matr_mult_csr().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if memory for the chunks could not be allocated.
+*/
+int create_multiply_schedule(
+    const unsigned int thread_count, const MultiplyConfig* const config,
+    Matrix* matrix_a, Matrix* matrix_b, Matrix* matrix_result, const uint64_t* const row_flops,
+    struct MultiplyArg*** arguments, unsigned int* chunk_count
+    );
+
+/*
+Portable row kernel, used if the CPU supports neither AVX2 nor AVX-512.
+*/
+void accumulate_row_scalar(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    );
+
+/*
+Row kernel using AVX2. The values of the accumulator are gathered 4 at a time with
+_mm256_i64gather_ps, updated with FMA and written back lane by lane (AVX2 has no scatter).
+If two of the 4 lanes hit the same column, the 4 products are added one by one instead.
+
+The CPU must support AVX2 and FMA.
+*/
+void accumulate_row_avx2(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    );
+
+/*
+Row kernel using AVX-512. The values of the accumulator are gathered 8 at a time, updated
+with FMA and scattered back with _mm512_i64scatter_ps. Before scattering, vpconflictq checks
+that no two lanes hit the same column, otherwise the 8 products are added one by one.
+
+The CPU must support AVX-512F, AVX-512CD and FMA.
+*/
+void accumulate_row_avx512(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    float* const restrict accumulator
+    );
+
+/*
+accumulate_row_avx2() and accumulate_row_avx512() for a double accumulator. The _mixed
+kernels convert the float values of B to double before the FMA, the _double kernels
+load double values. Same CPU requirements as the float kernels.
+*/
+void accumulate_row_avx2_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+void accumulate_row_avx512_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+void accumulate_row_avx2_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+void accumulate_row_avx512_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    const uint64_t rowA,
+    double* const restrict accumulator
+    );
+
+/*
+Returns the fastest row kernel the CPU supports (AVX-512, then AVX2, then scalar).
+The CPU is checked on the first call only, later calls return the cached kernel.
+This function is thread safe.
+*/
+accumulate_row_fn best_row_kernel(void);
+
+/*
+Returns a printable name of the given row kernel ("AVX-512", "AVX2" or "scalar").
+*/
+const char* row_kernel_name(accumulate_row_fn kernel);
+
+/*
+Numeric pass of the two-phase Gustavson algorithm with an exchangeable row kernel. The
+result matrix must have been initialized by symbolic_multiply(). For every row, the
+columns are collected with a marker array, accumulate_row() adds the products into a dense
+accumulator and the row is gathered into values/colIndices (exact zeros are dropped).
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed.
+*/
+int multiply_with_row_kernel(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result,
+    accumulate_row_fn accumulate_row
+    );
+
+/*
+multiply_with_row_kernel() with a double accumulator, for PRECISION_MIXED and
+PRECISION_DOUBLE. The result of the _double version must have been initialized by
+symbolic_multiply_double().
+*/
+int multiply_with_row_kernel_mixed(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result,
+    accumulate_row_mixed_fn accumulate_row
+    );
+int multiply_with_row_kernel_double(
+    const DoubleMatrix* const restrict matrix_a,
+    const DoubleMatrix* const restrict matrix_b,
+    DoubleMatrix* const restrict matrix_result,
+    accumulate_row_double_fn accumulate_row
+    );
+
+/*
+This is version 7 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V7().
+
+Two-phase Gustavson's algorithm like version 6, the numeric pass uses accumulate_row_avx2().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed.
+*/
+int multiply_V7(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+This is version 8 of the CSR Matrix multiplication algorithm, called in matr_mult_csr_V8().
+
+Two-phase Gustavson's algorithm like version 6, the numeric pass uses accumulate_row_avx512().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the accumulator or the marker array cannot be malloc'ed.
+*/
+int multiply_V8(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result
+    );
+
+/*
+This function, called in matr_mult_csr(), starts threads that then multiply the chunks of
+rows in the given queue. Each thread calls multiply_queue_worker(). With --numa (see
+mult_config), thread i is pinned with numa_pin_thread(), a failed pinning is not an error.
+
+Return values:
+    0 if the threads all started with no error.
+    HEAP_MEMORY_ERROR if memory for the thread array could not be allocated.
+    THREAD_START_ERROR if one of the threads could not be created.
+*/
+int start_threads(
+    const unsigned int thread_count, pthread_t** threads, struct MultiplyQueue* queue
+    );
+
+/*
+Returns the number of CPUs the process may run on (its affinity mask), and the number of
+processors of the system if the mask cannot be read.
+*/
+unsigned int available_cpus(void);
+
+/*
+Returns the size of the L2 cache in bytes, or DEFAULT_CACHE_SIZE if the system does not
+report it.
+*/
+uint64_t l2_cache_size(void);
+
+/*
+Cost model for the number of threads in matr_mult_csr().
+
+If config->thread_count is set, it is used as is. Otherwise every thread must get at least
+THREAD_COND_MIN_FLOPS estimated flops, THREAD_COND_MIN_VALUES non-zero values and
+THREAD_COND_MIN_ROWS rows of A, and half of an L2 cache worth of working set. The result
+never exceeds the number of available CPUs (taken from the affinity mask) or rows of A.
+
+The inputs and the result of the model are stored in decision.
+
+Return value: The number of threads to use (at least 1).
+*/
+unsigned int choose_thread_count(
+    const Matrix* const matrix_a, const Matrix* const matrix_b, const uint64_t flops,
+    const MultiplyConfig* const config, ThreadDecision* const decision
+    );
+
+/*
+Checks if multiplication of the given matrices (in CSR format) is mathematically defined.
+
+Return values:
+    1 if they can be multiplied,
+    0 if not.
+*/
+int can_multiply(const Matrix* const a, const Matrix* const b);
+
+/*
+Cleans up zero values in the given matrix, as the CSR format does not store them.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR when a malloc/realloc call returns a null pointer.
+*/
+int clean_up_csr(Matrix* const matrix);
+
+/*
+This is a helper function is called in _clean_up_csr(). Used to clean up the zero values in the matrix.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR when a malloc call returns a null pointer.
+*/
+int _clean_up_matrix_arrays(Matrix* matrix, uint64_t* non_zero_values);
+
+/*
+Predicts the amount of non-zero-values in the resulting CSR matrix.
+Usage of this function greatly decreases memory usage, as the memory for the
+array is dynamically allocated on the heap.
+
+The prediction is stored in 'values_size'. It is an upper limit, the estimator
+SIZE_ESTIMATE_BOUND of estimate_values_dimension().
+
+Return value: 
+    0 on success.
+    HEAP_MEMORY_ERROR if a malloc call fails.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+int predict_values_dimension(
+    const Matrix* const restrict matrix_a, 
+    const Matrix* const restrict matrix_b, 
+    uint64_t* const values_size
+    );
+
+/*
+Estimates the number of non-zero values of A*B with the given estimator (SIZE_ESTIMATE_*, see
+config.h) and stores it in values_size:
+
+SIZE_ESTIMATE_BOUND: the flops of every row, but at most noCols of B. An upper bound that
+    ignores products meeting in the same column.
+SIZE_ESTIMATE_EXACT: the distinct columns of every row (a symbolic pass with a marker), the
+    exact nnz unless values cancel out to zero. Costs about as much as the products themselves.
+SIZE_ESTIMATE_SAMPLE: the distinct columns of SIZE_SAMPLE_ROWS rows spread evenly over A,
+    scaled by the share of the bound they reached to all rows, plus 1/SIZE_SAMPLE_MARGIN
+    and at most the bound. Every row reaches between 0 and all of its bound, so the error
+    shrinks like 1/sqrt(SIZE_SAMPLE_ROWS) of the bound, but it can be too low. With
+    SIZE_SAMPLE_ROWS rows or less, the exact count is used.
+
+The pass over all rows (the bound, and the exact count) is split into one chunk per thread
+with about the same number of values of A, which run on the thread pool if it exists,
+otherwise on newly started threads. Small matrices stay on the calling thread.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the markers or the chunks cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+int estimate_values_dimension(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const int estimator,
+    uint64_t* const values_size
+    );
+
+/*
+Sums the bound of every row of A*B in bound and, if exact_flag is set, the distinct columns of
+every row in nnz (see estimate_values_dimension()).
+
+This function is called in estimate_values_dimension() and should not be called outside of it.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the markers or the chunks cannot be malloc'ed.
+    THREAD_START_ERROR if one of the threads cannot be created/started.
+*/
+int _estimate_all_rows(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    const int exact_flag,
+    uint64_t* const bound,
+    uint64_t* const nnz
+    );
+
+/*
+Adds the bound and, if marker is not NULL, the distinct columns of every step-th row from
+first_row to last_row - 1 of A*B to a struct SizeEstimateArg.
+*/
+void* size_estimate_task(void* void_arg);
+
+/*
+Estimates the work (flops) of every row of the result matrix. The flops of a row are the
+sum of the lengths of the rows of B that the non-zero values of the row of A point to.
+
+Allocates an array of size noRows of A + 1 and stores the prefix sum of the flops per row in
+it, so row_flops[i+1] - row_flops[i] are the flops of row i and row_flops[noRows] is the
+total. This array should then be free'd.
+
+Return value:
+    0 on success.
+    HEAP_MEMORY_ERROR if the array cannot be malloc'ed.
+*/
+int compute_row_flops(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    uint64_t** const row_flops
+    );
+
+/*
+Stores the prefix sum of the flops per row (see compute_row_flops()) in row_flops, which
+must hold noRows of A + 1 elements.
+*/
+void fill_row_flops(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    uint64_t* const restrict row_flops
+    );
+
+/*
+Initializes an empty MultiplyWorkspace, no memory is allocated until the first multiplication.
+*/
+void init_multiply_workspace(MultiplyWorkspace* const workspace);
+
+/*
+Frees all buffers of the workspace and empties it, so it can be used again. Results that
+point into the workspace are invalid afterwards.
+*/
+void free_multiply_workspace(MultiplyWorkspace* const workspace);
+
+/*
+Makes sure the buffer *array of the workspace holds at least count elements of element_size
+bytes. A buffer that is too small is replaced by one of at least twice its capacity, its
+contents are not kept. If zeroed is not 0, the new buffer is zeroed.
+
+This function is called in matr_mult_csr_ws().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the new buffer cannot be allocated, *array is NULL then.
+*/
+int _reserve_workspace_array(
+    void** const array, uint64_t* const capacity, const size_t element_size,
+    const uint64_t count, const int zeroed
+    );
+
+/*
+Initializes an empty plan, it is created on the first matr_mult_csr_planned(). If scatter_flag
+is not 0, the plan will also hold the scatter map (one index per product of A*B).
+*/
+void init_multiply_plan(MultiplyPlan* const plan, const int scatter_flag);
+
+/*
+Frees the arrays of the plan and empties it, the scatter flag is kept.
+*/
+void free_multiply_plan(MultiplyPlan* const plan);
+
+/*
+Initializes an empty chain, the order is chosen on the first matr_mult_chain().
+*/
+void init_multiply_chain(MultiplyChain* const chain);
+
+/*
+Frees the order and the workspaces of the chain and empties it. Intermediate products are
+invalid afterwards.
+*/
+void free_multiply_chain(MultiplyChain* const chain);
+
+/*
+Chooses the order of the count >= 2 operands with the least estimated flops (dynamic
+programming over all subchains, like the classic matrix chain order but with a sparse cost
+model). The previous order of the chain is free'd.
+
+The flops of two adjacent operands k and k+1 are exact, like in compute_row_flops()
+(every value in column i of k meets the values in row i of k+1). A product keeps the row
+lengths of its first and the column counts of its last operand, scaled to its estimated nnz,
+so multiplying two subchains at operand k costs those flops scaled by both factors. The nnz
+of a product of m x n entries with f flops is f * m * n / (f + m * n): close to f while
+products rarely meet, and close to m * n for a product that fills up.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if one of the arrays cannot be malloc'ed, the chain is empty then.
+*/
+int choose_chain_order(const Matrix* const* const operands, const unsigned int count, MultiplyChain* const chain);
+
+/*
+Initializes an empty MultiplyBatch, no memory is allocated until the first matr_mult_csr_batch().
+*/
+void init_multiply_batch(MultiplyBatch* const batch);
+
+/*
+Frees the slab and the scratch of the batch and empties it. Results that point into the slab
+are invalid afterwards.
+*/
+void free_multiply_batch(MultiplyBatch* const batch);
+
+/*
+Stores the upper bound of the non-zero values of every product of a task (struct BatchTask)
+in the valuesSize of its result: the sum of min(flops, noCols of B) over the rows, like the
+row slots of fill_row_offsets(). It only reads the row pointers of B, so it is much cheaper
+than a symbolic pass.
+
+This function is run on the thread pool by matr_mult_csr_batch().
+*/
+void* batch_bound_task(void* void_task);
+
+/*
+Multiplies every product of a task (struct BatchTask) into its result, whose subarrays
+already point into the slab, in a single pass like multiply_V6(): the columns of a row are
+collected while its products are accumulated, so no symbolic pass is needed. Values that
+cancel out are dropped, the valuesSize of the result is set to its actual nnz.
+
+This function is run on the thread pool by matr_mult_csr_batch().
+*/
+void* batch_numeric_task(void* void_task);
+
+/*
+Checks if the plan was created for matrices with the dimensions and nnz of A and B.
+
+Return values:
+    1 if the plan can be used for A*B,
+    0 if it is empty or belongs to other matrices.
+*/
+int multiply_plan_matches(
+    const MultiplyPlan* const plan, const Matrix* const matrix_a, const Matrix* const matrix_b
+    );
+
+/*
+Computes the structure of A*B (and the scatter map if the flag of the plan is set) into
+the plan, the previous plan is free'd.
+
+This function is called in matr_mult_csr_planned().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if one of the arrays cannot be malloc'ed, the plan is empty then.
+*/
+int create_multiply_plan(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    MultiplyPlan* const restrict plan
+    );
+
+/*
+Numeric pass on the structure of the plan, which must match A and B. The subarrays of the
+result are malloc'ed and belong to the result. Zeros from numerical cancellation are dropped.
+
+This function is called in matr_mult_csr_planned().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the result or the accumulator cannot be malloc'ed.
+*/
+int multiply_planned(
+    const Matrix* const restrict matrix_a,
+    const Matrix* const restrict matrix_b,
+    Matrix* const restrict matrix_result,
+    const MultiplyPlan* const restrict plan
+    );
+
+/*
+SpMM kernels (see dense_rows_fn). Every row of C is the sum of the rows of B picked by the
+values of the row of A, scaled by them. The AVX kernels keep a block of the row of C in
+registers (32 columns with AVX2, 64 with AVX-512) while all values of the row of A are
+added into it with FMA, so every element of C is stored once. All columns are summed in the
+order of A, the AVX kernels give the same results as each other.
+
+The CPU must support AVX2 and FMA for spmm_rows_avx2(), AVX-512F for spmm_rows_avx512().
+*/
+void spmm_rows_scalar(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+void spmm_rows_avx2(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+void spmm_rows_avx512(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+
+/*
+SpMV kernels (see dense_rows_fn): every element of the vector C is the dot product of a row
+of A with the vector B. The AVX kernels gather the elements of B picked by 4 (AVX2) or 8
+(AVX-512) column indices at a time and sum the lanes at the end of the row, so the sums
+are rounded differently than in the scalar kernel.
+
+Same CPU requirements as the SpMM kernels.
+*/
+void spmv_rows_scalar(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+void spmv_rows_avx2(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+void spmv_rows_avx512(
+    const Matrix* const restrict matrix_a, const DenseMatrix* const restrict matrix_b,
+    DenseMatrix* const restrict matrix_result, const uint64_t first_row, const uint64_t last_row
+    );
+
+/*
+Returns the fastest SpMM or SpMV kernel the CPU supports (AVX-512, then AVX2, then scalar).
+The CPU is checked on the first call only, like in best_row_kernel(). These functions are
+thread safe.
+*/
+dense_rows_fn best_spmm_kernel(void);
+dense_rows_fn best_spmv_kernel(void);
+
+/*
+Resolves and caches a kernel for best_spmm_kernel() and best_spmv_kernel().
+
+This function is called in best_spmm_kernel() and best_spmv_kernel() and should not be called outside of them.
+*/
+dense_rows_fn _best_dense_kernel(
+    dense_rows_fn* const cached, dense_rows_fn avx512, dense_rows_fn avx2, dense_rows_fn scalar
+    );
+
+/*
+Returns a printable name of the given SpMM or SpMV kernel ("AVX-512", "AVX2" or "scalar").
+*/
+const char* dense_kernel_name(dense_rows_fn kernel);
+
+/*
+Runs the kernel of a chunk of rows (struct DenseRowsArg) of matr_mult_spmm().
+*/
+void* dense_rows_task(void* void_arg);
+
+/*
+Returns the end of a chunk of rows that starts at first_row: the first row r with
+prefix[r] + r >= weight (binary search), at most noRows. prefix is a prefix sum over the rows
+(like rowPointers or the flops of compute_row_flops()), the row itself is counted as well, so
+empty rows are spread over the chunks too.
+*/
+uint64_t find_chunk_end(
+    const uint64_t* const prefix, const uint64_t noRows, const uint64_t first_row, const uint64_t weight
+    );
+
+/*
+Stores the slot offsets of the rows of a product with a complemented mask in rowPointers
+(noRows of the mask + 1 elements): the slot of a row has room for its flops, but at most for
+the columns that are not in the mask row. row_flops is the prefix sum from compute_row_flops(),
+noCols is noCols of B.
+
+This function is called in matr_mult_csr_masked_complement().
+
+Return value: The total size of the slots, the size of values and colIndices of the result.
+*/
+uint64_t fill_complement_offsets(
+    const Matrix* const restrict mask, const uint64_t noCols, const uint64_t* const restrict row_flops,
+    uint64_t* const restrict rowPointers
+    );
+
+/*
+Multiplies the rows first_row to last_row - 1 of a masked product (struct MaskedRowsArg) into
+their slots, which start at rowPointers[row] of the result, and stores the number of values
+of every row in rowNnz.
+
+With a mask, a product of A and B is only accumulated if its column is in the mask row, and
+the row of C is gathered in the order of the mask row. With a complemented mask, the products
+whose column is in the mask row are skipped, the row is gathered in the order the columns were
+found, like in V6. Exact zeros are dropped in both cases.
+
+Every row stamps the columns of its mask row in marker with 2 * row + 1 and the columns it
+found with 2 * row + 2, so marker never has to be reset. It must be zeroed before the first
+row, accumulator must be zeroed and is zeroed again on return.
+*/
+void* masked_rows_task(void* void_arg);
 
 /*
 Initializes an empty result CSR matrix.
@@ -181,10 +1526,13 @@ If the value passed for predict_flag is not 0, the size of the values array is
 mathematically predicted, in contrast to init_empty_csr_matrix_prediction(). 
 This prediction is an upper limit to the size of values, which greatly improves 
 performance in a very big but relatively sparse matrix (e.g 100x100 but only 1 nnz).
+predict_flag is the estimator of estimate_values_dimension() then (PREDICT_SIZE is the
+upper limit). SIZE_ESTIMATE_SAMPLE can be too low, the caller has to grow the arrays then.
 
 Return values:
     0 on success.
     HEAP_MEMORY_ERROR when memory for one of the subarrays could not be allocated.
+    THREAD_START_ERROR when the threads of the estimator could not be started.
 */
 int init_empty_csr_matrix(
     const Matrix* const restrict matrix_a, const Matrix* const restrict matrix_b, 
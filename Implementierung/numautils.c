@@ -0,0 +1,214 @@
+/*
+This file contains the definitions of the NUMA functions.
+*/
+
+// We need this for sched_getcpu(), pthread_setaffinity_np() and the CPU_* macros
+#define _GNU_SOURCE
+
+// Default C library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+// Threading
+#include <pthread.h>
+#include <sched.h>
+
+// Our headers
+#include "numautils.h"
+#include "matrixutils.h"
+#include "utils.h"
+#include "constants.h"
+#include "config.h"
+
+
+// Topology of the CPUs in the affinity mask, read once by _read_numa_topology()
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static unsigned int node_count = 1;
+static cpu_set_t node_cpus[NUMA_MAX_NODES];
+static unsigned int cpu_nodes[CPU_SETSIZE];  // node index of every CPU, 0 for CPUs of no node
+static int pin_order[CPU_SETSIZE];  // CPUs round robin over the nodes
+static unsigned int pin_count = 0;
+
+
+unsigned int numa_node_count(void) {
+    pthread_once(&topology_once, &_read_numa_topology);
+    return node_count;
+}
+
+unsigned int numa_current_node(void) {
+    pthread_once(&topology_once, &_read_numa_topology);
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < CPU_SETSIZE ? cpu_nodes[cpu] : 0;
+}
+
+int numa_pin_thread(pthread_t thread, const unsigned int worker) {
+    pthread_once(&topology_once, &_read_numa_topology);
+    if (pin_count == 0) {
+        return NUMA_PIN_ERROR;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(pin_order[worker % pin_count], &cpu_set);
+    return pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) ? NUMA_PIN_ERROR : 0;
+}
+
+int numa_replicate_matrix(const Matrix* const matrix, Matrix** replicas) {
+    pthread_once(&topology_once, &_read_numa_topology);
+
+    *replicas = calloc(node_count, sizeof(Matrix));
+    struct ReplicaArg* args = malloc(sizeof(struct ReplicaArg) * node_count);
+    pthread_t* threads = malloc(sizeof(pthread_t) * node_count);
+    if (*replicas == NULL || args == NULL || threads == NULL) {
+        free_pointers(3, *replicas, args, threads);
+        *replicas = NULL;
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // Start one thread on every node, it allocates and copies the replica of its node
+    int result = 0;
+    unsigned int started = 0;
+    for (unsigned int node = 0; node < node_count; node++) {
+        args[node].matrix = matrix;
+        args[node].replica = &(*replicas)[node];
+        args[node].result = 0;
+
+        pthread_attr_t attr;
+        if (pthread_attr_init(&attr)) {
+            result = THREAD_START_ERROR;
+            break;
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &node_cpus[node]);
+        int create_result = pthread_create(&threads[node], &attr, &_replicate_on_node, &args[node]);
+        pthread_attr_destroy(&attr);
+        if (create_result) {
+            result = THREAD_START_ERROR;
+            break;
+        }
+        started++;
+    }
+
+    for (unsigned int node = 0; node < started; node++) {
+        pthread_join(threads[node], NULL);
+        if (args[node].result != 0 && result == 0) {
+            result = args[node].result;
+        }
+    }
+    free_pointers(2, args, threads);
+
+    if (result != 0) {
+        numa_free_replicas(*replicas);
+        *replicas = NULL;
+    }
+    return result;
+}
+
+void numa_free_replicas(Matrix* replicas) {
+    if (replicas == NULL) {
+        return;
+    }
+    // The replicas array is calloc'ed, so replicas that were never copied hold NULL ptrs
+    for (unsigned int node = 0; node < node_count; node++) {
+        free_pointers(3, replicas[node].values, replicas[node].colIndices, replicas[node].rowPointers);
+    }
+    free(replicas);
+}
+
+/*
+Adds the CPUs of a list like "0-3,8-11" (the format of the cpulist files) to cpu_set.
+*/
+static void _parse_cpu_list(const char* list, cpu_set_t* const cpu_set) {
+    char* endptr;
+    while (*list >= '0' && *list <= '9') {
+        unsigned long first = strtoul(list, &endptr, 10);
+        unsigned long last = first;
+        if (*endptr == '-') {
+            last = strtoul(endptr + 1, &endptr, 10);
+        }
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, cpu_set);
+        }
+        list = *endptr == ',' ? endptr + 1 : endptr;
+    }
+}
+
+void _read_numa_topology(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;  // nothing can be pinned, everything stays on node 0
+    }
+
+    // Nodes without a CPU of the affinity mask are skipped, their memory is only reached remotely
+    node_count = 0;
+    char path[64];
+    char list[4096];
+    for (unsigned int node = 0; node < NUMA_MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) {
+            continue;  // node ids can have gaps
+        }
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (fgets(list, sizeof(list), file) != NULL) {
+            _parse_cpu_list(list, &cpu_set);
+        }
+        fclose(file);
+
+        CPU_AND(&node_cpus[node_count], &cpu_set, &allowed);
+        if (CPU_COUNT(&node_cpus[node_count]) > 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &node_cpus[node_count])) {
+                    cpu_nodes[cpu] = node_count;
+                }
+            }
+            node_count++;
+        }
+    }
+    if (node_count == 0) {
+        // No NUMA information (e.g. no sysfs), all CPUs form one node
+        node_count = 1;
+        node_cpus[0] = allowed;
+    }
+
+    // Take the next CPU of every node in turn
+    unsigned int taken[NUMA_MAX_NODES] = {0};
+    int found = 1;
+    while (found) {
+        found = 0;
+        for (unsigned int node = 0; node < node_count; node++) {
+            unsigned int seen = 0;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &node_cpus[node]) && seen++ == taken[node]) {
+                    pin_order[pin_count++] = cpu;
+                    taken[node]++;
+                    found = 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void* _replicate_on_node(void* void_arg) {
+    struct ReplicaArg* arg = (struct ReplicaArg*) void_arg;  // to fit thread creation signature
+    const Matrix* matrix = arg->matrix;
+    Matrix* replica = arg->replica;
+
+    // Allocated and written by this thread, so the pages are placed on its node
+    *replica = *matrix;
+    replica->mapping = NULL;
+    replica->mappingSize = 0;
+    replica->values = malloc_safe(sizeof(float), matrix->valuesSize ? matrix->valuesSize : 1);
+    replica->colIndices = malloc_safe(sizeof(uint64_t), matrix->valuesSize ? matrix->valuesSize : 1);
+    replica->rowPointers = malloc_safe(sizeof(uint64_t), matrix->rowPointersSize);
+    if (replica->values == NULL || replica->colIndices == NULL || replica->rowPointers == NULL) {
+        arg->result = HEAP_MEMORY_ERROR;  // the replica is free'd by numa_free_replicas()
+        return NULL;
+    }
+    memcpy(replica->values, matrix->values, sizeof(float) * matrix->valuesSize);
+    memcpy(replica->colIndices, matrix->colIndices, sizeof(uint64_t) * matrix->valuesSize);
+    memcpy(replica->rowPointers, matrix->rowPointers, sizeof(uint64_t) * matrix->rowPointersSize);
+
+    return NULL;  // this is required for pthread_create()
+}
@@ -0,0 +1,82 @@
+#ifndef NUMAUTILS_H
+#define NUMAUTILS_H
+
+// Default C library headers
+#include <stdint.h>
+#include <pthread.h>
+
+// Our headers
+#include "csrmatrix.h"
+
+// This file contains the NUMA topology, thread pinning and replication used by matr_mult_csr() with --numa.
+
+// Define constants
+#define NUMA_PIN_ERROR -7  // the affinity of a thread cannot be set
+
+/*
+The ReplicaArg struct is passed to _replicate_on_node() by numa_replicate_matrix(), one for
+every node. result is the return value of the copy (0 or HEAP_MEMORY_ERROR).
+*/
+struct ReplicaArg {
+    const Matrix* matrix;
+    Matrix* replica;
+    int result;
+};
+
+/*
+Returns the number of NUMA nodes with at least one CPU in the affinity mask of the process,
+1 if the system does not report its nodes.
+The topology is read from /sys/devices/system/node on the first call of any numa_ function.
+*/
+unsigned int numa_node_count(void);
+
+/*
+Returns the index (0 to numa_node_count() - 1) of the node the calling thread runs on.
+*/
+unsigned int numa_current_node(void);
+
+/*
+Pins thread to a single CPU of the affinity mask. Consecutive workers are spread round robin
+over the nodes, so a few threads already use the memory bandwidth of every node. Worker 0
+of the thread pool is the calling thread of thread_pool_run().
+
+Return values:
+    0 on success.
+    NUMA_PIN_ERROR if the affinity of the thread cannot be set, it keeps running unpinned.
+*/
+int numa_pin_thread(pthread_t thread, const unsigned int worker);
+
+/*
+Copies the subarrays of matrix once for every node into *replicas (numa_node_count() matrices).
+Every copy is made by a thread running on its node, so its pages are first touched there.
+The replicas must be free'd with numa_free_replicas().
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if a copy cannot be malloc'ed, *replicas is NULL.
+    THREAD_START_ERROR if a copying thread cannot be started, *replicas is NULL.
+*/
+int numa_replicate_matrix(const Matrix* const matrix, Matrix** replicas);
+
+/*
+Frees the replicas created by numa_replicate_matrix(). Does nothing for NULL.
+*/
+void numa_free_replicas(Matrix* replicas);
+
+/*
+Reads the CPUs of every node and the pinning order once.
+
+This function is called with pthread_once() by the numa_ functions and should not be called
+outside of them.
+*/
+void _read_numa_topology(void);
+
+/*
+Copies a matrix (struct ReplicaArg) on the node of the calling thread.
+
+This function is the start routine of the threads of numa_replicate_matrix() and should not
+be called outside of it.
+*/
+void* _replicate_on_node(void* void_arg);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+This file contains the definitions of the pipeline stages of --pipeline.
+*/
+
+// Default C library
+#include <stdlib.h>
+// Threading
+#include <pthread.h>
+
+// Our headers
+#include "pipeline.h"
+#include "constants.h"
+#include "matrixutils.h"
+#include "utils.h"
+
+
+int init_block_queue(BlockQueue* const queue) {
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = 0;
+    queue->error = 0;
+
+    if (pthread_mutex_init(&queue->lock, NULL) != 0) {
+        return THREAD_START_ERROR;
+    }
+    if (pthread_cond_init(&queue->not_empty, NULL) != 0) {
+        pthread_mutex_destroy(&queue->lock);
+        return THREAD_START_ERROR;
+    }
+    if (pthread_cond_init(&queue->not_full, NULL) != 0) {
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->lock);
+        return THREAD_START_ERROR;
+    }
+    return 0;
+}
+
+void free_block_queue(BlockQueue* const queue) {
+    for (unsigned int i = 0; i < queue->count; i++) {
+        free_csr_matrix(queue->blocks[(queue->head + i) % PIPELINE_QUEUE_DEPTH]);
+    }
+    queue->count = 0;
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+int push_block(BlockQueue* const queue, Matrix* const block) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == PIPELINE_QUEUE_DEPTH && !queue->closed) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->blocks[(queue->head + queue->count) % PIPELINE_QUEUE_DEPTH] = block;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+Matrix* pop_block(BlockQueue* const queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    Matrix* block = NULL;
+    if (queue->count) {
+        block = queue->blocks[queue->head];
+        queue->head = (queue->head + 1) % PIPELINE_QUEUE_DEPTH;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return block;
+}
+
+void close_block_queue(BlockQueue* const queue, const int error) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    if (!queue->error) {
+        queue->error = error;
+    }
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void* read_blocks_thread(void* void_task) {
+    BlockReaderTask* task = (BlockReaderTask*) void_task;
+
+    while (1) {
+        int result = read_row_block(task->reader);
+        if (result != MATRIX_READ_SUCCESS) {
+            close_block_queue(task->queue, result);
+            return NULL;
+        }
+        if (!task->reader->block.noRows) {
+            break;  // all rows were read
+        }
+
+        Matrix* block = _detach_row_block(task->reader);
+        if (block == NULL) {
+            close_block_queue(task->queue, HEAP_MEMORY_ERROR);
+            return NULL;
+        }
+        if (push_block(task->queue, block) != 0) {
+            free_csr_matrix(block);  // the multiplication stopped
+            return NULL;
+        }
+    }
+
+    close_block_queue(task->queue, 0);
+    return NULL;
+}
+
+void* write_blocks_thread(void* void_task) {
+    BlockWriterTask* task = (BlockWriterTask*) void_task;
+
+    Matrix* block;
+    while ((block = pop_block(task->queue)) != NULL) {
+        int result = write_row_block(task->writer, block);
+        free_csr_matrix(block);
+        if (result != MATRIX_WRITE_SUCCESS) {
+            close_block_queue(task->queue, FILE_WRITE_ERROR);
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+Matrix* _detach_row_block(RowBlockReader* const reader) {
+    Matrix* block = malloc(sizeof(Matrix));
+    if (block == NULL) {
+        return NULL;
+    }
+    *block = reader->block;
+    block->mapping = NULL;
+    block->mappingSize = 0;
+
+    // read_row_block() reallocates arrays without capacity
+    reader->block.values = NULL;
+    reader->block.colIndices = NULL;
+    reader->block.rowPointers = NULL;
+    reader->valuesCapacity = 0;
+    reader->rowPointersCapacity = 0;
+    return block;
+}
@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Default C library headers
+#include <stdint.h>
+#include <pthread.h>
+
+// Our headers
+#include "csrmatrix.h"
+#include "utils.h"
+#include "config.h"
+
+// This file contains the stages of the pipelined multiplication (--pipeline).
+
+/*
+The struct BlockQueue hands row blocks (heap matrices, see free_csr_matrix()) from one stage
+of the pipeline to the next. It is a ring buffer of at most PIPELINE_QUEUE_DEPTH blocks, so a
+fast producer waits on not_full instead of filling the memory.
+
+closed is set when no more blocks are pushed, either because the producer is done or a stage
+failed. error is the first error code given to close_block_queue() that is not 0.
+*/
+typedef struct {
+    Matrix* blocks[PIPELINE_QUEUE_DEPTH];
+    unsigned int head;  // index of the next block to pop
+    unsigned int count;
+    int closed;
+    int error;
+
+    pthread_mutex_t lock;  // protects everything above
+    pthread_cond_t not_empty;  // signalled when a block is pushed or the queue is closed
+    pthread_cond_t not_full;  // signalled when a block is popped or the queue is closed
+} BlockQueue;
+
+/*
+Argument of read_blocks_thread(): the opened reader of A and the queue its blocks go to.
+*/
+typedef struct {
+    RowBlockReader* reader;
+    BlockQueue* queue;
+} BlockReaderTask;
+
+/*
+Argument of write_blocks_thread(): the opened writer of the result and the queue its blocks
+come from.
+*/
+typedef struct {
+    RowBlockWriter* writer;
+    BlockQueue* queue;
+} BlockWriterTask;
+
+/*
+Initializes an empty, open queue.
+
+Return values:
+    0 on success.
+    THREAD_START_ERROR if the mutex or the condition variables cannot be created.
+*/
+int init_block_queue(BlockQueue* const queue);
+
+/*
+Frees the blocks that are still in the queue and destroys its mutex and condition variables.
+*/
+void free_block_queue(BlockQueue* const queue);
+
+/*
+Appends block to the queue, waiting while the queue is full. The queue owns the block then.
+
+Return values:
+    0 on success.
+    -1 if the queue was closed (the consumer failed), the block still belongs to the caller.
+*/
+int push_block(BlockQueue* const queue, Matrix* const block);
+
+/*
+Takes the oldest block out of the queue, waiting while the queue is empty and open.
+
+Return value: The block, or NULL if the queue is closed and empty.
+*/
+Matrix* pop_block(BlockQueue* const queue);
+
+/*
+Closes the queue and wakes up all stages that wait for it. Blocks that were pushed before
+can still be popped. error is kept if the queue has no error yet, 0 closes it regularly.
+*/
+void close_block_queue(BlockQueue* const queue, const int error);
+
+/*
+Start routine of the thread that reads A: reads the blocks of task->reader and pushes them
+into task->queue until all rows were read. The queue is closed afterwards, with
+MATRIX_FILE_FORMAT_ERROR or HEAP_MEMORY_ERROR if A could not be read.
+
+Return value: NULL
+*/
+void* read_blocks_thread(void* void_task);
+
+/*
+Start routine of the thread that writes the result: pops the blocks of task->queue, appends
+them with write_row_block() and frees them until the queue is closed and empty. If writing
+fails, the queue is closed with FILE_WRITE_ERROR and the thread returns.
+
+Return value: NULL
+*/
+void* write_blocks_thread(void* void_task);
+
+/*
+Moves the block of reader into a new heap matrix, so the next read_row_block() allocates
+new arrays instead of overwriting it.
+This function is called in read_blocks_thread() and should not be called outside of it.
+
+Return value: The block, or NULL if it cannot be malloc'ed.
+*/
+Matrix* _detach_row_block(RowBlockReader* const reader);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+This file contains the definitions of the worker thread pool functions.
+*/
+
+// Default C library
+#include <stdlib.h>
+// Threading
+#include <pthread.h>
+
+// Our headers
+#include "threadpool.h"
+#include "numautils.h"
+#include "constants.h"
+#include "config.h"
+
+
+// The library-level pool, NULL while no pool exists
+static struct ThreadPool* pool = NULL;
+
+
+int thread_pool_init(const unsigned int thread_count) {
+    if (pool != NULL) {
+        return 0;
+    }
+    if (!thread_count) {
+        return THREAD_POOL_START_ERROR;
+    }
+
+    struct ThreadPool* new_pool = malloc(sizeof(struct ThreadPool));
+    if (new_pool == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    new_pool->threads = malloc(sizeof(pthread_t) * thread_count);  // thread_count is a small number, no overflow
+    if (new_pool->threads == NULL) {
+        free(new_pool);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    pthread_mutex_init(&new_pool->lock, NULL);
+    pthread_mutex_init(&new_pool->run_lock, NULL);
+    pthread_cond_init(&new_pool->work_cond, NULL);
+    pthread_cond_init(&new_pool->done_cond, NULL);
+    new_pool->generation = 0;
+    new_pool->shutdown = 0;
+    new_pool->fn = NULL;
+    new_pool->args = NULL;
+    new_pool->task_count = 0;
+    new_pool->next_task = 0;
+    new_pool->worker_limit = 0;
+    new_pool->active_workers = 0;
+    new_pool->thread_count = 0;
+
+    for (unsigned int i = 0; i < thread_count; i++) {
+        if (pthread_create(&new_pool->threads[i], NULL, &_thread_pool_worker, new_pool)) {
+            // Error creating thread, stop the workers that were already started
+            pool = new_pool;
+            thread_pool_shutdown();
+            return THREAD_POOL_START_ERROR;
+        }
+        new_pool->thread_count++;
+    }
+
+    if (mult_config.numa != NUMA_OFF) {
+        // The calling thread works on the jobs as well, it is worker 0
+        numa_pin_thread(pthread_self(), 0);
+        for (unsigned int i = 0; i < thread_count; i++) {
+            numa_pin_thread(new_pool->threads[i], i + 1);  // only a hint, see numa_pin_thread()
+        }
+    }
+
+    pool = new_pool;
+    return 0;
+}
+
+void thread_pool_shutdown(void) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool);
+    pool = NULL;
+}
+
+unsigned int thread_pool_size(void) {
+    return pool == NULL ? 0 : pool->thread_count;
+}
+
+int thread_pool_run(thread_pool_fn fn, void** args, const unsigned int task_count, const unsigned int thread_limit) {
+    if (pool == NULL) {
+        return THREAD_POOL_START_ERROR;
+    }
+
+    pthread_mutex_lock(&pool->run_lock);
+
+    // Publish the job and wake up the workers
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->args = args;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+    pool->worker_limit = thread_limit && thread_limit - 1 < pool->thread_count ? thread_limit - 1 : pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Help with the tasks instead of just waiting
+    _thread_pool_run_tasks(pool, fn, args, task_count);
+
+    // All tasks are handed out now, so no worker can join anymore. Wait until every
+    // worker that joined this job has left it
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active_workers) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run_lock);
+
+    return 0;
+}
+
+// HELPER FUNCTIONS BELOW //
+// ---------------------- //
+
+void* _thread_pool_worker(void* void_pool) {
+    struct ThreadPool* worker_pool = (struct ThreadPool*) void_pool;
+    uint64_t seen_generation = 0;
+
+    pthread_mutex_lock(&worker_pool->lock);
+    while (1) {
+        while (!worker_pool->shutdown && worker_pool->generation == seen_generation) {
+            pthread_cond_wait(&worker_pool->work_cond, &worker_pool->lock);
+        }
+        if (worker_pool->shutdown) {
+            break;
+        }
+
+        // Join the new job, unless its tasks are already all handed out. Then the caller
+        // of thread_pool_run() may be about to return and free the arguments. Workers
+        // beyond the limit of the job skip it as well
+        seen_generation = worker_pool->generation;
+        if (__atomic_load_n(&worker_pool->next_task, __ATOMIC_RELAXED) >= worker_pool->task_count ||
+            worker_pool->active_workers >= worker_pool->worker_limit) {
+            continue;
+        }
+        thread_pool_fn fn = worker_pool->fn;
+        void** args = worker_pool->args;
+        unsigned int task_count = worker_pool->task_count;
+        worker_pool->active_workers++;
+        pthread_mutex_unlock(&worker_pool->lock);
+
+        _thread_pool_run_tasks(worker_pool, fn, args, task_count);
+
+        // Leave the job
+        pthread_mutex_lock(&worker_pool->lock);
+        if (--worker_pool->active_workers == 0) {
+            pthread_cond_signal(&worker_pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&worker_pool->lock);
+
+    return NULL;  // this is required for pthread_create()
+}
+
+void _thread_pool_run_tasks(struct ThreadPool* pool, thread_pool_fn fn, void** args, const unsigned int task_count) {
+    unsigned int task;
+    while ((task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED)) < task_count) {
+        fn(args[task]);
+    }
+}
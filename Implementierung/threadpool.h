@@ -0,0 +1,108 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Default C library headers
+#include <stdint.h>
+#include <pthread.h>
+
+// This file contains the library-level worker thread pool used by matr_mult_csr().
+
+// Define constants
+#define THREAD_POOL_START_ERROR -6  // error creating the worker threads of the pool
+
+/*
+Function type of a task run by the pool. It is the same as the start routine of a
+POSIX thread, so functions like multiply_main_implementation() can be used as is.
+*/
+typedef void* (*thread_pool_fn)(void* arg);
+
+/*
+The ThreadPool struct holds a set of worker threads that are created once and then
+reused for every job. A job consists of task_count calls fn(args[i]). Idle workers
+sleep on work_cond until a new job (generation) is published.
+
+Only one job runs at a time, run_lock serializes callers of thread_pool_run().
+*/
+struct ThreadPool {
+    pthread_t* threads;
+    unsigned int thread_count;
+
+    pthread_mutex_t lock;  // protects the job description and the counters below
+    pthread_mutex_t run_lock;  // held by the caller of thread_pool_run() for the whole job
+    pthread_cond_t work_cond;  // signalled when a new job is published or on shutdown
+    pthread_cond_t done_cond;  // signalled when the last worker leaves the current job
+
+    uint64_t generation;  // incremented for every new job
+    int shutdown;
+
+    thread_pool_fn fn;
+    void** args;
+    unsigned int task_count;
+    unsigned int next_task;  // index of the next task to hand out (atomic)
+    unsigned int worker_limit;  // most workers that may join the job
+    unsigned int active_workers;  // workers currently running tasks of the job
+};
+
+/*
+Creates the library-level thread pool with thread_count worker threads. Once the pool
+exists, matr_mult_csr() runs its threads on it instead of calling pthread_create()
+for every multiplication. The pool must be shut down with thread_pool_shutdown().
+
+The caller of thread_pool_run() works on the tasks as well, so a job runs on up to
+thread_count + 1 threads. For n threads in total, create the pool with n - 1 workers.
+
+With --numa (see mult_config), the workers and the calling thread are pinned to CPUs
+spread over the NUMA nodes with numa_pin_thread().
+
+Calling this function while the pool already exists does nothing.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if memory for the pool cannot be allocated.
+    THREAD_POOL_START_ERROR if one of the worker threads cannot be created.
+*/
+int thread_pool_init(const unsigned int thread_count);
+
+/*
+Wakes up and joins all worker threads of the library-level pool and frees its memory.
+matr_mult_csr() goes back to creating its own threads afterwards.
+
+Must not be called while a multiplication is running on the pool.
+*/
+void thread_pool_shutdown(void);
+
+/*
+Returns the number of worker threads of the library-level pool, or 0 if there is no pool.
+*/
+unsigned int thread_pool_size(void);
+
+/*
+Runs fn(args[i]) for every i < task_count on the library-level pool and blocks until all
+tasks are finished. The calling thread works on the tasks as well. Tasks are handed out
+one at a time, so task_count may be larger than the number of workers.
+
+At most thread_limit threads, the calling thread included, work on the job, so a smaller
+thread count than the size of the pool can be used. 0 lets all workers join.
+
+Return values:
+    0 on success.
+    THREAD_POOL_START_ERROR if there is no pool.
+*/
+int thread_pool_run(thread_pool_fn fn, void** args, const unsigned int task_count, const unsigned int thread_limit);
+
+/*
+The loop every worker thread of the pool runs until the pool is shut down.
+
+This function is called in thread_pool_init() and should not be called outside of it.
+*/
+void* _thread_pool_worker(void* void_pool);
+
+/*
+Takes tasks of the current job from the pool until there are none left.
+
+This function is called by the workers and by thread_pool_run() and should not be
+called outside of them.
+*/
+void _thread_pool_run_tasks(struct ThreadPool* pool, thread_pool_fn fn, void** args, const unsigned int task_count);
+
+#endif
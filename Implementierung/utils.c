@@ -1,17 +1,45 @@
+// We need this for madvise()
+#define _GNU_SOURCE
+
 // C library headers
 #include <getopt.h>
 #include <string.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <time.h>
+// Memory mapped file reading
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Our headers
 #include "csrmatrix.h"
 #include "utils.h"
+#include "matrixutils.h"
+#include "bench.h"
 
 // Constants for argument parsing
 const char* matrix_optstring = ":a:b:o:hB::V:";
 const struct option matrix_options[] = {
         {"help", no_argument, NULL, 'h'},
+        {"schedule", required_argument, NULL, OPT_SCHEDULE},
+        {"chunk-size", required_argument, NULL, OPT_CHUNK_SIZE},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"precision", required_argument, NULL, OPT_PRECISION},
+        {"stream", optional_argument, NULL, OPT_STREAM},
+        {"plan", no_argument, NULL, OPT_PLAN},
+        {"numa", required_argument, NULL, OPT_NUMA},
+        {"bench", optional_argument, NULL, OPT_BENCH},
+        {"bench-impls", required_argument, NULL, OPT_BENCH_IMPLS},
+        {"warmup", required_argument, NULL, OPT_WARMUP},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"pipeline", optional_argument, NULL, OPT_PIPELINE},
+        {"chain", required_argument, NULL, OPT_CHAIN},
+        {"dense", no_argument, NULL, OPT_DENSE},
+        {"mask", required_argument, NULL, OPT_MASK},
+        {"complement", no_argument, NULL, OPT_COMPLEMENT},
+        {"estimate", required_argument, NULL, OPT_ESTIMATE},
         {0, 0, 0, 0}
     };
 
@@ -25,7 +53,47 @@ const char* HELP_MSG =
 "Optional arguments:\n"
 "  -h, --help     Display help message and exit program\n"
 "  -B<n>    Measure time n times and print (n is optional, default: n = 1)\n"
-"  -V <n>    Implementation to use (default: n = 0)\n";
+"  -V <n>    Implementation to use (default: n = 0)\n"
+"  --schedule <s>    How V0 distributes rows to threads: static, balanced or dynamic\n"
+"                    (default: dynamic)\n"
+"  --chunk-size <n>    Rows per chunk for --schedule dynamic (default: flop-balanced chunks)\n"
+"  --threads <n>    Number of threads for V0, 1 runs single threaded (default: cost model)\n"
+"  --precision <p>    Value type of V6 - V9: float, mixed (float values, double accumulation)\n"
+"                     or double (default: float)\n"
+"  --stream[=<n>]    Read A in blocks of n non-zero values and write the result block by block,\n"
+"                    so A and the result don't have to fit into memory (default: n = 4194304)\n"
+"  --pipeline[=<n>]    Like --stream with blocks of n non-zero values (default: n = 262144), but\n"
+"                      A and B are read at the same time, and while a block is multiplied the\n"
+"                      next blocks of A are read and the finished blocks of the result written\n"
+"  --plan    With -B, compute the structure of the result once and only redo the numeric work\n"
+"            in every run, for matrices whose sparsity pattern doesn't change (replaces -V)\n"
+"  --numa <m>    NUMA placement of V0: pin (pin the threads to CPUs spread over the nodes) or\n"
+"                replicate (pin, and give every node its own copy of B if it is small enough)\n"
+"  --bench[=<f>]    Benchmark the implementations of --bench-impls on A and B and print min,\n"
+"                   median and p95 of the runs, GFLOP/s, GB/s and the time of every phase and\n"
+"                   of the I/O as text, json or csv (default: text). -B<n> is the number of\n"
+"                   measured runs (default: n = 5)\n"
+"  --bench-impls <l>    Implementations for --bench, all or a list like 0,2-5\n"
+"                       (default: all but the dense V1)\n"
+"  --warmup <n>    Runs of every implementation before the measured runs of --bench (default: 1)\n"
+"  --stats    Print the counters of V0: products, predicted and actual nnz of the result, allocated\n"
+"             bytes, phases and the busy time and rows of every thread (also switched on by\n"
+"             the environment variable " MULTIPLY_STATS_ENV ")\n"
+"  --chain <filename>    Multiply the result by one more matrix, can be given several times:\n"
+"                        A * B * C1 * C2 * ... is multiplied by V0 in the order of the least\n"
+"                        estimated flops, the intermediate products stay in memory\n"
+"  --dense    B and the result are dense matrices: one line \"rows,cols\", then one line of\n"
+"             comma separated values per row. A * B is multiplied by the SpMM kernels, or the\n"
+"             SpMV kernels if B has one column\n"
+"  --mask <filename>    Only compute the values of A * B that are in the sparsity pattern of\n"
+"                       this matrix (its values are ignored)\n"
+"  --complement    With --mask, only compute the values that are not in the pattern of the mask\n"
+"  --estimate <e>    Size estimate of the result arrays of V5: bound (upper limit from the\n"
+"                    flops of every row), exact (symbolic pass) or sample (exact count of\n"
+"                    a sample of the rows, the arrays grow if it was too low) (default: sample)\n"
+"\n"
+"Input files can be in the text or in the binary CSR format, which is detected automatically.\n"
+"The result is written in the binary format if the output filename ends with " BINARY_CSR_EXTENSION ".\n";
 
 const char* HOW_TO_USE_MSG = "Add -h or --help to learn how to use the program.\n";
 const char* ILLEGAL_NUMBER_MEASURES_MSG = "Number of times to measure cannot be \"%s\"\n";
@@ -34,6 +102,27 @@ const char* MISSING_ARG_MSG = "Missing argument for option -%c\n";
 const char* ILLEGAL_IMPLEMENTATION_MSG = "The implementation to use cannot be \"%s\"\n";
 const char* NON_OPTION_ARGS_MSG = "Non-option arguments are not allowed: %s\n";
 const char* ALREADY_PARSED_MSG = "Argument '-%c' was given twice\n";
+const char* ALREADY_PARSED_LONG_MSG = "Argument '--%s' was given twice\n";
+const char* ILLEGAL_SCHEDULE_MSG = "The scheduling strategy cannot be \"%s\" (use static, balanced or dynamic)\n";
+const char* ILLEGAL_NUMA_MSG = "The NUMA mode cannot be \"%s\" (use pin or replicate)\n";
+const char* ILLEGAL_CHUNK_SIZE_MSG = "The chunk size cannot be \"%s\"\n";
+const char* ILLEGAL_THREAD_COUNT_MSG = "The number of threads cannot be \"%s\"\n";
+const char* ILLEGAL_PRECISION_MSG = "The precision cannot be \"%s\" (use float, mixed or double)\n";
+const char* PRECISION_IMPLEMENTATION_MSG = "Implementation %u only supports --precision float (use V6 - V9)\n";
+const char* ILLEGAL_STREAM_BLOCK_MSG = "The stream block size cannot be \"%s\"\n";
+const char* STREAM_OPTIONS_MSG = "--stream cannot be combined with -B or --precision double\n";
+const char* PIPELINE_OPTIONS_MSG = "--pipeline cannot be combined with --stream, -B or --precision double\n";
+const char* PLAN_OPTIONS_MSG = "--plan requires -B and --precision float\n";
+const char* ILLEGAL_BENCH_FORMAT_MSG = "The benchmark output format cannot be \"%s\" (use text, json or csv)\n";
+const char* ILLEGAL_BENCH_IMPLS_MSG = "The implementations to benchmark cannot be \"%s\"\n";
+const char* ILLEGAL_WARMUP_MSG = "The number of warmup runs cannot be \"%s\"\n";
+const char* BENCH_OPTIONS_MSG = "--bench requires --precision float and cannot be combined with --stream, --pipeline or --plan\n";
+const char* DENSE_OPTIONS_MSG = "--dense uses --precision float and cannot be combined with -V, --stream, --pipeline, --plan, --bench or --chain\n";
+const char* MASK_OPTIONS_MSG = "--mask uses --precision float and cannot be combined with -V, --stream, --pipeline, --plan, --bench, --chain or --dense\n";
+const char* COMPLEMENT_MASK_MSG = "--complement requires --mask\n";
+const char* ILLEGAL_ESTIMATE_MSG = "The size estimate cannot be \"%s\" (use bound, exact or sample)\n";
+const char* ESTIMATE_OPTIONS_MSG = "--estimate only applies to -V 5 and --bench\n";
+const char* CHAIN_OPTIONS_MSG = "--chain uses V0 with --precision float and cannot be combined with -V, --stream, --pipeline, --plan or --bench\n";
 
 const char* MISSING_FILENAME_A_MSG = "Missing filename for matrix A\n";
 const char* MISSING_FILENAME_B_MSG = "Missing filename for matrix B\n";
@@ -61,12 +150,39 @@ int parse_arguments(
     uint8_t* implementation,
     int* measure_flag,
     uint64_t* number_measures,
+    MultiplyConfig* config,
+    uint64_t* stream_block_nnz,
+    int* pipeline_flag,
+    int* plan_flag,
+    BenchConfig* bench,
+    char*** chain_filenames,
+    unsigned int* chain_count,
+    int* dense_flag,
+    char** filename_mask,
+    int* complement_flag,
     char** error_message
 ) {
     opterr = 0;  // silence error messages from getopt
 
-    //                   a  b  o  B  V
-    int flag_array[5] = {0, 0, 0, 0, 0};
+    //                    a  b  o  B  V  schedule  chunk-size  threads  precision  stream  plan  numa  bench
+    int flag_array[21] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    //                    bench-impls  warmup  stats  pipeline  dense  mask  complement  estimate
+                          0, 0, 0, 0, 0, 0, 0, 0};
+    *stream_block_nnz = 0;
+    *pipeline_flag = 0;
+    *plan_flag = 0;
+    *chain_filenames = NULL;
+    *chain_count = 0;
+    *dense_flag = 0;
+    *complement_flag = 0;
+    bench->enabled = 0;
+    bench->format = BENCH_TEXT;
+    bench->warmup = BENCH_DEFAULT_WARMUP;
+    bench->implementations = BENCH_DEFAULT_IMPLEMENTATIONS;
+
+    // The counters can be switched on without changing the command line, --stats does the same
+    const char* stats_env = getenv(MULTIPLY_STATS_ENV);
+    config->stats = stats_env != NULL && stats_env[0] != '\0' && strcmp(stats_env, "0") != 0;
 
     int ch;
     char* endptr;  // used in string to number conversion
@@ -165,6 +281,284 @@ int parse_arguments(
                 }
                 *implementation = (uint8_t) tmp_implementation;
                 break;
+            case OPT_SCHEDULE:
+                if (flag_array[5]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "schedule");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[5] = 1;
+
+                if (!strcmp(optarg, "static")) {
+                    config->schedule = SCHEDULE_STATIC;
+                } else if (!strcmp(optarg, "balanced")) {
+                    config->schedule = SCHEDULE_BALANCED;
+                } else if (!strcmp(optarg, "dynamic")) {
+                    config->schedule = SCHEDULE_DYNAMIC;
+                } else {
+                    set_error_message(error_message, ILLEGAL_SCHEDULE_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_CHUNK_SIZE:
+                if (flag_array[6]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "chunk-size");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[6] = 1;
+
+                // Check if a negative number was given
+                if (optarg[0] == '-') {
+                    set_error_message(error_message, ILLEGAL_CHUNK_SIZE_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+
+                errno = 0;
+                config->chunk_size = strtoull(optarg, &endptr, 10);
+                if (errno || *endptr != '\0' || config->chunk_size == 0) {
+                    set_error_message(error_message, ILLEGAL_CHUNK_SIZE_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_THREADS:
+                if (flag_array[7]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "threads");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[7] = 1;
+
+                // Check if a negative number was given
+                if (optarg[0] == '-') {
+                    set_error_message(error_message, ILLEGAL_THREAD_COUNT_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+
+                errno = 0;
+                uint64_t tmp_threads = strtoull(optarg, &endptr, 10);
+                if (errno || *endptr != '\0' || tmp_threads == 0 || tmp_threads > MAX_THREADS) {
+                    set_error_message(error_message, ILLEGAL_THREAD_COUNT_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                config->thread_count = (unsigned int) tmp_threads;
+                break;
+            case OPT_PRECISION:
+                if (flag_array[8]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "precision");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[8] = 1;
+
+                if (!strcmp(optarg, "float")) {
+                    config->precision = PRECISION_FLOAT;
+                } else if (!strcmp(optarg, "mixed")) {
+                    config->precision = PRECISION_MIXED;
+                } else if (!strcmp(optarg, "double")) {
+                    config->precision = PRECISION_DOUBLE;
+                } else {
+                    set_error_message(error_message, ILLEGAL_PRECISION_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_STREAM:
+                if (flag_array[9]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "stream");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[9] = 1;
+
+                if (optarg == NULL) {
+                    // optional argument not given, use the default block size
+                    *stream_block_nnz = STREAM_BLOCK_NNZ;
+                    break;
+                }
+
+                // Check if a negative number was given
+                if (optarg[0] == '-') {
+                    set_error_message(error_message, ILLEGAL_STREAM_BLOCK_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+
+                errno = 0;
+                *stream_block_nnz = strtoull(optarg, &endptr, 10);
+                if (errno || *endptr != '\0' || *stream_block_nnz == 0) {
+                    set_error_message(error_message, ILLEGAL_STREAM_BLOCK_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_PLAN:
+                if (flag_array[10]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "plan");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[10] = 1;
+                *plan_flag = 1;
+                break;
+            case OPT_NUMA:
+                if (flag_array[11]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "numa");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[11] = 1;
+
+                if (!strcmp(optarg, "pin")) {
+                    config->numa = NUMA_PIN;
+                } else if (!strcmp(optarg, "replicate")) {
+                    config->numa = NUMA_REPLICATE;
+                } else {
+                    set_error_message(error_message, ILLEGAL_NUMA_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_BENCH:
+                if (flag_array[12]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "bench");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[12] = 1;
+                bench->enabled = 1;
+
+                if (optarg == NULL || !strcmp(optarg, "text")) {
+                    bench->format = BENCH_TEXT;
+                } else if (!strcmp(optarg, "json")) {
+                    bench->format = BENCH_JSON;
+                } else if (!strcmp(optarg, "csv")) {
+                    bench->format = BENCH_CSV;
+                } else {
+                    set_error_message(error_message, ILLEGAL_BENCH_FORMAT_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_BENCH_IMPLS:
+                if (flag_array[13]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "bench-impls");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[13] = 1;
+
+                if (_parse_implementation_list(optarg, &bench->implementations) == ARGPARSE_ERROR) {
+                    set_error_message(error_message, ILLEGAL_BENCH_IMPLS_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_WARMUP:
+                if (flag_array[14]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "warmup");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[14] = 1;
+
+                // Check if a negative number was given
+                if (optarg[0] == '-') {
+                    set_error_message(error_message, ILLEGAL_WARMUP_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+
+                errno = 0;
+                bench->warmup = strtoull(optarg, &endptr, 10);  // 0 is allowed, it measures the cold run
+                if (errno || *endptr != '\0') {
+                    set_error_message(error_message, ILLEGAL_WARMUP_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_STATS:
+                if (flag_array[15]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "stats");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[15] = 1;
+                config->stats = 1;
+                break;
+            case OPT_PIPELINE:
+                if (flag_array[16]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "pipeline");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[16] = 1;
+                *pipeline_flag = 1;
+
+                if (optarg == NULL) {
+                    // optional argument not given, use the default block size
+                    *stream_block_nnz = PIPELINE_BLOCK_NNZ;
+                    break;
+                }
+
+                // Check if a negative number was given
+                if (optarg[0] == '-') {
+                    set_error_message(error_message, ILLEGAL_STREAM_BLOCK_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+
+                errno = 0;
+                *stream_block_nnz = strtoull(optarg, &endptr, 10);
+                if (errno || *endptr != '\0' || *stream_block_nnz == 0) {
+                    set_error_message(error_message, ILLEGAL_STREAM_BLOCK_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_CHAIN:
+                // Every --chain appends an operand, so it can be given several times
+                if (*chain_count % CHAIN_FILENAMES_GROWTH == 0) {
+                    char** tmp_filenames = realloc(
+                        *chain_filenames, (*chain_count + CHAIN_FILENAMES_GROWTH) * sizeof(char*)
+                        );
+                    if (tmp_filenames == NULL) {
+                        set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+                        return ARGPARSE_ERROR;
+                    }
+                    *chain_filenames = tmp_filenames;
+                }
+                (*chain_filenames)[*chain_count] = NULL;
+                if (_parse_filename(&(*chain_filenames)[*chain_count], optarg) == HEAP_MEMORY_ERROR) {
+                    set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+                    return ARGPARSE_ERROR;
+                }
+                (*chain_count)++;
+                break;
+            case OPT_DENSE:
+                if (flag_array[17]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "dense");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[17] = 1;
+                *dense_flag = 1;
+                break;
+            case OPT_MASK:
+                if (flag_array[18]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "mask");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[18] = 1;
+
+                if (_parse_filename(filename_mask, optarg) == HEAP_MEMORY_ERROR) {
+                    set_error_message(error_message, HEAP_MEMORY_ERROR_MSG);
+                    return ARGPARSE_ERROR;
+                }
+                break;
+            case OPT_COMPLEMENT:
+                if (flag_array[19]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "complement");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[19] = 1;
+                *complement_flag = 1;
+                break;
+            case OPT_ESTIMATE:
+                if (flag_array[20]) {
+                    set_error_message(error_message, ALREADY_PARSED_LONG_MSG, "estimate");
+                    return ARGPARSE_ERROR;
+                }
+                flag_array[20] = 1;
+
+                if (!strcmp(optarg, "bound")) {
+                    config->size_estimate = SIZE_ESTIMATE_BOUND;
+                } else if (!strcmp(optarg, "exact")) {
+                    config->size_estimate = SIZE_ESTIMATE_EXACT;
+                } else if (!strcmp(optarg, "sample")) {
+                    config->size_estimate = SIZE_ESTIMATE_SAMPLE;
+                } else {
+                    set_error_message(error_message, ILLEGAL_ESTIMATE_MSG, optarg);
+                    return ARGPARSE_ERROR;
+                }
+                break;
             case '?':  // not a valid argument
                 set_error_message(error_message, ILLEGAL_ARG_MSG, optopt);
                 return ARGPARSE_ERROR;
@@ -198,129 +592,143 @@ int parse_arguments(
         return ARGPARSE_ERROR;
     }
 
-    return ARGPARSE_SUCCESS;
-}
+    // Checked first, as V0 (the default implementation) only supports float
+    if (bench->enabled && (*stream_block_nnz || *plan_flag || config->precision != PRECISION_FLOAT)) {
+        set_error_message(error_message, BENCH_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
+    }
 
-int read_matrix_from_file(const char* filename, Matrix** matrix) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        return FILE_OPEN_ERROR;
+    // Only the two-phase Gustavson implementations are generated for other value types
+    if (config->precision != PRECISION_FLOAT && (*implementation < 6 || *implementation > 9)) {
+        set_error_message(error_message, PRECISION_IMPLEMENTATION_MSG, *implementation);
+        return ARGPARSE_ERROR;
     }
 
-    // Read noRows and noCols
-    uint64_t* row_col_array;
-    uint64_t row_col_array_size = 0;
-    int read_result = _read_uint_64_array(file, &row_col_array, &row_col_array_size, NOT_LAST_LINE);
-    switch (read_result) {
-        case HEAP_MEMORY_ERROR:
-        case MATRIX_FILE_FORMAT_ERROR:
-            // error parsing no rows and cols, array already freed inside the function
-            fclose(file);
-            return read_result;
-        case MATRIX_READ_SUCCESS:
-        default:
-            break;
+    // The pipeline is a streaming mode of its own
+    if (*pipeline_flag && (flag_array[9] || *measure_flag || config->precision == PRECISION_DOUBLE)) {
+        set_error_message(error_message, PIPELINE_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
-    
-    // Check if the first row had exactly two values
-    if (row_col_array_size != 2) {
-        free(row_col_array);
-        fclose(file);
-        return MATRIX_FILE_FORMAT_ERROR;
+
+    // Streaming works on float blocks and doesn't repeat the multiplication
+    if (*stream_block_nnz && (*measure_flag || config->precision == PRECISION_DOUBLE)) {
+        set_error_message(error_message, STREAM_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
 
-    // Store the arrays values in variables and free up its memory
-    uint64_t noRows = row_col_array[0];
-    uint64_t noCols = row_col_array[1];
-    free(row_col_array);
+    // The plan only pays off for repeated multiplications, it is built for float matrices
+    if (*plan_flag && (!*measure_flag || config->precision != PRECISION_FLOAT)) {
+        set_error_message(error_message, PLAN_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
+    }
 
-    // Check if noRows and noCols are valid (> 0)
-    if (!noRows || !noCols) {
-        fclose(file);
-        return MATRIX_FILE_FORMAT_ERROR;
+    // The chain keeps its intermediate products in the workspaces of V0
+    if (*chain_count && (flag_array[4] || *stream_block_nnz || *plan_flag || bench->enabled
+            || config->precision != PRECISION_FLOAT)) {
+        set_error_message(error_message, CHAIN_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
 
-    // Read values
-    float* values;
-    uint64_t values_size = 0;
-    read_result = _read_float_array(file, &values, &values_size, NOT_LAST_LINE);
-    switch (read_result) {
-        case HEAP_MEMORY_ERROR:
-        case MATRIX_FILE_FORMAT_ERROR:
-            // error parsing values, array already freed in function
-            fclose(file);
-            return read_result;
-        case MATRIX_READ_SUCCESS:
-        default:
-            break;
+    // The dense product has kernels of its own, which only exist for float
+    if (*dense_flag && (flag_array[4] || *stream_block_nnz || *plan_flag || bench->enabled || *chain_count
+            || config->precision != PRECISION_FLOAT)) {
+        set_error_message(error_message, DENSE_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
 
-    // Check if values size is more than possible (rows x cols) and check for zero values
-    if (_check_values(values, values_size, noRows, noCols) == MATRIX_FILE_FORMAT_ERROR) {
-        // array freed on error in function
-        fclose(file);
-        return MATRIX_FILE_FORMAT_ERROR;
+    // The masked product is a variant of V0 for float matrices that are read as a whole
+    if (*complement_flag && *filename_mask == NULL) {
+        set_error_message(error_message, COMPLEMENT_MASK_MSG);
+        return ARGPARSE_ERROR;
+    }
+    if (*filename_mask != NULL && (flag_array[4] || *stream_block_nnz || *plan_flag || bench->enabled
+            || *chain_count || *dense_flag || config->precision != PRECISION_FLOAT)) {
+        set_error_message(error_message, MASK_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
 
-    // Read colIndices
-    uint64_t* colIndices;
-    uint64_t col_indices_size = 0;
-    read_result = _read_uint_64_array(file, &colIndices, &col_indices_size, NOT_LAST_LINE);
-    switch (read_result) {
-        case HEAP_MEMORY_ERROR:
-        case MATRIX_FILE_FORMAT_ERROR:
-            // error, col_indices already freed in function call
-            free(values);
-            fclose(file);
-            return read_result;
-        case MATRIX_READ_SUCCESS:
-        default:
-            break;
+    // Only V5 allocates its result from an estimate
+    if (flag_array[20] && *implementation != 5 && !bench->enabled) {
+        set_error_message(error_message, ESTIMATE_OPTIONS_MSG);
+        return ARGPARSE_ERROR;
     }
 
-    // Check if columns indices are valid
-    if (_check_col_indices(colIndices, col_indices_size, values_size, noCols) == MATRIX_FILE_FORMAT_ERROR) {
-        // col_indices freed in function call
-        free(values);
-        fclose(file);
-        return MATRIX_FILE_FORMAT_ERROR;
+    // The benchmark runs every implementation on the same float matrices, read as a whole
+    if (bench->enabled) {
+        if (!*measure_flag) {
+            *number_measures = BENCH_DEFAULT_RUNS;
+        }
+        if (flag_array[4] && !flag_array[13]) {
+            // -V alone benchmarks a single implementation
+            bench->implementations = UINT64_C(1) << *implementation;
+        }
     }
 
-    // Read rowPointers and check if they are valid
-    uint64_t row_pointers_size = 8;
-    uint64_t* rowPointers;
-    read_result = _read_uint_64_array(file, &rowPointers, &row_pointers_size, EOF);  // last line in the file!
-    switch (read_result) {
-        case HEAP_MEMORY_ERROR:
-        case MATRIX_FILE_FORMAT_ERROR:
-            // error, rowPointers array freed in function call
-            free(values);
-            free(colIndices);
-            fclose(file);
-            return read_result;
-        case MATRIX_READ_SUCCESS:
-        default:
-            break;
+    return ARGPARSE_SUCCESS;
+}
+
+int _parse_implementation_list(const char* list, uint64_t* implementations) {
+    if (!strcmp(list, "all")) {
+        *implementations = (UINT64_C(1) << NUMBER_OF_IMPLEMENTATIONS) - 1;
+        return 0;
     }
 
-    // Check if the row pointers are valid
-    if (_check_row_pointers(rowPointers, row_pointers_size, values_size, noRows, noCols) == MATRIX_FILE_FORMAT_ERROR) {
-        // rowPointers freed in function call
-        free(values);
-        free(colIndices);
-        fclose(file);
-        return MATRIX_FILE_FORMAT_ERROR;
+    *implementations = 0;
+    const char* pos = list;
+    while (1) {
+        // Every entry is a number or a range of two numbers, no signs or spaces
+        char* endptr;
+        if (*pos < '0' || *pos > '9') {
+            return ARGPARSE_ERROR;
+        }
+        errno = 0;
+        uint64_t first = strtoull(pos, &endptr, 10);
+        uint64_t last = first;
+        if (*endptr == '-') {
+            pos = endptr + 1;
+            if (*pos < '0' || *pos > '9') {
+                return ARGPARSE_ERROR;
+            }
+            last = strtoull(pos, &endptr, 10);
+        }
+        if (errno || first > last || last >= NUMBER_OF_IMPLEMENTATIONS) {
+            return ARGPARSE_ERROR;
+        }
+        for (uint64_t i = first; i <= last; i++) {
+            *implementations |= UINT64_C(1) << i;
+        }
+
+        if (*endptr == '\0') {
+            return 0;
+        }
+        if (*endptr != ',') {
+            return ARGPARSE_ERROR;
+        }
+        pos = endptr + 1;
     }
+}
 
-    fclose(file);  // we are now done with the file
+int read_matrix_from_file(const char* filename, Matrix** matrix) {
+    uint64_t noRows, noCols, values_size, row_pointers_size;
+    void* values;
+    uint64_t* colIndices;
+    uint64_t* rowPointers;
+    void* mapping;
+    size_t mapping_size;
+    int read_result = _read_csr_file(
+        filename, PRECISION_FLOAT, &noRows, &noCols,
+        &values, &values_size, &colIndices, &rowPointers, &row_pointers_size,
+        &mapping, &mapping_size
+        );
+    if (read_result != MATRIX_READ_SUCCESS) {
+        return read_result;
+    }
 
     // Initialize the CSR matrix
     *matrix = malloc(sizeof(Matrix));
     if (*matrix == NULL) {
         // free all arrays that were read
-        free(values);
-        free(colIndices);
-        free(rowPointers);
+        _free_csr_arrays(values, colIndices, rowPointers, mapping, mapping_size);
         return HEAP_MEMORY_ERROR;
     }
 
@@ -331,57 +739,379 @@ int read_matrix_from_file(const char* filename, Matrix** matrix) {
     (*matrix)->colIndices = colIndices;
     (*matrix)->rowPointers = rowPointers;
     (*matrix)->rowPointersSize = row_pointers_size;
+    (*matrix)->mapping = mapping;
+    (*matrix)->mappingSize = mapping_size;
 
     return MATRIX_READ_SUCCESS;
 }
 
-int write_matrix_to_file(const char* filename, const Matrix* const matrix) {
-    FILE* file = fopen(filename, "w");
-    if (file == NULL) {
-        return FILE_OPEN_ERROR;
+int read_double_matrix_from_file(const char* filename, DoubleMatrix** matrix) {
+    uint64_t noRows, noCols, values_size, row_pointers_size;
+    void* values;
+    uint64_t* colIndices;
+    uint64_t* rowPointers;
+    void* mapping;
+    size_t mapping_size;
+    int read_result = _read_csr_file(
+        filename, PRECISION_DOUBLE, &noRows, &noCols,
+        &values, &values_size, &colIndices, &rowPointers, &row_pointers_size,
+        &mapping, &mapping_size
+        );
+    if (read_result != MATRIX_READ_SUCCESS) {
+        return read_result;
     }
 
-    // Write number of rows and ","
-    int length = snprintf(NULL, 0, "%lu,", matrix->noRows);  // used to check if successfully written to file
-    if (fprintf(file, "%lu,", matrix->noRows) != length) {
-        fclose(file);
-        return FILE_WRITE_ERROR;
+    *matrix = malloc(sizeof(DoubleMatrix));
+    if (*matrix == NULL) {
+        _free_csr_arrays(values, colIndices, rowPointers, mapping, mapping_size);
+        return HEAP_MEMORY_ERROR;
     }
 
-    // Write number of columns and newline character
-    length = snprintf(NULL, 0, "%lu\n", matrix->noCols);
-    if (fprintf(file, "%lu\n", matrix->noCols) != length) {
-        fclose(file);
-        return FILE_WRITE_ERROR;
-    }
+    (*matrix)->noRows = noRows;
+    (*matrix)->noCols = noCols;
+    (*matrix)->values = values;
+    (*matrix)->valuesSize = values_size;
+    (*matrix)->colIndices = colIndices;
+    (*matrix)->rowPointers = rowPointers;
+    (*matrix)->rowPointersSize = row_pointers_size;
+    (*matrix)->mapping = mapping;
+    (*matrix)->mappingSize = mapping_size;
 
-    // Write values
-    if (_write_float_array(file, matrix->values, matrix->valuesSize) != ARRAY_WRITE_SUCCESS) {
-        fclose(file);
-        return FILE_WRITE_ERROR;
-    }
-    if (fwrite("\n", 1, 1, file) != 1) {  // write new line
-        fclose(file);
-        return FILE_WRITE_ERROR;
-    }
+    return MATRIX_READ_SUCCESS;
+}
 
-    // Write col_indices
-    if (_write_uint_64_array(file, matrix->colIndices, matrix->valuesSize) != ARRAY_WRITE_SUCCESS) {
-        fclose(file);
-        return FILE_WRITE_ERROR;
-    }
-    if (fwrite("\n", 1, 1, file) != 1) {  // write new line
-        fclose(file);
-        return FILE_WRITE_ERROR;
+int read_dense_matrix_from_file(const char* filename, DenseMatrix** matrix) {
+    const char* data;
+    size_t data_size;
+    int mapped;
+    int read_result = _map_file(filename, &data, &data_size, &mapped);
+    if (read_result != 0) {
+        return read_result;
     }
+    const char* cursor = data;
+    const char* const end = data + data_size;
 
-    // Write row_ptr
-    if (_write_uint_64_array(file, matrix->rowPointers, matrix->rowPointersSize) != ARRAY_WRITE_SUCCESS) {
-        fclose(file);
-        return FILE_WRITE_ERROR;
+    // Read noRows and noCols
+    uint64_t* row_col_array;
+    uint64_t row_col_array_size = 0;
+    read_result = _read_uint_64_array(&cursor, end, &row_col_array, &row_col_array_size, 2, NOT_LAST_LINE);
+    if (read_result != MATRIX_READ_SUCCESS) {
+        _unmap_file(data, data_size, mapped);
+        return read_result;
+    }
+    uint64_t noRows = row_col_array[0];
+    uint64_t noCols = row_col_array[1];
+    free(row_col_array);
+
+    // Every value takes at least one character and its separator, so a larger matrix can't be in the file
+    if (!noRows || !noCols || noCols > data_size || noRows > data_size / noCols) {
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    *matrix = malloc(sizeof(DenseMatrix));
+    if (*matrix == NULL || init_dense_matrix(*matrix, noRows, noCols) == HEAP_MEMORY_ERROR) {
+        free(*matrix);
+        *matrix = NULL;
+        _unmap_file(data, data_size, mapped);
+        return HEAP_MEMORY_ERROR;
+    }
+
+    // One line per row with exactly noCols values, zeros included
+    for (uint64_t row = 0; row < noRows; row++) {
+        const char* line_end;
+        read_result = _next_line(&cursor, end, &line_end, row + 1 == noRows ? EOF : NOT_LAST_LINE);
+        const char* ptr = cursor;
+        float* values = (*matrix)->values + row * (*matrix)->stride;
+        for (uint64_t col = 0; col < noCols && read_result == 0; col++) {
+            double value;
+            read_result = _parse_value(&ptr, line_end, &value, PRECISION_FLOAT);
+            if (read_result != 0) {
+                break;
+            }
+            values[col] = (float) value;
+            if (col + 1 < noCols) {
+                // Another value must follow after a comma
+                read_result = ptr < line_end && *ptr == ',' ? 0 : MATRIX_FILE_FORMAT_ERROR;
+                ptr++;
+            }
+        }
+        if (read_result != 0 || ptr != line_end) {
+            free_dense_matrix(*matrix);
+            *matrix = NULL;
+            _unmap_file(data, data_size, mapped);
+            return MATRIX_FILE_FORMAT_ERROR;
+        }
+        cursor = line_end + 1;
+    }
+
+    _unmap_file(data, data_size, mapped);
+    return MATRIX_READ_SUCCESS;
+}
+
+int write_dense_matrix_to_file(const char* filename, const DenseMatrix* const matrix) {
+    WriteBuffer buffer;  // large, but only lives while writing
+    buffer.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);  // same as fopen(filename, "w")
+    if (buffer.fd == -1) {
+        return FILE_OPEN_ERROR;
+    }
+    buffer.length = 0;
+    buffer.error = 0;
+
+    // Write number of rows and columns, then every row on its own line
+    buffer.length += _format_uint_64(buffer.data, matrix->noRows);
+    buffer.data[buffer.length++] = ',';
+    buffer.length += _format_uint_64(buffer.data + buffer.length, matrix->noCols);
+    for (uint64_t row = 0; row < matrix->noRows; row++) {
+        buffer.data[buffer.length++] = '\n';  // the array functions always leave room for the newline
+        _write_float_array(&buffer, matrix->values + row * matrix->stride, matrix->noCols);
+    }
+
+    // Errors are remembered in the buffer, so checking after the last flush is enough
+    _flush_write_buffer(&buffer);
+    if (close(buffer.fd) == -1 || buffer.error) {
+        return FILE_WRITE_ERROR;
+    }
+
+    return MATRIX_WRITE_SUCCESS;
+}
+
+int _read_csr_file(
+    const char* filename, const int precision, uint64_t* const noRows, uint64_t* const noCols,
+    void** values, uint64_t* const values_size,
+    uint64_t** colIndices, uint64_t** rowPointers, uint64_t* const row_pointers_size,
+    void** mapping, size_t* const mapping_size
+    ) {
+    const char* data;
+    size_t data_size;
+    int mapped;
+    int read_result = _map_file(filename, &data, &data_size, &mapped);
+    if (read_result != 0) {
+        return read_result;
+    }
+
+    // Binary files are recognized by their magic number, text files start with a digit
+    if (data_size >= sizeof(BinaryCsrHeader) && memcmp(data, BINARY_CSR_MAGIC, BINARY_CSR_MAGIC_SIZE) == 0) {
+        return _read_binary_csr(
+            data, data_size, mapped, precision, noRows, noCols, values, values_size,
+            colIndices, rowPointers, row_pointers_size, mapping, mapping_size
+            );
+    }
+    *mapping = NULL;  // the text format is always parsed into heap arrays
+    *mapping_size = 0;
+    const char* cursor = data;  // start of the line to parse next
+    const char* const end = data + data_size;
+
+    // Read noRows and noCols
+    uint64_t* row_col_array;
+    uint64_t row_col_array_size = 0;
+    read_result = _read_uint_64_array(&cursor, end, &row_col_array, &row_col_array_size, 2, NOT_LAST_LINE);
+    switch (read_result) {
+        case HEAP_MEMORY_ERROR:
+        case MATRIX_FILE_FORMAT_ERROR:
+            // error parsing no rows and cols (e.g. not exactly two values), array already freed inside the function
+            _unmap_file(data, data_size, mapped);
+            return read_result;
+        case MATRIX_READ_SUCCESS:
+        default:
+            break;
+    }
+
+    // Store the arrays values in variables and free up its memory
+    *noRows = row_col_array[0];
+    *noCols = row_col_array[1];
+    free(row_col_array);
+
+    // Check if noRows and noCols are valid (> 0)
+    if (!*noRows || !*noCols || *noRows == UINT64_MAX) {
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    // Read values, their number is only known after counting them
+    *values_size = 0;
+    read_result = _read_value_array(&cursor, end, values, values_size, NOT_LAST_LINE, precision);
+    switch (read_result) {
+        case HEAP_MEMORY_ERROR:
+        case MATRIX_FILE_FORMAT_ERROR:
+            // error parsing values, array already freed in function
+            _unmap_file(data, data_size, mapped);
+            return read_result;
+        case MATRIX_READ_SUCCESS:
+        default:
+            break;
+    }
+
+    // Check if values size is more than possible (rows x cols) and check for zero values
+    if (_check_values(*values, *values_size, *noRows, *noCols, precision) == MATRIX_FILE_FORMAT_ERROR) {
+        free(*values);
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    // Read colIndices, there must be one per value
+    uint64_t col_indices_size = 0;
+    read_result = _read_uint_64_array(&cursor, end, colIndices, &col_indices_size, *values_size, NOT_LAST_LINE);
+    switch (read_result) {
+        case HEAP_MEMORY_ERROR:
+        case MATRIX_FILE_FORMAT_ERROR:
+            // error, col_indices already freed in function call
+            free(*values);
+            _unmap_file(data, data_size, mapped);
+            return read_result;
+        case MATRIX_READ_SUCCESS:
+        default:
+            break;
+    }
+
+    // Check if columns indices are valid
+    if (_check_col_indices(*colIndices, col_indices_size, *values_size, *noCols) == MATRIX_FILE_FORMAT_ERROR) {
+        free(*values);
+        free(*colIndices);
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    // Read rowPointers (noRows + 1 of them) and check if they are valid
+    read_result = _read_uint_64_array(&cursor, end, rowPointers, row_pointers_size, *noRows + 1, EOF);  // last line in the file!
+    switch (read_result) {
+        case HEAP_MEMORY_ERROR:
+        case MATRIX_FILE_FORMAT_ERROR:
+            // error, rowPointers array freed in function call
+            free(*values);
+            free(*colIndices);
+            _unmap_file(data, data_size, mapped);
+            return read_result;
+        case MATRIX_READ_SUCCESS:
+        default:
+            break;
+    }
+
+    // Check if the row pointers are valid
+    if (_check_row_pointers(*rowPointers, *row_pointers_size, *values_size, *noRows, *noCols) == MATRIX_FILE_FORMAT_ERROR) {
+        free(*values);
+        free(*colIndices);
+        free(*rowPointers);
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    _unmap_file(data, data_size, mapped);  // we are now done with the file
+
+    return MATRIX_READ_SUCCESS;
+}
+
+int write_matrix_to_file(const char* filename, const Matrix* const matrix) {
+    return _write_csr_file(
+        filename, PRECISION_FLOAT, matrix->noRows, matrix->noCols, matrix->values,
+        matrix->valuesSize, matrix->colIndices, matrix->rowPointers, matrix->rowPointersSize
+        );
+}
+
+int write_double_matrix_to_file(const char* filename, const DoubleMatrix* const matrix) {
+    return _write_csr_file(
+        filename, PRECISION_DOUBLE, matrix->noRows, matrix->noCols, matrix->values,
+        matrix->valuesSize, matrix->colIndices, matrix->rowPointers, matrix->rowPointersSize
+        );
+}
+
+int _write_csr_file(
+    const char* filename, const int precision, const uint64_t noRows, const uint64_t noCols,
+    const void* const values, const uint64_t values_size,
+    const uint64_t* const colIndices, const uint64_t* const rowPointers, const uint64_t row_pointers_size
+    ) {
+    if (_has_binary_extension(filename)) {
+        return _write_binary_csr_file(
+            filename, precision, noRows, noCols, values, values_size, colIndices, rowPointers, row_pointers_size
+            );
+    }
+
+    WriteBuffer buffer;  // large, but only lives while writing
+    buffer.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);  // same as fopen(filename, "w")
+    if (buffer.fd == -1) {
+        return FILE_OPEN_ERROR;
+    }
+    buffer.length = 0;
+    buffer.error = 0;
+
+    // Write number of rows and columns
+    buffer.length += _format_uint_64(buffer.data, noRows);
+    buffer.data[buffer.length++] = ',';
+    buffer.length += _format_uint_64(buffer.data + buffer.length, noCols);
+    buffer.data[buffer.length++] = '\n';
+
+    // Write values, col_indices and row_ptr, each on its own line
+    if (precision == PRECISION_DOUBLE) {
+        _write_double_array(&buffer, values, values_size);
+    } else {
+        _write_float_array(&buffer, values, values_size);
+    }
+    buffer.data[buffer.length++] = '\n';  // the array functions always leave room for the newline
+    _write_uint_64_array(&buffer, colIndices, values_size);
+    buffer.data[buffer.length++] = '\n';
+    _write_uint_64_array(&buffer, rowPointers, row_pointers_size);
+
+    // Errors are remembered in the buffer, so checking after the last flush is enough
+    _flush_write_buffer(&buffer);
+    if (close(buffer.fd) == -1 || buffer.error) {
+        return FILE_WRITE_ERROR;
+    }
+
+    return MATRIX_WRITE_SUCCESS;
+}
+
+int _has_binary_extension(const char* filename) {
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(BINARY_CSR_EXTENSION);
+    return length >= extension_length && strcmp(filename + length - extension_length, BINARY_CSR_EXTENSION) == 0;
+}
+
+uint64_t _align_binary_offset(const uint64_t offset) {
+    return (offset + BINARY_CSR_ALIGNMENT - 1) / BINARY_CSR_ALIGNMENT * BINARY_CSR_ALIGNMENT;
+}
+
+int _write_binary_csr_file(
+    const char* filename, const int precision, const uint64_t noRows, const uint64_t noCols,
+    const void* const values, const uint64_t values_size,
+    const uint64_t* const colIndices, const uint64_t* const rowPointers, const uint64_t row_pointers_size
+    ) {
+    // Lay out the sections one after another, each aligned to BINARY_CSR_ALIGNMENT
+    const uint64_t value_width = precision == PRECISION_DOUBLE ? sizeof(double) : sizeof(float);
+    BinaryCsrHeader header = {0};
+    memcpy(header.magic, BINARY_CSR_MAGIC, BINARY_CSR_MAGIC_SIZE);
+    header.indexWidth = sizeof(uint64_t);
+    header.valueType = precision == PRECISION_DOUBLE ? PRECISION_DOUBLE : PRECISION_FLOAT;
+    header.noRows = noRows;
+    header.noCols = noCols;
+    header.valuesSize = values_size;
+    header.rowPointersSize = row_pointers_size;
+    header.valuesOffset = _align_binary_offset(sizeof(header));
+    header.colIndicesOffset = _align_binary_offset(header.valuesOffset + values_size * value_width);
+    header.rowPointersOffset = _align_binary_offset(header.colIndicesOffset + values_size * sizeof(uint64_t));
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        return FILE_OPEN_ERROR;
+    }
+
+    // Write every section behind the zero padding that aligns it
+    static const char padding[BINARY_CSR_ALIGNMENT] = {0};
+    const uint64_t values_end = header.valuesOffset + values_size * value_width;
+    const uint64_t col_indices_end = header.colIndicesOffset + values_size * sizeof(uint64_t);
+    if (_write_fully(fd, &header, sizeof(header)) != 0
+        || _write_fully(fd, padding, header.valuesOffset - sizeof(header)) != 0
+        || _write_fully(fd, values, values_size * value_width) != 0
+        || _write_fully(fd, padding, header.colIndicesOffset - values_end) != 0
+        || _write_fully(fd, colIndices, values_size * sizeof(uint64_t)) != 0
+        || _write_fully(fd, padding, header.rowPointersOffset - col_indices_end) != 0
+        || _write_fully(fd, rowPointers, row_pointers_size * sizeof(uint64_t)) != 0) {
+        close(fd);
+        return FILE_WRITE_ERROR;
+    }
+
+    if (close(fd) == -1) {
+        return FILE_WRITE_ERROR;
     }
-
-    fclose(file);
 
     return MATRIX_WRITE_SUCCESS;
 }
@@ -422,247 +1152,376 @@ int _parse_filename(char** dest, const char* const src) {
 // READING
 // -------
 
-int _read_uint_64_array(FILE* file, uint64_t** array, uint64_t* array_size, const int eof_flag) {
-    // Define variables used for reading
-    int ch;
-    char* endptr;  // used for strtoull
-    int trailing_comma_flag = 0;
+int _map_file(const char* filename, const char** data, size_t* const size, int* const mapped) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return FILE_OPEN_ERROR;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        // Writable but private, binary matrices point into the mapping and must never change the file
+        void* mapping = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);  // only a hint, the result doesn't matter
+            close(fd);
+            *data = mapping;
+            *size = file_stat.st_size;
+            *mapped = 1;
+            return 0;
+        }
+    }
 
-    size_t buffer_size = 128;  // 128 bytes should be more than enough for parsing
-    char* buffer = malloc(sizeof(char) * buffer_size);
+    // Not a regular file (e.g. a pipe) or mmap failed, read it in large blocks instead
+    size_t capacity = 1 << 20;
+    size_t length = 0;
+    char* buffer = malloc(capacity);
     if (buffer == NULL) {
+        close(fd);
         return HEAP_MEMORY_ERROR;
     }
-    uint8_t buffer_index = 0;
-
-    // Allocate memory to array
-    uint64_t array_index = 0;
-    *array_size = 8;
-    *array = malloc_safe(sizeof(uint64_t), *array_size);
-    if (*array == NULL) {
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, buffer + length, capacity - length)) > 0) {
+        length += bytes_read;
+        if (length == capacity) {
+            char* tmp_buffer = realloc_safe(buffer, 2, capacity);
+            if (tmp_buffer == NULL) {  // realloc_safe() already freed the buffer
+                close(fd);
+                return HEAP_MEMORY_ERROR;
+            }
+            buffer = tmp_buffer;
+            capacity *= 2;
+        }
+    }
+    close(fd);
+    if (bytes_read == -1) {
         free(buffer);
-        return HEAP_MEMORY_ERROR;
+        return FILE_OPEN_ERROR;
     }
 
-    uint64_t value;
-    while (buffer_index < buffer_size) {
-        ch = fgetc(file);
+    *data = buffer;
+    *size = length;
+    *mapped = 0;
+    return 0;
+}
 
-        if (ch >= '0' && ch <= '9') {
-            // Read digit into buffer and reset trailing comma flag
-            buffer[buffer_index++] = ch;
-            trailing_comma_flag = 0;
-        } else if (ch == eof_flag) {  // EOF or newline, stop parsing this line
-            if (trailing_comma_flag || !array_index) {
-                // we have an unmatched comma, e.g 2,5,
-                // or a premature EOF/newline
-                goto read_uint64_error;
-            }
+void _unmap_file(const char* data, const size_t size, const int mapped) {
+    if (mapped) {
+        munmap((void*) data, size);
+    } else {
+        free((void*) data);
+    }
+}
 
-            // Add terminating null byte
-            buffer[buffer_index] = '\0';
+int _next_line(const char** cursor, const char* const end, const char** line_end, const int eof_flag) {
+    if (eof_flag == EOF) {
+        // The last line ends with the file, a newline character in it is a format error
+        *line_end = end;
+    } else {
+        *line_end = memchr(*cursor, '\n', end - *cursor);
+        if (*line_end == NULL) {
+            return MATRIX_FILE_FORMAT_ERROR;  // premature EOF
+        }
+    }
 
-            // String to integer conversion
-            errno = 0;
-            value = strtoull(buffer, &endptr, 10);
-            if (errno || *endptr != '\0') {
-                goto read_uint64_error;
-            }
+    // Every value takes at least one character plus its comma
+    return *line_end > *cursor ? 0 : MATRIX_FILE_FORMAT_ERROR;
+}
+
+int _parse_uint_64(const char** ptr, const char* const line_end, uint64_t* const value) {
+    // Parse the digits of one value, checking for overflow
+    const char* value_start = *ptr;
+    uint64_t result = 0;
+    while (*ptr < line_end && **ptr >= '0' && **ptr <= '9') {
+        uint64_t digit = *(*ptr)++ - '0';
+        if (result > (UINT64_MAX - digit) / 10) {
+            return MATRIX_FILE_FORMAT_ERROR;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+
+    return *ptr == value_start ? MATRIX_FILE_FORMAT_ERROR : 0;
+}
+
+int _read_uint_64_array(
+    const char** cursor, const char* const end, uint64_t** array, uint64_t* array_size,
+    const uint64_t expected_size, const int eof_flag
+    ) {
+    const char* line_end;
+    if (_next_line(cursor, end, &line_end, eof_flag) != 0) {
+        *array = NULL;
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
-            (*array)[array_index++] = value;
+    // A line of n values has at least 2n - 1 characters, so a wrong size can be rejected right away
+    if (expected_size - 1 > (uint64_t) (line_end - *cursor) / 2) {
+        *array = NULL;
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
-            buffer_index = buffer_size;  // invalidates loop condition, exits loop
+    *array = malloc_safe(sizeof(uint64_t), expected_size);
+    if (*array == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+
+    const char* ptr = *cursor;
+    uint64_t array_index = 0;
+    while (1) {
+        uint64_t value;
+        if (_parse_uint_64(&ptr, line_end, &value) != 0 || array_index == expected_size) {
+            // no digits (e.g. 2,,5 or 2,5,), overflow or more values than expected
+            goto read_uint64_error;
+        }
+        (*array)[array_index++] = value;
+
+        if (ptr == line_end) {
             break;
-        } else {
-            switch (ch) {
-                case ',':  // parse buffer and start reading another value
-                    if (!buffer_index) {
-                        // Comma with no value parsed, error
-                        goto read_uint64_error;
-                    }
+        }
+        if (*ptr++ != ',') {  // unmatched character
+            goto read_uint64_error;
+        }
+    }
 
-                    // Add terminating null byte
-                    buffer[buffer_index] = '\0';
+    if (array_index != expected_size) {
+        read_uint64_error:
+        free(*array);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
-                    // String to integer conversion
-                    errno = 0;
-                    value = strtoull(buffer, &endptr, 10);
-                    if (errno || *endptr != '\0') {
-                        goto read_uint64_error;
-                    }
+    *array_size = array_index;
+    *cursor = line_end + 1;
+    return MATRIX_READ_SUCCESS;
+}
 
-                    (*array)[array_index++] = value;
-                    if (array_index == *array_size) {
-                        // double array size
-                        *array_size = (*array_size) * 2;
-                        *array = realloc_safe(*array, sizeof(uint64_t), *array_size);
-                        if (*array == NULL) {
-                            free(buffer);
-                            return HEAP_MEMORY_ERROR;
-                        }
-                    }
+// Exact powers of ten for the fast path of _parse_value()
+static const float float_powers_of_ten[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+static const double double_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-                    // Reset buffer index and set trailing comma flag
-                    buffer_index = 0;
-                    trailing_comma_flag = 1;
-                    break;
-                default:  // unmatched character
-                    read_uint64_error:
-                    free(*array);
-                    free(buffer);
-                    return MATRIX_FILE_FORMAT_ERROR;
+int _parse_value(const char** ptr, const char* const line_end, double* const value, const int precision) {
+    const char* start = *ptr;
+    const char* p = start;
+    int negative = 0;
+    if (p < line_end && *p == '-') {  // only the first character can be a minus
+        negative = 1;
+        p++;
+    }
+
+    // Digits with at most one decimal point, the mantissa is exact for up to 19 digits
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fraction_digits = 0;
+    int decimal_point_flag = 0;
+    for (; p < line_end && *p != ','; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                fraction_digits += decimal_point_flag;
             }
+            digits += mantissa != 0 || digits;  // leading zeros don't count
+        } else if (*p == '.' && !decimal_point_flag) {
+            decimal_point_flag = 1;
+        } else {
+            return MATRIX_FILE_FORMAT_ERROR;
         }
     }
+    *ptr = p;
 
-    free(buffer);
+    size_t length = p - start;
+    if (length == 0 || length == (size_t) negative + decimal_point_flag) {
+        // nothing but a sign and/or a decimal point, e.g. - or .
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
-    // Resize array to just accommodate actual number of elements
-    *array_size = array_index;
-    *array = realloc_safe(*array, sizeof(uint64_t), *array_size);
-    if (*array == NULL) {
-        return HEAP_MEMORY_ERROR;
+    // Clinger's fast path: mantissa and power of ten are exact, so one division rounds correctly
+    if (precision == PRECISION_DOUBLE) {
+        if (digits < 19 && mantissa <= (1ull << 53) && fraction_digits <= 22) {
+            *value = (double) mantissa / double_powers_of_ten[fraction_digits];
+            *value = negative ? -*value : *value;
+            return 0;
+        }
+    } else if (digits < 19 && mantissa <= (1ull << 24) && fraction_digits <= 10) {
+        float float_value = (float) mantissa / float_powers_of_ten[fraction_digits];
+        *value = negative ? -float_value : float_value;
+        return 0;
     }
 
-    return MATRIX_READ_SUCCESS;
+    // Slow path: too many digits for the fast path, let the C library round correctly
+    char buffer[128];
+    if (length >= sizeof(buffer)) {
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    char* endptr;
+    errno = 0;
+    *value = precision == PRECISION_DOUBLE ? strtod(buffer, &endptr) : strtof(buffer, &endptr);
+    if (errno == ERANGE || *endptr != '\0') {
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+    return 0;
 }
 
-int _read_float_array(FILE* file, float** array, uint64_t* array_size, const int eof_flag) {
-    // Define variables used for reading
-    int ch;
-    int decimal_point_flag = 0;
-    char* endptr;  // used for strtof
-    int trailing_comma_flag = 0;
+int _read_value_array(
+    const char** cursor, const char* const end, void** array, uint64_t* array_size,
+    const int eof_flag, const int precision
+    ) {
+    const char* line_end;
+    if (_next_line(cursor, end, &line_end, eof_flag) != 0) {
+        *array = NULL;
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
-    size_t buffer_size = 128;  // 128 bytes should be more than enough for parsing a float
-    char* buffer = malloc(sizeof(char) * buffer_size);
-    if (buffer == NULL) {
-        fclose(file);
-        return HEAP_MEMORY_ERROR;
+    // Count the values first, so that the array is allocated exactly once
+    uint64_t expected_size = 1;
+    for (const char* ptr = *cursor; ptr < line_end; ptr++) {
+        expected_size += *ptr == ',';
     }
-    uint8_t buffer_index = 0;
 
-    // Allocate memory to array
-    uint64_t array_index = 0;
-    *array_size = 8;
-    *array = malloc_safe(sizeof(float), *array_size);
+    const int double_flag = precision == PRECISION_DOUBLE;
+    *array = malloc_safe(double_flag ? sizeof(double) : sizeof(float), expected_size);
     if (*array == NULL) {
-        free(buffer);
         return HEAP_MEMORY_ERROR;
     }
 
-    float value;
-    while (buffer_index < buffer_size) {
-        ch = fgetc(file);
+    const char* ptr = *cursor;
+    for (uint64_t array_index = 0; array_index < expected_size; array_index++) {
+        double value;
+        if (_parse_value(&ptr, line_end, &value, precision) != 0) {
+            free(*array);
+            return MATRIX_FILE_FORMAT_ERROR;
+        }
+        if (double_flag) {
+            ((double*) *array)[array_index] = value;
+        } else {
+            ((float*) *array)[array_index] = (float) value;
+        }
+        ptr++;  // skip the comma
+    }
 
-        if (ch >= '0' && ch <= '9') {
-            // Read digit into buffer and reset comma flag
-            buffer[buffer_index++] = ch;
-            trailing_comma_flag = 0;
-        } else if (ch == eof_flag) {  // EOF or newline character
-            if (trailing_comma_flag || !array_index) {
-                // we have an unmatched comma, e.g 2,5,
-                // or a premature EOF/newline
-                goto read_float_error;
-            }
+    *array_size = expected_size;
+    *cursor = line_end + 1;
+    return MATRIX_READ_SUCCESS;
+}
 
-            // Add terminating null byte at end of buffer
-            buffer[buffer_index] = '\0';
+int _binary_section_fits(const uint64_t offset, const uint64_t count, const uint64_t width, const size_t file_size) {
+    // The section must be aligned for its elements and lie completely inside the file
+    return offset % width == 0 && offset <= file_size && count <= (file_size - offset) / width;
+}
 
-            // String to float conversion
-            errno = 0;
-            value = strtof(buffer, &endptr);
-            if (errno == ERANGE || *endptr != '\0') {
-                goto read_float_error;
-            }
-            
-            (*array)[array_index++] = value;
+void* _copy_binary_values(const void* src, const uint64_t count, const uint32_t value_type, const int precision) {
+    const int double_flag = precision == PRECISION_DOUBLE;
+    void* values = malloc_safe(double_flag ? sizeof(double) : sizeof(float), count);
+    if (values == NULL) {
+        return NULL;
+    }
 
-            buffer_index = buffer_size;  // exit loop
-            break;
+    for (uint64_t i = 0; i < count; i++) {
+        double value = value_type == PRECISION_DOUBLE ? ((const double*) src)[i] : ((const float*) src)[i];
+        if (double_flag) {
+            ((double*) values)[i] = value;
         } else {
-            switch (ch) {
-                case '.':
-                    // Check if we already had a decimal point
-                    if (decimal_point_flag) {
-                        goto read_float_error;
-                    } else {
-                        buffer[buffer_index++] = '.';
-                    }
-                    break;
-                case ',':  // parse buffer and start reading another value
-                    if (!buffer_index) {
-                        // Comma with no value parsed, error
-                        goto read_float_error;
-                    }
-                    // Add terminating null byte at end of buffer
-                    buffer[buffer_index] = '\0';
-
-                    // String to float conversion
-                    errno = 0;
-                    value = strtof(buffer, &endptr);
-                    if (errno == ERANGE || *endptr != '\0') {
-                        goto read_float_error;
-                    }
+            ((float*) values)[i] = (float) value;
+        }
+    }
 
-                    (*array)[array_index++] = value;
-                    if (array_index == *array_size) {
-                        // double array size
-                        *array_size = (*array_size) * 2;
-                        *array = realloc_safe(*array, sizeof(float), *array_size);
-                        if (*array == NULL) {
-                            return HEAP_MEMORY_ERROR;
-                        }
-                    }
+    return values;
+}
 
-                    // Set/reset flags and buffer index to read a new value
-                    decimal_point_flag = 0;
-                    trailing_comma_flag = 1;
-                    buffer_index = 0;
+uint64_t* _copy_binary_indices(const void* src, const uint64_t count, const uint32_t index_width) {
+    uint64_t* indices = malloc_safe(sizeof(uint64_t), count);
+    if (indices == NULL) {
+        return NULL;
+    }
 
-                    break;
-                case '-':
-                    if (!buffer_index) {  // only the first character can be a minus
-                        buffer[buffer_index++] = '-';
-                    } else {
-                        goto read_float_error;
-                    }
-                    break;
-                default:  // unmatched character (EOF included), error
-                    read_float_error:
-                    free(*array);
-                    free(buffer);
-                    return MATRIX_FILE_FORMAT_ERROR;
-            }
+    if (index_width == sizeof(uint64_t)) {
+        memcpy(indices, src, count * sizeof(uint64_t));
+    } else {
+        for (uint64_t i = 0; i < count; i++) {
+            indices[i] = ((const uint32_t*) src)[i];
         }
     }
 
-    // Resize array to accommodate just the actual number of elements in the array
-    *array_size = array_index;
-    *array = realloc_safe(*array, sizeof(float), *array_size);
-    if (*array == NULL) {
-        return HEAP_MEMORY_ERROR;
+    return indices;
+}
+
+int _read_binary_csr(
+    const char* data, const size_t data_size, const int mapped, const int precision,
+    uint64_t* const noRows, uint64_t* const noCols, void** values, uint64_t* const values_size,
+    uint64_t** colIndices, uint64_t** rowPointers, uint64_t* const row_pointers_size,
+    void** mapping, size_t* const mapping_size
+    ) {
+    BinaryCsrHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // Validate the header, every section has to fit into the file
+    const uint64_t value_width = header.valueType == PRECISION_DOUBLE ? sizeof(double) : sizeof(float);
+    if ((header.valueType != PRECISION_FLOAT && header.valueType != PRECISION_DOUBLE)
+        || (header.indexWidth != sizeof(uint32_t) && header.indexWidth != sizeof(uint64_t))
+        || !header.noRows || !header.noCols || header.noRows == UINT64_MAX
+        || !_binary_section_fits(header.valuesOffset, header.valuesSize, value_width, data_size)
+        || !_binary_section_fits(header.colIndicesOffset, header.valuesSize, header.indexWidth, data_size)
+        || !_binary_section_fits(header.rowPointersOffset, header.rowPointersSize, header.indexWidth, data_size)) {
+        _unmap_file(data, data_size, mapped);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    *noRows = header.noRows;
+    *noCols = header.noCols;
+    *values_size = header.valuesSize;
+    *row_pointers_size = header.rowPointersSize;
+
+    const int value_type = precision == PRECISION_DOUBLE ? PRECISION_DOUBLE : PRECISION_FLOAT;
+    if (mapped && header.indexWidth == sizeof(uint64_t) && header.valueType == (uint32_t) value_type) {
+        // Same layout as in memory, the subarrays point straight into the mapping
+        *values = (void*) (data + header.valuesOffset);
+        *colIndices = (uint64_t*) (data + header.colIndicesOffset);
+        *rowPointers = (uint64_t*) (data + header.rowPointersOffset);
+        *mapping = (void*) data;
+        *mapping_size = data_size;
+    } else {
+        // Different index width or value type (or not mapped at all), convert into heap arrays
+        *values = _copy_binary_values(data + header.valuesOffset, header.valuesSize, header.valueType, precision);
+        *colIndices = _copy_binary_indices(data + header.colIndicesOffset, header.valuesSize, header.indexWidth);
+        *rowPointers = _copy_binary_indices(data + header.rowPointersOffset, header.rowPointersSize, header.indexWidth);
+        _unmap_file(data, data_size, mapped);
+        *mapping = NULL;
+        *mapping_size = 0;
+        if (*values == NULL || *colIndices == NULL || *rowPointers == NULL) {
+            free_pointers(3, *values, *colIndices, *rowPointers);
+            return HEAP_MEMORY_ERROR;
+        }
     }
 
-    free(buffer);  // free buffer used for parsing
+    // The multiplication functions rely on a valid structure, so binary files are checked as well
+    if (_check_values(*values, *values_size, *noRows, *noCols, precision) == MATRIX_FILE_FORMAT_ERROR
+        || _check_col_indices(*colIndices, *values_size, *values_size, *noCols) == MATRIX_FILE_FORMAT_ERROR
+        || _check_row_pointers(*rowPointers, *row_pointers_size, *values_size, *noRows, *noCols) == MATRIX_FILE_FORMAT_ERROR) {
+        _free_csr_arrays(*values, *colIndices, *rowPointers, *mapping, *mapping_size);
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
 
     return MATRIX_READ_SUCCESS;
 }
 
 int _check_values(
-    float* values, const uint64_t values_size,
-    const uint64_t noRows, const uint64_t noCols
+    const void* values, const uint64_t values_size,
+    const uint64_t noRows, const uint64_t noCols, const int precision
 ) {
     if (values_size > noRows*noCols) {
         // e.g 3x5 matrix can have a maximum of 15 values but values_size is 20.
         values_check_error:
-        free(values);
         return MATRIX_FILE_FORMAT_ERROR;
     }
 
     // Check for zeroes in array
     for (uint64_t i = 0; i < values_size; i++) {
-        if (values[i] == 0.0f) {
+        double value = precision == PRECISION_DOUBLE ? ((double*) values)[i] : ((float*) values)[i];
+        if (value == 0.0) {
             goto values_check_error;
         }
     }
@@ -671,12 +1530,12 @@ int _check_values(
 }
 
 int _check_col_indices (
-    uint64_t* colIndices, const uint64_t col_indices_size, 
+    const uint64_t* colIndices, const uint64_t col_indices_size, 
     const uint64_t values_size, const uint64_t noCols
     ) {
     // Check if the size of the column indices matches that of the values array
     if (col_indices_size != values_size) {
-        col_indices_check_error: free(colIndices);
+        col_indices_check_error:
         return MATRIX_FILE_FORMAT_ERROR;
     }
 
@@ -690,12 +1549,12 @@ int _check_col_indices (
 }
 
 int _check_row_pointers(
-    uint64_t* rowPointers, const uint64_t row_pointers_size, 
+    const uint64_t* rowPointers, const uint64_t row_pointers_size, 
     const uint64_t values_size, const uint64_t noRows, const uint64_t noCols
     ) {
     // At least two row pointers and exactly 1 more than number of rows
     if (row_pointers_size < 2 || row_pointers_size != noRows + 1) {
-        row_pointers_check_error: free(rowPointers);
+        row_pointers_check_error:
         return MATRIX_FILE_FORMAT_ERROR;
     }
 
@@ -723,63 +1582,715 @@ int _check_row_pointers(
     return 0;
 }
 
+// STREAMING
+// ---------
+
+int open_row_block_reader(const char* filename, const uint64_t block_nnz, RowBlockReader** reader) {
+    RowBlockReader* r = calloc(1, sizeof(RowBlockReader));
+    if (r == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+    r->blockNnz = block_nnz;
+
+    int read_result = _map_file(filename, &r->data, &r->dataSize, &r->mapped);
+    if (read_result != 0) {
+        free(r);
+        return read_result;
+    }
+    const char* const end = r->data + r->dataSize;
+
+    if (r->dataSize >= sizeof(BinaryCsrHeader) && memcmp(r->data, BINARY_CSR_MAGIC, BINARY_CSR_MAGIC_SIZE) == 0) {
+        // Binary: the cursors point to the next element of each section
+        BinaryCsrHeader header;
+        memcpy(&header, r->data, sizeof(header));
+        const uint64_t value_width = header.valueType == PRECISION_DOUBLE ? sizeof(double) : sizeof(float);
+        if ((header.valueType != PRECISION_FLOAT && header.valueType != PRECISION_DOUBLE)
+            || (header.indexWidth != sizeof(uint32_t) && header.indexWidth != sizeof(uint64_t))
+            || header.rowPointersSize != header.noRows + 1
+            || !_binary_section_fits(header.valuesOffset, header.valuesSize, value_width, r->dataSize)
+            || !_binary_section_fits(header.colIndicesOffset, header.valuesSize, header.indexWidth, r->dataSize)
+            || !_binary_section_fits(header.rowPointersOffset, header.rowPointersSize, header.indexWidth, r->dataSize)) {
+            goto open_reader_format_error;
+        }
+        r->binary = 1;
+        r->indexWidth = header.indexWidth;
+        r->valueType = header.valueType;
+        r->block.noRows = header.noRows;
+        r->block.noCols = header.noCols;
+        r->valuesCursor = r->data + header.valuesOffset;
+        r->valuesEnd = r->valuesCursor + header.valuesSize * value_width;
+        r->colIndicesCursor = r->data + header.colIndicesOffset;
+        r->colIndicesEnd = r->colIndicesCursor + header.valuesSize * header.indexWidth;
+        r->rowPointersCursor = r->data + header.rowPointersOffset;
+        r->rowPointersEnd = r->rowPointersCursor + header.rowPointersSize * header.indexWidth;
+    } else {
+        // Text: the cursors point into the values, column indices and row pointers lines
+        const char* cursor = r->data;
+        uint64_t* row_col_array;
+        uint64_t row_col_array_size;
+        read_result = _read_uint_64_array(&cursor, end, &row_col_array, &row_col_array_size, 2, NOT_LAST_LINE);
+        if (read_result != MATRIX_READ_SUCCESS) {
+            _unmap_file(r->data, r->dataSize, r->mapped);
+            free(r);
+            return read_result;
+        }
+        r->block.noRows = row_col_array[0];
+        r->block.noCols = row_col_array[1];
+        free(row_col_array);
+
+        const char* line_end;
+        if (_next_line(&cursor, end, &line_end, NOT_LAST_LINE) != 0) {
+            goto open_reader_format_error;
+        }
+        r->valuesCursor = cursor;
+        r->valuesEnd = line_end;
+        cursor = line_end + 1;
+        if (_next_line(&cursor, end, &line_end, NOT_LAST_LINE) != 0) {
+            goto open_reader_format_error;
+        }
+        r->colIndicesCursor = cursor;
+        r->colIndicesEnd = line_end;
+        cursor = line_end + 1;
+        if (_next_line(&cursor, end, &line_end, EOF) != 0) {
+            goto open_reader_format_error;
+        }
+        r->rowPointersCursor = cursor;
+        r->rowPointersEnd = line_end;
+    }
+    r->noRows = r->block.noRows;
+    r->noCols = r->block.noCols;
+
+    // Same checks as for a whole matrix: valid dimensions and a first row pointer of 0
+    uint64_t first_row_pointer;
+    if (!r->noRows || !r->noCols || r->noRows == UINT64_MAX
+        || _next_row_pointer(r, &first_row_pointer) != 0 || first_row_pointer != 0) {
+        goto open_reader_format_error;
+    }
+    r->releasedValues = r->valuesCursor;
+    r->releasedColIndices = r->colIndicesCursor;
+    r->releasedRowPointers = r->rowPointersCursor;
+
+    *reader = r;
+    return MATRIX_READ_SUCCESS;
+
+    open_reader_format_error:
+    _unmap_file(r->data, r->dataSize, r->mapped);
+    free(r);
+    return MATRIX_FILE_FORMAT_ERROR;
+}
+
+int _next_row_pointer(RowBlockReader* const reader, uint64_t* const row_pointer) {
+    if (reader->binary) {
+        if (reader->rowPointersCursor == reader->rowPointersEnd) {
+            return MATRIX_FILE_FORMAT_ERROR;
+        }
+        *row_pointer = reader->indexWidth == sizeof(uint64_t)
+            ? *(const uint64_t*) reader->rowPointersCursor
+            : *(const uint32_t*) reader->rowPointersCursor;
+        reader->rowPointersCursor += reader->indexWidth;
+        return 0;
+    }
+    const int separator_flag = reader->rowPointersStarted;
+    reader->rowPointersStarted = 1;
+    return _next_text_uint_64(&reader->rowPointersCursor, reader->rowPointersEnd, separator_flag, row_pointer);
+}
+
+int _next_text_uint_64(const char** cursor, const char* const line_end, const int separator_flag, uint64_t* const value) {
+    // Every value but the first of a line is preceded by a comma
+    if (separator_flag && (*cursor == line_end || *(*cursor)++ != ',')) {
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+    return _parse_uint_64(cursor, line_end, value);
+}
+
+int _read_block_entries(RowBlockReader* const reader, const uint64_t count) {
+    Matrix* block = &reader->block;
+    for (uint64_t i = 0; i < count; i++) {
+        double value;
+        uint64_t col_index;
+        if (reader->binary) {
+            // The section sizes were checked against the row pointers when the block was planned
+            if (reader->valueType == PRECISION_DOUBLE) {
+                value = *(const double*) reader->valuesCursor;
+                reader->valuesCursor += sizeof(double);
+            } else {
+                value = *(const float*) reader->valuesCursor;
+                reader->valuesCursor += sizeof(float);
+            }
+            col_index = reader->indexWidth == sizeof(uint64_t)
+                ? *(const uint64_t*) reader->colIndicesCursor
+                : *(const uint32_t*) reader->colIndicesCursor;
+            reader->colIndicesCursor += reader->indexWidth;
+        } else {
+            const uint64_t value_index = reader->nextValue + i;
+            if (value_index && (reader->valuesCursor == reader->valuesEnd || *reader->valuesCursor++ != ',')) {
+                return MATRIX_FILE_FORMAT_ERROR;
+            }
+            if (_parse_value(&reader->valuesCursor, reader->valuesEnd, &value, PRECISION_FLOAT) != 0
+                || _next_text_uint_64(&reader->colIndicesCursor, reader->colIndicesEnd, value_index != 0, &col_index) != 0) {
+                return MATRIX_FILE_FORMAT_ERROR;
+            }
+        }
+
+        // Same checks as _check_values() and _check_col_indices()
+        block->values[i] = (float) value;
+        if (block->values[i] == 0.0f || col_index >= reader->noCols) {
+            return MATRIX_FILE_FORMAT_ERROR;
+        }
+        block->colIndices[i] = col_index;
+    }
+
+    return 0;
+}
+
+void _release_consumed(const char** released, const char* const cursor) {
+    // Drop the pages before cursor from memory, they are read back from the file if needed
+    const uintptr_t page_mask = ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+    const char* release_end = (const char*) ((uintptr_t) cursor & page_mask);
+    const char* release_start = (const char*) ((uintptr_t) *released & page_mask);
+    if (release_end > release_start) {
+        madvise((void*) release_start, release_end - release_start, MADV_DONTNEED);
+        *released = release_end;
+    }
+}
+
+int read_row_block(RowBlockReader* const reader) {
+    Matrix* block = &reader->block;
+    block->noRows = 0;
+    block->valuesSize = 0;
+    block->rowPointersSize = 1;
+
+    // Take rows until the block holds blockNnz values or rows, but at least one row
+    const uint64_t block_start = reader->nextValue;
+    uint64_t block_end = block_start;
+    while (reader->nextRow < reader->noRows) {
+        if (!reader->pendingFlag) {
+            uint64_t row_pointer;
+            if (_next_row_pointer(reader, &row_pointer) != 0
+                || row_pointer < block_end || row_pointer - block_end > reader->noCols) {
+                return MATRIX_FILE_FORMAT_ERROR;  // same checks as _check_row_pointers()
+            }
+            reader->pendingRowPointer = row_pointer;
+            reader->pendingFlag = 1;
+        }
+        if (block->noRows && (reader->pendingRowPointer - block_start > reader->blockNnz
+                || block->noRows >= reader->blockNnz)) {
+            break;  // the row stays pending for the next block
+        }
+
+        if (block->noRows + 1 >= reader->rowPointersCapacity) {
+            reader->rowPointersCapacity = 2 * (block->noRows + 1);
+            block->rowPointers = realloc_safe(block->rowPointers, sizeof(uint64_t), reader->rowPointersCapacity);
+            if (block->rowPointers == NULL) {  // realloc_safe() already freed the array
+                return HEAP_MEMORY_ERROR;
+            }
+        }
+        block_end = reader->pendingRowPointer;
+        block->rowPointers[++block->noRows] = block_end - block_start;
+        reader->pendingFlag = 0;
+        reader->nextRow++;
+    }
+    if (block->rowPointers == NULL) {  // only at the end of an empty first block
+        return MATRIX_READ_SUCCESS;
+    }
+    block->rowPointers[0] = 0;
+    block->rowPointersSize = block->noRows + 1;
+
+    // Read the values and column indices of the block
+    const uint64_t count = block_end - block_start;
+    if (reader->binary) {
+        const uint64_t value_width = reader->valueType == PRECISION_DOUBLE ? sizeof(double) : sizeof(float);
+        if (count > (uint64_t) (reader->valuesEnd - reader->valuesCursor) / value_width) {
+            return MATRIX_FILE_FORMAT_ERROR;  // the row pointers point behind the values
+        }
+    }
+    if (count > reader->valuesCapacity) {
+        reader->valuesCapacity = count;
+        block->values = realloc_safe(block->values, sizeof(float), count);
+        block->colIndices = realloc_safe(block->colIndices, sizeof(uint64_t), count);
+        if (block->values == NULL || block->colIndices == NULL) {
+            return HEAP_MEMORY_ERROR;
+        }
+    }
+    if (_read_block_entries(reader, count) != 0) {
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+    block->valuesSize = count;
+    reader->nextValue = block_end;
+
+    // After the last row, every value, column index and row pointer has to be used up
+    if (reader->nextRow == reader->noRows && (reader->valuesCursor != reader->valuesEnd
+            || reader->colIndicesCursor != reader->colIndicesEnd
+            || reader->rowPointersCursor != reader->rowPointersEnd)) {
+        return MATRIX_FILE_FORMAT_ERROR;
+    }
+
+    if (reader->mapped) {
+        _release_consumed(&reader->releasedValues, reader->valuesCursor);
+        _release_consumed(&reader->releasedColIndices, reader->colIndicesCursor);
+        _release_consumed(&reader->releasedRowPointers, reader->rowPointersCursor);
+    }
+
+    return MATRIX_READ_SUCCESS;
+}
+
+void close_row_block_reader(RowBlockReader* reader) {
+    if (reader) {
+        _unmap_file(reader->data, reader->dataSize, reader->mapped);
+        free_pointers(3, reader->block.values, reader->block.colIndices, reader->block.rowPointers);
+        free(reader);
+    }
+}
+
+int _open_spill_file(const char* filename) {
+    // Next to the output instead of /tmp, which may live in memory
+    char* template = malloc(strlen(filename) + sizeof(".XXXXXX"));
+    if (template == NULL) {
+        return -1;
+    }
+    strcpy(template, filename);
+    strcat(template, ".XXXXXX");
+    int fd = mkstemp(template);
+    if (fd != -1) {
+        unlink(template);  // removed as soon as it is closed
+    }
+    free(template);
+
+    return fd;
+}
+
+void _buffer_bytes(WriteBuffer* const buffer, const void* const data, const size_t size) {
+    const char* bytes = data;
+    size_t remaining = size;
+    while (remaining) {
+        if (buffer->length == WRITE_BUFFER_SIZE) {
+            _flush_write_buffer(buffer);
+        }
+        size_t chunk = WRITE_BUFFER_SIZE - buffer->length;
+        chunk = chunk < remaining ? chunk : remaining;
+        memcpy(buffer->data + buffer->length, bytes, chunk);
+        buffer->length += chunk;
+        bytes += chunk;
+        remaining -= chunk;
+    }
+}
+
+int open_row_block_writer(
+    const char* filename, const uint64_t noRows, const uint64_t noCols, RowBlockWriter** writer
+    ) {
+    RowBlockWriter* w = malloc(sizeof(RowBlockWriter));
+    if (w == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+    w->binary = _has_binary_extension(filename);
+    w->noRows = noRows;
+    w->noCols = noCols;
+    w->valuesWritten = 0;
+    w->values.length = w->colIndices.length = w->rowPointers.length = 0;
+    w->values.error = w->colIndices.error = w->rowPointers.error = 0;
+
+    // The values go straight into the output, the other subarrays are spilled until the end
+    w->values.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    w->colIndices.fd = _open_spill_file(filename);
+    w->rowPointers.fd = _open_spill_file(filename);
+    if (w->values.fd == -1 || w->colIndices.fd == -1 || w->rowPointers.fd == -1) {
+        _close_row_block_files(w);
+        free(w);
+        return FILE_OPEN_ERROR;
+    }
+
+    const uint64_t first_row_pointer = 0;
+    if (w->binary) {
+        // The header is written last, when the offsets are known
+        static const char padding[BINARY_CSR_ALIGNMENT] = {0};
+        _buffer_bytes(&w->values, padding, _align_binary_offset(sizeof(BinaryCsrHeader)));
+        _buffer_bytes(&w->rowPointers, &first_row_pointer, sizeof(uint64_t));
+    } else {
+        w->values.length += _format_uint_64(w->values.data, noRows);
+        w->values.data[w->values.length++] = ',';
+        w->values.length += _format_uint_64(w->values.data + w->values.length, noCols);
+        w->values.data[w->values.length++] = '\n';
+        w->rowPointers.data[w->rowPointers.length++] = '0';
+    }
+
+    *writer = w;
+    return MATRIX_WRITE_SUCCESS;
+}
+
+int write_row_block(RowBlockWriter* const writer, const Matrix* const block) {
+    if (writer->binary) {
+        _buffer_bytes(&writer->values, block->values, block->valuesSize * sizeof(float));
+        _buffer_bytes(&writer->colIndices, block->colIndices, block->valuesSize * sizeof(uint64_t));
+        for (uint64_t i = 1; i < block->rowPointersSize; i++) {
+            const uint64_t row_pointer = writer->valuesWritten + block->rowPointers[i];
+            _buffer_bytes(&writer->rowPointers, &row_pointer, sizeof(uint64_t));
+        }
+    } else {
+        // Continue the lines of the previous blocks
+        if (writer->valuesWritten && block->valuesSize) {
+            writer->values.data[writer->values.length++] = ',';
+            writer->colIndices.data[writer->colIndices.length++] = ',';
+        }
+        _write_float_array(&writer->values, block->values, block->valuesSize);
+        _write_uint_64_array(&writer->colIndices, block->colIndices, block->valuesSize);
+        for (uint64_t i = 1; i < block->rowPointersSize; i++) {
+            if (WRITE_BUFFER_SIZE - writer->rowPointers.length < MAX_ELEMENT_LENGTH) {
+                _flush_write_buffer(&writer->rowPointers);
+            }
+            WriteBuffer* buffer = &writer->rowPointers;
+            buffer->data[buffer->length++] = ',';
+            buffer->length += _format_uint_64(buffer->data + buffer->length, writer->valuesWritten + block->rowPointers[i]);
+        }
+    }
+    writer->valuesWritten += block->valuesSize;
+
+    return writer->values.error || writer->colIndices.error || writer->rowPointers.error
+        ? FILE_WRITE_ERROR
+        : MATRIX_WRITE_SUCCESS;
+}
+
+void _append_spill_file(RowBlockWriter* const writer, WriteBuffer* const spill) {
+    // Move the spilled data behind what is already in the output
+    _flush_write_buffer(spill);
+    _flush_write_buffer(&writer->values);
+    if (lseek(spill->fd, 0, SEEK_SET) == -1) {
+        writer->values.error = 1;
+        return;
+    }
+    ssize_t bytes_read;
+    while (!writer->values.error && (bytes_read = read(spill->fd, spill->data, WRITE_BUFFER_SIZE)) != 0) {
+        if (bytes_read == -1) {
+            if (errno != EINTR) {
+                writer->values.error = 1;
+            }
+        } else if (_write_fully(writer->values.fd, spill->data, bytes_read) != 0) {
+            writer->values.error = 1;
+        }
+    }
+}
+
+void _close_row_block_files(RowBlockWriter* const writer) {
+    int fds[3] = {writer->values.fd, writer->colIndices.fd, writer->rowPointers.fd};
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != -1 && close(fds[i]) == -1) {
+            writer->values.error = 1;
+        }
+    }
+}
+
+int finish_row_block_writer(RowBlockWriter* writer) {
+    if (writer->binary) {
+        BinaryCsrHeader header = {0};
+        memcpy(header.magic, BINARY_CSR_MAGIC, BINARY_CSR_MAGIC_SIZE);
+        header.indexWidth = sizeof(uint64_t);
+        header.valueType = PRECISION_FLOAT;
+        header.noRows = writer->noRows;
+        header.noCols = writer->noCols;
+        header.valuesSize = writer->valuesWritten;
+        header.rowPointersSize = writer->noRows + 1;
+        header.valuesOffset = _align_binary_offset(sizeof(header));
+        const uint64_t values_end = header.valuesOffset + header.valuesSize * sizeof(float);
+        header.colIndicesOffset = _align_binary_offset(values_end);
+        const uint64_t col_indices_end = header.colIndicesOffset + header.valuesSize * sizeof(uint64_t);
+        header.rowPointersOffset = _align_binary_offset(col_indices_end);
+
+        static const char padding[BINARY_CSR_ALIGNMENT] = {0};
+        _buffer_bytes(&writer->values, padding, header.colIndicesOffset - values_end);
+        _append_spill_file(writer, &writer->colIndices);
+        _buffer_bytes(&writer->values, padding, header.rowPointersOffset - col_indices_end);
+        _append_spill_file(writer, &writer->rowPointers);
+        if (pwrite(writer->values.fd, &header, sizeof(header), 0) != sizeof(header)) {
+            writer->values.error = 1;
+        }
+    } else {
+        writer->values.data[writer->values.length++] = '\n';
+        _append_spill_file(writer, &writer->colIndices);
+        writer->values.data[writer->values.length++] = '\n';
+        _append_spill_file(writer, &writer->rowPointers);
+    }
+
+    _close_row_block_files(writer);
+    int error = writer->values.error;
+    free(writer);
+
+    return error ? FILE_WRITE_ERROR : MATRIX_WRITE_SUCCESS;
+}
+
+void discard_row_block_writer(RowBlockWriter* writer, const char* filename) {
+    if (writer) {
+        _close_row_block_files(writer);
+        unlink(filename);  // don't leave an incomplete result behind
+        free(writer);
+    }
+}
+
 // WRITING
 // -------
 
-int _write_float_array(FILE* file, float* const array, size_t size) {
-    if (size--) {  // check if size is greater than 0
-        float value;
-        int length;  // used to check if fprintf succeeded
-        for (size_t i = 0; i < size; i++) {
-            value = array[i];
-            length = snprintf(NULL, 0, "%g,", value);
-            if (fprintf(file, "%g,", value) != length) {
+int _write_fully(const int fd, const void* const data, const size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, (const char*) data + written, size - written);
+        if (result == -1) {
+            if (errno != EINTR) {
                 return FILE_WRITE_ERROR;
             }
+        } else {
+            written += result;  // write() may write less than requested
         }
+    }
 
-        // Write last element without trailing comma
-        value = array[size];
-        length = snprintf(NULL, 0, "%g", value);
-        if (fprintf(file, "%g", value) != length) {
-            return FILE_WRITE_ERROR;
-        }
+    return 0;
+}
+
+void _flush_write_buffer(WriteBuffer* const buffer) {
+    if (!buffer->error && _write_fully(buffer->fd, buffer->data, buffer->length) != 0) {
+        buffer->error = 1;
     }
+    buffer->length = 0;
+}
 
-    return ARRAY_WRITE_SUCCESS;
+size_t _format_uint_64(char* const out, uint64_t value) {
+    // Write the digits backwards into a scratch buffer, then copy them over
+    char digits[20];  // UINT64_MAX has 20 digits
+    size_t length = 0;
+    do {
+        digits[sizeof(digits) - ++length] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    memcpy(out, digits + sizeof(digits) - length, length);
+
+    return length;
 }
 
-int _write_uint_64_array(FILE* file, uint64_t* const array, size_t size) {
-    if (size--) {  // check if size is greater than 0
-        uint64_t value;
-        int length;  // used to check if fprintf succeeded
-        for (size_t i = 0; i < size; i++) {
-            value = array[i];
-            length = snprintf(NULL, 0, "%lu,", value);
-            if (fprintf(file, "%lu,", value) != length) {
-                return FILE_WRITE_ERROR;
+// Powers of ten up to 10^19, the largest one fitting into 64 bits
+static const uint64_t uint_64_powers_of_ten[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+    };
+
+size_t _format_general(
+    char* const out, const uint64_t mantissa, const int exponent, const int negative, const int precision
+    ) {
+    typedef unsigned __int128 uint128_t;
+
+    // 2^(bits - 1) <= value < 2^bits, so the decimal exponent is at least floor((bits - 1) * log10(2))
+    const int bits = 64 - __builtin_clzll(mantissa) + exponent;
+    int decimal_exponent = ((bits - 1) * 78913) >> 18;  // 78913 / 2^18 ~ log10(2), the shift rounds down
+
+    // Scale the value to precision digits, value * 10^scale = numerator / denominator exactly
+    uint64_t digits;
+    while (1) {
+        const int scale = precision - 1 - decimal_exponent;
+        uint128_t numerator = mantissa;
+        uint128_t denominator = 1;
+        if (scale >= 0) {
+            numerator *= scale > 19
+                ? (uint128_t) uint_64_powers_of_ten[19] * uint_64_powers_of_ten[scale - 19]
+                : uint_64_powers_of_ten[scale];
+        } else {
+            denominator = uint_64_powers_of_ten[-scale];
+        }
+        if (exponent >= 0) {
+            numerator <<= exponent;
+        } else {
+            denominator <<= -exponent;
+        }
+
+        const uint128_t quotient = numerator / denominator;
+        if (quotient >= uint_64_powers_of_ten[precision]) {
+            decimal_exponent++;  // the estimate was one too small
+            continue;
+        }
+
+        // Round the exact remainder to nearest, ties to even like printf()
+        const uint128_t remainder = numerator % denominator;
+        digits = quotient;
+        if (2 * remainder > denominator || (2 * remainder == denominator && (digits & 1))) {
+            digits++;
+        }
+        if (digits == uint_64_powers_of_ten[precision]) {  // rounded up to the next power of ten
+            digits = uint_64_powers_of_ten[precision - 1];
+            decimal_exponent++;
+        }
+        break;
+    }
+
+    // Print the significant digits without trailing zeros, like %g does
+    char digit_string[20];
+    int digit_count = (int) _format_uint_64(digit_string, digits);
+    while (digit_count > 1 && digit_string[digit_count - 1] == '0') {
+        digit_count--;
+    }
+
+    size_t length = 0;
+    if (negative) {
+        out[length++] = '-';
+    }
+    if (decimal_exponent >= -4 && decimal_exponent < precision) {
+        // Fixed notation
+        if (decimal_exponent >= 0) {
+            for (int i = 0; i <= decimal_exponent; i++) {
+                out[length++] = i < digit_count ? digit_string[i] : '0';
+            }
+            if (digit_count > decimal_exponent + 1) {
+                out[length++] = '.';
+                memcpy(out + length, digit_string + decimal_exponent + 1, digit_count - decimal_exponent - 1);
+                length += digit_count - decimal_exponent - 1;
             }
+        } else {
+            out[length++] = '0';
+            out[length++] = '.';
+            for (int i = -1; i > decimal_exponent; i--) {
+                out[length++] = '0';
+            }
+            memcpy(out + length, digit_string, digit_count);
+            length += digit_count;
+        }
+    } else {
+        // Exponential notation with at least two exponent digits
+        out[length++] = digit_string[0];
+        if (digit_count > 1) {
+            out[length++] = '.';
+            memcpy(out + length, digit_string + 1, digit_count - 1);
+            length += digit_count - 1;
+        }
+        out[length++] = 'e';
+        out[length++] = decimal_exponent < 0 ? '-' : '+';
+        const unsigned exponent_value = decimal_exponent < 0 ? -decimal_exponent : decimal_exponent;
+        if (exponent_value < 10) {
+            out[length++] = '0';
+        }
+        length += _format_uint_64(out + length, exponent_value);
+    }
+
+    return length;
+}
+
+size_t _format_float(char* const out, const float value) {
+    uint32_t value_bits;
+    memcpy(&value_bits, &value, sizeof(value_bits));
+    const float magnitude = value < 0 ? -value : value;
+
+    // Zero, subnormal, infinite, NaN or too far from 1 for exact 128 bit arithmetic
+    if (!(magnitude >= 1e-20f && magnitude < 1e20f)) {
+        return snprintf(out, MAX_ELEMENT_LENGTH, "%g", value);
+    }
+
+    const uint64_t mantissa = (value_bits & 0x7fffff) | 0x800000;
+    const int exponent = (int) ((value_bits >> 23) & 0xff) - 127 - 23;
+    return _format_general(out, mantissa, exponent, value < 0, 6);
+}
+
+size_t _format_double(char* const out, const double value) {
+    uint64_t value_bits;
+    memcpy(&value_bits, &value, sizeof(value_bits));
+    const double magnitude = value < 0 ? -value : value;
+
+    // Zero, subnormal, infinite, NaN or too far from 1 for exact 128 bit arithmetic
+    if (!(magnitude >= 1e-5 && magnitude < 1e17)) {
+        return snprintf(out, MAX_ELEMENT_LENGTH, "%.17g", value);
+    }
+
+    const uint64_t mantissa = (value_bits & 0xfffffffffffffull) | 0x10000000000000ull;
+    const int exponent = (int) ((value_bits >> 52) & 0x7ff) - 1023 - 52;
+    return _format_general(out, mantissa, exponent, value < 0, 17);
+}
+
+void _write_float_array(WriteBuffer* const buffer, const float* const array, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (WRITE_BUFFER_SIZE - buffer->length < MAX_ELEMENT_LENGTH) {
+            _flush_write_buffer(buffer);
         }
+        buffer->length += _format_float(buffer->data + buffer->length, array[i]);
+        buffer->data[buffer->length++] = ',';
+    }
+    buffer->length -= size != 0;  // no trailing comma after the last element
+}
 
-        // Write last element without trailing comma
-        value = array[size];
-        length = snprintf(NULL, 0, "%lu", value);
-        if (fprintf(file, "%lu", value) != length) {
-            return FILE_WRITE_ERROR;
+void _write_double_array(WriteBuffer* const buffer, const double* const array, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (WRITE_BUFFER_SIZE - buffer->length < MAX_ELEMENT_LENGTH) {
+            _flush_write_buffer(buffer);
         }
+        buffer->length += _format_double(buffer->data + buffer->length, array[i]);
+        buffer->data[buffer->length++] = ',';
     }
+    buffer->length -= size != 0;  // no trailing comma after the last element
+}
 
-    return ARRAY_WRITE_SUCCESS;
+void _write_uint_64_array(WriteBuffer* const buffer, const uint64_t* const array, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (WRITE_BUFFER_SIZE - buffer->length < MAX_ELEMENT_LENGTH) {
+            _flush_write_buffer(buffer);
+        }
+        buffer->length += _format_uint_64(buffer->data + buffer->length, array[i]);
+        buffer->data[buffer->length++] = ',';
+    }
+    buffer->length -= size != 0;  // no trailing comma after the last element
 }
 
 // MEMORY MANAGEMENT FUNCTIONS BELOW //
 // --------------------------------- //
 
+void _free_csr_arrays(
+    void* values, uint64_t* colIndices, uint64_t* rowPointers, void* mapping, const size_t mapping_size
+    ) {
+    if (mapping) {
+        munmap(mapping, mapping_size);  // the subarrays point into the mapping
+    } else {
+        free(values);
+        free(colIndices);
+        free(rowPointers);
+    }
+}
+
 void free_csr_matrix(Matrix* matrix) {
+    if (matrix) {
+        _free_csr_arrays(
+            matrix->values, matrix->colIndices, matrix->rowPointers, matrix->mapping, matrix->mappingSize
+            );
+        free(matrix);
+    }
+}
+
+void free_double_csr_matrix(DoubleMatrix* matrix) {
+    if (matrix) {
+        _free_csr_arrays(
+            matrix->values, matrix->colIndices, matrix->rowPointers, matrix->mapping, matrix->mappingSize
+            );
+        free(matrix);
+    }
+}
+
+uint64_t dense_stride(const uint64_t noCols) {
+    if (noCols == 1) {
+        return 1;
+    }
+    return (noCols + DENSE_STRIDE_FLOATS - 1) / DENSE_STRIDE_FLOATS * DENSE_STRIDE_FLOATS;
+}
+
+int init_dense_matrix(DenseMatrix* const matrix, const uint64_t noRows, const uint64_t noCols) {
+    matrix->noRows = noRows;
+    matrix->noCols = noCols;
+    matrix->stride = dense_stride(noCols);
+
+    // aligned_alloc() needs a multiple of the alignment, which a vector does not always have
+    uint64_t bytes = noRows * matrix->stride * sizeof(float);
+    bytes = (bytes + DENSE_ALIGNMENT - 1) / DENSE_ALIGNMENT * DENSE_ALIGNMENT;
+    matrix->values = aligned_alloc(DENSE_ALIGNMENT, bytes ? bytes : DENSE_ALIGNMENT);
+    if (matrix->values == NULL) {
+        return HEAP_MEMORY_ERROR;
+    }
+    memset(matrix->values, 0, bytes);
+    return 0;
+}
+
+void free_dense_matrix(DenseMatrix* matrix) {
     if (matrix) {
         free(matrix->values);
-        free(matrix->colIndices);
-        free(matrix->rowPointers);
         free(matrix);
     }
 }
@@ -796,6 +2307,22 @@ void free_pointers(const int n, ...) {
     va_end(args);
 }
 
+void free_filename_list(char** filenames, const unsigned int count) {
+    if (filenames == NULL) {
+        return;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        free(filenames[i]);
+    }
+    free(filenames);
+}
+
+double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
 void free_csr_matrices(const int n, ...) {
     va_list args;
     va_start(args, n);
@@ -806,4 +2333,4 @@ void free_csr_matrices(const int n, ...) {
         free_csr_matrix(matrix_to_free);
     }
     va_end(args);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -10,6 +10,7 @@
 // Our header files
 #include "constants.h"
 #include "csrmatrix.h"
+#include "config.h"
 
 
 // Message constants
@@ -25,6 +26,27 @@ extern const char* MISSING_FILENAME_A_MSG;  // message to print when filename a
 extern const char* MISSING_FILENAME_B_MSG;  // message to print when filename b is missing
 extern const char* MISSING_FILENAME_O_MSG;  // message to print when the output filename is missing
 extern const char* ALREADY_PARSED_MSG;  // message to print when an argument is given twice (like -a -a)
+extern const char* ALREADY_PARSED_LONG_MSG;  // message to print when a long argument is given twice (like --schedule)
+extern const char* ILLEGAL_SCHEDULE_MSG;  // message to print when the scheduling strategy is unknown
+extern const char* ILLEGAL_NUMA_MSG;  // message to print when the NUMA mode is unknown
+extern const char* ILLEGAL_CHUNK_SIZE_MSG;  // message to print when the chunk size is not a positive number
+extern const char* ILLEGAL_THREAD_COUNT_MSG;  // message to print when the thread count is not a positive number
+extern const char* ILLEGAL_PRECISION_MSG;  // message to print when the precision is unknown
+extern const char* PRECISION_IMPLEMENTATION_MSG;  // message to print when the implementation only supports float
+extern const char* ILLEGAL_STREAM_BLOCK_MSG;  // message to print when the stream block size is not a positive number
+extern const char* STREAM_OPTIONS_MSG;  // message to print when --stream is combined with -B or --precision double
+extern const char* PIPELINE_OPTIONS_MSG;  // message to print when --pipeline is combined with --stream, -B or --precision double
+extern const char* PLAN_OPTIONS_MSG;  // message to print when --plan is given without -B or with another precision
+extern const char* ILLEGAL_BENCH_FORMAT_MSG;  // message to print when the output format of --bench is unknown
+extern const char* ILLEGAL_BENCH_IMPLS_MSG;  // message to print when the implementation list of --bench-impls is invalid
+extern const char* ILLEGAL_WARMUP_MSG;  // message to print when the number of warmup runs is not a number
+extern const char* CHAIN_OPTIONS_MSG;  // message to print when --chain is combined with -V, a streaming mode, --plan, --bench or another precision
+extern const char* DENSE_OPTIONS_MSG;  // message to print when --dense is combined with -V, a streaming mode, --plan, --bench, --chain or another precision
+extern const char* MASK_OPTIONS_MSG;  // message to print when --mask is combined with -V, a streaming mode, --plan, --bench, --chain, --dense or another precision
+extern const char* COMPLEMENT_MASK_MSG;  // message to print when --complement is given without --mask
+extern const char* ILLEGAL_ESTIMATE_MSG;  // message to print when the size estimate is unknown
+extern const char* ESTIMATE_OPTIONS_MSG;  // message to print when --estimate is given for another implementation than V5
+extern const char* BENCH_OPTIONS_MSG;  // message to print when --bench is combined with --stream, --pipeline, --plan or another precision
 
 extern const char* FILE_OPEN_ERROR_MSG;  // message displayed when there is an error opening a given file
 extern const char* MATRIX_FILE_FORMAT_ERROR_MSG;  // message to print when the matrix in the file is not correctly formatted
@@ -40,6 +62,28 @@ extern const char* THREAD_START_ERROR_MSG;  // message displayed when multithrea
 #define ARGPARSE_SUCCESS 0
 #define ARGPARSE_HELP 1
 
+// Values returned by getopt_long() for options that only have a long form
+#define OPT_SCHEDULE 256
+#define OPT_CHUNK_SIZE 257
+#define OPT_THREADS 258
+#define OPT_PRECISION 259
+#define OPT_STREAM 260
+#define OPT_PLAN 261
+#define OPT_NUMA 262
+#define OPT_BENCH 263
+#define OPT_BENCH_IMPLS 264
+#define OPT_WARMUP 265
+#define OPT_STATS 266
+#define OPT_PIPELINE 267
+#define OPT_CHAIN 268
+#define OPT_DENSE 269
+#define OPT_MASK 270
+#define OPT_COMPLEMENT 271
+#define OPT_ESTIMATE 272
+
+// The filenames of --chain are grown by this many entries at a time
+#define CHAIN_FILENAMES_GROWTH 8
+
 // Matrix writing error codes
 #define ARRAY_WRITE_SUCCESS 0
 #define MATRIX_WRITE_SUCCESS 0
@@ -52,6 +96,33 @@ extern const char* THREAD_START_ERROR_MSG;  // message displayed when multithrea
 
 // Matrix read success code
 #define MATRIX_READ_SUCCESS 0
+
+// Binary CSR format: magic number (never starts with a digit like the text format), alignment of
+// the sections in the file and extension of output files that are written in this format
+#define BINARY_CSR_MAGIC "\x89" "CSR\r\n\x1a\n"
+#define BINARY_CSR_MAGIC_SIZE 8
+#define BINARY_CSR_ALIGNMENT 64
+#define BINARY_CSR_EXTENSION ".csrb"
+
+/*
+Header at the start of a binary CSR file, in native byte order. indexWidth is the size of
+a column index/row pointer in bytes (4 or 8), valueType PRECISION_FLOAT or PRECISION_DOUBLE.
+The other members have the same meaning as in Matrix. The subarrays follow at the given
+byte offsets from the start of the file, aligned to BINARY_CSR_ALIGNMENT when written by
+write_matrix_to_file(), so an 8 byte index, matching value type file can be used in place.
+*/
+typedef struct {
+    char magic[BINARY_CSR_MAGIC_SIZE];
+    uint32_t indexWidth;
+    uint32_t valueType;
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t valuesSize;
+    uint64_t rowPointersSize;
+    uint64_t valuesOffset;
+    uint64_t colIndicesOffset;
+    uint64_t rowPointersOffset;
+} BinaryCsrHeader;
 // Passed to matrix reading function when the line to be read is not the last line in the file.
 #define NOT_LAST_LINE '\n'
 
@@ -62,6 +133,22 @@ from which files the matrices should be read, in which file the resulting matrix
 should be stored, whether the time it takes for the program to be executed should
 be measured, and also how many times the time should be measured.
 
+Options of the multithreaded implementation (--schedule, --chunk-size, --threads, --numa, --stats
+or MULTIPLY_STATS_ENV) and the
+value type of V6 - V9 (--precision) are stored in config.
+stream_block_nnz is the block size of --stream or --pipeline, or 0 if the matrices are not streamed.
+pipeline_flag is set to 1 if the streamed stages should overlap (--pipeline).
+plan_flag is set to 1 if the measured runs should use a cached plan (--plan).
+The settings of --bench, --bench-impls and --warmup are stored in bench. With --bench,
+number_measures is the number of measured runs of every implementation (default:
+BENCH_DEFAULT_RUNS).
+The filenames of --chain are stored in the order they were given in *chain_filenames, an array
+of *chain_count strings (NULL if there are none). The array and its strings should be free'd
+with free_filename_list(), also on error.
+dense_flag is set to 1 if B is a dense matrix that is multiplied with matr_mult_spmm() (--dense).
+filename_mask is the mask of matr_mult_csr_masked() (--mask), NULL if there is none. It should
+be free'd, also on error. complement_flag is set to 1 if the mask is complemented (--complement).
+
 Return values:
     ARGPARSE_SUCCESS when all arguments have been parsed correctly.
     ARGPARSE_ERROR when there was an error in parsing, exit prematurely.
@@ -76,13 +163,39 @@ int parse_arguments(
     uint8_t* implementation,
     int* measure_flag,
     uint64_t* number_measures,
+    MultiplyConfig* config,
+    uint64_t* stream_block_nnz,
+    int* pipeline_flag,
+    int* plan_flag,
+    BenchConfig* bench,
+    char*** chain_filenames,
+    unsigned int* chain_count,
+    int* dense_flag,
+    char** filename_mask,
+    int* complement_flag,
     char** error_message
 );
 
+/*
+Parses the implementation list of --bench-impls: "all" or comma separated implementation
+numbers and ranges like "0,2-5". Bit i of implementations is set for every listed Vi.
+
+This function is called in parse_arguments() and should not be called outside of it.
+
+Return values:
+    0 on success.
+    ARGPARSE_ERROR if the list is empty or names an implementation that doesn't exist.
+*/
+int _parse_implementation_list(const char* list, uint64_t* implementations);
+
 /*
 Reads a matrix in CSR format from the given filename. Allocates memory on the heap for the matrix and
 its data (values, column indices, row pointers). This matrix should then be free'd.
 
+The file can be in the text or in the binary CSR format, which is recognized by BINARY_CSR_MAGIC.
+A binary file with 8 byte indices and float values is not copied: the subarrays point into
+the memory mapped file (see Matrix.mapping), free_csr_matrix() unmaps it.
+
 On error, the matrix is not allocated.
 
 Return values:
@@ -93,8 +206,15 @@ Return values:
 */
 int read_matrix_from_file(const char* filename, Matrix** matrix);
 
+/*
+Same as read_matrix_from_file(), but the values are parsed with strtod() into a DoubleMatrix.
+Used for --precision double.
+*/
+int read_double_matrix_from_file(const char* filename, DoubleMatrix** matrix);
+
 /*
 Writes a non-NULL CSR matrix to the given filename. Does NOT free the matrix or its subarrays.
+If filename ends with BINARY_CSR_EXTENSION, the binary CSR format is written, otherwise text.
 
 Return values:
     MATRIX_WRITE_SUCCESS when the matrix is successfully written to the file.
@@ -103,6 +223,41 @@ Return values:
 */
 int write_matrix_to_file(const char* filename, const Matrix* const matrix);
 
+/*
+Same as write_matrix_to_file() for a DoubleMatrix. The values are written with 17
+significant digits (%.17g), so they can be read back without loss.
+*/
+int write_double_matrix_to_file(const char* filename, const DoubleMatrix* const matrix);
+
+/*
+Reads a dense matrix (the right-hand side of --dense) from the given filename into a
+heap-allocated DenseMatrix, which should then be free'd with free_dense_matrix().
+
+The format is the first line of the text CSR format ("noRows,noCols") followed by one line
+per row with exactly noCols comma separated values, zeros included. The last line has no
+newline at its end, like in the CSR format. A vector is a matrix with one column.
+
+On error, the matrix is not allocated and *matrix is NULL.
+
+Return values:
+    MATRIX_READ_SUCCESS when the matrix is successfully read.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    MATRIX_FILE_FORMAT_ERROR if the file is improperly formatted.
+    HEAP_MEMORY_ERROR if there is an error allocating memory to the matrix.
+*/
+int read_dense_matrix_from_file(const char* filename, DenseMatrix** matrix);
+
+/*
+Writes a dense matrix to the given filename in the format of read_dense_matrix_from_file(),
+the values like write_matrix_to_file() (%g). The padding of the rows is not written.
+
+Return values:
+    MATRIX_WRITE_SUCCESS when the matrix is successfully written to the file.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    FILE_WRITE_ERROR when there is an error writing to the file.
+*/
+int write_dense_matrix_to_file(const char* filename, const DenseMatrix* const matrix);
+
 /*
 This function is used to set the error message to be printed on stderr later on.
 'error_message' will hold the formatted string at the end of the function call.
@@ -131,9 +286,106 @@ int _parse_filename(char** dest, const char* const src);
 
 
 /*
-Reads a unsigned long long (uint64_t) array from a file, whose values are separated by commas. 
+Reads a CSR matrix from the given file into its subarrays: noRows and noCols, the
+values (float or double, depending on precision), the column indices and the row pointers.
+Every part is validated with the _check_*() functions below.
+
+The whole file is mapped into memory (see _map_file()) and scanned in place, so the arrays
+can be allocated once with their final size instead of being grown while reading.
+
+If the file is in the binary format, it is handed over to _read_binary_csr(). mapping is set
+to the mapping the subarrays point into, or NULL if they are heap arrays.
+
+This function is called in read_matrix_from_file() and read_double_matrix_from_file() and
+should not be called outside of them. On error, no array has to be freed.
+
+Return values:
+    MATRIX_READ_SUCCESS when the matrix was successfully read.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    MATRIX_FILE_FORMAT_ERROR if the file is improperly formatted (invalid CSR).
+    HEAP_MEMORY_ERROR if there is an error allocating memory to the arrays.
+*/
+int _read_csr_file(
+    const char* filename, const int precision, uint64_t* const noRows, uint64_t* const noCols,
+    void** values, uint64_t* const values_size,
+    uint64_t** colIndices, uint64_t** rowPointers, uint64_t* const row_pointers_size,
+    void** mapping, size_t* const mapping_size
+    );
+
+/*
+Reads the binary CSR file that _read_csr_file() mapped to data. Takes ownership of data.
+If the file is mapped and its index width and value type match the requested precision,
+the subarrays point into the mapping and mapping is set to data. Otherwise the subarrays are
+converted into heap arrays, data is released and mapping is set to NULL.
+Like the text format, the subarrays are validated with the _check_*() functions.
+
+Return values:
+    MATRIX_READ_SUCCESS when the matrix was successfully read.
+    MATRIX_FILE_FORMAT_ERROR if the header or the subarrays are invalid.
+    HEAP_MEMORY_ERROR if there is an error allocating memory to the arrays.
+*/
+int _read_binary_csr(
+    const char* data, const size_t data_size, const int mapped, const int precision,
+    uint64_t* const noRows, uint64_t* const noCols, void** values, uint64_t* const values_size,
+    uint64_t** colIndices, uint64_t** rowPointers, uint64_t* const row_pointers_size,
+    void** mapping, size_t* const mapping_size
+    );
+
+/*
+Returns 1 if count elements of width bytes starting at offset are aligned and lie inside a file
+of file_size bytes, 0 otherwise.
+*/
+int _binary_section_fits(const uint64_t offset, const uint64_t count, const uint64_t width, const size_t file_size);
+
+/*
+Copies count values of value_type (PRECISION_FLOAT or PRECISION_DOUBLE) from src into a new heap
+array of doubles if precision is PRECISION_DOUBLE, otherwise floats. Returns NULL on allocation error.
+*/
+void* _copy_binary_values(const void* src, const uint64_t count, const uint32_t value_type, const int precision);
+
+/*
+Copies count indices of index_width bytes (4 or 8) from src into a new uint64_t heap array.
+Returns NULL on allocation error.
+*/
+uint64_t* _copy_binary_indices(const void* src, const uint64_t count, const uint32_t index_width);
+
+/*
+Maps the file into memory read-only and stores its start in data and its length in size.
+If the file cannot be mapped (e.g. it is a pipe), it is read into a heap buffer in large
+blocks instead, mapped tells which of both happened. Release the data with _unmap_file().
+
+Return values:
+    0 on success.
+    FILE_OPEN_ERROR when the file cannot be opened or read.
+    HEAP_MEMORY_ERROR if the read buffer cannot be allocated.
+*/
+int _map_file(const char* filename, const char** data, size_t* const size, int* const mapped);
+
+/*
+Releases the data returned by _map_file().
+*/
+void _unmap_file(const char* data, const size_t size, const int mapped);
+
+/*
+Finds the end of the line starting at cursor and stores it in line_end. The last line
+(eof_flag EOF) ends with the file, any other line (NOT_LAST_LINE) with a newline character.
+
+Returns 0, or MATRIX_FILE_FORMAT_ERROR if the line is empty or the newline is missing.
+*/
+int _next_line(const char** cursor, const char* const end, const char** line_end, const int eof_flag);
+
+/*
+Parses the digits at ptr (up to line_end) into value and moves ptr behind them.
+Returns 0, or MATRIX_FILE_FORMAT_ERROR if there are no digits or the value overflows.
+*/
+int _parse_uint_64(const char** ptr, const char* const line_end, uint64_t* const value);
+
+/*
+Reads a unsigned long long (uint64_t) array from the line at cursor, whose values are separated by commas.
+The line has to hold exactly expected_size values, so the array is allocated only once.
 Allocates memory for the array, stores its length in array_size. This memory should then be free'd.
 If an error occurs during parsing, the array is freed up before returning.
+On success cursor is moved to the start of the next line.
 
 This function is called in read_matrix_from_file() and should generally not be called outside of it.
 
@@ -144,12 +396,29 @@ Return values:
     HEAP_MEMORY_ERROR when memory for the array could not be allocated.
     MATRIX_FILE_FORMAT_ERROR when the file is not correctly formatted.
 */
-int _read_uint_64_array(FILE* file, uint64_t** array, uint64_t* array_size, const int eof_flag);
+int _read_uint_64_array(
+    const char** cursor, const char* const end, uint64_t** array, uint64_t* array_size,
+    const uint64_t expected_size, const int eof_flag
+    );
+
+/*
+Parses one value at ptr (digits, an optional leading minus and an optional decimal point)
+up to the next comma or line_end and stores it in value. ptr is moved behind the value.
+
+Short values are converted exactly with a single division by a power of ten (Clinger's fast
+path), longer ones with strtof()/strtod(), depending on precision.
+
+Returns 0, or MATRIX_FILE_FORMAT_ERROR if the value is malformed or out of range.
+*/
+int _parse_value(const char** ptr, const char* const line_end, double* const value, const int precision);
 
 /*
-Reads a float array from a file, whose values are separated by commas. Allocates
+Reads a float array from the line at cursor, whose values are separated by commas. Allocates
 memory for the array, stores its length in array_size. This memory should then be free'd.
 If an error occurs during parsing, the array is freed up before returning.
+On success cursor is moved to the start of the next line.
+
+The array holds doubles if precision is PRECISION_DOUBLE, otherwise floats.
 
 This function is called in read_matrix_from_file() and should generally not be called outside of it.
 
@@ -160,7 +429,10 @@ Return values:
     HEAP_MEMORY_ERROR when memory for the array could not be allocated.
     MATRIX_FILE_FORMAT_ERROR when the file is not correctly formatted.
 */
-int _read_float_array(FILE* file, float** array, uint64_t* array_size, const int eof_flag);
+int _read_value_array(
+    const char** cursor, const char* const end, void** array, uint64_t* array_size,
+    const int eof_flag, const int precision
+    );
 
 /*
 Called in read_matrix_to_file() to check if the values parsed from the file actually make up
@@ -168,7 +440,7 @@ a valid CSR matrix. The values must be non zero and the size of the parsed array
 than or equal to what the matrix can mathematically hold. This check is important because the 
 multiplication functions assume that the CSR matrices given have a valid structure.
 
-On error, the value array is freed.
+The values are doubles if precision is PRECISION_DOUBLE. The array is not freed on error.
 
 This function is called in read_matrix_from_file() and should not be called outside of it.
 
@@ -177,8 +449,8 @@ Return values:
     MATRIX_FILE_FORMAT_ERROR if they are not.
 */
 int _check_values(
-    float* values, const uint64_t values_size,
-    const uint64_t noRows, const uint64_t noCols
+    const void* values, const uint64_t values_size,
+    const uint64_t noRows, const uint64_t noCols, const int precision
 );
 
 /*
@@ -186,7 +458,7 @@ Called in read_matrix_to_file() to check if the column index parsed from the fil
 a valid CSR matrix. This is important because the multiplication functions assume that the given
 CSR matrices have a valid structure.
 
-On error, the column index array is freed.
+The array is not freed on error.
 
 This function is called in read_matrix_from_file() and should not be called outside of it.
 
@@ -195,7 +467,7 @@ Return values:
     MATRIX_FILE_FORMAT_ERROR if they are not.
 */
 int _check_col_indices (
-    uint64_t* colIndices, const uint64_t col_indices_size, 
+    const uint64_t* colIndices, const uint64_t col_indices_size, 
     const uint64_t values_size, const uint64_t noCols
     );
 
@@ -204,7 +476,7 @@ Called in read_matrix_to_file() to check if the row pointers parsed from the fil
 a valid CSR matrix. This is important because the multiplication functions assume that the given
 CSR matrices have a valid structure.
 
-On error, the row pointer array is freed.
+The array is not freed on error.
 
 This function is called in read_matrix_from_file() and should not be called outside of it.
 
@@ -213,37 +485,350 @@ Return values:
     MATRIX_FILE_FORMAT_ERROR if they are not.
 */
 int _check_row_pointers(
-    uint64_t* rowPointers, const uint64_t row_pointers_size, 
+    const uint64_t* rowPointers, const uint64_t row_pointers_size, 
     const uint64_t values_size, const uint64_t noRows, const uint64_t noCols
     );
 
+// Size of the buffer the CSR writer formats into before writing it to the file
+#define WRITE_BUFFER_SIZE (1 << 18)
+// Room left in the buffer for each element, enough for -1.2345678901234567e-308 plus a comma
+#define MAX_ELEMENT_LENGTH 32
+
 /*
-Writes an array of floats to the given file. The values are each separated by commas.
+Output buffer of _write_csr_file(). Elements are formatted directly into data and written
+to fd with write() whenever the buffer is nearly full. error is set once a write fails,
+the following flushes are then skipped.
+*/
+typedef struct {
+    int fd;
+    size_t length;
+    int error;
+    char data[WRITE_BUFFER_SIZE];
+} WriteBuffer;
+
+/*
+Writes size bytes of data to fd, retrying until everything is written.
+
+Returns 0, or FILE_WRITE_ERROR if write() fails.
+*/
+int _write_fully(const int fd, const void* const data, const size_t size);
+
+/*
+Writes the buffered data to the file and empties the buffer. Sets buffer->error on failure.
+*/
+void _flush_write_buffer(WriteBuffer* const buffer);
+
+/*
+Formats value in decimal to out (like %lu) and returns the number of characters written.
+No terminating null byte is written.
+*/
+size_t _format_uint_64(char* const out, uint64_t value);
+
+/*
+Formats the value mantissa * 2^exponent (negated if negative is set) to out exactly like %.<precision>g
+and returns the number of characters written. No terminating null byte is written.
+
+The digits are rounded with exact 128 bit integer arithmetic, so mantissa * 10^(precision - 1) must
+be representable in it: precision is at most 19, and the value must not be too far from 1
+(see _format_float() and _format_double()).
+*/
+size_t _format_general(
+    char* const out, const uint64_t mantissa, const int exponent, const int negative, const int precision
+    );
+
+/*
+Formats value to out exactly like %g and returns the number of characters written.
+Values outside [1e-20, 1e20) are formatted with snprintf().
+*/
+size_t _format_float(char* const out, const float value);
+
+/*
+Formats value to out exactly like %.17g and returns the number of characters written.
+Values outside [1e-5, 1e17) are formatted with snprintf().
+*/
+size_t _format_double(char* const out, const double value);
+
+/*
+Writes an array of floats (%g) to the buffer. The values are each separated by commas.
 
 This function is called in write_matrix_to_file() and should not be called outside of it.
+Afterwards there is always room for at least one more character in the buffer.
+*/
+void _write_float_array(WriteBuffer* const buffer, const float* const array, const size_t size);
 
-Return values:
-    ARRAY_WRITE_SUCCESS on success.
-    FILE_WRITE_ERROR when the array was not successfully written to the file.
+/*
+Writes an array of doubles (%.17g) to the buffer. The values are each separated by commas.
+
+This function is called in write_double_matrix_to_file() and should not be called outside of it.
+Afterwards there is always room for at least one more character in the buffer.
 */
-int _write_float_array(FILE* file, float* const array, size_t size);
+void _write_double_array(WriteBuffer* const buffer, const double* const array, const size_t size);
+
 /*
-Writes an array of uint64_t's to the given file. The values are each separated by commas.
+Writes an array of uint64_t's (%lu) to the buffer. The values are each separated by commas.
 
 This function is called in write_matrix_to_file() and should not be called outside of it.
+Afterwards there is always room for at least one more character in the buffer.
+*/
+void _write_uint_64_array(WriteBuffer* const buffer, const uint64_t* const array, const size_t size);
+
+/*
+Writes the subarrays of a CSR matrix to the given file. values holds doubles if
+precision is PRECISION_DOUBLE, otherwise floats.
+
+This function is called in write_matrix_to_file() and write_double_matrix_to_file()
+and should not be called outside of them.
+
+Return values:
+    MATRIX_WRITE_SUCCESS when the matrix is successfully written to the file.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    FILE_WRITE_ERROR when there is an error writing to the file.
+*/
+int _write_csr_file(
+    const char* filename, const int precision, const uint64_t noRows, const uint64_t noCols,
+    const void* const values, const uint64_t values_size,
+    const uint64_t* const colIndices, const uint64_t* const rowPointers, const uint64_t row_pointers_size
+    );
+
+/*
+Returns 1 if filename ends with BINARY_CSR_EXTENSION, 0 otherwise.
+*/
+int _has_binary_extension(const char* filename);
+
+/*
+Rounds offset up to the next multiple of BINARY_CSR_ALIGNMENT.
+*/
+uint64_t _align_binary_offset(const uint64_t offset);
+
+/*
+Writes the subarrays of a CSR matrix to the given file in the binary CSR format (see BinaryCsrHeader)
+with 8 byte indices. values holds doubles if precision is PRECISION_DOUBLE, otherwise floats.
+
+This function is called in _write_csr_file() and should not be called outside of it.
+
+Return values:
+    MATRIX_WRITE_SUCCESS when the matrix is successfully written to the file.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    FILE_WRITE_ERROR when there is an error writing to the file.
+*/
+int _write_binary_csr_file(
+    const char* filename, const int precision, const uint64_t noRows, const uint64_t noCols,
+    const void* const values, const uint64_t values_size,
+    const uint64_t* const colIndices, const uint64_t* const rowPointers, const uint64_t row_pointers_size
+    );
+
+
+/*
+The struct RowBlockReader reads a CSR matrix file (text or binary) in blocks of consecutive rows,
+so a matrix larger than the memory can be multiplied block by block (see --stream).
+
+The file is mapped as a whole (see _map_file()), the cursors point to the next value, column
+index and row pointer, which are lines of the text format or sections of the binary format.
+Consumed pages are dropped from memory again (released* is where the next release starts).
+block holds the current block with heap arrays that are reused, its row pointers start at 0.
+blockNnz limits the number of values and rows of a block, a longer row forms a block of its own.
+pendingRowPointer is the already read end of row nextRow if pendingFlag is set.
+*/
+typedef struct {
+    const char* data;
+    size_t dataSize;
+    int mapped;
+
+    int binary;
+    uint32_t indexWidth;  // binary only
+    uint32_t valueType;  // binary only
+
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t blockNnz;
+    uint64_t nextRow;
+    uint64_t nextValue;
+    uint64_t pendingRowPointer;
+    int pendingFlag;
+    int rowPointersStarted;  // text only, set after the first row pointer was read
+
+    const char* valuesCursor;
+    const char* valuesEnd;
+    const char* colIndicesCursor;
+    const char* colIndicesEnd;
+    const char* rowPointersCursor;
+    const char* rowPointersEnd;
+    const char* releasedValues;
+    const char* releasedColIndices;
+    const char* releasedRowPointers;
+
+    Matrix block;
+    uint64_t valuesCapacity;
+    uint64_t rowPointersCapacity;
+} RowBlockReader;
+
+/*
+Opens the CSR matrix file filename for reading it with read_row_block(). The dimensions are
+read right away and stored in noRows and noCols of the reader. Close it with close_row_block_reader().
+
+Return values:
+    MATRIX_READ_SUCCESS when the file was opened.
+    FILE_OPEN_ERROR when the file cannot be opened.
+    MATRIX_FILE_FORMAT_ERROR if the dimensions or the first row pointer are invalid.
+    HEAP_MEMORY_ERROR if the reader cannot be allocated.
+*/
+int open_row_block_reader(const char* filename, const uint64_t block_nnz, RowBlockReader** reader);
+
+/*
+Reads the next block of rows into reader->block, validating it like read_matrix_from_file() does.
+reader->block.noRows is 0 when all rows were read.
+
+Return values:
+    MATRIX_READ_SUCCESS when the block was read.
+    MATRIX_FILE_FORMAT_ERROR if the file is improperly formatted (invalid CSR).
+    HEAP_MEMORY_ERROR if there is an error allocating memory to the block.
+*/
+int read_row_block(RowBlockReader* const reader);
+
+/*
+Unmaps the file and frees the reader including its block.
+*/
+void close_row_block_reader(RowBlockReader* reader);
+
+/*
+Reads the next row pointer of the file into row_pointer.
+Returns 0, or MATRIX_FILE_FORMAT_ERROR if there is none.
+*/
+int _next_row_pointer(RowBlockReader* const reader, uint64_t* const row_pointer);
+
+/*
+Parses the next value of a comma separated text line at cursor into value. separator_flag
+is set if the value is not the first of its line and therefore has to follow a comma.
+Returns 0, or MATRIX_FILE_FORMAT_ERROR if the value is malformed.
+*/
+int _next_text_uint_64(const char** cursor, const char* const line_end, const int separator_flag, uint64_t* const value);
+
+/*
+Reads the next count values and column indices into the block and checks them
+like _check_values() and _check_col_indices(). Returns 0 or MATRIX_FILE_FORMAT_ERROR.
+*/
+int _read_block_entries(RowBlockReader* const reader, const uint64_t count);
+
+/*
+Drops the whole pages of the mapping between *released and cursor from memory
+and moves *released to the end of the dropped range.
+*/
+void _release_consumed(const char** released, const char* const cursor);
+
+/*
+The struct RowBlockWriter writes the result rows of a streamed multiplication block by block.
+The output format is chosen like in write_matrix_to_file().
+
+Both formats store all values before all column indices and row pointers. So only the values
+are written to the output file right away, the column indices and row pointers are spilled
+into unlinked temporary files next to it and appended by finish_row_block_writer().
+valuesWritten is the number of values written so far.
+*/
+typedef struct {
+    int binary;
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t valuesWritten;
+    WriteBuffer values;
+    WriteBuffer colIndices;
+    WriteBuffer rowPointers;
+} RowBlockWriter;
+
+/*
+Creates the output file filename for a noRows x noCols result and the reader's spill files.
+Append the blocks with write_row_block(), then call finish_row_block_writer() or
+discard_row_block_writer().
 
 Return values:
-    ARRAY_WRITE_SUCCESS on success.
-    FILE_WRITE_ERROR when the array was not successfully written to the file.
+    MATRIX_WRITE_SUCCESS when the files were created.
+    FILE_OPEN_ERROR when a file cannot be created.
+    HEAP_MEMORY_ERROR if the writer cannot be allocated.
+*/
+int open_row_block_writer(
+    const char* filename, const uint64_t noRows, const uint64_t noCols, RowBlockWriter** writer
+    );
+
+/*
+Appends the rows of block to the result. The row pointers of block start at 0.
+
+Returns MATRIX_WRITE_SUCCESS, or FILE_WRITE_ERROR if writing failed.
+*/
+int write_row_block(RowBlockWriter* const writer, const Matrix* const block);
+
+/*
+Appends the spilled subarrays to the output, completes the file and frees the writer.
+
+Returns MATRIX_WRITE_SUCCESS, or FILE_WRITE_ERROR if writing failed.
+*/
+int finish_row_block_writer(RowBlockWriter* writer);
+
+/*
+Closes the files of the writer, removes the incomplete output file filename and frees the writer.
+Used after an error. Does nothing if writer is NULL.
+*/
+void discard_row_block_writer(RowBlockWriter* writer, const char* filename);
+
+/*
+Creates an unlinked temporary file next to filename. Returns its file descriptor or -1.
+*/
+int _open_spill_file(const char* filename);
+
+/*
+Copies size bytes of data into the buffer, flushing it whenever it is full.
+*/
+void _buffer_bytes(WriteBuffer* const buffer, const void* const data, const size_t size);
+
+/*
+Flushes the output and the spill buffer and copies the spill file to the end of the output.
+Errors are recorded in writer->values.error.
+*/
+void _append_spill_file(RowBlockWriter* const writer, WriteBuffer* const spill);
+
+/*
+Closes the output and spill files that are open (not -1). Errors are recorded in writer->values.error.
 */
-int _write_uint_64_array(FILE* file, uint64_t* const array, size_t size);
+void _close_row_block_files(RowBlockWriter* const writer);
 
+/*
+Releases the subarrays of a CSR matrix: unmaps mapping if it is not NULL (the subarrays point
+into it), frees the subarrays otherwise.
+*/
+void _free_csr_arrays(
+    void* values, uint64_t* colIndices, uint64_t* rowPointers, void* mapping, const size_t mapping_size
+    );
 
 /*
 Frees a heap-allocated CSR matrix and all of its heap-allocated attributes.
 */
 void free_csr_matrix(Matrix* matrix);
 
+/*
+Frees a heap-allocated DoubleMatrix and all of its heap-allocated attributes.
+*/
+void free_double_csr_matrix(DoubleMatrix* matrix);
+
+/*
+Returns the stride of a DenseMatrix with noCols columns: 1 for a vector, otherwise noCols
+rounded up to DENSE_STRIDE_FLOATS.
+*/
+uint64_t dense_stride(const uint64_t noCols);
+
+/*
+Sets the dimensions and the stride of a DenseMatrix and allocates its values, aligned to
+DENSE_ALIGNMENT and zeroed (including the padding). This function assumes that memory for
+the DenseMatrix struct itself was already allocated.
+
+Return values:
+    0 on success.
+    HEAP_MEMORY_ERROR if the values cannot be allocated, values is NULL then.
+*/
+int init_dense_matrix(DenseMatrix* const matrix, const uint64_t noRows, const uint64_t noCols);
+
+/*
+Frees a heap-allocated DenseMatrix and its values. matrix can be NULL.
+*/
+void free_dense_matrix(DenseMatrix* matrix);
+
 /*
 A function that calls free() on all given pointers.
 
@@ -251,6 +836,12 @@ Used to make the main function clearer and easier to understand.
 */
 void free_pointers(const int n, ...);
 
+/*
+Frees the count strings of a heap-allocated array of filenames and the array itself (like the
+filenames of --chain). filenames can be NULL.
+*/
+void free_filename_list(char** filenames, const unsigned int count);
+
 /*
 A function that calls free_csr_matrix() on all given matrices.
 
@@ -258,6 +849,11 @@ Used to make the main function clearer and easier to understand.
 */
 void free_csr_matrices(const int n, ...);
 
+/*
+Returns the time of CLOCK_MONOTONIC in seconds, used to time the runs and phases of --bench.
+*/
+double monotonic_seconds(void);
+
 /*
 Checks for a possible overflow during a memory allocation.
 